@@ -0,0 +1,246 @@
+#ifndef enhancer_bufferpool_hpp
+#define enhancer_bufferpool_hpp
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <enhancer/imageview.hpp>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    class BufferPool;
+
+    // A buffer borrowed from a BufferPool, which gets it back when the handle is reset or destroyed. The contents of
+    // a buffer are not initialized and may be anything that a previous user has left.
+    class PooledBuffer
+    {
+    public:
+        PooledBuffer() = default;
+        ~PooledBuffer() { reset(); }
+
+        PooledBuffer(PooledBuffer&& other) noexcept;
+        PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+        PooledBuffer(const PooledBuffer&) = delete;
+        PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+        void*       getData() const { return m_data; }
+        std::size_t getSize() const { return m_size; }
+
+        template <typename T> T* getData() const { return static_cast<T*>(m_data); }
+
+        // A view of the buffer as an image with packed rows; the buffer has to be large enough for the image
+        template <typename T>
+        ImageView<T> getImageView(const int width, const int height, const ChannelOrder order = ChannelOrder::RGBA) const;
+
+        // Returns the buffer to its pool
+        void reset();
+
+    private:
+        friend class BufferPool;
+
+        PooledBuffer(BufferPool* pool, void* data, const std::size_t size, const int size_class) :
+            m_pool(pool), m_data(data), m_size(size), m_size_class(size_class)
+        {
+        }
+
+        BufferPool* m_pool       = nullptr;
+        void*       m_data       = nullptr;
+        std::size_t m_size       = 0;
+        int         m_size_class = 0;
+    };
+
+    struct BufferPoolStats
+    {
+        // The buffers that had to be allocated and the requests served from the cache
+        std::size_t num_allocations = 0;
+        std::size_t num_reuses      = 0;
+
+        // The bytes held by the pool, not counting the buffers currently lent out
+        std::size_t cached_bytes = 0;
+    };
+
+    // A cache of 64-byte-aligned buffers (output images, float planes, scratch rows) in power-of-two size classes, so
+    // that a pipeline running repeatedly on frames of the same size stops allocating after the first frame. Buffers
+    // beyond `max_cached_bytes` are freed when returned instead of being cached. Thread-safe.
+    class BufferPool
+    {
+    public:
+        explicit BufferPool(const std::size_t max_cached_bytes = std::size_t(256) << 20) :
+            m_max_cached_bytes(max_cached_bytes)
+        {
+        }
+        ~BufferPool() { trim(); }
+
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        // Borrows a buffer of at least `size` bytes
+        PooledBuffer acquire(const std::size_t size);
+
+        // Frees all the cached buffers; the buffers currently lent out are not affected
+        void trim();
+
+        BufferPoolStats getStats() const;
+
+    private:
+        friend class PooledBuffer;
+
+        static constexpr int         num_size_classes = 48;
+        static constexpr std::size_t alignment        = 64;
+
+        mutable std::mutex                               m_mutex;
+        std::array<std::vector<void*>, num_size_classes> m_free_buffers;
+        std::size_t                                      m_max_cached_bytes;
+        BufferPoolStats                                  m_stats;
+
+        void release(void* data, const int size_class);
+
+        static int         getSizeClass(const std::size_t size);
+        static std::size_t getClassSize(const int size_class) { return std::size_t(64) << size_class; }
+    };
+
+    // The pool of the calling thread, for scratch buffers of the workers of a ThreadPool, which then never contend
+    // for a lock. The pool is destroyed when its thread exits, so its buffers must be returned before that.
+    inline BufferPool& get_thread_buffer_pool();
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept :
+        m_pool(other.m_pool), m_data(other.m_data), m_size(other.m_size), m_size_class(other.m_size_class)
+    {
+        other.m_pool = nullptr;
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+
+    inline PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+
+            m_pool       = other.m_pool;
+            m_data       = other.m_data;
+            m_size       = other.m_size;
+            m_size_class = other.m_size_class;
+
+            other.m_pool = nullptr;
+            other.m_data = nullptr;
+            other.m_size = 0;
+        }
+        return *this;
+    }
+
+    template <typename T>
+    ImageView<T> PooledBuffer::getImageView(const int width, const int height, const ChannelOrder order) const
+    {
+        const std::ptrdiff_t stride = std::ptrdiff_t(width) * getNumChannels(order) * sizeof(T);
+        assert(std::size_t(stride) * height <= m_size);
+
+        return ImageView<T>(getData<T>(), width, height, stride, order);
+    }
+
+    inline void PooledBuffer::reset()
+    {
+        if (m_pool != nullptr) { m_pool->release(m_data, m_size_class); }
+
+        m_pool = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    inline int BufferPool::getSizeClass(const std::size_t size)
+    {
+        int size_class = 0;
+        while (size_class + 1 < num_size_classes && getClassSize(size_class) < size)
+        {
+            ++size_class;
+        }
+        return size_class;
+    }
+
+    inline PooledBuffer BufferPool::acquire(const std::size_t size)
+    {
+        const int         size_class = getSizeClass(size);
+        const std::size_t class_size = getClassSize(size_class);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            std::vector<void*>& free_buffers = m_free_buffers[size_class];
+            if (!free_buffers.empty())
+            {
+                void* data = free_buffers.back();
+                free_buffers.pop_back();
+
+                ++m_stats.num_reuses;
+                m_stats.cached_bytes -= class_size;
+
+                return PooledBuffer(this, data, class_size, size_class);
+            }
+
+            ++m_stats.num_allocations;
+        }
+
+        // Allocates outside the lock, which other threads may need meanwhile
+        void* data = ::operator new(class_size, std::align_val_t(alignment));
+        return PooledBuffer(this, data, class_size, size_class);
+    }
+
+    inline void BufferPool::release(void* data, const int size_class)
+    {
+        const std::size_t class_size = getClassSize(size_class);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (m_stats.cached_bytes + class_size <= m_max_cached_bytes)
+            {
+                // The free list keeps its capacity, so that it does not allocate again in the steady state
+                m_free_buffers[size_class].push_back(data);
+                m_stats.cached_bytes += class_size;
+                return;
+            }
+        }
+
+        ::operator delete(data, std::align_val_t(alignment));
+    }
+
+    inline void BufferPool::trim()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (std::vector<void*>& free_buffers : m_free_buffers)
+        {
+            for (void* data : free_buffers)
+            {
+                ::operator delete(data, std::align_val_t(alignment));
+            }
+            free_buffers.clear();
+        }
+        m_stats.cached_bytes = 0;
+    }
+
+    inline BufferPoolStats BufferPool::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    inline BufferPool& get_thread_buffer_pool()
+    {
+        // Scratch buffers are small and per thread, so a tighter bound than the default keeps idle workers lean
+        static thread_local BufferPool pool(std::size_t(64) << 20);
+        return pool;
+    }
+} // namespace enhancer
+
+#endif /* enhancer_bufferpool_hpp */
@@ -2,7 +2,11 @@
 #define enhancer_hpp
 
 #include <Eigen/Core>
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 
 namespace enhancer
 {
@@ -16,7 +20,52 @@ namespace enhancer
     // Interface
     ///////////////////////////////////////////////////////////
 
-    inline Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb, const Eigen::VectorXd& parameters);
+    // How the power functions of the pipeline are evaluated. Exact uses std::pow; the approximate modes evaluate the
+    // 2.2 gamma curves as polynomials of the mantissa scaled by a small table of powers of two, and the other powers
+    // as exp2(y * log2(x)) with polynomial exp2 and log2. Maximum absolute differences of an output channel from
+    // Exact, measured over random colors and parameter vectors (with and without ENHANCER_WITH_LIFT_GAMMA_GAIN):
+    // - Fast:    6e-5 (99.99% of the channels within 1e-6); 8-bit results differ by at most one level
+    // - Fastest: 2.5e-2 (99.9% within 4e-4); 8-bit results differ by at most three levels
+    // The largest differences occur next to values clipped to zero, where the fractional powers are steepest.
+    enum class Accuracy
+    {
+        Exact,
+        Fast,
+        Fastest,
+    };
+
+    // The range of the intermediate and the output values. Display clamps them to [0, 1] as the shader does.
+    // SceneReferred only clamps negative values, so that values above 1 (e.g., highlights of HDR inputs, or those
+    // pushed up by brightness or contrast) pass through to the output for downstream tone mapping; integer outputs
+    // are still clamped when quantized.
+    enum class ValueRange
+    {
+        Display,
+        SceneReferred,
+    };
+
+    // The parameters of the configured parameter set in a fixed-size vector. Unlike an Eigen::VectorXd, it lives on
+    // the stack, so calls on a hot path should hold the parameters in one.
+    typedef Eigen::Matrix<double, NUM_PARAMETERS, 1> ParameterVector;
+
+    // `parameters` may be any Eigen vector expression of NUM_PARAMETERS elements (an Eigen::VectorXd, a
+    // ParameterVector, `0.5 * p`, ...); it is read in place, so the call does not allocate
+    template <typename Derived>
+    Eigen::Vector3d enhance(const Eigen::Vector3d&            input_rgb,
+                            const Eigen::MatrixBase<Derived>& parameters,
+                            const Accuracy                    accuracy = Accuracy::Exact,
+                            const ValueRange                  range    = ValueRange::Display);
+
+    // Parameter sets for the compile-time specialized pipeline (see Enhancer)
+    struct DefaultParams;
+    struct LiftGammaGainParams;
+    struct ColorBalanceV1;
+
+    template <typename ParameterSet,
+              unsigned   StageMask = ParameterSet::all_stages,
+              Accuracy   A         = Accuracy::Exact,
+              ValueRange R         = ValueRange::Display>
+    class Enhancer;
 
     ///////////////////////////////////////////////////////////
     // Implementation
@@ -24,19 +73,244 @@ namespace enhancer
 
     namespace internal
     {
-        inline Eigen::Vector3d convertRgbToLinearRgb(const Eigen::Vector3d& rgb)
+        // The stages below are templated over the scalar type S, which is double except in enhancer/gradient.hpp,
+        // where it is a dual number carrying the derivatives with respect to the parameters. Functions of S that are
+        // not in Eigen (pow, tan, clamp, getValue, which drops the derivatives for branching, and withValue, which
+        // replaces the value but keeps the derivatives) are called unqualified, so that the overloads of other scalar
+        // types are found by argument-dependent lookup.
+        template <typename S> using Vector3 = Eigen::Matrix<S, 3, 1>;
+
+        inline double getValue(const double x) { return x; }
+        inline double withValue(const double /*x*/, const double value) { return value; }
+
+        // How a decoded parameter of scalar type S is made from its value; `is_active` tells whether the parameter
+        // is inside [0, 1], i.e., whether the decoded value follows it or is clamped. Stages whose values do not
+        // have usable derivatives check `has_derivatives` to compute these separately.
+        template <typename S> struct ScalarTraits
+        {
+            static constexpr bool has_derivatives = false;
+
+            static double makeParameter(const double value, const int /*index*/, const bool /*is_active*/) { return value; }
+        };
+
+        // Implementations of the power functions for each Accuracy
+        namespace math
+        {
+            // Splits a positive normal x into x = (1 + fraction) * 2^exponent with fraction in [0, 1); returns false
+            // for zero, subnormal, and negative values
+            inline bool splitDouble(const double x, double& fraction, int& exponent)
+            {
+                std::uint64_t bits;
+                std::memcpy(&bits, &x, sizeof(double));
+
+                const int biased_exponent = static_cast<int>(bits >> 52);
+                if (biased_exponent == 0 || biased_exponent >= 0x7ff) { return false; }
+
+                exponent = biased_exponent - 1023;
+                bits     = (bits & 0x000fffffffffffffull) | 0x3ff0000000000000ull;
+
+                std::memcpy(&fraction, &bits, sizeof(double));
+                fraction -= 1.0;
+
+                return true;
+            }
+
+            inline double makePowerOfTwo(const int exponent)
+            {
+                const std::uint64_t bits = static_cast<std::uint64_t>(std::max(-1022, std::min(exponent, 1023)) + 1023) << 52;
+
+                double value;
+                std::memcpy(&value, &bits, sizeof(double));
+
+                return value;
+            }
+
+            template <std::size_t N> inline double evaluatePolynomial(const double (&coefficients)[N], const double x)
+            {
+                double sum = coefficients[N - 1];
+                for (std::size_t i = N - 1; i > 0; --i) { sum = sum * x + coefficients[i - 1]; }
+                return sum;
+            }
+
+            // log2(x) for x > 0: the logarithm of the mantissa m, taken in [sqrt(1/2), sqrt(2)), is the atanh series
+            // 2 / ln(2) * (t + t^3 / 3 + ...) with t = (m - 1) / (m + 1), |t| < 0.172
+            template <int NumTerms> inline double log2Approx(const double x)
+            {
+                constexpr double coefficients[] = { 1.0, 1.0 / 3.0, 1.0 / 5.0, 1.0 / 7.0, 1.0 / 9.0, 1.0 / 11.0 };
+                static_assert(NumTerms >= 1 && NumTerms <= 6, "Unsupported number of terms");
+
+                double fraction;
+                int    exponent;
+                if (!splitDouble(x, fraction, exponent)) { return -1022.0; }
+
+                double mantissa = 1.0 + fraction;
+                if (mantissa > 1.41421356237309515)
+                {
+                    mantissa *= 0.5;
+                    ++exponent;
+                }
+
+                const double t  = (mantissa - 1.0) / (mantissa + 1.0);
+                const double t2 = t * t;
+
+                double sum = coefficients[NumTerms - 1];
+                for (int i = NumTerms - 2; i >= 0; --i) { sum = sum * t2 + coefficients[i]; }
+
+                return exponent + 2.88539008177792681 * t * sum;
+            }
+
+            // 2^y: the rounded integer part goes into the exponent bits and 2^f for f in [-0.5, 0.5] is the Taylor
+            // polynomial of exp(f ln 2)
+            template <int Degree> inline double exp2Approx(const double y)
+            {
+                constexpr double coefficients[] = { 1.0,
+                                                    0.6931471805599453,
+                                                    0.2402265069591007,
+                                                    0.055504108664821576,
+                                                    0.009618129107628477,
+                                                    0.0013333558146428441,
+                                                    0.00015403530393381606,
+                                                    1.5252733804059838e-05,
+                                                    1.3215486790144305e-06,
+                                                    1.0178086009239696e-07 };
+                static_assert(Degree >= 1 && Degree <= 9, "Unsupported degree");
+
+                // Rounding by truncating a positive value avoids a call of std::floor on targets without SSE4.1
+                const double clamped = std::max(-1022.0, std::min(y, 1023.0));
+                const int    integer = static_cast<int>(clamped + 1024.5) - 1024;
+                const double f       = clamped - integer;
+
+                double sum = coefficients[Degree];
+                for (int i = Degree - 1; i >= 0; --i) { sum = sum * f + coefficients[i]; }
+
+                return sum * makePowerOfTwo(integer);
+            }
+
+            // x^(Numerator / Denominator) for the fixed exponents of the gamma curves, without any logarithm:
+            // ((1 + f) * 2^e)^p = (1 + f)^p * 2^(q + r / Denominator) where q and r are the quotient and the
+            // remainder of Numerator * e / Denominator; (1 + f)^p is a minimax polynomial in f (`coefficients`, fit
+            // for the relative error) and 2^(r / Denominator) is a table of `Denominator` entries
+            template <int Numerator, int Denominator, std::size_t N>
+            inline double powRationalApprox(const double x, const double (&coefficients)[N], const double (&roots)[Denominator])
+            {
+                double fraction;
+                int    exponent;
+                if (!splitDouble(x, fraction, exponent)) { return 0.0; }
+
+                const int product   = Numerator * exponent;
+                const int quotient  = (product >= 0 ? product : product - (Denominator - 1)) / Denominator;
+                const int remainder = product - quotient * Denominator;
+
+                return evaluatePolynomial(coefficients, fraction) * roots[remainder] * makePowerOfTwo(quotient);
+            }
+
+            // The only one for scalar types other than double; the exponent `y` may be a double or an S
+            struct Exact
+            {
+                template <typename S, typename Y> static Vector3<S> pow(const Vector3<S>& x, const Y& y) { return x.array().pow(y).matrix(); }
+                template <typename S> static Vector3<S> pow(const Vector3<S>& x, const Vector3<S>& y) { return x.array().pow(y.array()).matrix(); }
+
+                template <typename S> static Vector3<S> decodeGamma(const Vector3<S>& rgb) { return pow(rgb, 2.2); }
+                template <typename S> static Vector3<S> encodeGamma(const Vector3<S>& linear_rgb) { return pow(linear_rgb, 1.0 / 2.2); }
+            };
+
+            // 2^(r / 5) and 2^(r / 11)
+            struct GammaRoots
+            {
+                static constexpr double fifths[5] = { 1.0, 1.148698354997035, 1.3195079107728942, 1.515716566510398, 1.7411011265922482 };
+
+                static constexpr double elevenths[11] = { 1.0,
+                                                          1.0650410894399627,
+                                                          1.1343125221954626,
+                                                          1.2080894444044472,
+                                                          1.2866648980094317,
+                                                          1.3703509847201236,
+                                                          1.4594801056814461,
+                                                          1.5544062817709192,
+                                                          1.6555065597696215,
+                                                          1.7631825099920424,
+                                                          1.8778618213234126 };
+            };
+
+            // Relative errors of the gamma curves: 1.5e-8 (decode) and 2.2e-8 (encode)
+            struct FastGammaCurves
+            {
+                static double decode(const double x)
+                {
+                    constexpr double coefficients[] = { 1.000000014770878,   2.199998072163648,     1.3200390233083537,   0.08771058475478727,
+                                                        -0.016571326557463486, 0.0043569501249972895, -0.0007399664461924702 };
+                    return powRationalApprox<11, 5>(x, coefficients, GammaRoots::fifths);
+                }
+
+                static double encode(const double x)
+                {
+                    constexpr double coefficients[] = { 1.0000000219488905,  0.4545422727308324,    -0.12389167113669762, 0.06317716335416176,
+                                                        -0.03749513076462549, 0.02049186956821459,   -0.007992232977303842, 0.0015187220743350367 };
+                    return powRationalApprox<5, 11>(x, coefficients, GammaRoots::elevenths);
+                }
+            };
+
+            // Relative errors of the gamma curves: 3.1e-5 (decode) and 7.2e-5 (encode); the same polynomials are used
+            // in enhancer.fs with ENHANCER_ACCURACY_FASTEST
+            struct FastestGammaCurves
+            {
+                static double decode(const double x)
+                {
+                    constexpr double coefficients[] = { 1.0000313515071373, 2.1984700509337243, 1.3303186249161785, 0.0661174463298021 };
+                    return powRationalApprox<11, 5>(x, coefficients, GammaRoots::fifths);
+                }
+
+                static double encode(const double x)
+                {
+                    constexpr double coefficients[] = { 1.0000721846371292, 0.4516915554304192, -0.10635521311473461, 0.02504137605588145 };
+                    return powRationalApprox<5, 11>(x, coefficients, GammaRoots::elevenths);
+                }
+            };
+
+            // pow(x, y) = exp2(y * log2(x)) for x > 0, and 0 for x <= 0 (all the exponents in the pipeline are
+            // positive); non-positive values also encode to 0 instead of NaN
+            template <int NumLogTerms, int ExpDegree, typename GammaCurves> struct Approximate
+            {
+                static double pow(const double x, const double y) { return x > 0.0 ? exp2Approx<ExpDegree>(y * log2Approx<NumLogTerms>(x)) : 0.0; }
+
+                static Eigen::Vector3d pow(const Eigen::Vector3d& x, const double y) { return Eigen::Vector3d(pow(x(0), y), pow(x(1), y), pow(x(2), y)); }
+                static Eigen::Vector3d pow(const Eigen::Vector3d& x, const Eigen::Vector3d& y) { return Eigen::Vector3d(pow(x(0), y(0)), pow(x(1), y(1)), pow(x(2), y(2))); }
+
+                static Eigen::Vector3d decodeGamma(const Eigen::Vector3d& rgb)
+                {
+                    return Eigen::Vector3d(GammaCurves::decode(rgb(0)), GammaCurves::decode(rgb(1)), GammaCurves::decode(rgb(2)));
+                }
+
+                static Eigen::Vector3d encodeGamma(const Eigen::Vector3d& linear_rgb)
+                {
+                    return Eigen::Vector3d(GammaCurves::encode(linear_rgb(0)), GammaCurves::encode(linear_rgb(1)), GammaCurves::encode(linear_rgb(2)));
+                }
+            };
+
+            // Relative errors of pow: 5e-8 and 4e-4, respectively
+            typedef Approximate<4, 7, FastGammaCurves>    Fast;
+            typedef Approximate<2, 4, FastestGammaCurves> Fastest;
+
+            template <Accuracy A> struct Select { typedef Exact Type; };
+            template <> struct Select<Accuracy::Fast> { typedef Fast Type; };
+            template <> struct Select<Accuracy::Fastest> { typedef Fastest Type; };
+        } // namespace math
+
+        template <typename Math = math::Exact, typename Derived>
+        inline Vector3<typename Derived::Scalar> convertRgbToLinearRgb(const Eigen::MatrixBase<Derived>& rgb)
         {
-            return rgb.array().pow(2.2).matrix();
+            return Math::decodeGamma(Vector3<typename Derived::Scalar>(rgb));
         }
 
-        inline Eigen::Vector3d convertLinearRgbToRgb(const Eigen::Vector3d& linear_rgb)
+        template <typename Math = math::Exact, typename Derived>
+        inline Vector3<typename Derived::Scalar> convertLinearRgbToRgb(const Eigen::MatrixBase<Derived>& linear_rgb)
         {
-            return linear_rgb.array().pow(1.0 / 2.2).matrix();
+            return Math::encodeGamma(Vector3<typename Derived::Scalar>(linear_rgb));
         }
 
         // Y'UV (BT.709) to linear RGB
         // Values are from https://en.wikipedia.org/wiki/YUV
-        inline Eigen::Vector3d yuv2rgb(const Eigen::Vector3d& yuv)
+        template <typename Derived> inline Vector3<typename Derived::Scalar> yuv2rgb(const Eigen::MatrixBase<Derived>& yuv)
         {
             constexpr double m[9] = { +1.00000, +1.00000, +1.00000,   // 1st column
                                       +0.00000, -0.21482, +2.12798,   // 2nd column
@@ -46,7 +320,7 @@ namespace enhancer
 
         // Linear RGB to Y'UV (BT.709)
         // Values are from https://en.wikipedia.org/wiki/YUV
-        inline Eigen::Vector3d rgb2yuv(const Eigen::Vector3d& rgb)
+        template <typename Derived> inline Vector3<typename Derived::Scalar> rgb2yuv(const Eigen::MatrixBase<Derived>& rgb)
         {
             constexpr double m[9] = { +0.21260, -0.09991, +0.61500,   // 1st column
                                       +0.71520, -0.33609, -0.55861,   // 2nd column
@@ -54,15 +328,15 @@ namespace enhancer
             return Eigen::Map<const Eigen::Matrix3d>(m) * rgb;
         }
 
-        inline double rgb2h(const Eigen::Vector3d& rgb)
+        template <typename S> inline S rgb2h(const Vector3<S>& rgb)
         {
-            const double r = rgb(0);
-            const double g = rgb(1);
-            const double b = rgb(2);
-            const double M = std::max({r, g, b});
-            const double m = std::min({r, g, b});
+            const S r = rgb(0);
+            const S g = rgb(1);
+            const S b = rgb(2);
+            const S M = std::max({r, g, b});
+            const S m = std::min({r, g, b});
 
-            double h;
+            S h;
             if (M == m)      h = 0.0;
             else if (m == b) h = 60.0 * (g - r) / (M - m) + 60.0;
             else if (m == r) h = 60.0 * (b - g) / (M - m) + 180.0;
@@ -70,22 +344,22 @@ namespace enhancer
             else             abort();
             h /= 360.0;
             if (h < 0.0) {
-                ++ h;
+                h += 1.0;
             } else if (h > 1.0) {
-                -- h;
+                h -= 1.0;
             }
             return h;
         }
 
-        inline double rgb2s4hsv(const Eigen::Vector3d& rgb)
+        template <typename S> inline S rgb2s4hsv(const Vector3<S>& rgb)
         {
-            const double r = rgb(0);
-            const double g = rgb(1);
-            const double b = rgb(2);
-            const double M = std::max({r, g, b});
-            const double m = std::min({r, g, b});
+            const S r = rgb(0);
+            const S g = rgb(1);
+            const S b = rgb(2);
+            const S M = std::max({r, g, b});
+            const S m = std::min({r, g, b});
 
-            if (M < 1e-14) return 0.0;
+            if (M < 1e-14) return S(0.0);
             return (M - m) / M;
         }
 
@@ -136,19 +410,19 @@ namespace enhancer
             return rgb;
         }
 
-        inline Eigen::Vector3d rgb2hsv(const Eigen::Vector3d& rgb)
+        template <typename S> inline Vector3<S> rgb2hsv(const Vector3<S>& rgb)
         {
-            const double& r = rgb(0);
-            const double& g = rgb(1);
-            const double& b = rgb(2);
+            const S& r = rgb(0);
+            const S& g = rgb(1);
+            const S& b = rgb(2);
 
-            const double M = std::max({r, g, b});
+            const S M = std::max({r, g, b});
 
-            const double h = rgb2h(rgb);
-            const double s = rgb2s4hsv(rgb);
-            const double v = M;
+            const S h = rgb2h(rgb);
+            const S s = rgb2s4hsv(rgb);
+            const S v = M;
 
-            return Eigen::Vector3d(h, s, v);
+            return Vector3<S>(h, s, v);
         }
 
         inline double rgb2l(const Eigen::Vector3d& rgb)
@@ -162,24 +436,26 @@ namespace enhancer
             return 0.5 * (M + m);
         }
 
-        inline Eigen::Vector3d hsv2rgb(const Eigen::Vector3d& hsv)
+        template <typename S> inline Vector3<S> hsv2rgb(const Vector3<S>& hsv)
         {
-            const double& h = hsv(0);
-            const double& s = hsv(1);
-            const double& v = hsv(2);
+            const S& h = hsv(0);
+            const S& s = hsv(1);
+            const S& v = hsv(2);
 
             if (s < 1e-14)
             {
-                return Eigen::Vector3d(v, v, v);
+                return Vector3<S>(v, v, v);
             }
 
-            const double h6 = h * 6.0;
-            const int    i  = static_cast<int>(floor(h6)) % 6;
-            const double f  = h6 - static_cast<double>(i);
-            const double p  = v * (1 - s);
-            const double q  = v * (1 - (s * f));
-            const double t  = v * (1 - (s * (1 - f)));
-            double r, g, b;
+            // The fraction is taken before wrapping the sector so that h = 1 gives f = 0 (as in the shader)
+            const S      h6 = h * 6.0;
+            const double i6 = std::floor(getValue(h6));
+            const int    i  = static_cast<int>(i6) % 6;
+            const S      f  = h6 - i6;
+            const S      p  = v * (1 - s);
+            const S      q  = v * (1 - (s * f));
+            const S      t  = v * (1 - (s * (1 - f)));
+            S r, g, b;
             switch(i)
             {
                 case 0: r = v; g = t; b = p; break;
@@ -190,7 +466,7 @@ namespace enhancer
                 case 5: r = v; g = p; b = q; break;
             }
 
-            return Eigen::Vector3d(r, g, b);
+            return Vector3<S>(r, g, b);
         }
 
         inline Eigen::Vector3d rgb2hsl(const Eigen::Vector3d& rgb)
@@ -203,7 +479,25 @@ namespace enhancer
         }
 
         inline float clamp(const float value) { return std::max(0.0, std::min(static_cast<double>(value), 1.0)); }
-        inline Eigen::Vector3d clamp(const Eigen::Vector3d& v) { return Eigen::Vector3d(clamp(v.x()), clamp(v.y()), clamp(v.z())); }
+
+        template <typename Derived> inline Vector3<typename Derived::Scalar> clamp(const Eigen::MatrixBase<Derived>& v)
+        {
+            return Vector3<typename Derived::Scalar>(clamp(v.x()), clamp(v.y()), clamp(v.z()));
+        }
+
+        // clamp for ValueRange::Display; only the lower bound for ValueRange::SceneReferred
+        template <ValueRange R, typename S> inline Vector3<S> clampToRange(const Vector3<S>& v)
+        {
+            if constexpr (R == ValueRange::Display) { return clamp(v); }
+            else { return v.cwiseMax(0.0); }
+        }
+
+        // The final encoding of the pipelines
+        template <ValueRange R, typename Math, typename S> inline Vector3<S> convertLinearRgbToOutputRgb(const Vector3<S>& linear_rgb)
+        {
+            if constexpr (R == ValueRange::Display) { return clamp(convertLinearRgbToRgb<Math>(linear_rgb)); }
+            else { return convertLinearRgbToRgb<Math>(linear_rgb.cwiseMax(0.0)); }
+        }
 
         inline Eigen::Vector3d changeColorBalance(const Eigen::Vector3d& inputRgb, const Eigen::Vector3d& shift)
         {
@@ -219,125 +513,411 @@ namespace enhancer
             return hsl2rgb(Eigen::Vector3d(newHsl(0), newHsl(1), lightness));
         }
 
-        inline Eigen::Vector3d applyLiftGammaGainEffect(const Eigen::Vector3d& linear_rgb,
-                                                        const Eigen::Vector3d& lift,
-                                                        const Eigen::Vector3d& gamma,
-                                                        const Eigen::Vector3d& gain)
+        template <typename Math = math::Exact, typename S>
+        inline Vector3<S> applyLiftGammaGainEffect(const Vector3<S>& linear_rgb, const Vector3<S>& lift, const Vector3<S>& gamma, const Vector3<S>& gain)
         {
-            const Eigen::Array3d lift_applied_linear_rgb  = ((linear_rgb.array() - Eigen::Array3d::Ones()) * (Eigen::Array3d::Constant(2.0) - lift.array()) + Eigen::Array3d::Ones()).max(0.0);
-            const Eigen::Array3d gain_applied_linear_rgb  = lift_applied_linear_rgb * gain.array();
-            const Eigen::Array3d gamma_applied_linear_rgb = gain_applied_linear_rgb.pow(gamma.array().inverse());
+            const Eigen::Array<S, 3, 1> lift_applied_linear_rgb  = ((linear_rgb.array() - Eigen::Array3d::Ones()) * (Eigen::Array3d::Constant(2.0) - lift.array()) + Eigen::Array3d::Ones()).max(0.0);
+            const Eigen::Array<S, 3, 1> gain_applied_linear_rgb  = lift_applied_linear_rgb * gain.array();
+            const Vector3<S>            gamma_applied_linear_rgb = Math::pow(Vector3<S>(gain_applied_linear_rgb.matrix()), Vector3<S>(gamma.cwiseInverse()));
 
-            return gamma_applied_linear_rgb.matrix();
+            return gamma_applied_linear_rgb;
         }
 
-        inline Eigen::Vector3d applyTemperatureTintEffect(const Eigen::Vector3d& linear_rgb, const double temperature, const double tint)
+        template <ValueRange R = ValueRange::Display, typename S>
+        inline Vector3<S> applyTemperatureTintEffect(const Vector3<S>& linear_rgb, const S& temperature, const S& tint)
         {
             constexpr double scale = 0.10;
 
-            return clamp(yuv2rgb(rgb2yuv(linear_rgb) + temperature * scale * Eigen::Vector3d(0.0, -1.0, 1.0) + tint * scale * Eigen::Vector3d(0.0, 1.0, 1.0)));
+            return clampToRange<R>(yuv2rgb(rgb2yuv(linear_rgb) + temperature * scale * Eigen::Vector3d(0.0, -1.0, 1.0) + tint * scale * Eigen::Vector3d(0.0, 1.0, 1.0)));
         }
 
-        inline Eigen::Vector3d applyBrightnessEffect(const Eigen::Vector3d& linear_rgb, const double brightness)
+        template <typename Math = math::Exact, typename S>
+        inline Vector3<S> applyBrightnessEffect(const Vector3<S>& linear_rgb, const S& brightness)
         {
             constexpr double scale = 1.5;
 
-            return linear_rgb.array().pow(1.0 / (1.0 + scale * brightness)).matrix();
+            return Math::pow(linear_rgb, 1.0 / (1.0 + scale * brightness));
         }
 
-        inline Eigen::Vector3d applySaturationEffect(const Eigen::Vector3d& linear_rgb, const double saturation)
+        // HSV is well defined for values above 1 (v > 1), so only the lower bound matters for SceneReferred
+        template <ValueRange R = ValueRange::Display, typename S>
+        inline Vector3<S> applySaturationEffect(const Vector3<S>& linear_rgb, const S& saturation)
         {
-            const Eigen::Vector3d hsv = rgb2hsv(clamp(linear_rgb));
-            const double s = clamp(hsv(1) * (saturation + 1.0));
+            const Vector3<S> clamped_rgb = clampToRange<R>(linear_rgb);
+            const Vector3<S> hsv         = rgb2hsv(clamped_rgb);
+            const S s = clamp(hsv(1) * (saturation + 1.0));
 
-            return hsv2rgb(Eigen::Vector3d(hsv(0), s, hsv(2)));
+            const Vector3<S> values = hsv2rgb(Vector3<S>(hsv(0), s, hsv(2)));
+            if constexpr (!ScalarTraits<S>::has_derivatives) { return values; }
+            else
+            {
+                // The derivatives are those of the equivalent closed form v + k * (rgb - v), where k becomes 1 / s
+                // once k * s is clamped to 1; unlike the hue, it has no sector branches, so gray inputs and colors
+                // with two equal channels get the derivatives of both sides
+                const S& v      = hsv(2);
+                const S  factor = getValue(hsv(1)) < 1e-14 || getValue(s) < 1.0 ? saturation + 1.0 : v / (v - clamped_rgb.minCoeff());
+
+                Vector3<S> result;
+                for (int i = 0; i < 3; ++i) { result(i) = withValue(v + factor * (clamped_rgb(i) - v), getValue(values(i))); }
+                return result;
+            }
         }
 
-        inline Eigen::Vector3d applyContrastEffect(const Eigen::Vector3d& linear_rgb, const double contrast)
+        template <typename Math = math::Exact, typename S>
+        inline Vector3<S> applyContrastEffect(const Vector3<S>& linear_rgb, const S& contrast)
         {
+            using std::tan;
+
             constexpr double pi_4 = 3.14159265358979 * 0.25;
 
-            const double contrast_coef = std::tan((contrast + 1.0) * pi_4);
+            const S contrast_coef = tan((contrast + 1.0) * pi_4);
             
-            return convertRgbToLinearRgb((contrast_coef * (convertLinearRgbToRgb(linear_rgb) - Eigen::Vector3d::Constant(0.5)) + Eigen::Vector3d::Constant(0.5)).array().max(0.0));
+            return convertRgbToLinearRgb<Math>((contrast_coef * (convertLinearRgbToRgb<Math>(linear_rgb) - Eigen::Vector3d::Constant(0.5)) + Eigen::Vector3d::Constant(0.5)).array().max(0.0).matrix());
         }
 
-        inline Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb, const Eigen::VectorXd& parameters)
+        // clamp(parameter) + offset as a decoded parameter of scalar type S
+        template <typename S, typename Derived> inline S decodeParameter(const Eigen::MatrixBase<Derived>& parameters, const int index, const double offset)
         {
-            assert(parameters.size() == NUM_PARAMETERS);
+            const double parameter = parameters[index];
+            return ScalarTraits<S>::makeParameter(clamp(parameter) + offset, index, parameter > 0.0 && parameter < 1.0);
+        }
 
-            const double brightness  = clamp(parameters[0]) - 0.5;
-            const double contrast    = clamp(parameters[1]) - 0.5;
-            const double saturation  = clamp(parameters[2]) - 0.5;
+    } // namespace internal
 
-#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
-            const Eigen::Vector3d lift  = Eigen::Vector3d::Constant(0.5) + clamp(parameters.segment<3>(3)); // [0.5, 1.5]^3
-            const Eigen::Vector3d gamma = Eigen::Vector3d::Constant(0.5) + clamp(parameters.segment<3>(6)); // [0.5, 1.5]^3
-            const Eigen::Vector3d gain  = Eigen::Vector3d::Constant(0.5) + clamp(parameters.segment<3>(9)); // [0.5, 1.5]^3
-#else
-            const double temperature = clamp(parameters[3]) - 0.5;
-            const double tint        = clamp(parameters[4]) - 0.5;
-#endif
+    // Bit flags identifying the stages of the pipelines; an Enhancer instantiated with a subset of the stages of its
+    // parameter set does not contain the code of the others at all
+    namespace stage
+    {
+        constexpr unsigned temperature_tint = 1u << 0;
+        constexpr unsigned lift_gamma_gain  = 1u << 1;
+        constexpr unsigned color_balance    = 1u << 2;
+        constexpr unsigned brightness       = 1u << 3;
+        constexpr unsigned contrast         = 1u << 4;
+        constexpr unsigned saturation       = 1u << 5;
+    } // namespace stage
+
+    // Brightness, contrast, saturation, temperature, and tint
+    struct DefaultParams
+    {
+        static constexpr int      num_parameters = 5;
+        static constexpr unsigned all_stages     = stage::temperature_tint | stage::brightness | stage::contrast | stage::saturation;
 
-            Eigen::Vector3d linear_rgb = convertRgbToLinearRgb(input_rgb);
+        // S is the scalar type of the stages (see internal::Vector3)
+        template <typename S> struct BasicDecoded
+        {
+            S brightness;
+            S contrast;
+            S saturation;
+            S temperature;
+            S tint;
+        };
+
+        typedef BasicDecoded<double> Decoded;
+
+        template <typename S = double, typename Derived> static BasicDecoded<S> decode(const Eigen::MatrixBase<Derived>& parameters)
+        {
+            assert(parameters.size() == num_parameters);
+
+            BasicDecoded<S> decoded;
+
+            decoded.brightness  = internal::decodeParameter<S>(parameters, 0, -0.5);
+            decoded.contrast    = internal::decodeParameter<S>(parameters, 1, -0.5);
+            decoded.saturation  = internal::decodeParameter<S>(parameters, 2, -0.5);
+            decoded.temperature = internal::decodeParameter<S>(parameters, 3, -0.5);
+            decoded.tint        = internal::decodeParameter<S>(parameters, 4, -0.5);
+
+            return decoded;
+        }
+
+        // The stages in `StageMask` on linear RGB, without the final encoding
+        template <unsigned StageMask = all_stages, Accuracy A = Accuracy::Exact, ValueRange R = ValueRange::Display, typename S = double>
+        static internal::Vector3<S> applyStages(internal::Vector3<S> linear_rgb, const BasicDecoded<S>& parameters)
+        {
+            using namespace internal;
+            typedef typename math::Select<A>::Type Math;
 
-#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
-            // Lift/Gamma/Gain
-            linear_rgb = applyLiftGammaGainEffect(linear_rgb, lift, gamma, gain);
-#else
             // Approximate temperature/tint effect
-            linear_rgb = applyTemperatureTintEffect(linear_rgb, temperature, tint);
-#endif
+            if constexpr ((StageMask & stage::temperature_tint) != 0) { linear_rgb = applyTemperatureTintEffect<R>(linear_rgb, parameters.temperature, parameters.tint); }
 
             // Brightness
-            linear_rgb = applyBrightnessEffect(linear_rgb, brightness);
+            if constexpr ((StageMask & stage::brightness) != 0) { linear_rgb = applyBrightnessEffect<Math>(linear_rgb, parameters.brightness); }
 
             // Contrast
-            linear_rgb = applyContrastEffect(linear_rgb, contrast);
+            if constexpr ((StageMask & stage::contrast) != 0) { linear_rgb = applyContrastEffect<Math>(linear_rgb, parameters.contrast); }
 
             // Saturation
-            linear_rgb = applySaturationEffect(linear_rgb, saturation);
+            if constexpr ((StageMask & stage::saturation) != 0) { linear_rgb = applySaturationEffect<R>(linear_rgb, parameters.saturation); }
 
-            return clamp(convertLinearRgbToRgb(linear_rgb));
+            return linear_rgb;
         }
 
-        inline Eigen::Vector3d enhance_v1(const Eigen::Vector3d& input_rgb, const Eigen::VectorXd& parameters)
+        // The pipeline starting from an already linearized input (i.e., after convertRgbToLinearRgb)
+        template <unsigned StageMask = all_stages, Accuracy A = Accuracy::Exact, ValueRange R = ValueRange::Display, typename S = double>
+        static internal::Vector3<S> enhanceLinearRgb(const internal::Vector3<S>& linear_rgb, const BasicDecoded<S>& parameters)
+        {
+            typedef typename internal::math::Select<A>::Type Math;
+
+            return internal::convertLinearRgbToOutputRgb<R, Math>(applyStages<StageMask, A, R>(linear_rgb, parameters));
+        }
+
+        template <unsigned StageMask = all_stages, Accuracy A = Accuracy::Exact, ValueRange R = ValueRange::Display>
+        static Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb, const Decoded& parameters)
+        {
+            return enhanceLinearRgb<StageMask, A, R>(internal::convertRgbToLinearRgb<typename internal::math::Select<A>::Type>(input_rgb), parameters);
+        }
+    };
+
+    // Brightness, contrast, saturation, lift (3D), gamma (3D), and gain (3D)
+    struct LiftGammaGainParams
+    {
+        static constexpr int      num_parameters = 12;
+        static constexpr unsigned all_stages     = stage::lift_gamma_gain | stage::brightness | stage::contrast | stage::saturation;
+
+        // S is the scalar type of the stages (see internal::Vector3)
+        template <typename S> struct BasicDecoded
+        {
+            S                    brightness;
+            S                    contrast;
+            S                    saturation;
+            internal::Vector3<S> lift;
+            internal::Vector3<S> gamma;
+            internal::Vector3<S> gain;
+        };
+
+        typedef BasicDecoded<double> Decoded;
+
+        template <typename S = double, typename Derived> static BasicDecoded<S> decode(const Eigen::MatrixBase<Derived>& parameters)
         {
-            assert(parameters.size() == NUM_PARAMETERS);
+            assert(parameters.size() == num_parameters);
+
+            BasicDecoded<S> decoded;
 
-            const double          brightness  = parameters[0] - 0.5;
-            const double          contrast    = parameters[1] - 0.5;
-            const double          saturation  = parameters[2] - 0.5;
-            const Eigen::Vector3d balance     = parameters.segment<3>(3) - Eigen::Vector3d::Constant(0.5);
+            decoded.brightness = internal::decodeParameter<S>(parameters, 0, -0.5);
+            decoded.contrast   = internal::decodeParameter<S>(parameters, 1, -0.5);
+            decoded.saturation = internal::decodeParameter<S>(parameters, 2, -0.5);
+
+            // [0.5, 1.5]^3 each
+            for (int i = 0; i < 3; ++i)
+            {
+                decoded.lift(i)  = internal::decodeParameter<S>(parameters, 3 + i, 0.5);
+                decoded.gamma(i) = internal::decodeParameter<S>(parameters, 6 + i, 0.5);
+                decoded.gain(i)  = internal::decodeParameter<S>(parameters, 9 + i, 0.5);
+            }
+
+            return decoded;
+        }
+
+        template <unsigned StageMask = all_stages, Accuracy A = Accuracy::Exact, ValueRange R = ValueRange::Display, typename S = double>
+        static internal::Vector3<S> applyStages(internal::Vector3<S> linear_rgb, const BasicDecoded<S>& parameters)
+        {
+            using namespace internal;
+            typedef typename math::Select<A>::Type Math;
+
+            // Lift/Gamma/Gain
+            if constexpr ((StageMask & stage::lift_gamma_gain) != 0) { linear_rgb = applyLiftGammaGainEffect<Math>(linear_rgb, parameters.lift, parameters.gamma, parameters.gain); }
+
+            // Brightness
+            if constexpr ((StageMask & stage::brightness) != 0) { linear_rgb = applyBrightnessEffect<Math>(linear_rgb, parameters.brightness); }
+
+            // Contrast
+            if constexpr ((StageMask & stage::contrast) != 0) { linear_rgb = applyContrastEffect<Math>(linear_rgb, parameters.contrast); }
+
+            // Saturation
+            if constexpr ((StageMask & stage::saturation) != 0) { linear_rgb = applySaturationEffect<R>(linear_rgb, parameters.saturation); }
+
+            return linear_rgb;
+        }
+
+        // The pipeline starting from an already linearized input (i.e., after convertRgbToLinearRgb)
+        template <unsigned StageMask = all_stages, Accuracy A = Accuracy::Exact, ValueRange R = ValueRange::Display, typename S = double>
+        static internal::Vector3<S> enhanceLinearRgb(const internal::Vector3<S>& linear_rgb, const BasicDecoded<S>& parameters)
+        {
+            typedef typename internal::math::Select<A>::Type Math;
+
+            return internal::convertLinearRgbToOutputRgb<R, Math>(applyStages<StageMask, A, R>(linear_rgb, parameters));
+        }
+
+        template <unsigned StageMask = all_stages, Accuracy A = Accuracy::Exact, ValueRange R = ValueRange::Display>
+        static Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb, const Decoded& parameters)
+        {
+            return enhanceLinearRgb<StageMask, A, R>(internal::convertRgbToLinearRgb<typename internal::math::Select<A>::Type>(input_rgb), parameters);
+        }
+    };
+
+    // The original (v1) procedure: brightness, contrast, saturation, and color balance (3D). Unlike the other sets,
+    // it works directly on the gamma-encoded RGB values.
+    struct ColorBalanceV1
+    {
+        static constexpr int      num_parameters = 6;
+        static constexpr unsigned all_stages     = stage::color_balance | stage::brightness | stage::contrast | stage::saturation;
+
+        struct Decoded
+        {
+            double          brightness;
+            double          contrast;
+            double          saturation;
+            Eigen::Vector3d balance;
+        };
+
+        template <typename Derived> static Decoded decode(const Eigen::MatrixBase<Derived>& parameters)
+        {
+            assert(parameters.size() == num_parameters);
+
+            Decoded decoded;
+
+            decoded.brightness = parameters[0] - 0.5;
+            decoded.contrast   = parameters[1] - 0.5;
+            decoded.saturation = parameters[2] - 0.5;
+            decoded.balance    = Eigen::Vector3d(parameters.template segment<3>(3)) - Eigen::Vector3d::Constant(0.5);
+
+            return decoded;
+        }
+
+        // No power functions are involved, so the accuracy has no effect; the v1 procedure is display-referred and
+        // always clamps
+        template <unsigned StageMask = all_stages, Accuracy A = Accuracy::Exact, ValueRange R = ValueRange::Display>
+        static Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb, const Decoded& parameters)
+        {
+            using namespace internal;
+
+            Eigen::Vector3d rgb = input_rgb;
 
             // color balance
-            Eigen::Vector3d rgb = changeColorBalance(input_rgb, balance);
+            if constexpr ((StageMask & stage::color_balance) != 0) { rgb = changeColorBalance(rgb, parameters.balance); }
 
             // brightness
-            rgb *= 1.0 + brightness;
+            if constexpr ((StageMask & stage::brightness) != 0) { rgb *= 1.0 + parameters.brightness; }
 
             // contrast
-            constexpr double pi_4 = 3.14159265358979 * 0.25;
-            const double contrast_coef = std::tan((contrast + 1.0) * pi_4);
-            rgb = contrast_coef * (rgb - Eigen::Vector3d::Constant(0.5)) + Eigen::Vector3d::Constant(0.5);
+            if constexpr ((StageMask & stage::contrast) != 0)
+            {
+                constexpr double pi_4 = 3.14159265358979 * 0.25;
+                const double contrast_coef = std::tan((parameters.contrast + 1.0) * pi_4);
+                rgb = contrast_coef * (rgb - Eigen::Vector3d::Constant(0.5)) + Eigen::Vector3d::Constant(0.5);
+            }
 
             // clamp
             rgb = clamp(rgb);
 
             // saturation
-            Eigen::Vector3d hsv = rgb2hsv(rgb);
-            double s = hsv.y();
-            s *= saturation + 1.0;
-            hsv(1) = clamp(s);
-            const Eigen::Vector3d output_rgb = hsv2rgb(hsv);
+            if constexpr ((StageMask & stage::saturation) != 0)
+            {
+                Eigen::Vector3d hsv = rgb2hsv(rgb);
+                double s = hsv.y();
+                s *= parameters.saturation + 1.0;
+                hsv(1) = clamp(s);
+                rgb = hsv2rgb(hsv);
+            }
+
+            return rgb;
+        }
+    };
+
+    // The parameter set selected at build time by ENHANCER_WITH_LIFT_GAMMA_GAIN, which is used by the
+    // Eigen::VectorXd-based functions (enhance, enhance_image, ...) and by the shaders
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+    typedef LiftGammaGainParams ConfiguredParams;
+#else
+    typedef DefaultParams ConfiguredParams;
+#endif
+    static_assert(ConfiguredParams::num_parameters == NUM_PARAMETERS, "NUM_PARAMETERS must match the configured parameter set");
+
+    // A pipeline specialized for a parameter set at compile time. The parameters are held in a fixed-size vector and
+    // decoded once at construction, so evaluating a color involves no heap allocation. `StageMask` can be a subset
+    // of ParameterSet::all_stages to compile out stages that a preset never uses, e.g.,
+    // Enhancer<DefaultParams, stage::brightness | stage::contrast>. `A` selects the evaluation of the power functions
+    // and `R` the range of the values.
+    template <typename ParameterSet, unsigned StageMask, Accuracy A, ValueRange R> class Enhancer
+    {
+    public:
+        static_assert((StageMask & ~ParameterSet::all_stages) == 0, "StageMask contains stages that the parameter set does not have");
+
+        static constexpr int num_parameters = ParameterSet::num_parameters;
+
+        typedef Eigen::Matrix<double, num_parameters, 1> Parameters;
+        typedef typename ParameterSet::Decoded           Decoded;
+
+        explicit Enhancer(const Parameters& parameters) : m_decoded(ParameterSet::decode(parameters)) {}
+
+        Eigen::Vector3d operator()(const Eigen::Vector3d& input_rgb) const
+        {
+            return ParameterSet::template enhance<StageMask, A, R>(input_rgb, m_decoded);
+        }
+
+        static Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb, const Parameters& parameters)
+        {
+            return ParameterSet::template enhance<StageMask, A, R>(input_rgb, ParameterSet::decode(parameters));
+        }
+
+        const Decoded& getDecodedParameters() const { return m_decoded; }
+
+    private:
+        Decoded m_decoded;
+    };
 
-            return output_rgb;
+    namespace internal
+    {
+        // Shorthands for the configured parameter set
+        typedef ConfiguredParams::Decoded DecodedParameters;
+
+        template <typename Derived> inline DecodedParameters decodeParameters(const Eigen::MatrixBase<Derived>& parameters)
+        {
+            return ConfiguredParams::decode(parameters);
+        }
+
+        template <Accuracy A = Accuracy::Exact, ValueRange R = ValueRange::Display>
+        inline Eigen::Vector3d enhanceLinearRgb(const Eigen::Vector3d& linear_rgb, const DecodedParameters& parameters)
+        {
+            return ConfiguredParams::enhanceLinearRgb<ConfiguredParams::all_stages, A, R>(linear_rgb, parameters);
+        }
+
+        template <Accuracy A = Accuracy::Exact, ValueRange R = ValueRange::Display>
+        inline Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb, const DecodedParameters& parameters)
+        {
+            return ConfiguredParams::enhance<ConfiguredParams::all_stages, A, R>(input_rgb, parameters);
+        }
+
+        template <ValueRange R>
+        inline Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb, const DecodedParameters& parameters, const Accuracy accuracy)
+        {
+            switch (accuracy)
+            {
+                case Accuracy::Fast: return enhance<Accuracy::Fast, R>(input_rgb, parameters);
+                case Accuracy::Fastest: return enhance<Accuracy::Fastest, R>(input_rgb, parameters);
+                default: return enhance<Accuracy::Exact, R>(input_rgb, parameters);
+            }
+        }
+
+        inline Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb,
+                                       const DecodedParameters& parameters,
+                                       const Accuracy           accuracy,
+                                       const ValueRange         range = ValueRange::Display)
+        {
+            return range == ValueRange::SceneReferred ? enhance<ValueRange::SceneReferred>(input_rgb, parameters, accuracy)
+                                                      : enhance<ValueRange::Display>(input_rgb, parameters, accuracy);
+        }
+
+        inline Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb,
+                                       const Eigen::VectorXd& parameters,
+                                       const Accuracy         accuracy = Accuracy::Exact,
+                                       const ValueRange       range    = ValueRange::Display)
+        {
+            return enhance(input_rgb, decodeParameters(parameters), accuracy, range);
+        }
+
+        inline Eigen::Vector3d enhance_v1(const Eigen::Vector3d& input_rgb, const Eigen::VectorXd& parameters)
+        {
+            return ColorBalanceV1::enhance(input_rgb, ColorBalanceV1::decode(parameters));
         }
     } // namespace internal
 
-    inline Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb, const Eigen::VectorXd& parameters)
+    template <typename Derived>
+    Eigen::Vector3d enhance(const Eigen::Vector3d&            input_rgb,
+                            const Eigen::MatrixBase<Derived>& parameters,
+                            const Accuracy                    accuracy,
+                            const ValueRange                  range)
     {
-        return internal::enhance(input_rgb, parameters);
+        return internal::enhance(input_rgb, internal::decodeParameters(parameters), accuracy, range);
     }
 } // namespace enhancer
 
@@ -6,16 +6,36 @@
 #include <QOpenGLFunctions_3_2_Core>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLWidget>
+#include <QRectF>
 #include <array>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <enhancer/enhancer.hpp>
+#include <enhancer/imageview.hpp>
+#include <functional>
 #include <memory>
 
+class QOpenGLFramebufferObject;
 class QOpenGLShaderProgram;
 class QOpenGLTexture;
 
 namespace enhancer
 {
+    namespace internal
+    {
+        class GpuTimer;
+        class TexturePool;
+        struct UploadFormat;
+        struct TextureTile;
+        struct TiledImage;
+    } // namespace internal
+
+    // Renders on demand: setImage, setParameters, setAccuracy, and setRegionOfInterest schedule a repaint only when
+    // something changes, and repeated calls before the next frame (e.g., from a dragged slider) are coalesced by
+    // update() into one frame, which the swap interval then paces to the display. The rendered frame is cached in a
+    // framebuffer object of the size of the widget, so that repaints without changes (expose events, redundant
+    // update() calls, or polling a readback) only blit it instead of running the shader again.
     class EnhancerWidget : public QOpenGLWidget, protected QOpenGLFunctions_3_2_Core
     {
     public:
@@ -28,38 +48,101 @@ namespace enhancer
         EnhancerWidget(const Policy policy = Policy::AspectFit, QWidget* parent = nullptr);
         ~EnhancerWidget();
 
+        // The image is streamed to the GPU from paintGL through one of two alternating pixel buffer objects into
+        // mipmapped tiles of at most 2048 x 2048 pixels (or GL_MAX_TEXTURE_SIZE), which are reallocated only when the
+        // image size or format changes; calling this for every video frame is fine. Images larger than the widget are
+        // shown from a pyramid of half-resolution copies (built on demand), choosing the coarsest level that still
+        // has at least one pixel per device pixel. Only the tiles of that level within the visible part are
+        // uploaded, at most about 32 MiB per frame; a one-tile preview level fills the gaps until they arrive.
+        // 16-bit (Format_RGBA64 etc.) and, with Qt 6.2 or later, half/float (Format_RGBA16FPx4, Format_RGBA32FPx4
+        // etc.) images keep their precision in RGBA16, RGBA16F, or RGBA32F textures.
         void setImage(const QImage& image);
+
+        // Uploads pixels from an external buffer right away, without any intermediate image: the rows are copied
+        // once into a pixel buffer object, bottom-up views in a single copy as they are already in the OpenGL row
+        // order, and BGR(A) views are swizzled by the upload itself. The view is not referenced after the call, so
+        // all its tiles are uploaded at once and minified by the mipmaps only (no pyramid is built).
+        // Fails (returning false) until the widget has been shown, as the context does not exist before.
+        bool setImage(const ImageView<const std::uint8_t>& image);
+        bool setImage(const ImageView<const std::uint16_t>& image);
+        bool setImage(const ImageView<const Eigen::half>& image);
+        bool setImage(const ImageView<const float>& image);
+
+        // The last image set as a QImage, or a null image if the last image was set from a view
         const QImage& getImage() const { return m_image; }
 
+        // Shows the part of the image within `region` (in image pixels from the top-left corner) fitted to the widget
+        // according to the policy, for zooming and panning; a null or empty region shows the whole image
+        void setRegionOfInterest(const QRectF& region)
+        {
+            if (region == m_region_of_interest) { return; }
+
+            m_region_of_interest = region;
+            m_needs_render       = true;
+            update();
+        }
+
+        const QRectF& getRegionOfInterest() const { return m_region_of_interest; }
+
+        // Requests the enhanced image at its full resolution (as opaque RGBA8888). The image is rendered into an
+        // offscreen framebuffer in the next paintGL, where an asynchronous transfer into a pixel buffer object is
+        // started; `callback` is then called from a later paintGL (with the context current) once the transfer has
+        // completed, so paintGL never waits for the GPU. A request made while another is pending replaces it.
+        void requestEnhancedImage(std::function<void(const QImage&)> callback);
+
+        // The shader program is rebuilt with the corresponding ENHANCER_ACCURACY_* define (see enhancer.fs) in the
+        // next paintGL; the previous program is kept if the new one fails to build
+        void setAccuracy(const Accuracy accuracy)
+        {
+            if (accuracy == m_accuracy) { return; }
+            m_accuracy = accuracy;
+            update();
+        }
+
+        Accuracy getAccuracy() const { return m_accuracy; }
+
+        // Schedules a repaint if the parameters differ from the current ones; there is no need to call update()
         void setParameters(const std::array<GLfloat, NUM_PARAMETERS>& parameters)
         {
-            m_parameters = parameters;
+            if (parameters == m_parameters) { return; }
+
+            m_parameters   = parameters;
+            m_needs_render = true;
+            update();
         }
 
         template <typename T>
         void setParameters(const std::array<T, NUM_PARAMETERS>& parameters)
         {
-            for (int i = 0; i < NUM_PARAMETERS; ++ i) { m_parameters[i] = static_cast<GLfloat>(parameters[i]); }
+            std::array<GLfloat, NUM_PARAMETERS> converted;
+            for (int i = 0; i < NUM_PARAMETERS; ++ i) { converted[i] = static_cast<GLfloat>(parameters[i]); }
+            setParameters(converted);
         }
 
         template <typename T>
         void setParameters(const std::vector<T>& parameters)
         {
             assert(parameters.size() == NUM_PARAMETERS);
-            for (int i = 0; i < NUM_PARAMETERS; ++ i) { m_parameters[i] = static_cast<GLfloat>(parameters[i]); }
+            std::array<GLfloat, NUM_PARAMETERS> converted;
+            for (int i = 0; i < NUM_PARAMETERS; ++ i) { converted[i] = static_cast<GLfloat>(parameters[i]); }
+            setParameters(converted);
         }
 
         template <typename T>
         void setParameters(const T parameters[])
         {
-            for (int i = 0; i < NUM_PARAMETERS; ++ i) { m_parameters[i] = static_cast<GLfloat>(parameters[i]); }
+            std::array<GLfloat, NUM_PARAMETERS> converted;
+            for (int i = 0; i < NUM_PARAMETERS; ++ i) { converted[i] = static_cast<GLfloat>(parameters[i]); }
+            setParameters(converted);
         }
 
         template <typename T>
         void setParameters(const Eigen::Matrix<T, Eigen::Dynamic, 1>& parameters)
         {
             assert(parameters.size() == NUM_PARAMETERS);
-            for (int i = 0; i < NUM_PARAMETERS; ++ i) { m_parameters[i] = static_cast<GLfloat>(parameters[i]); }
+            std::array<GLfloat, NUM_PARAMETERS> converted;
+            for (int i = 0; i < NUM_PARAMETERS; ++ i) { converted[i] = static_cast<GLfloat>(parameters[i]); }
+            setParameters(converted);
         }
 
     protected:
@@ -71,14 +154,51 @@ namespace enhancer
         QImage m_image;
         bool   m_dirty;
         Policy m_policy;
+        QRectF m_region_of_interest;
+
+        // Whether the cached frame is outdated (or tiles of it are still to be uploaded)
+        bool                                      m_needs_render;
+        std::shared_ptr<QOpenGLFramebufferObject> m_frame_fbo;
 
         std::array<GLfloat, NUM_PARAMETERS> m_parameters;
 
+        Accuracy m_accuracy;
+        Accuracy m_program_accuracy;
+
         std::shared_ptr<QOpenGLShaderProgram> m_program;
-        std::shared_ptr<QOpenGLTexture>       m_texture;
+        std::unique_ptr<internal::TiledImage> m_tiled_image;
+        int                                   m_max_tile_size;
+
+        // The tile textures dropped from m_tiled_image, for reuse by the following images and levels
+        std::unique_ptr<internal::TexturePool> m_texture_pool;
 
         QOpenGLVertexArrayObject m_vao;
         QOpenGLBuffer            m_vbo;
+
+        std::array<QOpenGLBuffer, 2> m_upload_buffers;
+        int                          m_upload_index;
+
+        std::function<void(const QImage&)>        m_requested_readback_callback;
+        std::function<void(const QImage&)>        m_in_flight_readback_callback;
+        std::shared_ptr<QOpenGLFramebufferObject> m_readback_fbo;
+        QOpenGLBuffer                             m_readback_buffer;
+        GLsync                                    m_readback_fence;
+        int                                       m_readback_width;
+        int                                       m_readback_height;
+
+        // Only created in builds with ENHANCER_WITH_INSTRUMENTATION (see enhancer/instrumentation.hpp)
+        std::unique_ptr<internal::GpuTimer> m_gpu_timer;
+
+        bool buildProgram(const Accuracy accuracy);
+        void prepareTiledImage(const int width, const int height, const internal::UploadFormat& format, const bool has_pyramid);
+        void uploadImage();
+        bool uploadView(const void* top_row, const std::ptrdiff_t top_down_stride, const int width, const int height, const internal::UploadFormat& format);
+        void uploadTile(const int level, internal::TextureTile& tile);
+        void uploadPixels(internal::TextureTile& tile, const std::uint8_t* top_row, const std::ptrdiff_t top_down_stride, const internal::UploadFormat& format);
+        void drawTile(const internal::TextureTile& tile, const QRectF& uv_rect);
+        bool drawImage(const int w, const int h);
+        void startReadback();
+        void finishReadbackIfReady();
     };
 } // namespace enhancer
 
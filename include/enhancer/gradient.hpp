@@ -0,0 +1,315 @@
+#ifndef enhancer_gradient_hpp
+#define enhancer_gradient_hpp
+
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/enhancer.hpp>
+#include <enhancer/imageview.hpp>
+#include <enhancer/parallel.hpp>
+#include <vector>
+
+namespace enhancer
+{
+    namespace internal
+    {
+        namespace autodiff
+        {
+            template <int N> struct Dual;
+        } // namespace autodiff
+    } // namespace internal
+} // namespace enhancer
+
+// The dual numbers are Eigen scalars, so that the stages of enhancer.hpp can be instantiated with them; they mix with
+// doubles, which are the constants of the stages
+namespace Eigen
+{
+    template <int N> struct NumTraits<enhancer::internal::autodiff::Dual<N>> : NumTraits<double>
+    {
+        typedef enhancer::internal::autodiff::Dual<N> Real;
+        typedef enhancer::internal::autodiff::Dual<N> NonInteger;
+        typedef enhancer::internal::autodiff::Dual<N> Nested;
+        typedef enhancer::internal::autodiff::Dual<N> Literal;
+
+        enum
+        {
+            IsComplex             = 0,
+            IsInteger             = 0,
+            IsSigned              = 1,
+            RequireInitialization = 1,
+            ReadCost              = N + 1,
+            AddCost               = N + 1,
+            MulCost               = 2 * N + 1,
+        };
+    };
+
+    template <int N, typename BinaryOp> struct ScalarBinaryOpTraits<enhancer::internal::autodiff::Dual<N>, double, BinaryOp>
+    {
+        typedef enhancer::internal::autodiff::Dual<N> ReturnType;
+    };
+
+    template <int N, typename BinaryOp> struct ScalarBinaryOpTraits<double, enhancer::internal::autodiff::Dual<N>, BinaryOp>
+    {
+        typedef enhancer::internal::autodiff::Dual<N> ReturnType;
+    };
+} // namespace Eigen
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // The derivatives of the output channels (rows) with respect to the parameters (columns)
+    typedef Eigen::Matrix<double, 3, NUM_PARAMETERS> ColorJacobian;
+
+    // Returns the output of enhance (with the exact pipeline and ValueRange::Display) and writes its Jacobian with
+    // respect to `parameters` to `jacobian`. The derivatives are propagated in forward mode by instantiating the stages
+    // of the pipeline with dual numbers (see internal::autodiff), so a single evaluation gives all of them.
+    // Where the pipeline is not differentiable (clamping, hue sector boundaries, zero channels under fractional
+    // powers), the derivative of the branch taken is returned; parameters at or outside [0, 1] have zero derivatives.
+    inline Eigen::Vector3d enhance_with_jacobian(const Eigen::Vector3d& input_rgb, const Eigen::VectorXd& parameters, ColorJacobian& jacobian);
+
+    struct LossAndGradient
+    {
+        double          loss = 0.0;
+        Eigen::VectorXd gradient;
+    };
+
+    // The mean over the pixels of the squared Euclidean distance between the enhanced `src` and `target` (in [0, 1]
+    // display-encoded RGB) and its gradient with respect to `parameters`, for fitting the parameters to target images.
+    // The image is processed tile-parallel on `pool`; the tile sums are reduced in a fixed order, so the result does
+    // not depend on the scheduling. `T` is std::uint8_t, std::uint16_t, Eigen::half, or float; alpha is ignored.
+    template <typename T>
+    LossAndGradient compute_loss_and_gradient(ThreadPool&            pool,
+                                              const ImageView<T>&    src,
+                                              const ImageView<T>&    target,
+                                              const Eigen::VectorXd& parameters,
+                                              const TileSize&        tile_size = TileSize());
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    namespace internal
+    {
+        namespace autodiff
+        {
+            // A forward-mode dual number: a value and its gradient with respect to N variables. The values are
+            // computed exactly as in double precision, so the pipeline gives the same output with either scalar.
+            template <int N> struct Dual
+            {
+                typedef Eigen::Matrix<double, N, 1> Gradient;
+
+                double   value;
+                Gradient gradient;
+
+                Dual(const double value = 0.0) : value(value), gradient(Gradient::Zero()) {}
+                Dual(const double value, const Gradient& gradient) : value(value), gradient(gradient) {}
+
+                friend Dual operator-(const Dual& a) { return Dual(-a.value, -a.gradient); }
+
+                friend Dual operator+(const Dual& a, const Dual& b) { return Dual(a.value + b.value, a.gradient + b.gradient); }
+                friend Dual operator+(const Dual& a, const double b) { return Dual(a.value + b, a.gradient); }
+                friend Dual operator+(const double a, const Dual& b) { return Dual(a + b.value, b.gradient); }
+
+                friend Dual operator-(const Dual& a, const Dual& b) { return Dual(a.value - b.value, a.gradient - b.gradient); }
+                friend Dual operator-(const Dual& a, const double b) { return Dual(a.value - b, a.gradient); }
+                friend Dual operator-(const double a, const Dual& b) { return Dual(a - b.value, -b.gradient); }
+
+                friend Dual operator*(const Dual& a, const Dual& b) { return Dual(a.value * b.value, b.value * a.gradient + a.value * b.gradient); }
+                friend Dual operator*(const Dual& a, const double b) { return Dual(a.value * b, b * a.gradient); }
+                friend Dual operator*(const double a, const Dual& b) { return Dual(a * b.value, a * b.gradient); }
+
+                friend Dual operator/(const Dual& a, const Dual& b)
+                {
+                    const double value = a.value / b.value;
+                    return Dual(value, (a.gradient - value * b.gradient) / b.value);
+                }
+                friend Dual operator/(const Dual& a, const double b) { return Dual(a.value / b, a.gradient / b); }
+                friend Dual operator/(const double a, const Dual& b) { return Dual(a / b.value, (-a / (b.value * b.value)) * b.gradient); }
+
+                Dual& operator+=(const Dual& other) { return *this = *this + other; }
+                Dual& operator-=(const Dual& other) { return *this = *this - other; }
+                Dual& operator*=(const Dual& other) { return *this = *this * other; }
+                Dual& operator/=(const Dual& other) { return *this = *this / other; }
+                Dual& operator+=(const double other) { return *this = *this + other; }
+                Dual& operator-=(const double other) { return *this = *this - other; }
+                Dual& operator*=(const double other) { return *this = *this * other; }
+                Dual& operator/=(const double other) { return *this = *this / other; }
+
+                // Branches compare the values only
+                friend bool operator<(const Dual& a, const Dual& b) { return a.value < b.value; }
+                friend bool operator<(const Dual& a, const double b) { return a.value < b; }
+                friend bool operator>(const Dual& a, const double b) { return a.value > b; }
+                friend bool operator==(const Dual& a, const Dual& b) { return a.value == b.value; }
+            };
+
+            template <int N> inline double getValue(const Dual<N>& x) { return x.value; }
+            template <int N> inline Dual<N> withValue(const Dual<N>& x, const double value) { return Dual<N>(value, x.gradient); }
+
+            // x^y for x >= 0; the derivatives at x = 0 are taken as zero (they are infinite for y < 1)
+            template <int N> inline Dual<N> pow(const Dual<N>& x, const double y)
+            {
+                const double value = std::pow(x.value, y);
+                if (x.value <= 0.0) { return Dual<N>(value); }
+                return Dual<N>(value, (y * value / x.value) * x.gradient);
+            }
+
+            template <int N> inline Dual<N> pow(const Dual<N>& x, const Dual<N>& y)
+            {
+                const double value = std::pow(x.value, y.value);
+                if (x.value <= 0.0) { return Dual<N>(value); }
+                return Dual<N>(value, value * ((y.value / x.value) * x.gradient + std::log(x.value) * y.gradient));
+            }
+
+            template <int N> inline Dual<N> tan(const Dual<N>& x)
+            {
+                const double value = std::tan(x.value);
+                return Dual<N>(value, (1.0 + value * value) * x.gradient);
+            }
+
+            // The same rounding as internal::clamp, which goes through single precision; the derivatives vanish
+            // where the value is clamped
+            template <int N> inline Dual<N> clamp(const Dual<N>& x)
+            {
+                if (x.value <= 0.0) { return Dual<N>(0.0); }
+                if (x.value >= 1.0) { return Dual<N>(1.0); }
+                return Dual<N>(internal::clamp(x.value), x.gradient);
+            }
+
+            typedef Dual<NUM_PARAMETERS> ParameterDual;
+
+            // The parameters of the configured set over dual numbers, each seeded with its own unit derivative
+            typedef ConfiguredParams::BasicDecoded<ParameterDual> DualDecodedParameters;
+
+            // The input linearization does not depend on the parameters, so it is evaluated in plain doubles (and
+            // tabulated for 8-bit images); the stages are those of enhance (Accuracy::Exact, ValueRange::Display)
+            inline Vector3<ParameterDual> enhanceLinearRgbWithGradient(const Eigen::Vector3d& linear_rgb, const DualDecodedParameters& parameters)
+            {
+                return ConfiguredParams::enhanceLinearRgb(Vector3<ParameterDual>(linear_rgb.cast<ParameterDual>()), parameters);
+            }
+
+            template <typename T> struct LossLinearizer
+            {
+                Eigen::Vector3d operator()(const T* pixel, const ChannelIndices& indices) const
+                {
+                    typedef ChannelTraits<T> Traits;
+                    return internal::convertRgbToLinearRgb(Eigen::Vector3d(Traits::toDouble(pixel[indices.r]), Traits::toDouble(pixel[indices.g]), Traits::toDouble(pixel[indices.b])));
+                }
+
+                double toDouble(const T value) const { return ChannelTraits<T>::toDouble(value); }
+            };
+
+            template <> struct LossLinearizer<std::uint8_t>
+            {
+                std::array<double, 256> linear_table;
+
+                LossLinearizer()
+                {
+                    for (int i = 0; i < 256; ++i) { linear_table[i] = std::pow(static_cast<double>(i) / 255.0, 2.2); }
+                }
+
+                Eigen::Vector3d operator()(const std::uint8_t* pixel, const ChannelIndices& indices) const
+                {
+                    return Eigen::Vector3d(linear_table[pixel[indices.r]], linear_table[pixel[indices.g]], linear_table[pixel[indices.b]]);
+                }
+
+                double toDouble(const std::uint8_t value) const { return value * (1.0 / 255.0); }
+            };
+        } // namespace autodiff
+
+        template <int N> struct ScalarTraits<autodiff::Dual<N>>
+        {
+            static constexpr bool has_derivatives = true;
+
+            // An input variable (with a unit derivative) or, if clamped, a constant
+            static autodiff::Dual<N> makeParameter(const double value, const int index, const bool is_active)
+            {
+                autodiff::Dual<N> x(value);
+                if (is_active) { x.gradient(index) = 1.0; }
+                return x;
+            }
+        };
+    } // namespace internal
+
+    inline Eigen::Vector3d enhance_with_jacobian(const Eigen::Vector3d& input_rgb, const Eigen::VectorXd& parameters, ColorJacobian& jacobian)
+    {
+        using namespace internal::autodiff;
+
+        const DualDecodedParameters            decoded = ConfiguredParams::decode<ParameterDual>(parameters);
+        const internal::Vector3<ParameterDual> output  = enhanceLinearRgbWithGradient(internal::convertRgbToLinearRgb(input_rgb), decoded);
+
+        for (int i = 0; i < 3; ++i) { jacobian.row(i) = output(i).gradient.transpose(); }
+        return Eigen::Vector3d(output(0).value, output(1).value, output(2).value);
+    }
+
+    template <typename T>
+    LossAndGradient compute_loss_and_gradient(ThreadPool&            pool,
+                                              const ImageView<T>&    src,
+                                              const ImageView<T>&    target,
+                                              const Eigen::VectorXd& parameters,
+                                              const TileSize&        tile_size)
+    {
+        using namespace internal::autodiff;
+
+        assert(tile_size.width > 0 && tile_size.height > 0);
+        assert(src.width == target.width && src.height == target.height);
+
+        const DualDecodedParameters decoded = ConfiguredParams::decode<ParameterDual>(parameters);
+
+        const LossLinearizer<typename std::remove_const<T>::type> linearizer;
+
+        const internal::TileGrid grid(src.width, src.height, tile_size);
+
+        // One partial sum per tile; the loss is stored in the value and the gradient in the derivatives
+        std::vector<ParameterDual> tile_sums(grid.getNumTiles());
+
+        pool.parallelFor(grid.getNumTiles(), [&](const int i)
+        {
+            const internal::Tile tile = grid.getTile(i);
+
+            const int                      src_channels      = src.getNumChannels();
+            const int                      target_channels   = target.getNumChannels();
+            const internal::ChannelIndices src_indices       = internal::getChannelIndices(src.order);
+            const internal::ChannelIndices target_indices    = internal::getChannelIndices(target.order);
+            const int                      target_offsets[3] = { target_indices.r, target_indices.g, target_indices.b };
+
+            ParameterDual sum;
+            for (int y = tile.y; y < tile.y + tile.height; ++y)
+            {
+                const auto* src_row    = src.getRow(y);
+                const auto* target_row = target.getRow(y);
+
+                for (int x = tile.x; x < tile.x + tile.width; ++x)
+                {
+                    const internal::Vector3<ParameterDual> output = enhanceLinearRgbWithGradient(linearizer(src_row + x * src_channels, src_indices), decoded);
+
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        const ParameterDual difference = output(c) - linearizer.toDouble(target_row[x * target_channels + target_offsets[c]]);
+
+                        // d(difference^2) = 2 * difference * d(difference), accumulated without forming the product
+                        sum.value    += difference.value * difference.value;
+                        sum.gradient += (2.0 * difference.value) * difference.gradient;
+                    }
+                }
+            }
+            tile_sums[i] = sum;
+        });
+
+        ParameterDual total;
+        for (const ParameterDual& tile_sum : tile_sums) { total += tile_sum; }
+
+        const double num_pixels = static_cast<double>(src.width) * static_cast<double>(src.height);
+
+        LossAndGradient result;
+        result.loss     = num_pixels > 0.0 ? total.value / num_pixels : 0.0;
+        result.gradient = num_pixels > 0.0 ? Eigen::VectorXd(total.gradient / num_pixels) : Eigen::VectorXd(Eigen::VectorXd::Zero(NUM_PARAMETERS));
+        return result;
+    }
+} // namespace enhancer
+
+#endif /* enhancer_gradient_hpp */
@@ -0,0 +1,431 @@
+#ifndef enhancer_image_hpp
+#define enhancer_image_hpp
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/enhancer.hpp>
+#include <enhancer/imageview.hpp>
+#include <enhancer/instrumentation.hpp>
+#include <type_traits>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // Enhance a whole interleaved RGB (channels = 3) or RGBA (channels = 4) image. The alpha channel, if any, is
+    // copied as is. `stride` is the number of bytes between the beginnings of two consecutive rows (e.g.,
+    // QImage::bytesPerLine()) and is shared by `src` and `dst`. `src` and `dst` may point to the same buffer.
+    // `accuracy` trades the precision of the power functions for speed (see Accuracy).
+    inline void enhance_image(const std::uint8_t*    src,
+                              std::uint8_t*          dst,
+                              const int              width,
+                              const int              height,
+                              const std::ptrdiff_t   stride,
+                              const int              channels,
+                              const Eigen::VectorXd& parameters,
+                              const Accuracy         accuracy = Accuracy::Exact);
+
+    // 16-bit variant of enhance_image (e.g., 16-bit TIFF or QImage::Format_RGBA64), where 65535 corresponds to 1
+    inline void enhance_image(const std::uint16_t*   src,
+                              std::uint16_t*         dst,
+                              const int              width,
+                              const int              height,
+                              const std::ptrdiff_t   stride,
+                              const int              channels,
+                              const Eigen::VectorXd& parameters,
+                              const Accuracy         accuracy = Accuracy::Exact);
+
+    // Half-precision and float32 variants of enhance_image, where 1 is the display white. With
+    // ValueRange::SceneReferred, inputs above 1 are accepted and the outputs are not clamped to 1.
+    inline void enhance_image(const Eigen::half*     src,
+                              Eigen::half*           dst,
+                              const int              width,
+                              const int              height,
+                              const std::ptrdiff_t   stride,
+                              const int              channels,
+                              const Eigen::VectorXd& parameters,
+                              const Accuracy         accuracy = Accuracy::Exact,
+                              const ValueRange       range    = ValueRange::Display);
+
+    inline void enhance_image(const float*           src,
+                              float*                 dst,
+                              const int              width,
+                              const int              height,
+                              const std::ptrdiff_t   stride,
+                              const int              channels,
+                              const Eigen::VectorXd& parameters,
+                              const Accuracy         accuracy = Accuracy::Exact,
+                              const ValueRange       range    = ValueRange::Display);
+
+    // View-based variant of enhance_image for pixels in external buffers. `src` and `dst` have the same size but
+    // may differ in stride, channel order (e.g., a BGR decoder output written to an RGBA buffer), and row order; the
+    // alpha of an RGB `src` is opaque. `T` is deduced from `dst` and is std::uint8_t, std::uint16_t, Eigen::half, or
+    // float; `range` only applies to the floating-point types.
+    template <typename T>
+    void enhance_image(const typename ImageView<T>::ConstView& src,
+                       const ImageView<T>&                     dst,
+                       const Eigen::VectorXd&                  parameters,
+                       const Accuracy                          accuracy = Accuracy::Exact,
+                       const ValueRange                        range    = ValueRange::Display);
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    namespace internal
+    {
+        template <typename T> inline const T* getRow(const T* data, const std::ptrdiff_t stride, const int y)
+        {
+            return reinterpret_cast<const T*>(reinterpret_cast<const std::uint8_t*>(data) + stride * y);
+        }
+
+        template <typename T> inline T* getRow(T* data, const std::ptrdiff_t stride, const int y)
+        {
+            return reinterpret_cast<T*>(reinterpret_cast<std::uint8_t*>(data) + stride * y);
+        }
+
+        inline std::uint8_t quantize8(const double value)
+        {
+            return static_cast<std::uint8_t>(clamp(value) * 255.0 + 0.5);
+        }
+
+        inline std::uint16_t quantize16(const double value)
+        {
+            return static_cast<std::uint16_t>(std::max(0.0, std::min(value, 1.0)) * 65535.0 + 0.5);
+        }
+
+        // Conversions between the channel types of the typed image paths and [0, 1]-based doubles
+        template <typename T> struct ChannelTraits;
+
+        template <> struct ChannelTraits<std::uint8_t>
+        {
+            static double       toDouble(const std::uint8_t value) { return value * (1.0 / 255.0); }
+            static std::uint8_t fromDouble(const double value) { return quantize8(value); }
+        };
+
+        template <> struct ChannelTraits<std::uint16_t>
+        {
+            static double        toDouble(const std::uint16_t value) { return value * (1.0 / 65535.0); }
+            static std::uint16_t fromDouble(const double value) { return quantize16(value); }
+        };
+
+        template <> struct ChannelTraits<Eigen::half>
+        {
+            static double      toDouble(const Eigen::half value) { return static_cast<double>(static_cast<float>(value)); }
+            static Eigen::half fromDouble(const double value) { return Eigen::half(static_cast<float>(value)); }
+        };
+
+        template <> struct ChannelTraits<float>
+        {
+            static double toDouble(const float value) { return value; }
+            static float  fromDouble(const double value) { return static_cast<float>(value); }
+        };
+
+#if defined(ENHANCER_WITH_INSTRUMENTATION)
+        template <unsigned Stage, Accuracy A, ValueRange R>
+        inline void applyStageToRow(std::vector<Eigen::Vector3d>& row, const DecodedParameters& decoded, const InstrumentedStage instrumented_stage)
+        {
+            if constexpr ((ConfiguredParams::all_stages & Stage) != 0)
+            {
+                const StageTimer timer(instrumented_stage);
+                for (Eigen::Vector3d& linear_rgb : row) { linear_rgb = ConfiguredParams::applyStages<Stage, A, R>(linear_rgb, decoded); }
+            }
+        }
+
+        // The instrumented variant of the row loops: each stage runs over the whole row before the next one so that
+        // the stages can be timed separately. The stages are the same functions in the same order, so the results
+        // are identical; only the row has to make a round trip through a buffer between the stages.
+        template <Accuracy A, ValueRange R, typename Linearize, typename Write>
+        inline void enhanceRowByStage(const int width, const DecodedParameters& decoded, const Linearize& linearize, const Write& write)
+        {
+            typedef typename math::Select<A>::Type Math;
+
+            static thread_local std::vector<Eigen::Vector3d> row;
+            row.resize(width);
+
+            countProcessedPixels(static_cast<std::uint64_t>(width));
+
+            {
+                const StageTimer timer(InstrumentedStage::Linearize);
+                for (int x = 0; x < width; ++x) { row[x] = linearize(x); }
+            }
+
+            applyStageToRow<stage::temperature_tint, A, R>(row, decoded, InstrumentedStage::TemperatureTint);
+            applyStageToRow<stage::lift_gamma_gain, A, R>(row, decoded, InstrumentedStage::LiftGammaGain);
+            applyStageToRow<stage::brightness, A, R>(row, decoded, InstrumentedStage::Brightness);
+            applyStageToRow<stage::contrast, A, R>(row, decoded, InstrumentedStage::Contrast);
+            applyStageToRow<stage::saturation, A, R>(row, decoded, InstrumentedStage::Saturation);
+
+            {
+                const StageTimer timer(InstrumentedStage::Encode);
+                for (int x = 0; x < width; ++x) { write(x, convertLinearRgbToOutputRgb<R, Math>(row[x])); }
+            }
+        }
+#endif
+
+        // Enhances single rows; the setup shared by all the rows of an image is done once in the constructor, so
+        // that the rows can also be processed one at a time (e.g., while the results are still in the L1 cache)
+        template <Accuracy A, ValueRange R, typename T> class RowEnhancer
+        {
+        public:
+            RowEnhancer(const ChannelOrder src_order, const ChannelOrder dst_order, const DecodedParameters& decoded) :
+            m_src_channels(getNumChannels(src_order)),
+            m_dst_channels(getNumChannels(dst_order)),
+            m_src_indices(getChannelIndices(src_order)),
+            m_dst_indices(getChannelIndices(dst_order)),
+            m_decoded(decoded)
+            {
+            }
+
+            void operator()(const T* src_row, T* dst_row, const int width) const
+            {
+                typedef ChannelTraits<T> Traits;
+
+#if defined(ENHANCER_WITH_INSTRUMENTATION)
+                typedef typename math::Select<A>::Type Math;
+
+                enhanceRowByStage<A, R>(
+                    width,
+                    m_decoded,
+                    [&](const int x)
+                    {
+                        const T* src_pixel = src_row + x * m_src_channels;
+                        return convertRgbToLinearRgb<Math>(Eigen::Vector3d(Traits::toDouble(src_pixel[m_src_indices.r]),
+                                                                           Traits::toDouble(src_pixel[m_src_indices.g]),
+                                                                           Traits::toDouble(src_pixel[m_src_indices.b])));
+                    },
+                    [&](const int x, const Eigen::Vector3d& rgb)
+                    {
+                        const T* src_pixel = src_row + x * m_src_channels;
+                        T*       dst_pixel = dst_row + x * m_dst_channels;
+
+                        if (m_dst_channels == 4) { dst_pixel[3] = m_src_channels == 4 ? src_pixel[3] : Traits::fromDouble(1.0); }
+                        dst_pixel[m_dst_indices.r] = Traits::fromDouble(rgb(0));
+                        dst_pixel[m_dst_indices.g] = Traits::fromDouble(rgb(1));
+                        dst_pixel[m_dst_indices.b] = Traits::fromDouble(rgb(2));
+                    });
+#else
+                for (int x = 0; x < width; ++x)
+                {
+                    const T*              src_pixel = src_row + x * m_src_channels;
+                    T*                    dst_pixel = dst_row + x * m_dst_channels;
+                    const Eigen::Vector3d rgb       = enhance<A, R>(Eigen::Vector3d(Traits::toDouble(src_pixel[m_src_indices.r]),
+                                                                                    Traits::toDouble(src_pixel[m_src_indices.g]),
+                                                                                    Traits::toDouble(src_pixel[m_src_indices.b])),
+                                                                    m_decoded);
+
+                    if (m_dst_channels == 4) { dst_pixel[3] = m_src_channels == 4 ? src_pixel[3] : Traits::fromDouble(1.0); }
+                    dst_pixel[m_dst_indices.r] = Traits::fromDouble(rgb(0));
+                    dst_pixel[m_dst_indices.g] = Traits::fromDouble(rgb(1));
+                    dst_pixel[m_dst_indices.b] = Traits::fromDouble(rgb(2));
+                }
+#endif
+            }
+
+        private:
+            const int                m_src_channels;
+            const int                m_dst_channels;
+            const ChannelIndices     m_src_indices;
+            const ChannelIndices     m_dst_indices;
+            const DecodedParameters& m_decoded;
+        };
+
+        template <Accuracy A, ValueRange R> class RowEnhancer<A, R, std::uint8_t>
+        {
+        public:
+            RowEnhancer(const ChannelOrder src_order, const ChannelOrder dst_order, const DecodedParameters& decoded) :
+            m_src_channels(getNumChannels(src_order)),
+            m_dst_channels(getNumChannels(dst_order)),
+            m_src_indices(getChannelIndices(src_order)),
+            m_dst_indices(getChannelIndices(dst_order)),
+            m_decoded(decoded)
+            {
+                typedef typename math::Select<A>::Type Math;
+
+                // An 8-bit channel has only 256 possible values, so the input linearization is tabulated once per image
+                for (int i = 0; i < 256; ++i)
+                {
+                    m_linear_table[i] = convertRgbToLinearRgb<Math>(Eigen::Vector3d::Constant(static_cast<double>(i) / 255.0))(0);
+                }
+            }
+
+            void operator()(const std::uint8_t* src_row, std::uint8_t* dst_row, const int width) const
+            {
+#if defined(ENHANCER_WITH_INSTRUMENTATION)
+                enhanceRowByStage<A, R>(
+                    width,
+                    m_decoded,
+                    [&](const int x)
+                    {
+                        const std::uint8_t* src_pixel = src_row + x * m_src_channels;
+                        return Eigen::Vector3d(m_linear_table[src_pixel[m_src_indices.r]],
+                                               m_linear_table[src_pixel[m_src_indices.g]],
+                                               m_linear_table[src_pixel[m_src_indices.b]]);
+                    },
+                    [&](const int x, const Eigen::Vector3d& rgb)
+                    {
+                        const std::uint8_t* src_pixel = src_row + x * m_src_channels;
+                        std::uint8_t*       dst_pixel = dst_row + x * m_dst_channels;
+
+                        if (m_dst_channels == 4) { dst_pixel[3] = m_src_channels == 4 ? src_pixel[3] : 255; }
+                        dst_pixel[m_dst_indices.r] = quantize8(rgb(0));
+                        dst_pixel[m_dst_indices.g] = quantize8(rgb(1));
+                        dst_pixel[m_dst_indices.b] = quantize8(rgb(2));
+                    });
+#else
+                for (int x = 0; x < width; ++x)
+                {
+                    const std::uint8_t*   src_pixel  = src_row + x * m_src_channels;
+                    std::uint8_t*         dst_pixel  = dst_row + x * m_dst_channels;
+                    const Eigen::Vector3d linear_rgb = Eigen::Vector3d(m_linear_table[src_pixel[m_src_indices.r]],
+                                                                       m_linear_table[src_pixel[m_src_indices.g]],
+                                                                       m_linear_table[src_pixel[m_src_indices.b]]);
+                    const Eigen::Vector3d rgb        = enhanceLinearRgb<A, R>(linear_rgb, m_decoded);
+
+                    // Read the alpha before the color channels are written, as the buffers may be shared
+                    if (m_dst_channels == 4) { dst_pixel[3] = m_src_channels == 4 ? src_pixel[3] : 255; }
+                    dst_pixel[m_dst_indices.r] = quantize8(rgb(0));
+                    dst_pixel[m_dst_indices.g] = quantize8(rgb(1));
+                    dst_pixel[m_dst_indices.b] = quantize8(rgb(2));
+                }
+#endif
+            }
+
+        private:
+            const int                m_src_channels;
+            const int                m_dst_channels;
+            const ChannelIndices     m_src_indices;
+            const ChannelIndices     m_dst_indices;
+            const DecodedParameters& m_decoded;
+            std::array<double, 256>  m_linear_table;
+        };
+
+        template <Accuracy A, ValueRange R, typename T>
+        inline void enhanceImageRows(const ImageView<const T>& src, const ImageView<T>& dst, const DecodedParameters& decoded)
+        {
+            const RowEnhancer<A, R, T> row_enhancer(src.order, dst.order, decoded);
+
+            for (int y = 0; y < src.height; ++y) { row_enhancer(src.getRow(y), dst.getRow(y), src.width); }
+        }
+
+        template <ValueRange R, typename T>
+        inline void enhanceImageRows(const ImageView<const T>& src, const ImageView<T>& dst, const DecodedParameters& decoded, const Accuracy accuracy)
+        {
+            switch (accuracy)
+            {
+                case Accuracy::Fast: enhanceImageRows<Accuracy::Fast, R>(src, dst, decoded); break;
+                case Accuracy::Fastest: enhanceImageRows<Accuracy::Fastest, R>(src, dst, decoded); break;
+                default: enhanceImageRows<Accuracy::Exact, R>(src, dst, decoded); break;
+            }
+        }
+
+        // The accuracy and the range are resolved once per image so that the per-pixel code is specialized
+        template <typename T>
+        inline void enhanceImage(const ImageView<const T>& src,
+                                 const ImageView<T>&       dst,
+                                 const Eigen::VectorXd&    parameters,
+                                 const Accuracy            accuracy,
+                                 const ValueRange          range)
+        {
+            assert(src.width == dst.width && src.height == dst.height);
+
+            const TraceSpan span("enhance_image");
+
+            const DecodedParameters decoded = decodeParameters(parameters);
+
+            if (range == ValueRange::SceneReferred)
+            {
+                enhanceImageRows<ValueRange::SceneReferred>(src, dst, decoded, accuracy);
+            }
+            else
+            {
+                enhanceImageRows<ValueRange::Display>(src, dst, decoded, accuracy);
+            }
+        }
+
+        template <typename T>
+        inline void enhanceImage(const T*               src,
+                                 T*                     dst,
+                                 const int              width,
+                                 const int              height,
+                                 const std::ptrdiff_t   stride,
+                                 const int              channels,
+                                 const Eigen::VectorXd& parameters,
+                                 const Accuracy         accuracy,
+                                 const ValueRange       range)
+        {
+            assert(channels == 3 || channels == 4);
+
+            const ChannelOrder order = channels == 4 ? ChannelOrder::RGBA : ChannelOrder::RGB;
+            enhanceImage(ImageView<const T>(src, width, height, stride, order), ImageView<T>(dst, width, height, stride, order), parameters, accuracy, range);
+        }
+    } // namespace internal
+
+    inline void enhance_image(const std::uint8_t*    src,
+                              std::uint8_t*          dst,
+                              const int              width,
+                              const int              height,
+                              const std::ptrdiff_t   stride,
+                              const int              channels,
+                              const Eigen::VectorXd& parameters,
+                              const Accuracy         accuracy)
+    {
+        internal::enhanceImage(src, dst, width, height, stride, channels, parameters, accuracy, ValueRange::Display);
+    }
+
+    inline void enhance_image(const std::uint16_t*   src,
+                              std::uint16_t*         dst,
+                              const int              width,
+                              const int              height,
+                              const std::ptrdiff_t   stride,
+                              const int              channels,
+                              const Eigen::VectorXd& parameters,
+                              const Accuracy         accuracy)
+    {
+        internal::enhanceImage(src, dst, width, height, stride, channels, parameters, accuracy, ValueRange::Display);
+    }
+
+    inline void enhance_image(const Eigen::half*     src,
+                              Eigen::half*           dst,
+                              const int              width,
+                              const int              height,
+                              const std::ptrdiff_t   stride,
+                              const int              channels,
+                              const Eigen::VectorXd& parameters,
+                              const Accuracy         accuracy,
+                              const ValueRange       range)
+    {
+        internal::enhanceImage(src, dst, width, height, stride, channels, parameters, accuracy, range);
+    }
+
+    inline void enhance_image(const float*           src,
+                              float*                 dst,
+                              const int              width,
+                              const int              height,
+                              const std::ptrdiff_t   stride,
+                              const int              channels,
+                              const Eigen::VectorXd& parameters,
+                              const Accuracy         accuracy,
+                              const ValueRange       range)
+    {
+        internal::enhanceImage(src, dst, width, height, stride, channels, parameters, accuracy, range);
+    }
+
+    template <typename T>
+    void enhance_image(const typename ImageView<T>::ConstView& src,
+                       const ImageView<T>&                     dst,
+                       const Eigen::VectorXd&                  parameters,
+                       const Accuracy                          accuracy,
+                       const ValueRange                        range)
+    {
+        const bool is_integral = std::is_integral<T>::value;
+        internal::enhanceImage(src, dst, parameters, accuracy, is_integral ? ValueRange::Display : range);
+    }
+} // namespace enhancer
+
+#endif /* enhancer_image_hpp */
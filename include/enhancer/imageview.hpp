@@ -0,0 +1,128 @@
+#ifndef enhancer_imageview_hpp
+#define enhancer_imageview_hpp
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // The memory order of the channels of an interleaved pixel
+    enum class ChannelOrder
+    {
+        RGB,
+        BGR,
+        RGBA,
+        BGRA
+    };
+
+    inline int getNumChannels(const ChannelOrder order);
+
+    // A non-owning view of an interleaved image in an external buffer (e.g., a decoder output, a camera frame, a
+    // Windows DIB, or an OpenCV BGR matrix), so that the pixels can be processed and uploaded where they are.
+    // `data` points to the first row in memory, which is the bottom row of the image if `is_bottom_up` is set, and
+    // `stride` is the (positive) number of bytes between the beginnings of two consecutive rows in memory.
+    template <typename T> struct ImageView
+    {
+        typedef ImageView<const typename std::remove_const<T>::type> ConstView;
+
+        T*             data;
+        int            width;
+        int            height;
+        std::ptrdiff_t stride;
+        ChannelOrder   order;
+        bool           is_bottom_up;
+
+        ImageView(T*                   data,
+                  const int            width,
+                  const int            height,
+                  const std::ptrdiff_t stride,
+                  const ChannelOrder   order        = ChannelOrder::RGBA,
+                  const bool           is_bottom_up = false);
+
+        // Allows passing a view of mutable pixels where a view of constant pixels is expected
+        template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value>::type>
+        ImageView(const ImageView<U>& other);
+
+        int getNumChannels() const { return enhancer::getNumChannels(order); }
+
+        // Returns the y-th row counted from the top of the image, whatever the memory order of the rows
+        T* getRow(const int y) const;
+
+        // The number of bytes from a row to the row below it, which is negative for bottom-up images
+        std::ptrdiff_t getTopDownStride() const { return is_bottom_up ? -stride : stride; }
+
+        // A view of the rectangle whose top-left corner is (x, y), sharing the buffer and the stride
+        ImageView getSubView(const int x, const int y, const int sub_width, const int sub_height) const;
+    };
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline int getNumChannels(const ChannelOrder order)
+    {
+        return (order == ChannelOrder::RGBA || order == ChannelOrder::BGRA) ? 4 : 3;
+    }
+
+    namespace internal
+    {
+        // The positions of the red, green, and blue channels within a pixel
+        struct ChannelIndices
+        {
+            int r;
+            int g;
+            int b;
+        };
+
+        inline ChannelIndices getChannelIndices(const ChannelOrder order)
+        {
+            const bool is_bgr = order == ChannelOrder::BGR || order == ChannelOrder::BGRA;
+            return is_bgr ? ChannelIndices{ 2, 1, 0 } : ChannelIndices{ 0, 1, 2 };
+        }
+    } // namespace internal
+
+    template <typename T>
+    ImageView<T>::ImageView(T*                   data,
+                            const int            width,
+                            const int            height,
+                            const std::ptrdiff_t stride,
+                            const ChannelOrder   order,
+                            const bool           is_bottom_up) :
+    data(data), width(width), height(height), stride(stride), order(order), is_bottom_up(is_bottom_up)
+    {
+        assert(stride > 0);
+    }
+
+    template <typename T>
+    template <typename U, typename>
+    ImageView<T>::ImageView(const ImageView<U>& other) :
+    data(other.data), width(other.width), height(other.height), stride(other.stride), order(other.order), is_bottom_up(other.is_bottom_up)
+    {
+    }
+
+    template <typename T> T* ImageView<T>::getRow(const int y) const
+    {
+        typedef typename std::conditional<std::is_const<T>::value, const std::uint8_t, std::uint8_t>::type Byte;
+
+        const int memory_row = is_bottom_up ? height - 1 - y : y;
+        return reinterpret_cast<T*>(reinterpret_cast<Byte*>(data) + stride * memory_row);
+    }
+
+    template <typename T>
+    ImageView<T> ImageView<T>::getSubView(const int x, const int y, const int sub_width, const int sub_height) const
+    {
+        assert(x >= 0 && y >= 0 && x + sub_width <= width && y + sub_height <= height);
+
+        // The first row in memory of a bottom-up sub-view is its bottom row
+        T* first_row = getRow(is_bottom_up ? y + sub_height - 1 : y) + x * getNumChannels();
+        return ImageView(first_row, sub_width, sub_height, stride, order, is_bottom_up);
+    }
+} // namespace enhancer
+
+#endif /* enhancer_imageview_hpp */
@@ -0,0 +1,416 @@
+#ifndef enhancer_instrumentation_hpp
+#define enhancer_instrumentation_hpp
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // Whether the library is built with ENHANCER_WITH_INSTRUMENTATION (the CMake option ENHANCER_USE_INSTRUMENTATION).
+    // Without it, the hooks compile to nothing and the stats and traces stay empty.
+#if defined(ENHANCER_WITH_INSTRUMENTATION)
+    constexpr bool is_instrumentation_enabled = true;
+#else
+    constexpr bool is_instrumentation_enabled = false;
+#endif
+
+    // The timed parts of the batch path (enhance_image and the functions built on it, e.g., enhance_image_parallel,
+    // FramePipeline, and enhance_image_file) and of the GPU paths (OffscreenEnhancer and EnhancerWidget)
+    enum class InstrumentedStage
+    {
+        Linearize,
+        TemperatureTint,
+        LiftGammaGain,
+        Brightness,
+        Contrast,
+        Saturation,
+        Encode,
+        GpuUpload,
+        GpuDraw,
+        GpuReadback
+    };
+
+    constexpr int num_instrumented_stages = 10;
+
+    inline const char* get_stage_name(const InstrumentedStage stage);
+
+    struct TimingStats
+    {
+        std::uint64_t count   = 0;
+        double        seconds = 0.0;
+    };
+
+    struct InstrumentationStats
+    {
+        // Indexed by InstrumentedStage. The CPU stages are summed over the threads and counted per row. GPU uploads
+        // and readbacks are timed on the CPU (including any wait for the GPU), and draws on the GPU with
+        // GL_TIME_ELAPSED queries, where the driver supports them.
+        std::array<TimingStats, num_instrumented_stages> stages;
+
+        // The pixels that went through the CPU stages
+        std::uint64_t pixels_processed = 0;
+
+        // The tiles run by each thread of a ThreadPool (processImages and enhance_image_parallel), by thread index
+        std::vector<TimingStats> thread_tiles;
+
+        // Spans left out of the trace because its buffer was full
+        std::uint64_t num_dropped_spans = 0;
+
+        const TimingStats& getStage(const InstrumentedStage stage) const { return stages[static_cast<int>(stage)]; }
+    };
+
+    // A snapshot of what was recorded since the start or the last reset. It can be pulled at any time, also while
+    // images are being processed.
+    inline InstrumentationStats get_instrumentation_stats();
+
+    inline void reset_instrumentation();
+
+    // Writes the recorded spans in the Chrome trace-event format (JSON), which chrome://tracing and Perfetto open.
+    // The path variant returns false (after printing the reason) if the file cannot be written.
+    inline void write_chrome_trace(std::ostream& stream);
+    inline bool write_chrome_trace(const std::string& path);
+
+    namespace internal
+    {
+        // Records its lifetime as a span of the trace and, for a stage, adds it to the stage time. Use StageTimer
+        // instead for parts that run too often (e.g., per row) to be kept in the trace.
+        class TraceSpan
+        {
+        public:
+            explicit TraceSpan(const char* name);
+            TraceSpan(const char* name, const InstrumentedStage stage);
+            ~TraceSpan();
+
+            TraceSpan(const TraceSpan&) = delete;
+            TraceSpan& operator=(const TraceSpan&) = delete;
+
+#if defined(ENHANCER_WITH_INSTRUMENTATION)
+        private:
+            const char*  m_name;
+            int          m_stage;
+            std::int64_t m_begin;
+#endif
+        };
+
+        class StageTimer
+        {
+        public:
+            explicit StageTimer(const InstrumentedStage stage);
+            ~StageTimer();
+
+            StageTimer(const StageTimer&) = delete;
+            StageTimer& operator=(const StageTimer&) = delete;
+
+#if defined(ENHANCER_WITH_INSTRUMENTATION)
+        private:
+            InstrumentedStage m_stage;
+            std::int64_t      m_begin;
+#endif
+        };
+
+        // A "tile" span that is also added to the tile time of a thread of a ThreadPool
+        class TileTimer
+        {
+        public:
+            explicit TileTimer(const int thread_index);
+            ~TileTimer();
+
+            TileTimer(const TileTimer&) = delete;
+            TileTimer& operator=(const TileTimer&) = delete;
+
+#if defined(ENHANCER_WITH_INSTRUMENTATION)
+        private:
+            int          m_thread_index;
+            std::int64_t m_begin;
+#endif
+        };
+
+        inline void countProcessedPixels(const std::uint64_t num_pixels);
+
+        // Adds a stage time measured elsewhere (e.g., by a GPU timer query) that ended at about the current time; it
+        // is shown in the trace on a track of its own
+        inline void addMeasuredStageTime(const InstrumentedStage stage, const std::int64_t nanoseconds);
+    } // namespace internal
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline const char* get_stage_name(const InstrumentedStage stage)
+    {
+        switch (stage)
+        {
+            case InstrumentedStage::Linearize: return "linearize";
+            case InstrumentedStage::TemperatureTint: return "temperature_tint";
+            case InstrumentedStage::LiftGammaGain: return "lift_gamma_gain";
+            case InstrumentedStage::Brightness: return "brightness";
+            case InstrumentedStage::Contrast: return "contrast";
+            case InstrumentedStage::Saturation: return "saturation";
+            case InstrumentedStage::Encode: return "encode";
+            case InstrumentedStage::GpuUpload: return "gpu_upload";
+            case InstrumentedStage::GpuDraw: return "gpu_draw";
+            case InstrumentedStage::GpuReadback: return "gpu_readback";
+        }
+        return "";
+    }
+
+#if defined(ENHANCER_WITH_INSTRUMENTATION)
+    namespace internal
+    {
+        struct TraceEvent
+        {
+            const char*  name;
+            int          thread_id;
+            std::int64_t begin;
+            std::int64_t duration;
+        };
+
+        // The process-wide counters. Counters are lock-free; spans are appended under a lock to a buffer of bounded
+        // size, so a long-running process does not grow without limit.
+        class Instrumentation
+        {
+        public:
+            static constexpr int         max_threads = 256;
+            static constexpr std::size_t max_events  = std::size_t(1) << 20;
+
+            // The pseudo thread on which the GPU times are shown
+            static constexpr int gpu_thread_id = 0;
+
+            static Instrumentation& get()
+            {
+                static Instrumentation instance;
+                return instance;
+            }
+
+            // Nanoseconds since the first use
+            std::int64_t now() const
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+            }
+
+            // A small id per thread for the trace, starting at 1
+            static int getThreadId()
+            {
+                static std::atomic<int> next_id{ 1 };
+                static thread_local int id = next_id++;
+                return id;
+            }
+
+            void addStageTime(const InstrumentedStage stage, const std::int64_t nanoseconds)
+            {
+                Counter& counter = m_stages[static_cast<int>(stage)];
+                counter.count.fetch_add(1, std::memory_order_relaxed);
+                counter.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+            }
+
+            void addTileTime(const int thread_index, const std::int64_t nanoseconds)
+            {
+                Counter& counter = m_thread_tiles[std::min(thread_index, max_threads - 1)];
+                counter.count.fetch_add(1, std::memory_order_relaxed);
+                counter.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+                int num_threads = m_num_tile_threads.load(std::memory_order_relaxed);
+                while (num_threads <= thread_index && !m_num_tile_threads.compare_exchange_weak(num_threads, thread_index + 1)) {}
+            }
+
+            void addPixels(const std::uint64_t num_pixels) { m_pixels.fetch_add(num_pixels, std::memory_order_relaxed); }
+
+            void addSpan(const char* name, const int thread_id, const std::int64_t begin, const std::int64_t duration)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_events.size() < max_events) { m_events.push_back(TraceEvent{ name, thread_id, begin, duration }); }
+                else { ++m_num_dropped_spans; }
+            }
+
+            InstrumentationStats getStats()
+            {
+                InstrumentationStats stats;
+                for (int i = 0; i < num_instrumented_stages; ++i) { stats.stages[i] = m_stages[i].toStats(); }
+
+                stats.pixels_processed = m_pixels.load(std::memory_order_relaxed);
+
+                const int num_tile_threads = std::min(m_num_tile_threads.load(), max_threads);
+                for (int i = 0; i < num_tile_threads; ++i) { stats.thread_tiles.push_back(m_thread_tiles[i].toStats()); }
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                stats.num_dropped_spans = m_num_dropped_spans;
+                return stats;
+            }
+
+            void reset()
+            {
+                for (Counter& counter : m_stages) { counter.reset(); }
+                for (Counter& counter : m_thread_tiles) { counter.reset(); }
+                m_pixels           = 0;
+                m_num_tile_threads = 0;
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_events.clear();
+                m_num_dropped_spans = 0;
+            }
+
+            std::vector<TraceEvent> getEvents()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_events;
+            }
+
+        private:
+            struct Counter
+            {
+                std::atomic<std::uint64_t> count{ 0 };
+                std::atomic<std::uint64_t> nanoseconds{ 0 };
+
+                TimingStats toStats() const
+                {
+                    TimingStats stats;
+                    stats.count   = count.load(std::memory_order_relaxed);
+                    stats.seconds = 1e-9 * static_cast<double>(nanoseconds.load(std::memory_order_relaxed));
+                    return stats;
+                }
+
+                void reset()
+                {
+                    count       = 0;
+                    nanoseconds = 0;
+                }
+            };
+
+            Instrumentation() : m_epoch(std::chrono::steady_clock::now()) {}
+
+            const std::chrono::steady_clock::time_point m_epoch;
+
+            std::array<Counter, num_instrumented_stages> m_stages;
+            std::array<Counter, max_threads>             m_thread_tiles;
+            std::atomic<int>                             m_num_tile_threads{ 0 };
+            std::atomic<std::uint64_t>                   m_pixels{ 0 };
+
+            std::mutex              m_mutex;
+            std::vector<TraceEvent> m_events;
+            std::uint64_t           m_num_dropped_spans = 0;
+        };
+
+        inline TraceSpan::TraceSpan(const char* name) : m_name(name), m_stage(-1), m_begin(Instrumentation::get().now()) {}
+
+        inline TraceSpan::TraceSpan(const char* name, const InstrumentedStage stage) :
+        m_name(name), m_stage(static_cast<int>(stage)), m_begin(Instrumentation::get().now())
+        {
+        }
+
+        inline TraceSpan::~TraceSpan()
+        {
+            Instrumentation&   instrumentation = Instrumentation::get();
+            const std::int64_t duration        = instrumentation.now() - m_begin;
+
+            if (m_stage >= 0) { instrumentation.addStageTime(static_cast<InstrumentedStage>(m_stage), duration); }
+            instrumentation.addSpan(m_name, Instrumentation::getThreadId(), m_begin, duration);
+        }
+
+        inline StageTimer::StageTimer(const InstrumentedStage stage) : m_stage(stage), m_begin(Instrumentation::get().now()) {}
+
+        inline StageTimer::~StageTimer()
+        {
+            Instrumentation& instrumentation = Instrumentation::get();
+            instrumentation.addStageTime(m_stage, instrumentation.now() - m_begin);
+        }
+
+        inline TileTimer::TileTimer(const int thread_index) : m_thread_index(thread_index), m_begin(Instrumentation::get().now()) {}
+
+        inline TileTimer::~TileTimer()
+        {
+            Instrumentation&   instrumentation = Instrumentation::get();
+            const std::int64_t duration        = instrumentation.now() - m_begin;
+
+            instrumentation.addTileTime(m_thread_index, duration);
+            instrumentation.addSpan("tile", Instrumentation::getThreadId(), m_begin, duration);
+        }
+
+        inline void countProcessedPixels(const std::uint64_t num_pixels) { Instrumentation::get().addPixels(num_pixels); }
+
+        inline void addMeasuredStageTime(const InstrumentedStage stage, const std::int64_t nanoseconds)
+        {
+            Instrumentation& instrumentation = Instrumentation::get();
+            instrumentation.addStageTime(stage, nanoseconds);
+            instrumentation.addSpan(get_stage_name(stage), Instrumentation::gpu_thread_id, instrumentation.now() - nanoseconds, nanoseconds);
+        }
+    } // namespace internal
+
+    inline InstrumentationStats get_instrumentation_stats() { return internal::Instrumentation::get().getStats(); }
+
+    inline void reset_instrumentation() { internal::Instrumentation::get().reset(); }
+
+    inline void write_chrome_trace(std::ostream& stream)
+    {
+        const std::vector<internal::TraceEvent> events = internal::Instrumentation::get().getEvents();
+
+        // Complete events ("X") in microseconds with a fixed nanosecond fraction, since the default precision would
+        // round the timestamps of a long-running process; the names are string literals, which need no escaping
+        const std::ios_base::fmtflags flags     = stream.flags();
+        const std::streamsize         precision = stream.precision();
+        stream << std::fixed << std::setprecision(3);
+
+        stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << internal::Instrumentation::gpu_thread_id
+               << ",\"args\":{\"name\":\"GPU\"}}";
+        for (const internal::TraceEvent& event : events)
+        {
+            stream << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"enhancer\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread_id
+                   << ",\"ts\":" << 1e-3 * event.begin << ",\"dur\":" << 1e-3 * event.duration << "}";
+        }
+        stream << "\n]}\n";
+
+        stream.flags(flags);
+        stream.precision(precision);
+    }
+#else
+    namespace internal
+    {
+        inline TraceSpan::TraceSpan(const char*) {}
+        inline TraceSpan::TraceSpan(const char*, const InstrumentedStage) {}
+        inline TraceSpan::~TraceSpan() {}
+
+        inline StageTimer::StageTimer(const InstrumentedStage) {}
+        inline StageTimer::~StageTimer() {}
+
+        inline TileTimer::TileTimer(const int) {}
+        inline TileTimer::~TileTimer() {}
+
+        inline void countProcessedPixels(const std::uint64_t) {}
+        inline void addMeasuredStageTime(const InstrumentedStage, const std::int64_t) {}
+    } // namespace internal
+
+    inline InstrumentationStats get_instrumentation_stats() { return InstrumentationStats(); }
+
+    inline void reset_instrumentation() {}
+
+    inline void write_chrome_trace(std::ostream& stream) { stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[]}\n"; }
+#endif
+
+    inline bool write_chrome_trace(const std::string& path)
+    {
+        std::ofstream stream(path);
+        if (stream) { write_chrome_trace(stream); }
+        if (!stream)
+        {
+            std::cerr << "Error: Failed to write \"" << path << "\"." << std::endl;
+            return false;
+        }
+        return true;
+    }
+} // namespace enhancer
+
+#endif /* enhancer_instrumentation_hpp */
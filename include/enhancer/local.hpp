@@ -0,0 +1,453 @@
+#ifndef enhancer_local_hpp
+#define enhancer_local_hpp
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/enhancer.hpp>
+#include <enhancer/image.hpp>
+#include <enhancer/imageview.hpp>
+#include <enhancer/parallel.hpp>
+#include <enhancer/sweep.hpp>
+#include <enhancer/threadpool.hpp>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // A low-resolution grid of weights over the image plane and the luminance of the source (the guidance), as in a
+    // bilateral grid: a weight set in a few cells follows the edges of the image at full resolution, since pixels on
+    // either side of an edge fall into different luminance layers. The grid is sampled trilinearly with the texel
+    // center convention of OpenGL, so that the shader, which samples it as a 3D texture, gives the same weights.
+    struct GuidanceGrid
+    {
+        int width;
+        int height;
+        int depth;
+
+        // x varies fastest, then y (top-down), then the luminance
+        std::vector<float> weights;
+
+        GuidanceGrid(const int width, const int height, const int depth, const float weight = 0.0f);
+
+        float& at(const int x, const int y, const int z) { return weights[(static_cast<std::size_t>(z) * height + y) * width + x]; }
+        float  at(const int x, const int y, const int z) const { return weights[(static_cast<std::size_t>(z) * height + y) * width + x]; }
+
+        // `u` and `v` are the normalized position (see LocalAdjustment) and `luminance` is in [0, 1]
+        double sample(const double u, const double v, const double luminance) const;
+    };
+
+    // A parameter vector applied with a weight that varies over the image. Each pixel is enhanced once with the base
+    // parameters moved towards the parameters of each adjustment by its weight times `opacity`, so K adjustments cost
+    // a single pass instead of K passes and a composite. Positions and radii are normalized: (0, 0) is the top-left
+    // corner of the image and (1, 1) the bottom-right one.
+    struct LocalAdjustment
+    {
+        enum class Shape
+        {
+            Mask,
+            LinearGradient,
+            RadialGradient,
+            Grid
+        };
+
+        Shape           shape = Shape::Mask;
+        Eigen::VectorXd parameters;
+        double          opacity = 1.0;
+
+        // Shape::Mask: an 8-bit channel (255 for the full weight) of a buffer of the same size as the source, e.g.,
+        // the alpha of a painted RGBA layer or a grayscale (mask_channels = 1) matte; the buffer is not owned
+        const std::uint8_t* mask_data     = nullptr;
+        std::ptrdiff_t      mask_stride   = 0;
+        int                 mask_channels = 1;
+        int                 mask_channel  = 0;
+
+        // Shape::LinearGradient: the full weight up to `start`, falling linearly to none at `end`
+        Eigen::Vector2d start = Eigen::Vector2d::Zero();
+        Eigen::Vector2d end   = Eigen::Vector2d::Zero();
+
+        // Shape::RadialGradient: the full weight within the ellipse of radii (1 - feather) * `radii` around
+        // `center`, falling smoothly to none at the ellipse of `radii`
+        Eigen::Vector2d center  = Eigen::Vector2d::Zero();
+        Eigen::Vector2d radii   = Eigen::Vector2d::Zero();
+        double          feather = 0.0;
+
+        // Shape::Grid
+        std::shared_ptr<const GuidanceGrid> grid;
+    };
+
+    inline LocalAdjustment make_mask_adjustment(const Eigen::VectorXd& parameters,
+                                                const std::uint8_t*    mask_data,
+                                                const std::ptrdiff_t   mask_stride,
+                                                const int              mask_channels = 1,
+                                                const int              mask_channel  = 0);
+
+    inline LocalAdjustment make_linear_gradient_adjustment(const Eigen::VectorXd& parameters, const Eigen::Vector2d& start, const Eigen::Vector2d& end);
+
+    inline LocalAdjustment make_radial_gradient_adjustment(const Eigen::VectorXd& parameters,
+                                                           const Eigen::Vector2d& center,
+                                                           const Eigen::Vector2d& radii,
+                                                           const double           feather = 0.5);
+
+    inline LocalAdjustment make_grid_adjustment(const Eigen::VectorXd& parameters, std::shared_ptr<const GuidanceGrid> grid);
+
+    // Enhances `src` into `dst` (with the conventions of the view-based enhance_image) with `parameters` as the base
+    // parameters and `adjustments` blended on top of them in order. Pixels where all the weights are zero are
+    // identical to the output of enhance_image.
+    template <typename T>
+    void enhance_image_local(const typename ImageView<T>::ConstView& src,
+                             const ImageView<T>&                     dst,
+                             const Eigen::VectorXd&                  parameters,
+                             const std::vector<LocalAdjustment>&     adjustments,
+                             const Accuracy                          accuracy = Accuracy::Exact,
+                             const ValueRange                        range    = ValueRange::Display);
+
+    template <typename T>
+    void enhance_image_local_parallel(ThreadPool&                             pool,
+                                      const typename ImageView<T>::ConstView& src,
+                                      const ImageView<T>&                     dst,
+                                      const Eigen::VectorXd&                  parameters,
+                                      const std::vector<LocalAdjustment>&     adjustments,
+                                      const Accuracy                          accuracy  = Accuracy::Exact,
+                                      const ValueRange                        range     = ValueRange::Display,
+                                      const TileSize&                         tile_size = TileSize());
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline GuidanceGrid::GuidanceGrid(const int width, const int height, const int depth, const float weight) :
+    width(width), height(height), depth(depth), weights(static_cast<std::size_t>(width) * height * depth, weight)
+    {
+        assert(width > 0 && height > 0 && depth > 0);
+    }
+
+    inline double GuidanceGrid::sample(const double u, const double v, const double luminance) const
+    {
+        // The cell centers are at (i + 0.5) / size, and the coordinates are clamped to the outermost centers
+        const auto locate = [](const double coordinate, const int size, int& i0, int& i1, double& t)
+        {
+            const double position = std::max(0.0, std::min(coordinate * size - 0.5, static_cast<double>(size - 1)));
+
+            i0 = static_cast<int>(position);
+            i1 = std::min(i0 + 1, size - 1);
+            t  = position - i0;
+        };
+
+        int    x0, x1, y0, y1, z0, z1;
+        double tx, ty, tz;
+        locate(u, width, x0, x1, tx);
+        locate(v, height, y0, y1, ty);
+        locate(luminance, depth, z0, z1, tz);
+
+        const auto lerp = [](const double a, const double b, const double t) { return a + (b - a) * t; };
+
+        const double c00 = lerp(at(x0, y0, z0), at(x1, y0, z0), tx);
+        const double c10 = lerp(at(x0, y1, z0), at(x1, y1, z0), tx);
+        const double c01 = lerp(at(x0, y0, z1), at(x1, y0, z1), tx);
+        const double c11 = lerp(at(x0, y1, z1), at(x1, y1, z1), tx);
+
+        return lerp(lerp(c00, c10, ty), lerp(c01, c11, ty), tz);
+    }
+
+    inline LocalAdjustment make_mask_adjustment(const Eigen::VectorXd& parameters,
+                                                const std::uint8_t*    mask_data,
+                                                const std::ptrdiff_t   mask_stride,
+                                                const int              mask_channels,
+                                                const int              mask_channel)
+    {
+        assert(mask_data != nullptr && mask_channel >= 0 && mask_channel < mask_channels);
+
+        LocalAdjustment adjustment;
+        adjustment.shape         = LocalAdjustment::Shape::Mask;
+        adjustment.parameters    = parameters;
+        adjustment.mask_data     = mask_data;
+        adjustment.mask_stride   = mask_stride;
+        adjustment.mask_channels = mask_channels;
+        adjustment.mask_channel  = mask_channel;
+        return adjustment;
+    }
+
+    inline LocalAdjustment make_linear_gradient_adjustment(const Eigen::VectorXd& parameters, const Eigen::Vector2d& start, const Eigen::Vector2d& end)
+    {
+        assert((end - start).squaredNorm() > 0.0);
+
+        LocalAdjustment adjustment;
+        adjustment.shape      = LocalAdjustment::Shape::LinearGradient;
+        adjustment.parameters = parameters;
+        adjustment.start      = start;
+        adjustment.end        = end;
+        return adjustment;
+    }
+
+    inline LocalAdjustment make_radial_gradient_adjustment(const Eigen::VectorXd& parameters,
+                                                           const Eigen::Vector2d& center,
+                                                           const Eigen::Vector2d& radii,
+                                                           const double           feather)
+    {
+        assert(radii.minCoeff() > 0.0 && feather >= 0.0 && feather <= 1.0);
+
+        LocalAdjustment adjustment;
+        adjustment.shape      = LocalAdjustment::Shape::RadialGradient;
+        adjustment.parameters = parameters;
+        adjustment.center     = center;
+        adjustment.radii      = radii;
+        adjustment.feather    = feather;
+        return adjustment;
+    }
+
+    inline LocalAdjustment make_grid_adjustment(const Eigen::VectorXd& parameters, std::shared_ptr<const GuidanceGrid> grid)
+    {
+        assert(grid != nullptr);
+
+        LocalAdjustment adjustment;
+        adjustment.shape      = LocalAdjustment::Shape::Grid;
+        adjustment.parameters = parameters;
+        adjustment.grid       = std::move(grid);
+        return adjustment;
+    }
+
+    namespace internal
+    {
+        // 1 up to `inner`, 0 from `outer`, and a smoothstep in between; the same function is in enhancer.fs
+        inline double computeFalloff(const double inner, const double outer, const double distance)
+        {
+            if (distance <= inner) { return 1.0; }
+            if (distance >= outer) { return 0.0; }
+
+            const double t = (distance - inner) / (outer - inner);
+            return 1.0 - t * t * (3.0 - 2.0 * t);
+        }
+
+        // The weight of `adjustment` (before its opacity) at the pixel (x, y) of a width x height image, whose source
+        // has the (gamma-encoded) luminance `luminance`
+        inline double computeLocalWeight(const LocalAdjustment& adjustment,
+                                         const int              x,
+                                         const int              y,
+                                         const int              width,
+                                         const int              height,
+                                         const double           luminance)
+        {
+            const Eigen::Vector2d position((x + 0.5) / width, (y + 0.5) / height);
+
+            switch (adjustment.shape)
+            {
+                case LocalAdjustment::Shape::Mask:
+                {
+                    const std::uint8_t* row = adjustment.mask_data + adjustment.mask_stride * y;
+                    return row[x * adjustment.mask_channels + adjustment.mask_channel] * (1.0 / 255.0);
+                }
+                case LocalAdjustment::Shape::LinearGradient:
+                {
+                    const Eigen::Vector2d direction = adjustment.end - adjustment.start;
+                    const double          t         = (position - adjustment.start).dot(direction) / direction.squaredNorm();
+                    return 1.0 - std::max(0.0, std::min(t, 1.0));
+                }
+                case LocalAdjustment::Shape::RadialGradient:
+                {
+                    const double distance = (position - adjustment.center).cwiseQuotient(adjustment.radii).norm();
+                    return computeFalloff(1.0 - adjustment.feather, 1.0, distance);
+                }
+                case LocalAdjustment::Shape::Grid:
+                {
+                    return adjustment.grid->sample(position(0), position(1), luminance);
+                }
+            }
+            return 0.0;
+        }
+
+        // The state shared by the tiles: the base parameters, decoded once, and the offsets of the adjustments
+        template <typename T> struct LocalEnhancement
+        {
+            const ImageView<const T>&           src;
+            const ImageView<T>&                 dst;
+            const std::vector<LocalAdjustment>& adjustments;
+            ParameterVector                     base;
+            DecodedParameters                   base_decoded;
+            std::vector<ParameterVector>        offsets;
+            SweepLinearizer<T>                  linearizer;
+            Accuracy                            accuracy;
+            ValueRange                          range;
+            bool                                needs_luminance;
+
+            LocalEnhancement(const ImageView<const T>&           src,
+                             const ImageView<T>&                 dst,
+                             const Eigen::VectorXd&              parameters,
+                             const std::vector<LocalAdjustment>& adjustments,
+                             const Accuracy                      accuracy,
+                             const ValueRange                    range) :
+            src(src),
+            dst(dst),
+            adjustments(adjustments),
+            base(parameters),
+            base_decoded(decodeParameters(parameters)),
+            linearizer(accuracy),
+            accuracy(accuracy),
+            range(std::is_integral<T>::value ? ValueRange::Display : range),
+            needs_luminance(false)
+            {
+                assert(src.width == dst.width && src.height == dst.height);
+
+                for (const LocalAdjustment& adjustment : adjustments)
+                {
+                    assert(adjustment.parameters.size() == NUM_PARAMETERS);
+
+                    offsets.push_back(adjustment.opacity * (ParameterVector(adjustment.parameters) - base));
+                    needs_luminance = needs_luminance || adjustment.shape == LocalAdjustment::Shape::Grid;
+                }
+            }
+
+            // `linear_row` and `weights` are the row buffers of the calling task
+            void processTile(const Tile& tile, std::vector<Eigen::Vector3d>& linear_row, std::vector<double>& weights) const
+            {
+                typedef ChannelTraits<T> Traits;
+
+                const int            src_channels = src.getNumChannels();
+                const int            dst_channels = dst.getNumChannels();
+                const ChannelIndices src_indices  = getChannelIndices(src.order);
+                const ChannelIndices dst_indices  = getChannelIndices(dst.order);
+                const int            num_adjustments = static_cast<int>(adjustments.size());
+
+                linear_row.resize(tile.width);
+                weights.resize(static_cast<std::size_t>(tile.width) * num_adjustments);
+
+                for (int y = tile.y; y < tile.y + tile.height; ++y)
+                {
+                    const T* src_row = src.getRow(y) + tile.x * src_channels;
+                    T*       dst_row = dst.getRow(y) + tile.x * dst_channels;
+
+                    linearizer.linearizeRow(src_row, tile.width, src_channels, src_indices, linear_row.data());
+
+                    for (int i = 0; i < tile.width; ++i)
+                    {
+                        const T*     src_pixel = src_row + i * src_channels;
+                        const double luminance = needs_luminance ? 0.2126 * Traits::toDouble(src_pixel[src_indices.r]) +
+                                                                       0.7152 * Traits::toDouble(src_pixel[src_indices.g]) +
+                                                                       0.0722 * Traits::toDouble(src_pixel[src_indices.b])
+                                                                 : 0.0;
+
+                        for (int k = 0; k < num_adjustments; ++k)
+                        {
+                            weights[i * num_adjustments + k] = computeLocalWeight(adjustments[k], tile.x + i, y, src.width, src.height, luminance);
+                        }
+                    }
+
+                    switch (accuracy)
+                    {
+                        case Accuracy::Fast: enhanceRow<Accuracy::Fast>(linear_row, weights, src_row, src_channels, dst_row, dst_channels, dst_indices, tile.width); break;
+                        case Accuracy::Fastest: enhanceRow<Accuracy::Fastest>(linear_row, weights, src_row, src_channels, dst_row, dst_channels, dst_indices, tile.width); break;
+                        default: enhanceRow<Accuracy::Exact>(linear_row, weights, src_row, src_channels, dst_row, dst_channels, dst_indices, tile.width); break;
+                    }
+                }
+            }
+
+            template <Accuracy A>
+            void enhanceRow(const std::vector<Eigen::Vector3d>& linear_row,
+                            const std::vector<double>&          weights,
+                            const T*                            src_row,
+                            const int                           src_channels,
+                            T*                                  dst_row,
+                            const int                           dst_channels,
+                            const ChannelIndices&               dst_indices,
+                            const int                           width) const
+            {
+                if (range == ValueRange::SceneReferred)
+                {
+                    enhanceRow<A, ValueRange::SceneReferred>(linear_row, weights, src_row, src_channels, dst_row, dst_channels, dst_indices, width);
+                }
+                else
+                {
+                    enhanceRow<A, ValueRange::Display>(linear_row, weights, src_row, src_channels, dst_row, dst_channels, dst_indices, width);
+                }
+            }
+
+            template <Accuracy A, ValueRange R>
+            void enhanceRow(const std::vector<Eigen::Vector3d>& linear_row,
+                            const std::vector<double>&          weights,
+                            const T*                            src_row,
+                            const int                           src_channels,
+                            T*                                  dst_row,
+                            const int                           dst_channels,
+                            const ChannelIndices&               dst_indices,
+                            const int                           width) const
+            {
+                typedef ChannelTraits<T> Traits;
+
+                const int num_adjustments = static_cast<int>(adjustments.size());
+
+                for (int x = 0; x < width; ++x, src_row += src_channels, dst_row += dst_channels)
+                {
+                    const double* pixel_weights = weights.data() + x * num_adjustments;
+
+                    ParameterVector pixel_parameters = base;
+                    bool            is_adjusted      = false;
+                    for (int k = 0; k < num_adjustments; ++k)
+                    {
+                        if (pixel_weights[k] == 0.0) { continue; }
+
+                        pixel_parameters += pixel_weights[k] * offsets[k];
+                        is_adjusted = true;
+                    }
+
+                    // The parameters are decoded per pixel only where an adjustment applies
+                    const Eigen::Vector3d rgb = is_adjusted ? enhanceLinearRgb<A, R>(linear_row[x], decodeParameters(pixel_parameters))
+                                                            : enhanceLinearRgb<A, R>(linear_row[x], base_decoded);
+
+                    if (dst_channels == 4) { dst_row[3] = src_channels == 4 ? src_row[3] : Traits::fromDouble(1.0); }
+                    dst_row[dst_indices.r] = Traits::fromDouble(rgb(0));
+                    dst_row[dst_indices.g] = Traits::fromDouble(rgb(1));
+                    dst_row[dst_indices.b] = Traits::fromDouble(rgb(2));
+                }
+            }
+        };
+    } // namespace internal
+
+    template <typename T>
+    void enhance_image_local(const typename ImageView<T>::ConstView& src,
+                             const ImageView<T>&                     dst,
+                             const Eigen::VectorXd&                  parameters,
+                             const std::vector<LocalAdjustment>&     adjustments,
+                             const Accuracy                          accuracy,
+                             const ValueRange                        range)
+    {
+        const internal::LocalEnhancement<T> enhancement(src, dst, parameters, adjustments, accuracy, range);
+
+        std::vector<Eigen::Vector3d> linear_row;
+        std::vector<double>          weights;
+        enhancement.processTile(internal::Tile{ 0, 0, 0, src.width, src.height }, linear_row, weights);
+    }
+
+    template <typename T>
+    void enhance_image_local_parallel(ThreadPool&                             pool,
+                                      const typename ImageView<T>::ConstView& src,
+                                      const ImageView<T>&                     dst,
+                                      const Eigen::VectorXd&                  parameters,
+                                      const std::vector<LocalAdjustment>&     adjustments,
+                                      const Accuracy                          accuracy,
+                                      const ValueRange                        range,
+                                      const TileSize&                         tile_size)
+    {
+        assert(tile_size.width > 0 && tile_size.height > 0);
+
+        const internal::LocalEnhancement<T> enhancement(src, dst, parameters, adjustments, accuracy, range);
+
+        const internal::TileGrid grid(src.width, src.height, tile_size);
+
+        pool.parallelFor(grid.getNumTiles(), [&](const int i)
+        {
+            // Kept by each worker across tiles and calls, so that the steady state does not allocate
+            static thread_local std::vector<Eigen::Vector3d> linear_row;
+            static thread_local std::vector<double>          weights;
+            enhancement.processTile(grid.getTile(i), linear_row, weights);
+        });
+    }
+} // namespace enhancer
+
+#endif /* enhancer_local_hpp */
@@ -0,0 +1,533 @@
+#ifndef enhancer_lut_hpp
+#define enhancer_lut_hpp
+
+#include <cassert>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/image.hpp>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    struct LutError
+    {
+        double max_error;  // Maximum absolute difference over all the samples and channels
+        double mean_error; // Mean absolute difference over all the samples and channels
+    };
+
+    // A size^3 lattice sampled from enhance() with a fixed parameter vector. As enhance() is a pure function of the
+    // input color once the parameters are fixed, applying the lattice with tetrahedral interpolation replaces the
+    // whole transcendental pipeline with a few multiply-adds per pixel. The lattice is stored with the red index
+    // running fastest, which is also the order used by the .cube format.
+    class Lut3D
+    {
+    public:
+        enum class Interpolation
+        {
+            Trilinear,
+            Tetrahedral,
+        };
+
+        Lut3D(const Eigen::VectorXd& parameters, const int size = 33);
+
+        // A lattice of given values (3 * size^3, in the order above), e.g., read from a .cube file. It has no
+        // parameters, so computeError is not available.
+        Lut3D(const int size, std::vector<float> data);
+
+        // A lattice whose values stay in memory owned by `owner` (e.g., a mapped preset file, see
+        // enhancer/preset.hpp), which is kept alive by the lattice and its copies; nothing is copied
+        Lut3D(const Eigen::VectorXd& parameters, const int size, const float* data, std::shared_ptr<const void> owner);
+
+        int                    getSize() const { return m_size; }
+        const Eigen::VectorXd& getParameters() const { return m_parameters; }
+
+        // 3 * size^3 values; the values are immutable and shared by the copies of the lattice
+        const float* getData() const { return m_data.get(); }
+
+        Eigen::Vector3d apply(const Eigen::Vector3d& input_rgb, const Interpolation interpolation = Interpolation::Tetrahedral) const;
+
+        // Same buffer conventions as enhance_image
+        void apply(const std::uint8_t*  src,
+                   std::uint8_t*        dst,
+                   const int            width,
+                   const int            height,
+                   const std::ptrdiff_t stride,
+                   const int            channels,
+                   const Interpolation  interpolation = Interpolation::Tetrahedral) const;
+
+        void apply(const float*         src,
+                   float*               dst,
+                   const int            width,
+                   const int            height,
+                   const std::ptrdiff_t stride,
+                   const int            channels,
+                   const Interpolation  interpolation = Interpolation::Tetrahedral) const;
+
+        // Compares the interpolated values with the exact path at samples_per_axis^3 colors placed at the centers
+        // of a regular grid (i.e., mostly between lattice points, where the interpolation error is largest)
+        LutError computeError(const int samples_per_axis = 64, const Interpolation interpolation = Interpolation::Tetrahedral) const;
+
+    private:
+        int                          m_size;
+        Eigen::VectorXd              m_parameters;
+        std::shared_ptr<const float> m_data;
+
+        const float* getEntry(const int r, const int g, const int b) const
+        {
+            return m_data.get() + 3 * ((b * m_size + g) * m_size + r);
+        }
+
+        // `index` is the lower lattice index and `fraction` the position within the cell, for each channel
+        void interpolate(const int index[3], const float fraction[3], const Interpolation interpolation, float output[3]) const;
+    };
+
+    // A table holding the enhanced color of every 8-bit RGB triplet (256^3 entries, 48 MiB). Building it evaluates
+    // the exact path 16.7M times, but applying it is a single memory access per pixel with no interpolation error,
+    // so the output is identical to enhance_image for 8-bit images.
+    class ExactLut8
+    {
+    public:
+        ExactLut8(const Eigen::VectorXd& parameters);
+
+        const Eigen::VectorXd& getParameters() const { return m_parameters; }
+
+        void apply(const std::uint8_t*  src,
+                   std::uint8_t*        dst,
+                   const int            width,
+                   const int            height,
+                   const std::ptrdiff_t stride,
+                   const int            channels) const;
+
+    private:
+        Eigen::VectorXd           m_parameters;
+        std::vector<std::uint8_t> m_data;
+    };
+
+    // Writes `lut` as an Adobe/Resolve .cube file (LUT_3D_SIZE with the default [0, 1] domain), which grading tools
+    // such as DaVinci Resolve, Premiere, OCIO, and ffmpeg's lut3d filter read. Returns false on I/O errors.
+    inline bool write_cube_file(const std::string& path, const Lut3D& lut, const std::string& title = std::string());
+
+    // Reads a 3D .cube file; 1D LUTs and domains other than [0, 1] are not supported. Returns nullptr (after printing
+    // the reason) on failure.
+    inline std::unique_ptr<Lut3D> read_cube_file(const std::string& path);
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline Lut3D::Lut3D(const Eigen::VectorXd& parameters, const int size) : m_size(size), m_parameters(parameters)
+    {
+        assert(size >= 2);
+
+        const auto data = std::make_shared<std::vector<float>>(3 * static_cast<std::size_t>(size) * size * size);
+        m_data          = std::shared_ptr<const float>(data, data->data());
+
+        const internal::DecodedParameters decoded = internal::decodeParameters(parameters);
+        const double                      scale   = 1.0 / static_cast<double>(size - 1);
+
+        float* entry = data->data();
+        for (int b = 0; b < size; ++b)
+        {
+            for (int g = 0; g < size; ++g)
+            {
+                for (int r = 0; r < size; ++r)
+                {
+                    const Eigen::Vector3d rgb = internal::enhance(Eigen::Vector3d(r * scale, g * scale, b * scale), decoded);
+
+                    *(entry++) = static_cast<float>(rgb(0));
+                    *(entry++) = static_cast<float>(rgb(1));
+                    *(entry++) = static_cast<float>(rgb(2));
+                }
+            }
+        }
+    }
+
+    inline Lut3D::Lut3D(const int size, std::vector<float> data) : m_size(size)
+    {
+        assert(size >= 2 && data.size() == 3 * static_cast<std::size_t>(size) * size * size);
+
+        const auto shared_data = std::make_shared<std::vector<float>>(std::move(data));
+        m_data                 = std::shared_ptr<const float>(shared_data, shared_data->data());
+    }
+
+    inline Lut3D::Lut3D(const Eigen::VectorXd& parameters, const int size, const float* data, std::shared_ptr<const void> owner) :
+    m_size(size), m_parameters(parameters), m_data(std::move(owner), data)
+    {
+        assert(size >= 2 && data != nullptr);
+    }
+
+    inline void Lut3D::interpolate(const int index[3], const float fraction[3], const Interpolation interpolation, float output[3]) const
+    {
+        const int r0 = index[0], r1 = std::min(index[0] + 1, m_size - 1);
+        const int g0 = index[1], g1 = std::min(index[1] + 1, m_size - 1);
+        const int b0 = index[2], b1 = std::min(index[2] + 1, m_size - 1);
+
+        const float fr = fraction[0];
+        const float fg = fraction[1];
+        const float fb = fraction[2];
+
+        const float* c000 = getEntry(r0, g0, b0);
+        const float* c111 = getEntry(r1, g1, b1);
+
+        if (interpolation == Interpolation::Trilinear)
+        {
+            const float* c100 = getEntry(r1, g0, b0);
+            const float* c010 = getEntry(r0, g1, b0);
+            const float* c110 = getEntry(r1, g1, b0);
+            const float* c001 = getEntry(r0, g0, b1);
+            const float* c101 = getEntry(r1, g0, b1);
+            const float* c011 = getEntry(r0, g1, b1);
+
+            for (int c = 0; c < 3; ++c)
+            {
+                const float c00 = c000[c] + (c100[c] - c000[c]) * fr;
+                const float c10 = c010[c] + (c110[c] - c010[c]) * fr;
+                const float c01 = c001[c] + (c101[c] - c001[c]) * fr;
+                const float c11 = c011[c] + (c111[c] - c011[c]) * fr;
+                const float c0  = c00 + (c10 - c00) * fg;
+                const float c1  = c01 + (c11 - c01) * fg;
+
+                output[c] = c0 + (c1 - c0) * fb;
+            }
+            return;
+        }
+
+        // Tetrahedral: the cube is split into six tetrahedra sharing the main diagonal, and the one containing the
+        // point is selected by the order of the fractions
+        const float* c_first;
+        const float* c_second;
+        float        w_first, w_second, w_third, w_last;
+        if (fr > fg)
+        {
+            if (fg > fb)      { c_first = getEntry(r1, g0, b0); c_second = getEntry(r1, g1, b0); w_first = 1.0f - fr; w_second = fr - fg; w_third = fg - fb; w_last = fb; }
+            else if (fr > fb) { c_first = getEntry(r1, g0, b0); c_second = getEntry(r1, g0, b1); w_first = 1.0f - fr; w_second = fr - fb; w_third = fb - fg; w_last = fg; }
+            else              { c_first = getEntry(r0, g0, b1); c_second = getEntry(r1, g0, b1); w_first = 1.0f - fb; w_second = fb - fr; w_third = fr - fg; w_last = fg; }
+        }
+        else
+        {
+            if (fb > fg)      { c_first = getEntry(r0, g0, b1); c_second = getEntry(r0, g1, b1); w_first = 1.0f - fb; w_second = fb - fg; w_third = fg - fr; w_last = fr; }
+            else if (fb > fr) { c_first = getEntry(r0, g1, b0); c_second = getEntry(r0, g1, b1); w_first = 1.0f - fg; w_second = fg - fb; w_third = fb - fr; w_last = fr; }
+            else              { c_first = getEntry(r0, g1, b0); c_second = getEntry(r1, g1, b0); w_first = 1.0f - fg; w_second = fg - fr; w_third = fr - fb; w_last = fb; }
+        }
+
+        for (int c = 0; c < 3; ++c)
+        {
+            output[c] = w_first * c000[c] + w_second * c_first[c] + w_third * c_second[c] + w_last * c111[c];
+        }
+    }
+
+    inline Eigen::Vector3d Lut3D::apply(const Eigen::Vector3d& input_rgb, const Interpolation interpolation) const
+    {
+        int   index[3];
+        float fraction[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            const double position = internal::clamp(input_rgb(c)) * (m_size - 1);
+
+            index[c]    = std::min(static_cast<int>(position), m_size - 2);
+            fraction[c] = static_cast<float>(position - index[c]);
+        }
+
+        float output[3];
+        interpolate(index, fraction, interpolation, output);
+
+        return Eigen::Vector3d(output[0], output[1], output[2]);
+    }
+
+    inline void Lut3D::apply(const std::uint8_t*  src,
+                             std::uint8_t*        dst,
+                             const int            width,
+                             const int            height,
+                             const std::ptrdiff_t stride,
+                             const int            channels,
+                             const Interpolation  interpolation) const
+    {
+        assert(channels == 3 || channels == 4);
+
+        // The lattice position of each of the 256 possible channel values is computed once per call
+        int   index_table[256];
+        float fraction_table[256];
+        for (int i = 0; i < 256; ++i)
+        {
+            const double position = static_cast<double>(i) * (m_size - 1) / 255.0;
+
+            index_table[i]    = std::min(static_cast<int>(position), m_size - 2);
+            fraction_table[i] = static_cast<float>(position - index_table[i]);
+        }
+
+        for (int y = 0; y < height; ++y)
+        {
+            const std::uint8_t* src_row = internal::getRow(src, stride, y);
+            std::uint8_t*       dst_row = internal::getRow(dst, stride, y);
+
+            for (int x = 0; x < width; ++x)
+            {
+                const std::uint8_t* src_pixel = src_row + x * channels;
+                std::uint8_t*       dst_pixel = dst_row + x * channels;
+
+                const int   index[3]    = { index_table[src_pixel[0]], index_table[src_pixel[1]], index_table[src_pixel[2]] };
+                const float fraction[3] = { fraction_table[src_pixel[0]], fraction_table[src_pixel[1]], fraction_table[src_pixel[2]] };
+
+                float output[3];
+                interpolate(index, fraction, interpolation, output);
+
+                if (channels == 4) { dst_pixel[3] = src_pixel[3]; }
+                dst_pixel[0] = internal::quantize8(output[0]);
+                dst_pixel[1] = internal::quantize8(output[1]);
+                dst_pixel[2] = internal::quantize8(output[2]);
+            }
+        }
+    }
+
+    inline void Lut3D::apply(const float*         src,
+                             float*               dst,
+                             const int            width,
+                             const int            height,
+                             const std::ptrdiff_t stride,
+                             const int            channels,
+                             const Interpolation  interpolation) const
+    {
+        assert(channels == 3 || channels == 4);
+
+        const float scale = static_cast<float>(m_size - 1);
+
+        for (int y = 0; y < height; ++y)
+        {
+            const float* src_row = internal::getRow(src, stride, y);
+            float*       dst_row = internal::getRow(dst, stride, y);
+
+            for (int x = 0; x < width; ++x)
+            {
+                const float* src_pixel = src_row + x * channels;
+                float*       dst_pixel = dst_row + x * channels;
+
+                int   index[3];
+                float fraction[3];
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float position = std::max(0.0f, std::min(src_pixel[c], 1.0f)) * scale;
+
+                    index[c]    = std::min(static_cast<int>(position), m_size - 2);
+                    fraction[c] = position - static_cast<float>(index[c]);
+                }
+
+                float output[3];
+                interpolate(index, fraction, interpolation, output);
+
+                if (channels == 4) { dst_pixel[3] = src_pixel[3]; }
+                dst_pixel[0] = output[0];
+                dst_pixel[1] = output[1];
+                dst_pixel[2] = output[2];
+            }
+        }
+    }
+
+    inline LutError Lut3D::computeError(const int samples_per_axis, const Interpolation interpolation) const
+    {
+        assert(m_parameters.size() == NUM_PARAMETERS);
+
+        const internal::DecodedParameters decoded = internal::decodeParameters(m_parameters);
+
+        double max_error = 0.0;
+        double sum_error = 0.0;
+        for (int b = 0; b < samples_per_axis; ++b)
+        {
+            for (int g = 0; g < samples_per_axis; ++g)
+            {
+                for (int r = 0; r < samples_per_axis; ++r)
+                {
+                    const Eigen::Vector3d input_rgb = (Eigen::Vector3d(r, g, b) + Eigen::Vector3d::Constant(0.5)) / samples_per_axis;
+                    const Eigen::Vector3d error     = (apply(input_rgb, interpolation) - internal::enhance(input_rgb, decoded)).cwiseAbs();
+
+                    max_error = std::max(max_error, error.maxCoeff());
+                    sum_error += error.sum();
+                }
+            }
+        }
+
+        const double num_values = 3.0 * samples_per_axis * samples_per_axis * samples_per_axis;
+
+        return LutError{ max_error, sum_error / num_values };
+    }
+
+    inline ExactLut8::ExactLut8(const Eigen::VectorXd& parameters) :
+    m_parameters(parameters),
+    m_data(3 * 256 * 256 * 256)
+    {
+        // The table is first filled with the identity (i.e., the input colors ordered by (r << 16) | (g << 8) | b)
+        // and then enhanced in place as a 256 x 65536 RGB image
+        std::uint8_t* entry = m_data.data();
+        for (int r = 0; r < 256; ++r)
+        {
+            for (int g = 0; g < 256; ++g)
+            {
+                for (int b = 0; b < 256; ++b)
+                {
+                    *(entry++) = static_cast<std::uint8_t>(r);
+                    *(entry++) = static_cast<std::uint8_t>(g);
+                    *(entry++) = static_cast<std::uint8_t>(b);
+                }
+            }
+        }
+
+        enhance_image(m_data.data(), m_data.data(), 256, 256 * 256, 3 * 256, 3, parameters);
+    }
+
+    inline void ExactLut8::apply(const std::uint8_t*  src,
+                                 std::uint8_t*        dst,
+                                 const int            width,
+                                 const int            height,
+                                 const std::ptrdiff_t stride,
+                                 const int            channels) const
+    {
+        assert(channels == 3 || channels == 4);
+
+        for (int y = 0; y < height; ++y)
+        {
+            const std::uint8_t* src_row = internal::getRow(src, stride, y);
+            std::uint8_t*       dst_row = internal::getRow(dst, stride, y);
+
+            for (int x = 0; x < width; ++x)
+            {
+                const std::uint8_t* src_pixel = src_row + x * channels;
+                std::uint8_t*       dst_pixel = dst_row + x * channels;
+                const std::uint8_t* entry     = m_data.data() + 3 * ((src_pixel[0] << 16) | (src_pixel[1] << 8) | src_pixel[2]);
+
+                if (channels == 4) { dst_pixel[3] = src_pixel[3]; }
+                dst_pixel[0] = entry[0];
+                dst_pixel[1] = entry[1];
+                dst_pixel[2] = entry[2];
+            }
+        }
+    }
+
+    inline bool write_cube_file(const std::string& path, const Lut3D& lut, const std::string& title)
+    {
+        std::ofstream stream(path, std::ios::trunc);
+        if (!stream)
+        {
+            std::cerr << "Error: Failed to open \"" << path << "\" for writing." << std::endl;
+            return false;
+        }
+
+        // Decimal points regardless of the global locale, and nine significant digits to round-trip the floats
+        stream.imbue(std::locale::classic());
+        stream << std::setprecision(9);
+
+        if (!title.empty()) { stream << "TITLE \"" << title << "\"\n"; }
+        stream << "LUT_3D_SIZE " << lut.getSize() << "\n";
+        stream << "DOMAIN_MIN 0.0 0.0 0.0\n";
+        stream << "DOMAIN_MAX 1.0 1.0 1.0\n";
+
+        const std::size_t num_entries = static_cast<std::size_t>(lut.getSize()) * lut.getSize() * lut.getSize();
+        const float*      value       = lut.getData();
+        for (std::size_t i = 0; i < num_entries; ++i, value += 3) { stream << value[0] << ' ' << value[1] << ' ' << value[2] << '\n'; }
+
+        stream.flush();
+        if (!stream)
+        {
+            std::cerr << "Error: Failed to write \"" << path << "\"." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    inline std::unique_ptr<Lut3D> read_cube_file(const std::string& path)
+    {
+        std::ifstream stream(path);
+        if (!stream)
+        {
+            std::cerr << "Error: Failed to open \"" << path << "\"." << std::endl;
+            return nullptr;
+        }
+
+        const auto report = [&](const int line_number, const std::string& message) -> std::unique_ptr<Lut3D>
+        {
+            std::cerr << "Error: " << path << ":" << line_number << ": " << message << std::endl;
+            return nullptr;
+        };
+
+        int                size       = 0;
+        std::size_t        num_values = 0;
+        std::vector<float> data;
+        std::string        line;
+        for (int line_number = 1; std::getline(stream, line); ++line_number)
+        {
+            const std::size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') { continue; }
+
+            std::istringstream fields(line.substr(first));
+            fields.imbue(std::locale::classic());
+
+            if (std::isalpha(static_cast<unsigned char>(line[first])))
+            {
+                std::string keyword;
+                fields >> keyword;
+
+                if (keyword == "TITLE") { continue; }
+                if (keyword == "LUT_1D_SIZE") { return report(line_number, "1D LUTs are not supported."); }
+                if (keyword == "LUT_3D_SIZE")
+                {
+                    fields >> size;
+                    if (!fields || size < 2 || size > 256) { return report(line_number, "Invalid LUT_3D_SIZE."); }
+
+                    num_values = 3 * static_cast<std::size_t>(size) * size * size;
+                    data.reserve(num_values);
+                    continue;
+                }
+
+                // The domain is given as DOMAIN_MIN/DOMAIN_MAX (per channel) or LUT_3D_INPUT_RANGE (Resolve)
+                double range[3] = { 0.0, 0.0, 0.0 };
+                if (keyword == "DOMAIN_MIN" || keyword == "DOMAIN_MAX")
+                {
+                    fields >> range[0] >> range[1] >> range[2];
+
+                    const double expected = keyword == "DOMAIN_MIN" ? 0.0 : 1.0;
+                    if (!fields || range[0] != expected || range[1] != expected || range[2] != expected)
+                    {
+                        return report(line_number, "Domains other than [0, 1] are not supported.");
+                    }
+                    continue;
+                }
+                if (keyword == "LUT_3D_INPUT_RANGE")
+                {
+                    fields >> range[0] >> range[1];
+                    if (!fields || range[0] != 0.0 || range[1] != 1.0) { return report(line_number, "Domains other than [0, 1] are not supported."); }
+                    continue;
+                }
+                return report(line_number, "Unknown keyword \"" + keyword + "\".");
+            }
+
+            if (size == 0) { return report(line_number, "Values before LUT_3D_SIZE."); }
+            if (data.size() == num_values) { return report(line_number, "More values than LUT_3D_SIZE^3 entries."); }
+
+            float rgb[3];
+            fields >> rgb[0] >> rgb[1] >> rgb[2];
+            if (!fields) { return report(line_number, "Malformed entry."); }
+
+            data.insert(data.end(), rgb, rgb + 3);
+        }
+
+        if (size == 0 || data.size() != num_values)
+        {
+            std::cerr << "Error: " << path << ": " << data.size() / 3 << " entries for LUT_3D_SIZE " << size << "." << std::endl;
+            return nullptr;
+        }
+
+        return std::make_unique<Lut3D>(size, std::move(data));
+    }
+} // namespace enhancer
+
+#endif /* enhancer_lut_hpp */
@@ -0,0 +1,359 @@
+#ifndef enhancer_mappedfile_hpp
+#define enhancer_mappedfile_hpp
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // A mapped byte range of a file. The pages are read on first access and leave the resident memory of the process
+    // when the region is destroyed (or reset), so mapping a file a window at a time bounds the memory use regardless
+    // of the file size. A region stays valid after its MappedFile is closed.
+    class MappedRegion
+    {
+    public:
+        MappedRegion() = default;
+        ~MappedRegion() { reset(); }
+
+        MappedRegion(MappedRegion&& other) noexcept;
+        MappedRegion& operator=(MappedRegion&& other) noexcept;
+
+        MappedRegion(const MappedRegion&) = delete;
+        MappedRegion& operator=(const MappedRegion&) = delete;
+
+        bool isValid() const { return m_data != nullptr; }
+
+        // The first byte of the requested range; writing is only allowed if the file was opened for writing
+        std::uint8_t* getData() const { return m_data; }
+        std::size_t   getSize() const { return m_size; }
+
+        // Reads the pages of the region in advance, so that the next accesses do not wait for the disk
+        void prefetch() const;
+
+        // Writes the modified pages back to the file
+        bool flush() const;
+
+        void reset();
+
+    private:
+        friend class MappedFile;
+
+        MappedRegion(void* base, const std::size_t base_size, const std::size_t offset_in_base, const std::size_t size) :
+        m_base(base), m_base_size(base_size), m_data(static_cast<std::uint8_t*>(base) + offset_in_base), m_size(size)
+        {
+        }
+
+        // The mapping, which starts at the alignment boundary below the requested range
+        void*       m_base      = nullptr;
+        std::size_t m_base_size = 0;
+
+        std::uint8_t* m_data = nullptr;
+        std::size_t   m_size = 0;
+    };
+
+    // A file whose byte ranges are mapped into memory on demand
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile() { close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Opens an existing file. Returns false (after printing the reason) if it cannot be opened.
+        bool open(const std::string& path, const bool is_writable = false);
+
+        // Creates (or truncates) a writable file of `size` bytes, which read as zeros until they are written
+        bool create(const std::string& path, const std::uint64_t size);
+
+        void close();
+
+        bool          isOpen() const { return m_size != 0; }
+        bool          isWritable() const { return m_is_writable; }
+        std::uint64_t getSize() const { return m_size; }
+
+        // Maps [offset, offset + size), which has to be within the file; the returned region is invalid (and the
+        // reason printed) if the system refuses the mapping
+        MappedRegion map(const std::uint64_t offset, const std::size_t size) const;
+
+    private:
+#if defined(_WIN32)
+        HANDLE m_file    = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+#else
+        int m_file = -1;
+#endif
+        std::uint64_t m_size        = 0;
+        bool          m_is_writable = false;
+    };
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    namespace internal
+    {
+        // Mappings have to start at a multiple of this
+        inline std::size_t getMappingGranularity()
+        {
+#if defined(_WIN32)
+            static const std::size_t granularity = []()
+            {
+                SYSTEM_INFO info;
+                GetSystemInfo(&info);
+                return static_cast<std::size_t>(info.dwAllocationGranularity);
+            }();
+#else
+            static const std::size_t granularity = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+            return granularity;
+        }
+
+        inline std::size_t getPageSize()
+        {
+#if defined(_WIN32)
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return info.dwPageSize;
+#else
+            return getMappingGranularity();
+#endif
+        }
+    } // namespace internal
+
+    inline MappedRegion::MappedRegion(MappedRegion&& other) noexcept :
+    m_base(other.m_base), m_base_size(other.m_base_size), m_data(other.m_data), m_size(other.m_size)
+    {
+        other.m_base = nullptr;
+        other.m_data = nullptr;
+    }
+
+    inline MappedRegion& MappedRegion::operator=(MappedRegion&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            std::swap(m_base, other.m_base);
+            std::swap(m_base_size, other.m_base_size);
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+        }
+        return *this;
+    }
+
+    inline void MappedRegion::prefetch() const
+    {
+        if (m_base == nullptr) { return; }
+
+#if !defined(_WIN32)
+        ::madvise(m_base, m_base_size, MADV_WILLNEED);
+#endif
+
+        // Touching one byte per page makes the pages resident by the time this returns
+        const std::size_t            page_size = internal::getPageSize();
+        const volatile std::uint8_t* bytes     = static_cast<const std::uint8_t*>(m_base);
+        for (std::size_t offset = 0; offset < m_base_size; offset += page_size) { static_cast<void>(bytes[offset]); }
+    }
+
+    inline bool MappedRegion::flush() const
+    {
+        if (m_base == nullptr) { return true; }
+
+#if defined(_WIN32)
+        return FlushViewOfFile(m_base, m_base_size) != 0;
+#else
+        return ::msync(m_base, m_base_size, MS_SYNC) == 0;
+#endif
+    }
+
+    inline void MappedRegion::reset()
+    {
+        if (m_base == nullptr) { return; }
+
+#if defined(_WIN32)
+        UnmapViewOfFile(m_base);
+#else
+        ::munmap(m_base, m_base_size);
+#endif
+        m_base = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+#if defined(_WIN32)
+    inline bool MappedFile::open(const std::string& path, const bool is_writable)
+    {
+        close();
+
+        const DWORD access = is_writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+        m_file = CreateFileA(path.c_str(), access, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        LARGE_INTEGER file_size;
+        if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &file_size) || file_size.QuadPart == 0)
+        {
+            std::cerr << "Error: Failed to open \"" << path << "\"." << std::endl;
+            close();
+            return false;
+        }
+
+        m_mapping = CreateFileMappingA(m_file, nullptr, is_writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping == nullptr)
+        {
+            std::cerr << "Error: Failed to map \"" << path << "\"." << std::endl;
+            close();
+            return false;
+        }
+
+        m_size        = static_cast<std::uint64_t>(file_size.QuadPart);
+        m_is_writable = is_writable;
+        return true;
+    }
+
+    inline bool MappedFile::create(const std::string& path, const std::uint64_t size)
+    {
+        close();
+
+        m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        LARGE_INTEGER file_size;
+        file_size.QuadPart = static_cast<LONGLONG>(size);
+        if (size == 0 || m_file == INVALID_HANDLE_VALUE || !SetFilePointerEx(m_file, file_size, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file))
+        {
+            std::cerr << "Error: Failed to create \"" << path << "\"." << std::endl;
+            close();
+            return false;
+        }
+
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+        if (m_mapping == nullptr)
+        {
+            std::cerr << "Error: Failed to map \"" << path << "\"." << std::endl;
+            close();
+            return false;
+        }
+
+        m_size        = size;
+        m_is_writable = true;
+        return true;
+    }
+
+    inline void MappedFile::close()
+    {
+        if (m_mapping != nullptr) { CloseHandle(m_mapping); }
+        if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); }
+
+        m_file        = INVALID_HANDLE_VALUE;
+        m_mapping     = nullptr;
+        m_size        = 0;
+        m_is_writable = false;
+    }
+
+    inline MappedRegion MappedFile::map(const std::uint64_t offset, const std::size_t size) const
+    {
+        assert(isOpen() && size > 0 && offset + size <= m_size);
+
+        const std::uint64_t base_offset = offset - offset % internal::getMappingGranularity();
+        const std::size_t   base_size   = static_cast<std::size_t>(offset - base_offset) + size;
+
+        void* base = MapViewOfFile(m_mapping,
+                                   m_is_writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                                   static_cast<DWORD>(base_offset >> 32),
+                                   static_cast<DWORD>(base_offset & 0xffffffff),
+                                   base_size);
+        if (base == nullptr)
+        {
+            std::cerr << "Error: Failed to map " << size << " bytes at offset " << offset << "." << std::endl;
+            return MappedRegion();
+        }
+
+        return MappedRegion(base, base_size, static_cast<std::size_t>(offset - base_offset), size);
+    }
+#else
+    inline bool MappedFile::open(const std::string& path, const bool is_writable)
+    {
+        close();
+
+        m_file = ::open(path.c_str(), is_writable ? O_RDWR : O_RDONLY);
+
+        struct stat status;
+        if (m_file < 0 || ::fstat(m_file, &status) != 0 || status.st_size <= 0)
+        {
+            std::cerr << "Error: Failed to open \"" << path << "\"." << std::endl;
+            close();
+            return false;
+        }
+
+        m_size        = static_cast<std::uint64_t>(status.st_size);
+        m_is_writable = is_writable;
+        return true;
+    }
+
+    inline bool MappedFile::create(const std::string& path, const std::uint64_t size)
+    {
+        close();
+
+        // Truncating first and then extending leaves a sparse file, so no disk space is written before the pixels
+        m_file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (size == 0 || m_file < 0 || ::ftruncate(m_file, static_cast<off_t>(size)) != 0)
+        {
+            std::cerr << "Error: Failed to create \"" << path << "\"." << std::endl;
+            close();
+            return false;
+        }
+
+        m_size        = size;
+        m_is_writable = true;
+        return true;
+    }
+
+    inline void MappedFile::close()
+    {
+        if (m_file >= 0) { ::close(m_file); }
+
+        m_file        = -1;
+        m_size        = 0;
+        m_is_writable = false;
+    }
+
+    inline MappedRegion MappedFile::map(const std::uint64_t offset, const std::size_t size) const
+    {
+        assert(isOpen() && size > 0 && offset + size <= m_size);
+
+        const std::uint64_t base_offset = offset - offset % internal::getMappingGranularity();
+        const std::size_t   base_size   = static_cast<std::size_t>(offset - base_offset) + size;
+
+        const int protection = m_is_writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void*     base       = ::mmap(nullptr, base_size, protection, MAP_SHARED, m_file, static_cast<off_t>(base_offset));
+        if (base == MAP_FAILED)
+        {
+            std::cerr << "Error: Failed to map " << size << " bytes at offset " << offset << "." << std::endl;
+            return MappedRegion();
+        }
+
+        return MappedRegion(base, base_size, static_cast<std::size_t>(offset - base_offset), size);
+    }
+#endif
+} // namespace enhancer
+
+#endif /* enhancer_mappedfile_hpp */
@@ -0,0 +1,177 @@
+#ifndef enhancer_offscreenenhancer_hpp
+#define enhancer_offscreenenhancer_hpp
+
+#include <QImage>
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions_3_2_Core>
+#include <QOpenGLVertexArrayObject>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/enhancer.hpp>
+#include <memory>
+#include <vector>
+
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+class QOpenGLTexture;
+
+namespace enhancer
+{
+    struct ImageStatistics;
+    struct LocalAdjustment;
+
+    namespace internal
+    {
+        class GpuTimer;
+    } // namespace internal
+
+    // Runs the GLSL shaders (enhancer.vs/enhancer.fs) without a window: the image is rendered into a framebuffer
+    // object of a QOffscreenSurface at its full resolution and read back into a caller-provided buffer. Images larger
+    // than the maximum tile size (or GL_MAX_TEXTURE_SIZE) are rendered tile by tile, which is exact because the
+    // shader is a per-pixel operation.
+    //
+    // A QGuiApplication (or QApplication) has to exist, and the object has to be created and used in the thread
+    // owning it. On Linux hosts without a display server, run with QT_QPA_PLATFORM=offscreen (or eglfs), which gives
+    // a surfaceless EGL/GLX context, e.g., on Mesa llvmpipe.
+    class OffscreenEnhancer : protected QOpenGLFunctions_3_2_Core
+    {
+    public:
+        explicit OffscreenEnhancer(const int max_tile_size = 4096);
+        ~OffscreenEnhancer();
+
+        OffscreenEnhancer(const OffscreenEnhancer&) = delete;
+        OffscreenEnhancer& operator=(const OffscreenEnhancer&) = delete;
+
+        // False if the OpenGL 3.2 Core context or the shader program could not be created
+        bool isValid() const { return m_program != nullptr; }
+
+        int getMaxTileSize() const { return m_max_tile_size; }
+
+        // Rebuilds the shader program with the corresponding ENHANCER_ACCURACY_* define (see enhancer.fs); the
+        // previous program is kept if the new one fails to build
+        void     setAccuracy(const Accuracy accuracy);
+        Accuracy getAccuracy() const { return m_accuracy; }
+
+        void setParameters(const std::array<GLfloat, NUM_PARAMETERS>& parameters) { m_parameters = parameters; }
+
+        template <typename T>
+        void setParameters(const Eigen::Matrix<T, Eigen::Dynamic, 1>& parameters)
+        {
+            assert(parameters.size() == NUM_PARAMETERS);
+            for (int i = 0; i < NUM_PARAMETERS; ++i) { m_parameters[i] = static_cast<GLfloat>(parameters[i]); }
+        }
+
+        // Blends `adjustments` (see enhancer/local.hpp) into the parameters of each pixel in the following calls of
+        // enhanceImage and computeStatistics, with the ENHANCER_WITH_LOCAL_ADJUSTMENTS variant of the shader. Up to
+        // four adjustments are supported, and all the guidance grids among them must have the same size since they
+        // share one 3D texture. Masks are read at each call, so their buffers have to stay valid meanwhile. Returns
+        // false (keeping the previous adjustments) if these conditions are not met or the program cannot be built.
+        bool setLocalAdjustments(const std::vector<LocalAdjustment>& adjustments);
+        void clearLocalAdjustments();
+
+        // Same buffer conventions as enhance_image (enhancer/image.hpp): interleaved RGB or RGBA rows with `stride`
+        // bytes, alpha copied from `src`, and in-place operation allowed. Returns false on OpenGL errors. If
+        // `statistics` is given, the statistics of the output (see enhancer/statistics.hpp) are added to it from
+        // each tile as it is read back, which saves a second pass over `dst`.
+        bool enhanceImage(const std::uint8_t*  src,
+                          std::uint8_t*        dst,
+                          const int            width,
+                          const int            height,
+                          const std::ptrdiff_t stride,
+                          const int            channels,
+                          ImageStatistics*     statistics = nullptr);
+
+        bool enhanceImage(const float*         src,
+                          float*               dst,
+                          const int            width,
+                          const int            height,
+                          const std::ptrdiff_t stride,
+                          const int            channels,
+                          ImageStatistics*     statistics = nullptr);
+
+        // Returns an RGBA8888 image of the same size, or a null image on failure
+        QImage enhanceImage(const QImage& image, ImageStatistics* statistics = nullptr);
+
+        // Renders into `enhanced_image`, whose pixels are reused when it already is an unshared RGBA8888 image of the
+        // same size, so that processing a sequence of frames does not allocate an image per frame. An RGBA8888
+        // `image` is also read without conversion. Returns false on failure, leaving `enhanced_image` unspecified.
+        bool enhanceImage(const QImage& image, QImage& enhanced_image, ImageStatistics* statistics = nullptr);
+
+        // Adds the statistics of the output to `statistics` without writing any pixel
+        bool computeStatistics(const std::uint8_t*  src,
+                               const int            width,
+                               const int            height,
+                               const std::ptrdiff_t stride,
+                               const int            channels,
+                               ImageStatistics&     statistics);
+
+        bool computeStatistics(const float*         src,
+                               const int            width,
+                               const int            height,
+                               const std::ptrdiff_t stride,
+                               const int            channels,
+                               ImageStatistics&     statistics);
+
+        // Renders `image` with each of `parameter_sets` into the cells of one RGBA8888 atlas laid out by
+        // make_atlas_layout (enhancer/sweep.hpp) with `columns` columns (0 for a nearly square grid), uploading the
+        // source once and reading all the candidates back at once. Unused cells are transparent black. Returns a null
+        // image on failure or if the atlas exceeds the maximum tile size. Local adjustments are not applied.
+        QImage enhanceImageAtlas(const QImage& image, const std::vector<Eigen::VectorXd>& parameter_sets, const int columns = 0);
+
+    private:
+        int      m_max_tile_size;
+        Accuracy m_accuracy;
+
+        std::array<GLfloat, NUM_PARAMETERS> m_parameters;
+
+        std::unique_ptr<QOpenGLContext>           m_context;
+        std::unique_ptr<QOffscreenSurface>        m_surface;
+        std::shared_ptr<QOpenGLShaderProgram>     m_program;
+        std::unique_ptr<QOpenGLTexture>           m_texture;
+        std::unique_ptr<QOpenGLFramebufferObject> m_fbo;
+
+        std::vector<LocalAdjustment>          m_local_adjustments;
+        std::shared_ptr<QOpenGLShaderProgram> m_local_program;
+        std::unique_ptr<QOpenGLTexture>       m_mask_texture;
+        std::unique_ptr<QOpenGLTexture>       m_grid_texture;
+        std::vector<std::uint8_t>             m_mask_buffer;
+
+        QOpenGLVertexArrayObject m_vao;
+        QOpenGLBuffer            m_vbo;
+
+        std::vector<std::uint8_t> m_readback_buffer;
+
+        // Only created in builds with ENHANCER_WITH_INSTRUMENTATION (see enhancer/instrumentation.hpp)
+        std::unique_ptr<internal::GpuTimer> m_gpu_timer;
+
+        // Builds the program for `accuracy` (and its local-adjustment variant if there are local adjustments) and binds
+        // its vertex attribute to m_vbo in m_vao; the context has to be current
+        bool buildProgram(const Accuracy accuracy);
+
+        // Sets the "local_*" uniforms of m_local_program other than the tile origin; the program has to be bound
+        void setLocalUniforms(const int width, const int height);
+
+        // Copies the masks over the tile at (tile_x, tile_y) into the channels of m_mask_texture
+        void uploadLocalMasks(const int tile_x, const int tile_y, const int tile_width, const int tile_height);
+
+        // (Re)allocates the source texture and the framebuffer when their sizes or the pixel type change
+        void prepareTargets(const int texture_width, const int texture_height, const int framebuffer_width, const int framebuffer_height, const bool is_float);
+
+        // `dst` may be null when only `statistics` are wanted; the rows of `src` and `dst` may have different strides
+        template <typename T>
+        bool render(const T*             src,
+                    T*                   dst,
+                    const int            width,
+                    const int            height,
+                    const std::ptrdiff_t src_stride,
+                    const std::ptrdiff_t dst_stride,
+                    const int            channels,
+                    ImageStatistics*     statistics);
+    };
+} // namespace enhancer
+
+#endif /* enhancer_offscreenenhancer_hpp */
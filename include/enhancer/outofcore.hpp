@@ -0,0 +1,817 @@
+#ifndef enhancer_outofcore_hpp
+#define enhancer_outofcore_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <enhancer/mappedfile.hpp>
+#include <enhancer/parallel.hpp>
+#include <enhancer/stream.hpp>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // The type of the channel values of an image file
+    enum class SampleType
+    {
+        UInt8,
+        UInt16,
+        Float16,
+        Float32
+    };
+
+    inline int get_sample_size(const SampleType sample_type);
+
+    // An uncompressed interleaved RGB or RGBA image in a file, which is mapped a band of rows at a time, so that
+    // images larger than the memory (e.g., gigapixel scans) can be processed. Rows are `stride` bytes apart within
+    // runs of contiguous rows; a raw file has one run, and a TIFF file one per group of adjacent strips.
+    class ImageFile
+    {
+    public:
+        ImageFile() = default;
+
+        // Raw pixels starting `offset` bytes into the file, with rows `stride` bytes apart (0 for tightly packed
+        // rows). Returns false (after printing the reason) if the file cannot be opened or is too small.
+        bool openRaw(const std::string&   path,
+                     const int            width,
+                     const int            height,
+                     const int            channels,
+                     const SampleType     sample_type,
+                     const std::uint64_t  offset      = 0,
+                     const std::ptrdiff_t stride      = 0,
+                     const bool           is_writable = false);
+
+        // A little-endian TIFF or BigTIFF file with uncompressed, interleaved RGB or RGBA strips of 8- or 16-bit
+        // unsigned integers or 16- or 32-bit floats
+        bool openTiff(const std::string& path, const bool is_writable = false);
+
+        // Create writable files whose pixels read as zeros until they are written. createTiff writes a BigTIFF file
+        // if the image does not fit in a classic TIFF file (4 GiB).
+        bool createRaw(const std::string& path, const int width, const int height, const int channels, const SampleType sample_type);
+        bool createTiff(const std::string& path, const int width, const int height, const int channels, const SampleType sample_type);
+
+        int            getWidth() const { return m_width; }
+        int            getHeight() const { return m_height; }
+        int            getChannels() const { return m_channels; }
+        SampleType     getSampleType() const { return m_sample_type; }
+        std::ptrdiff_t getStride() const { return m_stride; }
+        bool           isWritable() const { return m_file.isWritable(); }
+
+        // The number of rows from row `y` to the end of its run of contiguous rows
+        int getNumContiguousRows(const int y) const;
+
+        // Maps rows [y, y + num_rows), which have to be in one run of contiguous rows
+        MappedRegion mapRows(const int y, const int num_rows) const;
+
+    private:
+        struct RowRun
+        {
+            int           first_row;
+            std::uint64_t offset;
+        };
+
+        bool setLayout(const std::string& path, const int width, const int height, const int channels, const SampleType sample_type, const std::ptrdiff_t stride);
+
+        const RowRun& findRun(const int y) const;
+
+        MappedFile m_file;
+
+        int            m_width       = 0;
+        int            m_height      = 0;
+        int            m_channels    = 0;
+        SampleType     m_sample_type = SampleType::UInt8;
+        std::ptrdiff_t m_stride      = 0;
+
+        std::vector<RowRun> m_runs;
+    };
+
+    struct OutOfCoreOptions
+    {
+        // The tiles of each band per thread of the pool. A band is sized to hold that many tiles for every thread
+        // (rounded up to whole rows of tiles), so the resident memory is proportional to the tile size times the
+        // number of threads and not to the image size. Images wider than all these tiles still need a full row of
+        // tiles per band.
+        int tiles_per_thread = 4;
+
+        // An upper bound on the bytes of source and destination rows that are mapped at any time, which caps the
+        // bands of very wide images (at least one row per band is mapped, however wide it is)
+        std::size_t working_set_bytes = std::size_t(256) << 20;
+
+        // The number of bands in flight: while one band is enhanced, the next one is read ahead and the previous one
+        // is written back
+        int num_bands = 3;
+
+        TileSize tile_size;
+    };
+
+    struct OutOfCoreStats
+    {
+        int num_bands   = 0;
+        int band_height = 0;
+
+        double seconds               = 0.0;
+        double megapixels_per_second = 0.0;
+
+        // Time spent inside each stage; the largest one is the bottleneck
+        double prefetch_seconds  = 0.0;
+        double enhance_seconds   = 0.0;
+        double writeback_seconds = 0.0;
+
+        // The largest number of bytes mapped at once
+        std::size_t peak_mapped_bytes = 0;
+    };
+
+    // Streams `src` through `kernel` into `dst` in bands of rows, tile-parallel on `pool`. Three stages run
+    // concurrently over a fixed number of bands: a read-ahead thread maps the source and destination rows of the next
+    // band and faults the source pages in, the calling thread enhances, and a write-back thread flushes the
+    // destination rows of the enhanced bands and unmaps them. Thus the mapped (and resident) pixels are about
+    // num_bands x tiles_per_thread tiles per thread of `pool`, never exceed options.working_set_bytes, and do not
+    // depend on the height of the files. The images have the same size, channels, and sample
+    // type (that of `T`), and `dst` is writable. `kernel` has the signature of enhance_image. Returns false (after
+    // printing the reason) if the images do not match or a band cannot be mapped or written back.
+    template <typename T, typename Kernel>
+    bool processImageFile(ThreadPool&             pool,
+                          const ImageFile&        src,
+                          const ImageFile&        dst,
+                          const Eigen::VectorXd&  parameters,
+                          Kernel                  kernel,
+                          const OutOfCoreOptions& options = OutOfCoreOptions(),
+                          OutOfCoreStats*         stats   = nullptr);
+
+    // processImageFile with the exact pipeline, for any sample type
+    inline bool enhance_image_file(ThreadPool&             pool,
+                                   const ImageFile&        src,
+                                   const ImageFile&        dst,
+                                   const Eigen::VectorXd&  parameters,
+                                   const Accuracy          accuracy = Accuracy::Exact,
+                                   const ValueRange        range    = ValueRange::Display,
+                                   const OutOfCoreOptions& options  = OutOfCoreOptions(),
+                                   OutOfCoreStats*         stats    = nullptr);
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline int get_sample_size(const SampleType sample_type)
+    {
+        switch (sample_type)
+        {
+            case SampleType::UInt8: return 1;
+            case SampleType::UInt16: return 2;
+            case SampleType::Float16: return 2;
+            case SampleType::Float32: return 4;
+        }
+        return 0;
+    }
+
+    namespace internal
+    {
+        template <typename T> struct SampleTypeTraits;
+
+        template <> struct SampleTypeTraits<std::uint8_t>
+        {
+            static constexpr SampleType sample_type = SampleType::UInt8;
+        };
+
+        template <> struct SampleTypeTraits<std::uint16_t>
+        {
+            static constexpr SampleType sample_type = SampleType::UInt16;
+        };
+
+        template <> struct SampleTypeTraits<Eigen::half>
+        {
+            static constexpr SampleType sample_type = SampleType::Float16;
+        };
+
+        template <> struct SampleTypeTraits<float>
+        {
+            static constexpr SampleType sample_type = SampleType::Float32;
+        };
+
+        // TIFF field types and tags (TIFF 6.0 and BigTIFF)
+        constexpr std::uint16_t tiff_short = 3;
+        constexpr std::uint16_t tiff_long  = 4;
+        constexpr std::uint16_t tiff_long8 = 16;
+
+        constexpr std::uint16_t tiff_image_width                = 256;
+        constexpr std::uint16_t tiff_image_length               = 257;
+        constexpr std::uint16_t tiff_bits_per_sample            = 258;
+        constexpr std::uint16_t tiff_compression                = 259;
+        constexpr std::uint16_t tiff_photometric_interpretation = 262;
+        constexpr std::uint16_t tiff_strip_offsets              = 273;
+        constexpr std::uint16_t tiff_samples_per_pixel          = 277;
+        constexpr std::uint16_t tiff_rows_per_strip             = 278;
+        constexpr std::uint16_t tiff_strip_byte_counts          = 279;
+        constexpr std::uint16_t tiff_planar_configuration       = 284;
+        constexpr std::uint16_t tiff_tile_width                 = 322;
+        constexpr std::uint16_t tiff_extra_samples              = 338;
+        constexpr std::uint16_t tiff_sample_format              = 339;
+
+        inline int getTiffTypeSize(const std::uint16_t type)
+        {
+            return type == tiff_short ? 2 : type == tiff_long ? 4 : type == tiff_long8 ? 8 : 0;
+        }
+
+        inline std::uint64_t readLittleEndian(const std::uint8_t* bytes, const int size)
+        {
+            std::uint64_t value = 0;
+            for (int i = size - 1; i >= 0; --i) { value = (value << 8) | bytes[i]; }
+            return value;
+        }
+
+        inline void appendLittleEndian(std::vector<std::uint8_t>& bytes, const std::uint64_t value, const int size)
+        {
+            for (int i = 0; i < size; ++i) { bytes.push_back(static_cast<std::uint8_t>(value >> (8 * i))); }
+        }
+
+        struct TiffEntry
+        {
+            std::uint16_t              tag;
+            std::uint16_t              type;
+            std::vector<std::uint64_t> values;
+        };
+
+        // Reads the fields of the first image file directory that locate the pixels; other fields are skipped
+        inline bool readTiffEntries(const std::string& path, std::map<std::uint16_t, std::vector<std::uint64_t>>& fields)
+        {
+            std::ifstream stream(path, std::ios::binary);
+
+            const auto read = [&](const std::uint64_t offset, std::uint8_t* bytes, const std::size_t size)
+            {
+                stream.seekg(static_cast<std::streamoff>(offset));
+                stream.read(reinterpret_cast<char*>(bytes), static_cast<std::streamsize>(size));
+                return static_cast<bool>(stream);
+            };
+
+            const auto report = [&](const char* message)
+            {
+                std::cerr << "Error: " << path << ": " << message << std::endl;
+                return false;
+            };
+
+            std::uint8_t header[16];
+            if (!stream || !read(0, header, 8)) { return report("Not a TIFF file."); }
+            if (header[0] == 'M' && header[1] == 'M') { return report("Only little-endian TIFF files are supported."); }
+            if (header[0] != 'I' || header[1] != 'I') { return report("Not a TIFF file."); }
+
+            const std::uint64_t version = readLittleEndian(header + 2, 2);
+            if (version == 43 && !read(0, header, 16)) { return report("Not a TIFF file."); }
+            if (version != 42 && (version != 43 || readLittleEndian(header + 4, 2) != 8)) { return report("Not a TIFF file."); }
+
+            // BigTIFF widens the counts and offsets to 64 bits
+            const bool is_big      = version == 43;
+            const int  offset_size = is_big ? 8 : 4;
+            const int  entry_size  = is_big ? 20 : 12;
+
+            const std::uint64_t directory_offset = readLittleEndian(header + 4 * (is_big ? 2 : 1), offset_size);
+
+            std::uint8_t count_bytes[8];
+            if (!read(directory_offset, count_bytes, is_big ? 8 : 2)) { return report("Truncated file."); }
+            const std::uint64_t num_entries = readLittleEndian(count_bytes, is_big ? 8 : 2);
+
+            const std::uint64_t first_entry_offset = directory_offset + (is_big ? 8 : 2);
+            for (std::uint64_t i = 0; i < num_entries; ++i)
+            {
+                std::uint8_t entry[20];
+                if (!read(first_entry_offset + i * entry_size, entry, entry_size)) { return report("Truncated file."); }
+
+                const std::uint16_t tag   = static_cast<std::uint16_t>(readLittleEndian(entry, 2));
+                const std::uint16_t type  = static_cast<std::uint16_t>(readLittleEndian(entry + 2, 2));
+                const std::uint64_t count = readLittleEndian(entry + 4, offset_size);
+
+                const bool is_needed = tag == tiff_image_width || tag == tiff_image_length || tag == tiff_bits_per_sample ||
+                                       tag == tiff_compression || tag == tiff_photometric_interpretation ||
+                                       tag == tiff_strip_offsets || tag == tiff_samples_per_pixel || tag == tiff_rows_per_strip ||
+                                       tag == tiff_strip_byte_counts || tag == tiff_planar_configuration ||
+                                       tag == tiff_tile_width || tag == tiff_sample_format;
+                if (!is_needed) { continue; }
+
+                const int type_size = getTiffTypeSize(type);
+                if (type_size == 0 || count == 0 || count > (std::uint64_t(1) << 32)) { return report("Unsupported field type."); }
+
+                // Values that fit in the offset field are stored in place
+                std::vector<std::uint8_t> value_bytes(count * type_size);
+                if (value_bytes.size() <= static_cast<std::size_t>(offset_size))
+                {
+                    std::memcpy(value_bytes.data(), entry + 4 + offset_size, value_bytes.size());
+                }
+                else if (!read(readLittleEndian(entry + 4 + offset_size, offset_size), value_bytes.data(), value_bytes.size()))
+                {
+                    return report("Truncated file.");
+                }
+
+                std::vector<std::uint64_t>& values = fields[tag];
+                values.resize(count);
+                for (std::uint64_t j = 0; j < count; ++j) { values[j] = readLittleEndian(value_bytes.data() + j * type_size, type_size); }
+            }
+
+            return true;
+        }
+
+        // Serializes the header and the image file directory of a single-image TIFF (or BigTIFF) file
+        inline std::vector<std::uint8_t> writeTiffHeader(const std::vector<TiffEntry>& entries, const bool is_big)
+        {
+            const int offset_size = is_big ? 8 : 4;
+            const int entry_size  = is_big ? 20 : 12;
+
+            std::vector<std::uint8_t> bytes = { 'I', 'I' };
+            appendLittleEndian(bytes, is_big ? 43 : 42, 2);
+            if (is_big)
+            {
+                appendLittleEndian(bytes, 8, 2);
+                appendLittleEndian(bytes, 0, 2);
+            }
+
+            const std::uint64_t directory_offset = bytes.size() + offset_size;
+            const std::uint64_t directory_size   = (is_big ? 8 : 2) + entries.size() * entry_size + offset_size;
+            appendLittleEndian(bytes, directory_offset, offset_size);
+            appendLittleEndian(bytes, entries.size(), is_big ? 8 : 2);
+
+            // Values that do not fit in the offset fields follow the directory, aligned to 8 bytes
+            std::vector<std::uint8_t> external_bytes;
+            for (const TiffEntry& entry : entries)
+            {
+                const int type_size = getTiffTypeSize(entry.type);
+
+                appendLittleEndian(bytes, entry.tag, 2);
+                appendLittleEndian(bytes, entry.type, 2);
+                appendLittleEndian(bytes, entry.values.size(), offset_size);
+
+                if (entry.values.size() * type_size <= static_cast<std::size_t>(offset_size))
+                {
+                    for (const std::uint64_t value : entry.values) { appendLittleEndian(bytes, value, type_size); }
+                    appendLittleEndian(bytes, 0, offset_size - static_cast<int>(entry.values.size()) * type_size);
+                }
+                else
+                {
+                    appendLittleEndian(bytes, directory_offset + directory_size + external_bytes.size(), offset_size);
+                    for (const std::uint64_t value : entry.values) { appendLittleEndian(external_bytes, value, type_size); }
+                    external_bytes.resize((external_bytes.size() + 7) / 8 * 8);
+                }
+            }
+            appendLittleEndian(bytes, 0, offset_size); // No next directory
+
+            bytes.insert(bytes.end(), external_bytes.begin(), external_bytes.end());
+            return bytes;
+        }
+
+        struct FileBand
+        {
+            int y;
+            int height;
+
+            MappedRegion src;
+            MappedRegion dst;
+        };
+    } // namespace internal
+
+    inline bool ImageFile::setLayout(const std::string&   path,
+                                     const int            width,
+                                     const int            height,
+                                     const int            channels,
+                                     const SampleType     sample_type,
+                                     const std::ptrdiff_t stride)
+    {
+        const std::ptrdiff_t row_bytes = static_cast<std::ptrdiff_t>(width) * channels * get_sample_size(sample_type);
+        if (width <= 0 || height <= 0 || (channels != 3 && channels != 4) || stride < row_bytes)
+        {
+            std::cerr << "Error: " << path << ": Unsupported image layout." << std::endl;
+            return false;
+        }
+
+        m_width       = width;
+        m_height      = height;
+        m_channels    = channels;
+        m_sample_type = sample_type;
+        m_stride      = stride;
+        m_runs.clear();
+        return true;
+    }
+
+    inline bool ImageFile::openRaw(const std::string&   path,
+                                   const int            width,
+                                   const int            height,
+                                   const int            channels,
+                                   const SampleType     sample_type,
+                                   const std::uint64_t  offset,
+                                   const std::ptrdiff_t stride,
+                                   const bool           is_writable)
+    {
+        const std::ptrdiff_t row_bytes = static_cast<std::ptrdiff_t>(width) * channels * get_sample_size(sample_type);
+        if (!setLayout(path, width, height, channels, sample_type, stride != 0 ? stride : row_bytes)) { return false; }
+        if (!m_file.open(path, is_writable)) { return false; }
+
+        if (offset + static_cast<std::uint64_t>(m_stride) * (height - 1) + row_bytes > m_file.getSize())
+        {
+            std::cerr << "Error: " << path << ": The file is smaller than the image." << std::endl;
+            m_file.close();
+            return false;
+        }
+
+        m_runs.push_back(RowRun{ 0, offset });
+        return true;
+    }
+
+    inline bool ImageFile::openTiff(const std::string& path, const bool is_writable)
+    {
+        std::map<std::uint16_t, std::vector<std::uint64_t>> fields;
+        if (!internal::readTiffEntries(path, fields)) { return false; }
+
+        const auto report = [&](const char* message)
+        {
+            std::cerr << "Error: " << path << ": " << message << std::endl;
+            m_file.close();
+            return false;
+        };
+
+        const auto get = [&](const std::uint16_t tag, const std::uint64_t default_value)
+        {
+            const auto field = fields.find(tag);
+            return field != fields.end() ? field->second.front() : default_value;
+        };
+
+        // All the samples of a pixel have to share one format
+        const auto is_uniform = [&](const std::uint16_t tag)
+        {
+            const auto field = fields.find(tag);
+            if (field == fields.end()) { return true; }
+
+            const std::vector<std::uint64_t>& values = field->second;
+            return std::all_of(values.begin(), values.end(), [&](const std::uint64_t value) { return value == values.front(); });
+        };
+
+        if (fields.count(internal::tiff_tile_width) != 0) { return report("Tiled TIFF files are not supported."); }
+        if (get(internal::tiff_compression, 1) != 1) { return report("Compressed TIFF files are not supported."); }
+        if (get(internal::tiff_planar_configuration, 1) != 1) { return report("Planar TIFF files are not supported."); }
+        if (get(internal::tiff_photometric_interpretation, 0) != 2) { return report("Only RGB TIFF files are supported."); }
+        if (!is_uniform(internal::tiff_bits_per_sample) || !is_uniform(internal::tiff_sample_format)) { return report("Mixed sample formats are not supported."); }
+
+        const std::uint64_t width    = get(internal::tiff_image_width, 0);
+        const std::uint64_t height   = get(internal::tiff_image_length, 0);
+        const std::uint64_t channels = get(internal::tiff_samples_per_pixel, 1);
+        if (width == 0 || height == 0 || width > std::numeric_limits<int>::max() || height > std::numeric_limits<int>::max())
+        {
+            return report("Invalid image size.");
+        }
+        if (channels != 3 && channels != 4) { return report("Only RGB and RGBA TIFF files are supported."); }
+        if (get(internal::tiff_rows_per_strip, height) == 0) { return report("Invalid rows per strip."); }
+
+        // SampleFormat 1 is unsigned integer data and 3 floating-point data
+        const std::uint64_t bits   = get(internal::tiff_bits_per_sample, 1);
+        const std::uint64_t format = get(internal::tiff_sample_format, 1);
+
+        SampleType sample_type;
+        if (bits == 8 && format == 1) { sample_type = SampleType::UInt8; }
+        else if (bits == 16 && format == 1) { sample_type = SampleType::UInt16; }
+        else if (bits == 16 && format == 3) { sample_type = SampleType::Float16; }
+        else if (bits == 32 && format == 3) { sample_type = SampleType::Float32; }
+        else { return report("Unsupported sample format."); }
+
+        const std::ptrdiff_t row_bytes = static_cast<std::ptrdiff_t>(width * channels * get_sample_size(sample_type));
+        if (!setLayout(path, static_cast<int>(width), static_cast<int>(height), static_cast<int>(channels), sample_type, row_bytes)) { return false; }
+        if (!m_file.open(path, is_writable)) { return false; }
+
+        const auto offsets     = fields.find(internal::tiff_strip_offsets);
+        const auto byte_counts = fields.find(internal::tiff_strip_byte_counts);
+        const int  rows_per_strip = static_cast<int>(std::min<std::uint64_t>(get(internal::tiff_rows_per_strip, height), height));
+        const int  num_strips     = (m_height + rows_per_strip - 1) / rows_per_strip;
+        if (offsets == fields.end() || byte_counts == fields.end() || offsets->second.size() != static_cast<std::size_t>(num_strips) ||
+            byte_counts->second.size() != static_cast<std::size_t>(num_strips))
+        {
+            return report("Missing or inconsistent strips.");
+        }
+
+        // Rows are tightly packed within strips; strips that follow each other in the file are merged into one run
+        for (int i = 0; i < num_strips; ++i)
+        {
+            const int           first_row   = i * rows_per_strip;
+            const std::uint64_t strip_bytes = static_cast<std::uint64_t>(std::min(rows_per_strip, m_height - first_row)) * m_stride;
+            const std::uint64_t offset      = offsets->second[i];
+            if (byte_counts->second[i] < strip_bytes || offset > m_file.getSize() || strip_bytes > m_file.getSize() - offset)
+            {
+                return report("Truncated strip.");
+            }
+
+            const bool is_adjacent = !m_runs.empty() && m_runs.back().offset + static_cast<std::uint64_t>(first_row - m_runs.back().first_row) * m_stride == offset;
+            if (!is_adjacent) { m_runs.push_back(RowRun{ first_row, offset }); }
+        }
+
+        return true;
+    }
+
+    inline bool ImageFile::createRaw(const std::string& path, const int width, const int height, const int channels, const SampleType sample_type)
+    {
+        const std::ptrdiff_t row_bytes = static_cast<std::ptrdiff_t>(width) * channels * get_sample_size(sample_type);
+        if (!setLayout(path, width, height, channels, sample_type, row_bytes)) { return false; }
+        if (!m_file.create(path, static_cast<std::uint64_t>(row_bytes) * height)) { return false; }
+
+        m_runs.push_back(RowRun{ 0, 0 });
+        return true;
+    }
+
+    inline bool ImageFile::createTiff(const std::string& path, const int width, const int height, const int channels, const SampleType sample_type)
+    {
+        using namespace internal;
+
+        const std::ptrdiff_t row_bytes = static_cast<std::ptrdiff_t>(width) * channels * get_sample_size(sample_type);
+        if (!setLayout(path, width, height, channels, sample_type, row_bytes)) { return false; }
+
+        // Strips of about 1 MiB, stored one after the other
+        const int           rows_per_strip = static_cast<int>(std::max<std::ptrdiff_t>(1, std::min<std::ptrdiff_t>(height, (1 << 20) / row_bytes)));
+        const int           num_strips     = (height + rows_per_strip - 1) / rows_per_strip;
+        const std::uint64_t pixel_bytes    = static_cast<std::uint64_t>(row_bytes) * height;
+        const bool          is_big         = pixel_bytes + 16 * static_cast<std::uint64_t>(num_strips) + (1 << 16) > std::numeric_limits<std::uint32_t>::max();
+        const std::uint16_t offset_type    = is_big ? tiff_long8 : tiff_long;
+
+        const bool                 is_float      = sample_type == SampleType::Float16 || sample_type == SampleType::Float32;
+        const std::uint64_t        bits          = 8 * get_sample_size(sample_type);
+        std::vector<std::uint64_t> strip_offsets(num_strips, 0);
+        std::vector<std::uint64_t> strip_byte_counts(num_strips);
+        for (int i = 0; i < num_strips; ++i) { strip_byte_counts[i] = static_cast<std::uint64_t>(std::min(rows_per_strip, height - i * rows_per_strip)) * row_bytes; }
+
+        std::vector<TiffEntry> entries = {
+            { tiff_image_width, tiff_long, { static_cast<std::uint64_t>(width) } },
+            { tiff_image_length, tiff_long, { static_cast<std::uint64_t>(height) } },
+            { tiff_bits_per_sample, tiff_short, std::vector<std::uint64_t>(channels, bits) },
+            { tiff_compression, tiff_short, { 1 } },
+            { tiff_photometric_interpretation, tiff_short, { 2 } },
+            { tiff_strip_offsets, offset_type, strip_offsets },
+            { tiff_samples_per_pixel, tiff_short, { static_cast<std::uint64_t>(channels) } },
+            { tiff_rows_per_strip, tiff_long, { static_cast<std::uint64_t>(rows_per_strip) } },
+            { tiff_strip_byte_counts, offset_type, strip_byte_counts },
+            { tiff_planar_configuration, tiff_short, { 1 } },
+        };
+        if (channels == 4) { entries.push_back({ tiff_extra_samples, tiff_short, { 2 } }); } // Unassociated alpha
+        entries.push_back({ tiff_sample_format, tiff_short, std::vector<std::uint64_t>(channels, is_float ? 3 : 1) });
+
+        // The header has the same size once the offsets are known; the pixels start on a page boundary
+        const std::uint64_t pixel_offset = (writeTiffHeader(entries, is_big).size() + 4095) / 4096 * 4096;
+        for (int i = 0; i < num_strips; ++i) { strip_offsets[i] = pixel_offset + static_cast<std::uint64_t>(i) * rows_per_strip * row_bytes; }
+        entries[5].values = strip_offsets;
+
+        const std::vector<std::uint8_t> header = writeTiffHeader(entries, is_big);
+        if (!m_file.create(path, pixel_offset + pixel_bytes)) { return false; }
+
+        MappedRegion header_region = m_file.map(0, header.size());
+        if (!header_region.isValid()) { return false; }
+        std::memcpy(header_region.getData(), header.data(), header.size());
+
+        m_runs.push_back(RowRun{ 0, pixel_offset });
+        return true;
+    }
+
+    inline const ImageFile::RowRun& ImageFile::findRun(const int y) const
+    {
+        assert(!m_runs.empty() && y >= 0 && y < m_height);
+
+        const auto next = std::upper_bound(m_runs.begin(), m_runs.end(), y, [](const int row, const RowRun& run) { return row < run.first_row; });
+        return *std::prev(next);
+    }
+
+    inline int ImageFile::getNumContiguousRows(const int y) const
+    {
+        const RowRun& run      = findRun(y);
+        const int     run_end  = &run == &m_runs.back() ? m_height : (&run + 1)->first_row;
+        return run_end - y;
+    }
+
+    inline MappedRegion ImageFile::mapRows(const int y, const int num_rows) const
+    {
+        assert(num_rows > 0 && num_rows <= getNumContiguousRows(y));
+
+        const RowRun&        run       = findRun(y);
+        const std::ptrdiff_t row_bytes = static_cast<std::ptrdiff_t>(m_width) * m_channels * get_sample_size(m_sample_type);
+        const std::uint64_t  offset    = run.offset + static_cast<std::uint64_t>(y - run.first_row) * m_stride;
+
+        return m_file.map(offset, static_cast<std::size_t>(m_stride) * (num_rows - 1) + row_bytes);
+    }
+
+    template <typename T, typename Kernel>
+    bool processImageFile(ThreadPool&             pool,
+                          const ImageFile&        src,
+                          const ImageFile&        dst,
+                          const Eigen::VectorXd&  parameters,
+                          Kernel                  kernel,
+                          const OutOfCoreOptions& options,
+                          OutOfCoreStats*         stats)
+    {
+        assert(options.working_set_bytes > 0 && options.num_bands > 0 && options.tiles_per_thread > 0);
+        assert(options.tile_size.width > 0 && options.tile_size.height > 0);
+
+        if (src.getWidth() != dst.getWidth() || src.getHeight() != dst.getHeight() || src.getChannels() != dst.getChannels() ||
+            src.getSampleType() != dst.getSampleType() || src.getSampleType() != internal::SampleTypeTraits<T>::sample_type)
+        {
+            std::cerr << "Error: The source and destination images differ in size or format." << std::endl;
+            return false;
+        }
+        if (!dst.isWritable())
+        {
+            std::cerr << "Error: The destination image is not writable." << std::endl;
+            return false;
+        }
+
+        const int width    = src.getWidth();
+        const int height   = src.getHeight();
+        const int channels = src.getChannels();
+
+        // Enough rows of tiles for tiles_per_thread tiles per thread, then as many rows as the budget allows, rounded
+        // down to whole tiles
+        const TileSize    tile_size       = options.tile_size;
+        const std::size_t band_pixels     = static_cast<std::size_t>(pool.getNumThreads()) * options.tiles_per_thread * tile_size.width * tile_size.height;
+        const std::size_t tile_row_pixels = static_cast<std::size_t>(width) * tile_size.height;
+        const std::size_t tile_rows       = (band_pixels + tile_row_pixels - 1) / tile_row_pixels;
+        const std::size_t band_row_bytes  = static_cast<std::size_t>(src.getStride() + dst.getStride()) * options.num_bands;
+        const std::size_t max_rows        = std::max<std::size_t>(1, options.working_set_bytes / band_row_bytes);
+        int               band_height     = static_cast<int>(std::min<std::size_t>({ static_cast<std::size_t>(height), tile_rows * tile_size.height, max_rows }));
+        if (band_height > tile_size.height) { band_height -= band_height % tile_size.height; }
+
+        std::vector<internal::FileBand> bands(options.num_bands);
+
+        // Every band index is always in exactly one of the queues or owned by one of the stages
+        internal::FrameQueue free_queue;
+        internal::FrameQueue mapped_queue;
+        internal::FrameQueue enhanced_queue;
+        for (int i = 0; i < options.num_bands; ++i) { free_queue.push(i); }
+
+        std::atomic<bool>  has_failed{ false };
+        std::exception_ptr exception;
+
+        const auto stop = [&]()
+        {
+            has_failed = true;
+            free_queue.close();
+            mapped_queue.close();
+            enhanced_queue.close();
+        };
+
+        OutOfCoreStats local_stats;
+        local_stats.band_height = band_height;
+
+        std::atomic<std::size_t> mapped_bytes{ 0 };
+
+        const auto begin = std::chrono::steady_clock::now();
+
+        std::thread prefetch_thread([&]()
+        {
+            int band_index;
+            for (int y = 0; y < height && !has_failed && free_queue.pop(band_index);)
+            {
+                internal::FileBand& band = bands[band_index];
+                band.y                   = y;
+                band.height              = std::min({ band_height, src.getNumContiguousRows(y), dst.getNumContiguousRows(y) });
+
+                local_stats.prefetch_seconds += internal::measureStageSeconds([&]()
+                {
+                    band.src = src.mapRows(band.y, band.height);
+                    band.dst = dst.mapRows(band.y, band.height);
+                    band.src.prefetch();
+                });
+                if (!band.src.isValid() || !band.dst.isValid())
+                {
+                    stop();
+                    break;
+                }
+
+                const std::size_t bytes = band.src.getSize() + band.dst.getSize();
+                local_stats.peak_mapped_bytes = std::max(local_stats.peak_mapped_bytes, mapped_bytes += bytes);
+                ++local_stats.num_bands;
+
+                y += band.height;
+                mapped_queue.push(band_index);
+            }
+            mapped_queue.close();
+        });
+
+        std::thread writeback_thread([&]()
+        {
+            int band_index;
+            while (!has_failed && enhanced_queue.pop(band_index))
+            {
+                internal::FileBand& band = bands[band_index];
+
+                bool is_flushed = false;
+                local_stats.writeback_seconds += internal::measureStageSeconds([&]() { is_flushed = band.dst.flush(); });
+                if (!is_flushed)
+                {
+                    std::cerr << "Error: Failed to write back rows " << band.y << " to " << band.y + band.height - 1 << "." << std::endl;
+                    stop();
+                    break;
+                }
+
+                mapped_bytes -= band.src.getSize() + band.dst.getSize();
+                band.src.reset();
+                band.dst.reset();
+
+                free_queue.push(band_index);
+            }
+            free_queue.close();
+        });
+
+        // The enhancement stage runs on the calling thread, which also takes part in the tile-parallel kernel
+        try
+        {
+            int band_index;
+            while (!has_failed && mapped_queue.pop(band_index))
+            {
+                const internal::FileBand& band     = bands[band_index];
+                const T*                  band_src = reinterpret_cast<const T*>(band.src.getData());
+                T*                        band_dst = reinterpret_cast<T*>(band.dst.getData());
+
+                local_stats.enhance_seconds += internal::measureStageSeconds([&]()
+                {
+                    if (src.getStride() == dst.getStride())
+                    {
+                        processImageTiles(pool, band_src, band_dst, width, band.height, src.getStride(), channels, parameters, kernel, options.tile_size);
+                        return;
+                    }
+
+                    // A single row has no stride, so the rows of each tile of differently laid out files are passed to
+                    // the kernel one at a time, all sharing the parameters of the band
+                    const internal::TileGrid grid(width, band.height, options.tile_size);
+
+                    pool.parallelFor(grid.getNumTiles(), [&](const int i)
+                    {
+                        const internal::TileTimer timer(pool.getCurrentThreadIndex());
+                        const internal::Tile      tile = grid.getTile(i);
+
+                        for (int y = tile.y; y < tile.y + tile.height; ++y)
+                        {
+                            kernel(internal::getPixel(band_src, src.getStride(), channels, tile.x, y),
+                                   internal::getPixel(band_dst, dst.getStride(), channels, tile.x, y),
+                                   tile.width,
+                                   1,
+                                   dst.getStride(),
+                                   channels,
+                                   parameters);
+                        }
+                    });
+                });
+
+                enhanced_queue.push(band_index);
+            }
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+            stop();
+        }
+        enhanced_queue.close();
+
+        prefetch_thread.join();
+        writeback_thread.join();
+
+        // Bands left mapped by a failure are unmapped without being written back
+        for (internal::FileBand& band : bands)
+        {
+            band.src.reset();
+            band.dst.reset();
+        }
+
+        if (exception) { std::rethrow_exception(exception); }
+        if (has_failed) { return false; }
+
+        local_stats.seconds               = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        local_stats.megapixels_per_second = local_stats.seconds > 0.0 ? 1e-6 * width * height / local_stats.seconds : 0.0;
+        if (stats != nullptr) { *stats = local_stats; }
+
+        return true;
+    }
+
+    inline bool enhance_image_file(ThreadPool&             pool,
+                                   const ImageFile&        src,
+                                   const ImageFile&        dst,
+                                   const Eigen::VectorXd&  parameters,
+                                   const Accuracy          accuracy,
+                                   const ValueRange        range,
+                                   const OutOfCoreOptions& options,
+                                   OutOfCoreStats*         stats)
+    {
+        const internal::EnhanceImageKernel kernel{ accuracy, range };
+
+        switch (src.getSampleType())
+        {
+            case SampleType::UInt8: return processImageFile<std::uint8_t>(pool, src, dst, parameters, kernel, options, stats);
+            case SampleType::UInt16: return processImageFile<std::uint16_t>(pool, src, dst, parameters, kernel, options, stats);
+            case SampleType::Float16: return processImageFile<Eigen::half>(pool, src, dst, parameters, kernel, options, stats);
+            case SampleType::Float32: return processImageFile<float>(pool, src, dst, parameters, kernel, options, stats);
+        }
+        return false;
+    }
+} // namespace enhancer
+
+#endif /* enhancer_outofcore_hpp */
@@ -0,0 +1,273 @@
+#ifndef enhancer_parallel_hpp
+#define enhancer_parallel_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/bufferpool.hpp>
+#include <enhancer/image.hpp>
+#include <enhancer/instrumentation.hpp>
+#include <enhancer/threadpool.hpp>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // The default tile (512 x 32 pixels) keeps the source and destination of a float RGBA tile within a typical
+    // 512 KiB L2 cache while giving a few hundred tasks per 24 MP image for load balancing
+    struct TileSize
+    {
+        int width  = 512;
+        int height = 32;
+    };
+
+    // One image of a batch processed by enhance_images_parallel / processImages
+    template <typename T> struct ImageTask
+    {
+        const T*        src;
+        T*              dst;
+        int             width;
+        int             height;
+        std::ptrdiff_t  stride;
+        int             channels;
+        Eigen::VectorXd parameters;
+    };
+
+    // Splits an image into tiles and runs `kernel` on them in parallel. `kernel` has the signature of
+    // enhance_image, i.e., kernel(src, dst, width, height, stride, channels, parameters), and receives each tile as a
+    // sub-image sharing the original stride; thus enhance_image, enhance_image_simd, or a lambda applying a Lut3D can
+    // be used as is.
+    template <typename T, typename Kernel>
+    void processImageTiles(ThreadPool&            pool,
+                           const T*               src,
+                           T*                     dst,
+                           const int              width,
+                           const int              height,
+                           const std::ptrdiff_t   stride,
+                           const int              channels,
+                           const Eigen::VectorXd& parameters,
+                           Kernel                 kernel,
+                           const TileSize&        tile_size = TileSize());
+
+    // Processes several images concurrently. The tiles of all the images are scheduled as a single batch, so small
+    // images do not leave threads idle.
+    template <typename T, typename Kernel>
+    void processImages(ThreadPool& pool, const std::vector<ImageTask<T>>& tasks, Kernel kernel, const TileSize& tile_size = TileSize());
+
+    // Parallel versions of enhance_image with the exact pipeline
+    template <typename T>
+    void enhance_image_parallel(ThreadPool&            pool,
+                                const T*               src,
+                                T*                     dst,
+                                const int              width,
+                                const int              height,
+                                const std::ptrdiff_t   stride,
+                                const int              channels,
+                                const Eigen::VectorXd& parameters,
+                                const TileSize&        tile_size = TileSize());
+
+    template <typename T>
+    void enhance_images_parallel(ThreadPool& pool, const std::vector<ImageTask<T>>& tasks, const TileSize& tile_size = TileSize());
+
+    // Parallel version of the view-based enhance_image; the tiles are sub-views of `src` and `dst`
+    template <typename T>
+    void enhance_image_parallel(ThreadPool&                             pool,
+                                const typename ImageView<T>::ConstView& src,
+                                const ImageView<T>&                     dst,
+                                const Eigen::VectorXd&                  parameters,
+                                const Accuracy                          accuracy  = Accuracy::Exact,
+                                const ValueRange                        range     = ValueRange::Display,
+                                const TileSize&                         tile_size = TileSize());
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    namespace internal
+    {
+        struct Tile
+        {
+            int task_index;
+            int x;
+            int y;
+            int width;
+            int height;
+        };
+
+        // The tiles of an image in row-major order, computed on demand so that scheduling needs no tile list
+        class TileGrid
+        {
+        public:
+            TileGrid(const int width, const int height, const TileSize& tile_size) :
+                m_width(width),
+                m_height(height),
+                m_tile_size(tile_size),
+                m_num_columns((width + tile_size.width - 1) / tile_size.width),
+                m_num_rows((height + tile_size.height - 1) / tile_size.height)
+            {
+                assert(tile_size.width > 0 && tile_size.height > 0);
+            }
+
+            int getNumTiles() const { return m_num_columns * m_num_rows; }
+
+            Tile getTile(const int index, const int task_index = 0) const
+            {
+                const int x = (index % m_num_columns) * m_tile_size.width;
+                const int y = (index / m_num_columns) * m_tile_size.height;
+
+                return Tile{ task_index, x, y, std::min(m_tile_size.width, m_width - x), std::min(m_tile_size.height, m_height - y) };
+            }
+
+        private:
+            int      m_width;
+            int      m_height;
+            TileSize m_tile_size;
+            int      m_num_columns;
+            int      m_num_rows;
+        };
+
+        template <typename T> inline const T* getPixel(const T* data, const std::ptrdiff_t stride, const int channels, const int x, const int y)
+        {
+            return getRow(data, stride, y) + x * channels;
+        }
+
+        template <typename T> inline T* getPixel(T* data, const std::ptrdiff_t stride, const int channels, const int x, const int y)
+        {
+            return getRow(data, stride, y) + x * channels;
+        }
+
+        struct EnhanceImageKernel
+        {
+            template <typename T>
+            void operator()(const T*               src,
+                            T*                     dst,
+                            const int              width,
+                            const int              height,
+                            const std::ptrdiff_t   stride,
+                            const int              channels,
+                            const Eigen::VectorXd& parameters) const
+            {
+                enhanceImage(src, dst, width, height, stride, channels, parameters, accuracy, range);
+            }
+
+            Accuracy   accuracy = Accuracy::Exact;
+            ValueRange range    = ValueRange::Display;
+        };
+    } // namespace internal
+
+    template <typename T, typename Kernel>
+    void processImageTiles(ThreadPool&            pool,
+                           const T*               src,
+                           T*                     dst,
+                           const int              width,
+                           const int              height,
+                           const std::ptrdiff_t   stride,
+                           const int              channels,
+                           const Eigen::VectorXd& parameters,
+                           Kernel                 kernel,
+                           const TileSize&        tile_size)
+    {
+        const internal::TileGrid grid(width, height, tile_size);
+
+        pool.parallelFor(grid.getNumTiles(), [&](const int i)
+        {
+            const internal::TileTimer timer(pool.getCurrentThreadIndex());
+            const internal::Tile      tile = grid.getTile(i);
+
+            kernel(internal::getPixel(src, stride, channels, tile.x, tile.y),
+                   internal::getPixel(dst, stride, channels, tile.x, tile.y),
+                   tile.width,
+                   tile.height,
+                   stride,
+                   channels,
+                   parameters);
+        });
+    }
+
+    template <typename T, typename Kernel>
+    void processImages(ThreadPool& pool, const std::vector<ImageTask<T>>& tasks, Kernel kernel, const TileSize& tile_size)
+    {
+        assert(tile_size.width > 0 && tile_size.height > 0);
+
+        const int num_tasks = static_cast<int>(tasks.size());
+
+        // The index of the first tile of each task, followed by the total number of tiles, from which a tile index is
+        // mapped back to its task by a binary search
+        const PooledBuffer first_tiles_buffer = get_thread_buffer_pool().acquire((num_tasks + 1) * sizeof(int));
+        int* const         first_tiles        = first_tiles_buffer.getData<int>();
+
+        first_tiles[0] = 0;
+        for (int i = 0; i < num_tasks; ++i)
+        {
+            first_tiles[i + 1] = first_tiles[i] + internal::TileGrid(tasks[i].width, tasks[i].height, tile_size).getNumTiles();
+        }
+
+        pool.parallelFor(first_tiles[num_tasks], [&](const int i)
+        {
+            const internal::TileTimer timer(pool.getCurrentThreadIndex());
+            const int                 task_index = static_cast<int>(std::upper_bound(first_tiles, first_tiles + num_tasks + 1, i) - first_tiles) - 1;
+            const ImageTask<T>&       task       = tasks[task_index];
+            const internal::Tile      tile       = internal::TileGrid(task.width, task.height, tile_size).getTile(i - first_tiles[task_index], task_index);
+
+            kernel(internal::getPixel(task.src, task.stride, task.channels, tile.x, tile.y),
+                   internal::getPixel(task.dst, task.stride, task.channels, tile.x, tile.y),
+                   tile.width,
+                   tile.height,
+                   task.stride,
+                   task.channels,
+                   task.parameters);
+        });
+    }
+
+    template <typename T>
+    void enhance_image_parallel(ThreadPool&            pool,
+                                const T*               src,
+                                T*                     dst,
+                                const int              width,
+                                const int              height,
+                                const std::ptrdiff_t   stride,
+                                const int              channels,
+                                const Eigen::VectorXd& parameters,
+                                const TileSize&        tile_size)
+    {
+        processImageTiles(pool, src, dst, width, height, stride, channels, parameters, internal::EnhanceImageKernel(), tile_size);
+    }
+
+    template <typename T>
+    void enhance_images_parallel(ThreadPool& pool, const std::vector<ImageTask<T>>& tasks, const TileSize& tile_size)
+    {
+        processImages(pool, tasks, internal::EnhanceImageKernel(), tile_size);
+    }
+
+    template <typename T>
+    void enhance_image_parallel(ThreadPool&                             pool,
+                                const typename ImageView<T>::ConstView& src,
+                                const ImageView<T>&                     dst,
+                                const Eigen::VectorXd&                  parameters,
+                                const Accuracy                          accuracy,
+                                const ValueRange                        range,
+                                const TileSize&                         tile_size)
+    {
+        assert(tile_size.width > 0 && tile_size.height > 0);
+        assert(src.width == dst.width && src.height == dst.height);
+
+        const internal::TileGrid grid(src.width, src.height, tile_size);
+
+        pool.parallelFor(grid.getNumTiles(), [&](const int i)
+        {
+            const internal::TileTimer timer(pool.getCurrentThreadIndex());
+            const internal::Tile      tile = grid.getTile(i);
+
+            enhance_image<T>(src.getSubView(tile.x, tile.y, tile.width, tile.height),
+                             dst.getSubView(tile.x, tile.y, tile.width, tile.height),
+                             parameters,
+                             accuracy,
+                             range);
+        });
+    }
+} // namespace enhancer
+
+#endif /* enhancer_parallel_hpp */
@@ -0,0 +1,294 @@
+#ifndef enhancer_pipeline_hpp
+#define enhancer_pipeline_hpp
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/image.hpp>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // The pipeline of the configured parameter set "compiled" for a specific parameter vector. Stages whose decoded
+    // parameters are within `tolerance` of their neutral values are skipped, and the gamma conversions between the
+    // remaining stages are merged: a chain such as the input linearization, the brightness curve, and the gamma
+    // encoding at the beginning of the contrast stage becomes a single pow with the product of the exponents, and a
+    // pow whose exponent is one disappears. With only one or two sliders moved, most of the pow calls of
+    // internal::enhance are removed, and with all the parameters at 0.5 the pipeline reduces to a clamp.
+    //
+    // The result matches internal::enhance up to floating-point rounding, except where internal::enhance itself
+    // deviates from the identity in a neutral stage: the neutral temperature/tint stage is a YUV round trip whose
+    // matrix leaks up to 1.5e-5 of a channel into the others, and the neutral HSV round trip of the saturation stage
+    // rounds through single precision. Both matter only for channels very close to zero, where the final 1/2.2
+    // gamma amplifies them (up to a few 8-bit levels); the compiled pipeline keeps such channels at their values.
+    class CompiledPipeline
+    {
+    public:
+        explicit CompiledPipeline(const Eigen::VectorXd& parameters, const double tolerance = 1e-6);
+
+        Eigen::Vector3d operator()(const Eigen::Vector3d& input_rgb) const;
+
+        // Same buffer conventions as enhance_image
+        void apply(const std::uint8_t*  src,
+                   std::uint8_t*        dst,
+                   const int            width,
+                   const int            height,
+                   const std::ptrdiff_t stride,
+                   const int            channels) const;
+
+        void apply(const float*         src,
+                   float*               dst,
+                   const int            width,
+                   const int            height,
+                   const std::ptrdiff_t stride,
+                   const int            channels) const;
+
+        // Bit flags (see enhancer::stage) of the stages that were not skipped
+        unsigned getActiveStages() const { return m_active_stages; }
+
+        // The number of per-channel pow evaluations per pixel (internal::enhance uses 15)
+        int getNumPowCalls() const;
+
+    private:
+        enum class OperationType
+        {
+            Pow,
+            TemperatureTint,
+            LiftGain,
+            Contrast,
+            Saturation,
+            Clamp,
+        };
+
+        struct Operation
+        {
+            OperationType   type;
+            Eigen::Vector3d exponent; // For Pow
+        };
+
+        std::vector<Operation> m_operations;
+        unsigned               m_active_stages;
+
+        // The first operation is a pow with the same exponent for all the channels, which the 8-bit path tabulates
+        bool   m_has_input_exponent;
+        double m_input_exponent;
+
+        Eigen::Matrix3d m_temperature_tint_matrix;
+        Eigen::Vector3d m_temperature_tint_offset;
+        Eigen::Vector3d m_lift_scale;
+        Eigen::Vector3d m_gain;
+        double          m_contrast_coef;
+        double          m_saturation;
+
+        Eigen::Vector3d run(Eigen::Vector3d rgb, const std::size_t first_operation) const;
+    };
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline CompiledPipeline::CompiledPipeline(const Eigen::VectorXd& parameters, const double tolerance) :
+    m_active_stages(0),
+    m_has_input_exponent(false),
+    m_input_exponent(1.0)
+    {
+        constexpr double gamma = 2.2;
+        constexpr double pi_4  = 3.14159265358979 * 0.25;
+
+        const internal::DecodedParameters decoded = internal::decodeParameters(parameters);
+
+        // The actual (linear) value of each channel is v^k, where v is the value held by the pipeline and k is the
+        // pending exponent; the pow is evaluated only when a stage needs the actual value
+        Eigen::Vector3d pending_exponent = Eigen::Vector3d::Constant(gamma);
+
+        const auto flush = [&]()
+        {
+            if ((pending_exponent - Eigen::Vector3d::Ones()).cwiseAbs().maxCoeff() > 1e-12)
+            {
+                m_operations.push_back(Operation{ OperationType::Pow, pending_exponent });
+            }
+            pending_exponent = Eigen::Vector3d::Ones();
+        };
+
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+        const bool is_lift_gamma_gain_active = (decoded.lift - Eigen::Vector3d::Ones()).cwiseAbs().maxCoeff() > tolerance ||
+                                               (decoded.gamma - Eigen::Vector3d::Ones()).cwiseAbs().maxCoeff() > tolerance ||
+                                               (decoded.gain - Eigen::Vector3d::Ones()).cwiseAbs().maxCoeff() > tolerance;
+        if (is_lift_gamma_gain_active)
+        {
+            flush();
+            m_lift_scale = Eigen::Vector3d::Constant(2.0) - decoded.lift;
+            m_gain       = decoded.gain;
+            m_operations.push_back(Operation{ OperationType::LiftGain, Eigen::Vector3d::Ones() });
+            pending_exponent = decoded.gamma.cwiseInverse();
+            m_active_stages |= stage::lift_gamma_gain;
+        }
+#else
+        if (std::abs(decoded.temperature) > tolerance || std::abs(decoded.tint) > tolerance)
+        {
+            constexpr double scale = 0.10;
+
+            flush();
+            for (int col = 0; col < 3; ++col)
+            {
+                m_temperature_tint_matrix.col(col) = internal::yuv2rgb(internal::rgb2yuv(Eigen::Vector3d::Unit(col)));
+            }
+            m_temperature_tint_offset = internal::yuv2rgb(decoded.temperature * scale * Eigen::Vector3d(0.0, -1.0, 1.0) + decoded.tint * scale * Eigen::Vector3d(0.0, 1.0, 1.0));
+            m_operations.push_back(Operation{ OperationType::TemperatureTint, Eigen::Vector3d::Ones() });
+            m_active_stages |= stage::temperature_tint;
+        }
+#endif
+
+        if (std::abs(decoded.brightness) > tolerance)
+        {
+            pending_exponent /= 1.0 + 1.5 * decoded.brightness;
+            m_active_stages |= stage::brightness;
+        }
+
+        m_contrast_coef = std::tan((decoded.contrast + 1.0) * pi_4);
+        if (std::abs(m_contrast_coef - 1.0) > tolerance)
+        {
+            // The contrast curve is applied to gamma-encoded values
+            pending_exponent /= gamma;
+            flush();
+            m_operations.push_back(Operation{ OperationType::Contrast, Eigen::Vector3d::Ones() });
+            pending_exponent = Eigen::Vector3d::Constant(gamma);
+            m_active_stages |= stage::contrast;
+        }
+
+        m_saturation = decoded.saturation;
+        if (std::abs(decoded.saturation) > tolerance)
+        {
+            flush();
+            m_operations.push_back(Operation{ OperationType::Saturation, Eigen::Vector3d::Ones() });
+            m_active_stages |= stage::saturation;
+        }
+
+        pending_exponent /= gamma;
+        flush();
+        m_operations.push_back(Operation{ OperationType::Clamp, Eigen::Vector3d::Ones() });
+
+        const Operation& first = m_operations.front();
+        if (first.type == OperationType::Pow && first.exponent.maxCoeff() == first.exponent.minCoeff())
+        {
+            m_has_input_exponent = true;
+            m_input_exponent     = first.exponent(0);
+        }
+    }
+
+    inline int CompiledPipeline::getNumPowCalls() const
+    {
+        int count = 0;
+        for (const Operation& operation : m_operations)
+        {
+            if (operation.type == OperationType::Pow) { count += 3; }
+        }
+        return count;
+    }
+
+    inline Eigen::Vector3d CompiledPipeline::run(Eigen::Vector3d rgb, const std::size_t first_operation) const
+    {
+        for (std::size_t i = first_operation; i < m_operations.size(); ++i)
+        {
+            const Operation& operation = m_operations[i];
+            switch (operation.type)
+            {
+                case OperationType::Pow:
+                    rgb = rgb.array().pow(operation.exponent.array()).matrix();
+                    break;
+                case OperationType::TemperatureTint:
+                    rgb = internal::clamp(m_temperature_tint_matrix * rgb + m_temperature_tint_offset);
+                    break;
+                case OperationType::LiftGain:
+                    rgb = (((rgb.array() - 1.0) * m_lift_scale.array() + 1.0).max(0.0) * m_gain.array()).matrix();
+                    break;
+                case OperationType::Contrast:
+                    rgb = (m_contrast_coef * (rgb.array() - 0.5) + 0.5).max(0.0).matrix();
+                    break;
+                case OperationType::Saturation:
+                    rgb = internal::applySaturationEffect(rgb, m_saturation);
+                    break;
+                case OperationType::Clamp:
+                    rgb = internal::clamp(rgb);
+                    break;
+            }
+        }
+        return rgb;
+    }
+
+    inline Eigen::Vector3d CompiledPipeline::operator()(const Eigen::Vector3d& input_rgb) const
+    {
+        return run(input_rgb, 0);
+    }
+
+    inline void CompiledPipeline::apply(const std::uint8_t*  src,
+                                        std::uint8_t*        dst,
+                                        const int            width,
+                                        const int            height,
+                                        const std::ptrdiff_t stride,
+                                        const int            channels) const
+    {
+        assert(channels == 3 || channels == 4);
+
+        // When the pipeline starts with a uniform pow, it is evaluated for the 256 possible values only once
+        const std::size_t       first_operation = m_has_input_exponent ? 1 : 0;
+        std::array<double, 256> input_table;
+        for (int i = 0; i < 256; ++i)
+        {
+            input_table[i] = std::pow(static_cast<double>(i) / 255.0, m_has_input_exponent ? m_input_exponent : 1.0);
+        }
+
+        for (int y = 0; y < height; ++y)
+        {
+            const std::uint8_t* src_row = internal::getRow(src, stride, y);
+            std::uint8_t*       dst_row = internal::getRow(dst, stride, y);
+
+            for (int x = 0; x < width; ++x)
+            {
+                const std::uint8_t*   src_pixel = src_row + x * channels;
+                std::uint8_t*         dst_pixel = dst_row + x * channels;
+                const Eigen::Vector3d rgb       = run(Eigen::Vector3d(input_table[src_pixel[0]], input_table[src_pixel[1]], input_table[src_pixel[2]]), first_operation);
+
+                if (channels == 4) { dst_pixel[3] = src_pixel[3]; }
+                dst_pixel[0] = internal::quantize8(rgb(0));
+                dst_pixel[1] = internal::quantize8(rgb(1));
+                dst_pixel[2] = internal::quantize8(rgb(2));
+            }
+        }
+    }
+
+    inline void CompiledPipeline::apply(const float*         src,
+                                        float*               dst,
+                                        const int            width,
+                                        const int            height,
+                                        const std::ptrdiff_t stride,
+                                        const int            channels) const
+    {
+        assert(channels == 3 || channels == 4);
+
+        for (int y = 0; y < height; ++y)
+        {
+            const float* src_row = internal::getRow(src, stride, y);
+            float*       dst_row = internal::getRow(dst, stride, y);
+
+            for (int x = 0; x < width; ++x)
+            {
+                const float*          src_pixel = src_row + x * channels;
+                float*                dst_pixel = dst_row + x * channels;
+                const Eigen::Vector3d rgb       = run(Eigen::Vector3d(src_pixel[0], src_pixel[1], src_pixel[2]), 0);
+
+                if (channels == 4) { dst_pixel[3] = src_pixel[3]; }
+                dst_pixel[0] = static_cast<float>(rgb(0));
+                dst_pixel[1] = static_cast<float>(rgb(1));
+                dst_pixel[2] = static_cast<float>(rgb(2));
+            }
+        }
+    }
+} // namespace enhancer
+
+#endif /* enhancer_pipeline_hpp */
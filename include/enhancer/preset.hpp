@@ -0,0 +1,364 @@
+#ifndef enhancer_preset_hpp
+#define enhancer_preset_hpp
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <enhancer/enhancer.hpp>
+#include <enhancer/lut.hpp>
+#include <enhancer/mappedfile.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // The meaning of a parameter vector, which otherwise depends on whether ENHANCER_WITH_LIFT_GAMMA_GAIN was defined
+    // when the vector was made
+    enum class ParameterSetKind : std::uint32_t
+    {
+        Default        = 0, // DefaultParams
+        LiftGammaGain  = 1, // LiftGammaGainParams
+        ColorBalanceV1 = 2, // ColorBalanceV1
+    };
+
+    // The pipeline a parameter vector is meant for: V1 is the original procedure on gamma-encoded values (enhance_v1
+    // in the code and ENHANCER_V_1_0 in the shader), and V2 the current one in linear RGB (enhance)
+    enum class PipelineVersion : std::uint32_t
+    {
+        V1 = 1,
+        V2 = 2,
+    };
+
+    constexpr PipelineVersion CURRENT_PIPELINE_VERSION = PipelineVersion::V2;
+
+    // The parameter set of this build
+    constexpr ParameterSetKind get_configured_parameter_set_kind();
+
+    constexpr int get_num_parameters(const ParameterSetKind kind);
+
+    // A parameter vector with its metadata and, optionally, a baked 3D LUT
+    struct Preset
+    {
+        std::string      name;
+        ParameterSetKind parameter_set    = get_configured_parameter_set_kind();
+        PipelineVersion  pipeline_version = CURRENT_PIPELINE_VERSION;
+        Eigen::VectorXd  parameters;
+
+        std::shared_ptr<const Lut3D> lut;
+
+        // Whether this build can evaluate the parameters: V1 presets always, V2 presets if their parameter set is
+        // the configured one
+        bool isApplicable() const;
+
+        // Dispatches to enhance or enhance_v1 according to the pipeline version; the preset has to be applicable
+        Eigen::Vector3d enhance(const Eigen::Vector3d& input_rgb) const;
+    };
+
+    // A preset of the configured parameter set and the current pipeline; `lut_size` > 0 bakes a Lut3D of that size
+    inline Preset make_preset(const std::string& name, const Eigen::VectorXd& parameters, const int lut_size = 0);
+
+    // Writes `preset` in the binary preset format (see MappedPreset). The file is written under a temporary name and
+    // renamed, so that readers never map a partial file. Returns false (after printing the reason) on failure.
+    inline bool save_preset(const std::string& path, const Preset& preset);
+
+    // Reads a preset file into `preset`. The parameters are copied, while the LUT stays in the mapped file.
+    inline bool load_preset(const std::string& path, Preset& preset);
+
+    // The header of a preset file (format version 1). The parameters (doubles), the name (UTF-8, not terminated), and
+    // the LUT (floats, red index fastest) follow at the given offsets, aligned for their types and in the byte order
+    // of the writer; the file is only read where it is mapped.
+    struct PresetFileHeader
+    {
+        char          magic[8];
+        std::uint32_t format_version;
+        std::uint32_t byte_order; // byte_order_mark as written by the writer
+        std::uint32_t parameter_set;
+        std::uint32_t pipeline_version;
+        std::uint32_t num_parameters;
+        std::uint32_t lut_size; // 0 if there is no LUT
+        std::uint32_t name_size;
+        std::uint32_t reserved;
+        std::uint64_t parameters_offset;
+        std::uint64_t name_offset;
+        std::uint64_t lut_offset;
+        std::uint64_t file_size;
+
+        static constexpr char          format_magic[8]        = { 'E', 'N', 'H', 'P', 'R', 'S', 'T', '\0' };
+        static constexpr std::uint32_t current_format_version = 1;
+        static constexpr std::uint32_t byte_order_mark        = 0x01020304;
+    };
+
+    static_assert(sizeof(PresetFileHeader) == 72, "The preset file header must have no padding");
+
+    // A preset file mapped into memory. Opening it maps the file and validates the header, so loading many presets
+    // costs no parsing and no LUT computation, and the pages of a LUT are only read when it is applied.
+    class MappedPreset
+    {
+    public:
+        MappedPreset() = default;
+
+        // Returns false (after printing the reason) if the file cannot be mapped or is not a valid preset file of
+        // this format version and byte order
+        bool open(const std::string& path);
+
+        bool isValid() const { return m_header != nullptr; }
+
+        ParameterSetKind getParameterSetKind() const { return static_cast<ParameterSetKind>(m_header->parameter_set); }
+        PipelineVersion  getPipelineVersion() const { return static_cast<PipelineVersion>(m_header->pipeline_version); }
+        std::string_view getName() const;
+
+        Eigen::Map<const Eigen::VectorXd> getParameters() const;
+
+        bool hasLut() const { return m_header->lut_size != 0; }
+        int  getLutSize() const { return static_cast<int>(m_header->lut_size); }
+
+        // A lattice on the mapped values, which keeps the mapping alive; the preset has to have a LUT
+        Lut3D getLut() const;
+
+        Preset toPreset() const;
+
+    private:
+        std::shared_ptr<const MappedRegion> m_mapping;
+
+        const PresetFileHeader* m_header = nullptr;
+    };
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    constexpr ParameterSetKind get_configured_parameter_set_kind()
+    {
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+        return ParameterSetKind::LiftGammaGain;
+#else
+        return ParameterSetKind::Default;
+#endif
+    }
+
+    constexpr int get_num_parameters(const ParameterSetKind kind)
+    {
+        switch (kind)
+        {
+            case ParameterSetKind::Default: return DefaultParams::num_parameters;
+            case ParameterSetKind::LiftGammaGain: return LiftGammaGainParams::num_parameters;
+            case ParameterSetKind::ColorBalanceV1: return ColorBalanceV1::num_parameters;
+        }
+        return 0;
+    }
+
+    namespace internal
+    {
+        // Returns the reason why the description is inconsistent, or nullptr
+        inline const char* validatePresetDescription(const std::uint32_t parameter_set,
+                                                     const std::uint32_t pipeline_version,
+                                                     const std::uint64_t num_parameters)
+        {
+            if (parameter_set > static_cast<std::uint32_t>(ParameterSetKind::ColorBalanceV1)) { return "Unknown parameter set."; }
+            if (pipeline_version != static_cast<std::uint32_t>(PipelineVersion::V1) &&
+                pipeline_version != static_cast<std::uint32_t>(PipelineVersion::V2))
+            {
+                return "Unknown pipeline version.";
+            }
+
+            const bool is_v1 = static_cast<PipelineVersion>(pipeline_version) == PipelineVersion::V1;
+            if (is_v1 != (static_cast<ParameterSetKind>(parameter_set) == ParameterSetKind::ColorBalanceV1))
+            {
+                return "The parameter set does not match the pipeline version.";
+            }
+            if (num_parameters != static_cast<std::uint64_t>(get_num_parameters(static_cast<ParameterSetKind>(parameter_set))))
+            {
+                return "The number of parameters does not match the parameter set.";
+            }
+            return nullptr;
+        }
+
+        inline std::uint64_t alignOffset(const std::uint64_t offset, const std::uint64_t alignment)
+        {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+    } // namespace internal
+
+    inline bool Preset::isApplicable() const
+    {
+        return pipeline_version == PipelineVersion::V1 ? parameter_set == ParameterSetKind::ColorBalanceV1
+                                                       : parameter_set == get_configured_parameter_set_kind();
+    }
+
+    inline Eigen::Vector3d Preset::enhance(const Eigen::Vector3d& input_rgb) const
+    {
+        assert(isApplicable());
+
+        return pipeline_version == PipelineVersion::V1 ? internal::enhance_v1(input_rgb, parameters) : enhancer::enhance(input_rgb, parameters);
+    }
+
+    inline Preset make_preset(const std::string& name, const Eigen::VectorXd& parameters, const int lut_size)
+    {
+        assert(parameters.size() == NUM_PARAMETERS);
+
+        Preset preset;
+        preset.name       = name;
+        preset.parameters = parameters;
+        if (lut_size > 0) { preset.lut = std::make_shared<const Lut3D>(parameters, lut_size); }
+        return preset;
+    }
+
+    inline bool save_preset(const std::string& path, const Preset& preset)
+    {
+        const char* invalid_reason = internal::validatePresetDescription(static_cast<std::uint32_t>(preset.parameter_set),
+                                                                         static_cast<std::uint32_t>(preset.pipeline_version),
+                                                                         static_cast<std::uint64_t>(preset.parameters.size()));
+        if (invalid_reason != nullptr)
+        {
+            std::cerr << "Error: " << invalid_reason << std::endl;
+            return false;
+        }
+
+        const int           lut_size   = preset.lut != nullptr ? preset.lut->getSize() : 0;
+        const std::uint64_t lut_values = 3 * static_cast<std::uint64_t>(lut_size) * lut_size * lut_size;
+
+        // The LUT starts on a cache line, which the mapping (aligned to a page) preserves
+        PresetFileHeader header = {};
+        std::memcpy(header.magic, PresetFileHeader::format_magic, sizeof(header.magic));
+        header.format_version    = PresetFileHeader::current_format_version;
+        header.byte_order        = PresetFileHeader::byte_order_mark;
+        header.parameter_set     = static_cast<std::uint32_t>(preset.parameter_set);
+        header.pipeline_version  = static_cast<std::uint32_t>(preset.pipeline_version);
+        header.num_parameters    = static_cast<std::uint32_t>(preset.parameters.size());
+        header.lut_size          = static_cast<std::uint32_t>(lut_size);
+        header.name_size         = static_cast<std::uint32_t>(preset.name.size());
+        header.parameters_offset = sizeof(PresetFileHeader);
+        header.name_offset       = header.parameters_offset + sizeof(double) * header.num_parameters;
+        header.lut_offset        = internal::alignOffset(header.name_offset + header.name_size, 64);
+        header.file_size         = header.lut_offset + sizeof(float) * lut_values;
+
+        std::vector<char> buffer(header.file_size, '\0');
+        std::memcpy(buffer.data(), &header, sizeof(header));
+        std::memcpy(buffer.data() + header.parameters_offset, preset.parameters.data(), sizeof(double) * header.num_parameters);
+        std::memcpy(buffer.data() + header.name_offset, preset.name.data(), header.name_size);
+        if (lut_size > 0) { std::memcpy(buffer.data() + header.lut_offset, preset.lut->getData(), sizeof(float) * lut_values); }
+
+        const std::string temp_path = path + ".tmp";
+        {
+            std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+            stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            if (!stream)
+            {
+                std::cerr << "Error: Failed to write \"" << temp_path << "\"." << std::endl;
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        if (error)
+        {
+            std::cerr << "Error: Failed to rename \"" << temp_path << "\" to \"" << path << "\": " << error.message() << std::endl;
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+        return true;
+    }
+
+    inline bool load_preset(const std::string& path, Preset& preset)
+    {
+        MappedPreset mapped_preset;
+        if (!mapped_preset.open(path)) { return false; }
+
+        preset = mapped_preset.toPreset();
+        return true;
+    }
+
+    inline bool MappedPreset::open(const std::string& path)
+    {
+        m_mapping.reset();
+        m_header = nullptr;
+
+        MappedFile file;
+        if (!file.open(path)) { return false; }
+
+        auto mapping = std::make_shared<const MappedRegion>(file.map(0, static_cast<std::size_t>(file.getSize())));
+        if (!mapping->isValid()) { return false; }
+
+        const auto report = [&](const char* message)
+        {
+            std::cerr << "Error: " << path << ": " << message << std::endl;
+            return false;
+        };
+
+        if (mapping->getSize() < sizeof(PresetFileHeader)) { return report("Not a preset file."); }
+
+        const PresetFileHeader* header = reinterpret_cast<const PresetFileHeader*>(mapping->getData());
+        if (std::memcmp(header->magic, PresetFileHeader::format_magic, sizeof(header->magic)) != 0) { return report("Not a preset file."); }
+        if (header->format_version != PresetFileHeader::current_format_version) { return report("Unsupported format version."); }
+        if (header->byte_order != PresetFileHeader::byte_order_mark) { return report("Written with another byte order."); }
+
+        const char* invalid_reason = internal::validatePresetDescription(header->parameter_set, header->pipeline_version, header->num_parameters);
+        if (invalid_reason != nullptr) { return report(invalid_reason); }
+
+        // The sections have to be aligned for their types and to fit in the file. The offsets come from the file, so
+        // they are compared with the remaining size instead of being added to the section sizes, which could wrap.
+        const std::uint64_t lut_values        = 3 * static_cast<std::uint64_t>(header->lut_size) * header->lut_size * header->lut_size;
+        const bool          is_lut_size_valid = header->lut_size == 0 || (header->lut_size >= 2 && header->lut_size <= 256);
+        const auto          fits              = [&](const std::uint64_t offset, const std::uint64_t size)
+        {
+            return offset <= header->file_size && size <= header->file_size - offset;
+        };
+        if (header->file_size != mapping->getSize() || !is_lut_size_valid ||
+            header->parameters_offset % alignof(double) != 0 || header->lut_offset % alignof(float) != 0 ||
+            !fits(header->parameters_offset, sizeof(double) * header->num_parameters) ||
+            !fits(header->name_offset, header->name_size) ||
+            !fits(header->lut_offset, sizeof(float) * lut_values))
+        {
+            return report("Corrupted or truncated file.");
+        }
+
+        m_mapping = std::move(mapping);
+        m_header  = header;
+        return true;
+    }
+
+    inline std::string_view MappedPreset::getName() const
+    {
+        return std::string_view(reinterpret_cast<const char*>(m_mapping->getData() + m_header->name_offset), m_header->name_size);
+    }
+
+    inline Eigen::Map<const Eigen::VectorXd> MappedPreset::getParameters() const
+    {
+        return Eigen::Map<const Eigen::VectorXd>(reinterpret_cast<const double*>(m_mapping->getData() + m_header->parameters_offset), m_header->num_parameters);
+    }
+
+    inline Lut3D MappedPreset::getLut() const
+    {
+        assert(hasLut());
+
+        const float* data = reinterpret_cast<const float*>(m_mapping->getData() + m_header->lut_offset);
+        return Lut3D(getParameters(), getLutSize(), data, m_mapping);
+    }
+
+    inline Preset MappedPreset::toPreset() const
+    {
+        assert(isValid());
+
+        Preset preset;
+        preset.name             = std::string(getName());
+        preset.parameter_set    = getParameterSetKind();
+        preset.pipeline_version = getPipelineVersion();
+        preset.parameters       = getParameters();
+        if (hasLut()) { preset.lut = std::make_shared<const Lut3D>(getLut()); }
+        return preset;
+    }
+} // namespace enhancer
+
+#endif /* enhancer_preset_hpp */
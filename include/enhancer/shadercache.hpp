@@ -0,0 +1,33 @@
+#ifndef enhancer_shadercache_hpp
+#define enhancer_shadercache_hpp
+
+#include <string>
+
+namespace enhancer
+{
+    // The shader programs of EnhancerWidget and OffscreenEnhancer are built once per variant (the ENHANCER_* defines
+    // of the accuracy mode, the parameter set, the pipeline version, and the vertex mapping) and per OpenGL context
+    // share group, and are shared by all the widgets and enhancers using the same variant there. Their shaders are
+    // added as cacheable (QOpenGLShaderProgram::addCacheableShaderFromSourceCode, Qt 5.9 or later), so Qt stores the
+    // linked binaries in its shader disk cache and the following launches skip compiling on drivers supporting
+    // program binaries. Qt keys the entries by the sources and the driver; the cache can be disabled with the
+    // Qt::AA_DisableShaderDiskCache application attribute.
+
+    // Counters since the start of the process (or the last reset)
+    struct ShaderCacheStatistics
+    {
+        // Programs handed out, and those of them that were already built in the same share group
+        int num_requests = 0;
+        int num_shared   = 0;
+
+        // Programs built, either compiled from source or linked from Qt's disk cache, and the wall-clock time spent
+        // in that; the latter tells which one happened
+        int    num_built          = 0;
+        double build_milliseconds = 0.0;
+    };
+
+    ShaderCacheStatistics get_shader_cache_statistics();
+    void                  reset_shader_cache_statistics();
+} // namespace enhancer
+
+#endif /* enhancer_shadercache_hpp */
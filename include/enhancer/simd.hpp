@@ -0,0 +1,458 @@
+#ifndef enhancer_simd_hpp
+#define enhancer_simd_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <enhancer/image.hpp>
+#include <type_traits>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ENHANCER_SIMD_X86
+#endif
+
+// The vector helpers are always inlined into the target-specific kernels. GCC still warns (-Wpsabi) that returning
+// their AVX vectors would change the ABI in translation units built without AVX; the warning does not apply, and
+// projects building with -Werror can pass -Wno-psabi as the targets of this repository do.
+#if defined(__GNUC__) || defined(__clang__)
+#define ENHANCER_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define ENHANCER_SIMD_INLINE inline
+#endif
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    enum class SimdLevel
+    {
+        Scalar,
+        Avx2,
+        Avx512,
+    };
+
+    // The best level supported by the running CPU (detected once)
+    inline SimdLevel detectSimdLevel();
+
+    // Single-precision variants of enhance_image. The pixels are processed as structure-of-arrays blocks by a
+    // kernel that is vectorized for AVX2 (8 lanes) and AVX-512 (16 lanes) and dispatched at runtime; the same kernel
+    // is also compiled as a plain scalar fallback. Transcendental functions are replaced with polynomial
+    // approximations (see internal::simd::fastLog2 and internal::simd::fastExp2), and the HSV round trip in the
+    // saturation stage is replaced with an equivalent branchless formulation. Measured over 2M random colors and
+    // parameter vectors, the maximum absolute difference from the double-precision enhance() is below 1e-3 (2.5e-4
+    // for output values above 0.01, where the final 1/2.2 gamma does not amplify float rounding), i.e., well below
+    // the 8-bit quantization step. Input values are clamped to [0, 1]. A `level` above detectSimdLevel() is lowered
+    // to it.
+    inline void enhance_image_simd(const float*           src,
+                                   float*                 dst,
+                                   const int              width,
+                                   const int              height,
+                                   const std::ptrdiff_t   stride,
+                                   const int              channels,
+                                   const Eigen::VectorXd& parameters,
+                                   const SimdLevel        level = detectSimdLevel());
+
+    inline void enhance_image_simd(const std::uint8_t*    src,
+                                   std::uint8_t*          dst,
+                                   const int              width,
+                                   const int              height,
+                                   const std::ptrdiff_t   stride,
+                                   const int              channels,
+                                   const Eigen::VectorXd& parameters,
+                                   const SimdLevel        level = detectSimdLevel());
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    namespace internal
+    {
+        namespace simd
+        {
+#if defined(ENHANCER_SIMD_X86)
+            typedef float        vfloat8 __attribute__((vector_size(32)));
+            typedef std::int32_t vint8 __attribute__((vector_size(32)));
+            typedef float        vfloat16 __attribute__((vector_size(64)));
+            typedef std::int32_t vint16 __attribute__((vector_size(64)));
+#endif
+
+            template <typename V> struct VectorTraits;
+            template <> struct VectorTraits<float> { typedef std::int32_t Int; };
+#if defined(ENHANCER_SIMD_X86)
+            template <> struct VectorTraits<vfloat8> { typedef vint8 Int; };
+            template <> struct VectorTraits<vfloat16> { typedef vint16 Int; };
+#endif
+
+            template <typename V> using IntOf = typename VectorTraits<V>::Int;
+
+            template <typename V> constexpr int getNumLanes() { return sizeof(V) / sizeof(float); }
+
+            template <typename V> ENHANCER_SIMD_INLINE V splat(const float x) { return V{} + x; }
+
+            template <typename V> ENHANCER_SIMD_INLINE IntOf<V> asInt(const V& x)
+            {
+                if constexpr (std::is_same<V, float>::value)
+                {
+                    std::int32_t i;
+                    std::memcpy(&i, &x, sizeof(float));
+                    return i;
+                }
+                else
+                {
+                    return (IntOf<V>) x;
+                }
+            }
+
+            template <typename V> ENHANCER_SIMD_INLINE V asFloat(const IntOf<V>& i)
+            {
+                if constexpr (std::is_same<V, float>::value)
+                {
+                    float x;
+                    std::memcpy(&x, &i, sizeof(float));
+                    return x;
+                }
+                else
+                {
+                    return (V) i;
+                }
+            }
+
+            template <typename V> ENHANCER_SIMD_INLINE IntOf<V> truncate(const V& x)
+            {
+                if constexpr (std::is_same<V, float>::value) { return static_cast<std::int32_t>(x); }
+                else { return __builtin_convertvector(x, IntOf<V>); }
+            }
+
+            template <typename V> ENHANCER_SIMD_INLINE V toFloat(const IntOf<V>& i)
+            {
+                if constexpr (std::is_same<V, float>::value) { return static_cast<float>(i); }
+                else { return __builtin_convertvector(i, V); }
+            }
+
+            // Lane-wise `condition ? a : b` where `condition` is the result of a comparison between two V values
+            template <typename V, typename M> ENHANCER_SIMD_INLINE V select(const M& condition, const V& a, const V& b)
+            {
+                if constexpr (std::is_same<V, float>::value) { return condition ? a : b; }
+                else { return asFloat<V>((condition & asInt(a)) | (~condition & asInt(b))); }
+            }
+
+            template <typename V> ENHANCER_SIMD_INLINE V min(const V& a, const V& b) { return select<V>(a < b, a, b); }
+            template <typename V> ENHANCER_SIMD_INLINE V max(const V& a, const V& b) { return select<V>(a > b, a, b); }
+            template <typename V> ENHANCER_SIMD_INLINE V clamp(const V& x) { return min(max(x, splat<V>(0.0f)), splat<V>(1.0f)); }
+
+            // log2(x) for x > 0 with absolute error below 1.4e-6 (excluding denormals): the exponent is extracted
+            // from the bit pattern and log2(1 + t), t in [0, 1), is approximated by t * P(t) with a degree-6 fit
+            template <typename V> ENHANCER_SIMD_INLINE V fastLog2(const V& x)
+            {
+                const IntOf<V> bits     = asInt(x);
+                const V        exponent = toFloat<V>(((bits >> 23) & 0xff) - 127);
+                const V        t        = asFloat<V>((bits & 0x007fffff) | 0x3f800000) - 1.0f;
+
+                V p = splat<V>(+0.0204903481f);
+                p   = p * t - 0.096066256f;
+                p   = p * t + 0.215588541f;
+                p   = p * t - 0.339247778f;
+                p   = p * t + 0.477705932f;
+                p   = p * t - 0.721162734f;
+                p   = p * t + 1.44269326f;
+
+                return exponent + p * t;
+            }
+
+            // 2^x with relative error below 1e-7 for x in [-126, 128): 2^floor(x) is composed in the exponent bits
+            // and 2^f, f in [0, 1), is approximated by a degree-5 fit; inputs below -126 are flushed toward zero
+            template <typename V> ENHANCER_SIMD_INLINE V fastExp2(const V& input)
+            {
+                const V x = min(max(input, splat<V>(-126.0f)), splat<V>(127.99f));
+
+                const V        truncated = toFloat<V>(truncate(x));
+                const V        floored   = select<V>(truncated > x, truncated - 1.0f, truncated);
+                const V        f         = x - floored;
+                const IntOf<V> exponent  = truncate(floored);
+
+                V p = splat<V>(0.00187623295f);
+                p   = p * f + 0.00899258403f;
+                p   = p * f + 0.0558236045f;
+                p   = p * f + 0.24015453f;
+                p   = p * f + 0.693152968f;
+                p   = p * f + 0.999999927f;
+
+                return asFloat<V>(asInt(p) + (exponent << 23));
+            }
+
+            // x^y for x >= 0 and y > 0; the relative error is about 1e-6 * y for the exponents used in the pipeline
+            template <typename V> ENHANCER_SIMD_INLINE V fastPow(const V& x, const float y)
+            {
+                return select<V>(x > 0.0f, fastExp2(fastLog2(x) * y), splat<V>(0.0f));
+            }
+
+            // Per-image constants derived from DecodedParameters
+            struct KernelCoefficients
+            {
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+                float lift_scale[3];
+                float gain[3];
+                float gamma_exponent[3];
+#else
+                float temperature_tint_matrix[9]; // Row-major yuv2rgb * rgb2yuv
+                float temperature_tint_offset[3];
+#endif
+                float brightness_exponent;
+                float contrast_coef;
+                float saturation_scale;
+            };
+
+            inline KernelCoefficients computeKernelCoefficients(const DecodedParameters& parameters)
+            {
+                KernelCoefficients coefficients;
+
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+                for (int c = 0; c < 3; ++c)
+                {
+                    coefficients.lift_scale[c]     = static_cast<float>(2.0 - parameters.lift(c));
+                    coefficients.gain[c]           = static_cast<float>(parameters.gain(c));
+                    coefficients.gamma_exponent[c] = static_cast<float>(1.0 / parameters.gamma(c));
+                }
+#else
+                // The temperature/tint effect is affine in linear RGB, so the YUV round trip collapses into a 3x3
+                // matrix and an offset
+                constexpr double scale = 0.10;
+
+                const Eigen::Vector3d zero = Eigen::Vector3d::Zero();
+                const Eigen::Vector3d yuv_offset = parameters.temperature * scale * Eigen::Vector3d(0.0, -1.0, 1.0) + parameters.tint * scale * Eigen::Vector3d(0.0, 1.0, 1.0);
+                const Eigen::Vector3d offset = yuv2rgb(rgb2yuv(zero) + yuv_offset);
+
+                for (int col = 0; col < 3; ++col)
+                {
+                    const Eigen::Vector3d column = yuv2rgb(rgb2yuv(Eigen::Vector3d::Unit(col)));
+                    for (int row = 0; row < 3; ++row)
+                    {
+                        coefficients.temperature_tint_matrix[3 * row + col] = static_cast<float>(column(row));
+                    }
+                }
+                for (int c = 0; c < 3; ++c)
+                {
+                    coefficients.temperature_tint_offset[c] = static_cast<float>(offset(c));
+                }
+#endif
+
+                constexpr double pi_4 = 3.14159265358979 * 0.25;
+
+                coefficients.brightness_exponent = static_cast<float>(1.0 / (1.0 + 1.5 * parameters.brightness));
+                coefficients.contrast_coef       = static_cast<float>(std::tan((parameters.contrast + 1.0) * pi_4));
+                coefficients.saturation_scale    = static_cast<float>(parameters.saturation + 1.0);
+
+                return coefficients;
+            }
+
+            // The whole pipeline for one vector of pixels. Compared with internal::enhance, the brightness pow and
+            // the gamma encoding at the beginning of the contrast stage are fused into a single pow, and the
+            // saturation stage uses the identity that, for a fixed hue and value, every channel of hsv2rgb is
+            // v * (1 - s * w) with w = (v - c) / (v - min) depending only on the hue, so the hue itself never has to
+            // be computed.
+            template <typename V> ENHANCER_SIMD_INLINE void enhancePixels(V& r, V& g, V& b, const KernelCoefficients& k)
+            {
+                constexpr float gamma = 2.2f;
+
+                V rgb[3] = { clamp(r), clamp(g), clamp(b) };
+
+                for (int c = 0; c < 3; ++c) { rgb[c] = fastPow(rgb[c], gamma); }
+
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+                for (int c = 0; c < 3; ++c)
+                {
+                    const V lifted = max((rgb[c] - 1.0f) * k.lift_scale[c] + 1.0f, splat<V>(0.0f));
+                    rgb[c]         = fastPow(lifted * k.gain[c], k.gamma_exponent[c] * k.brightness_exponent / gamma);
+                }
+#else
+                const V yuv_rgb[3] = { rgb[0], rgb[1], rgb[2] };
+                for (int c = 0; c < 3; ++c)
+                {
+                    const float* m = k.temperature_tint_matrix + 3 * c;
+                    const V linear = m[0] * yuv_rgb[0] + m[1] * yuv_rgb[1] + m[2] * yuv_rgb[2] + k.temperature_tint_offset[c];
+                    rgb[c]         = fastPow(clamp(linear), k.brightness_exponent / gamma);
+                }
+#endif
+
+                for (int c = 0; c < 3; ++c)
+                {
+                    rgb[c] = clamp(fastPow(max(k.contrast_coef * (rgb[c] - 0.5f) + 0.5f, splat<V>(0.0f)), gamma));
+                }
+
+                const V M     = max(rgb[0], max(rgb[1], rgb[2]));
+                const V m     = min(rgb[0], min(rgb[1], rgb[2]));
+                const V s     = min(k.saturation_scale * (M - m) / max(M, splat<V>(1e-30f)), splat<V>(1.0f));
+                const V range = max(M - m, splat<V>(1e-30f));
+
+                r = clamp(fastPow(M * (1.0f - s * ((M - rgb[0]) / range)), 1.0f / gamma));
+                g = clamp(fastPow(M * (1.0f - s * ((M - rgb[1]) / range)), 1.0f / gamma));
+                b = clamp(fastPow(M * (1.0f - s * ((M - rgb[2]) / range)), 1.0f / gamma));
+            }
+
+            // In-place enhancement of structure-of-arrays planes
+            template <typename V>
+            ENHANCER_SIMD_INLINE void enhancePlanes(float* r, float* g, float* b, const std::size_t count, const KernelCoefficients& k)
+            {
+                constexpr std::size_t num_lanes = getNumLanes<V>();
+
+                std::size_t i = 0;
+                for (; i + num_lanes <= count; i += num_lanes)
+                {
+                    V r_lanes, g_lanes, b_lanes;
+                    std::memcpy(&r_lanes, r + i, sizeof(V));
+                    std::memcpy(&g_lanes, g + i, sizeof(V));
+                    std::memcpy(&b_lanes, b + i, sizeof(V));
+
+                    enhancePixels(r_lanes, g_lanes, b_lanes, k);
+
+                    std::memcpy(r + i, &r_lanes, sizeof(V));
+                    std::memcpy(g + i, &g_lanes, sizeof(V));
+                    std::memcpy(b + i, &b_lanes, sizeof(V));
+                }
+                for (; i < count; ++i)
+                {
+                    enhancePixels(r[i], g[i], b[i], k);
+                }
+            }
+
+            inline void enhancePlanesScalar(float* r, float* g, float* b, const std::size_t count, const KernelCoefficients& k)
+            {
+                enhancePlanes<float>(r, g, b, count, k);
+            }
+
+#if defined(ENHANCER_SIMD_X86)
+            __attribute__((target("avx2,fma"))) inline void
+            enhancePlanesAvx2(float* r, float* g, float* b, const std::size_t count, const KernelCoefficients& k)
+            {
+                enhancePlanes<vfloat8>(r, g, b, count, k);
+            }
+
+            __attribute__((target("avx512f,fma"))) inline void
+            enhancePlanesAvx512(float* r, float* g, float* b, const std::size_t count, const KernelCoefficients& k)
+            {
+                enhancePlanes<vfloat16>(r, g, b, count, k);
+            }
+#endif
+
+            typedef void (*PlanesKernel)(float*, float*, float*, std::size_t, const KernelCoefficients&);
+
+            inline PlanesKernel getPlanesKernel(const SimdLevel level)
+            {
+                // Instructions that the CPU does not have would raise SIGILL, so the level is capped to the detected one
+                switch (std::min(level, detectSimdLevel()))
+                {
+#if defined(ENHANCER_SIMD_X86)
+                    case SimdLevel::Avx512: return enhancePlanesAvx512;
+                    case SimdLevel::Avx2:   return enhancePlanesAvx2;
+#endif
+                    default:                return enhancePlanesScalar;
+                }
+            }
+
+            // Number of pixels that are de-interleaved into the stack-allocated planes at a time
+            constexpr int block_size = 256;
+
+            template <typename T, typename Load, typename Store>
+            inline void enhanceImage(const T*               src,
+                                     T*                     dst,
+                                     const int              width,
+                                     const int              height,
+                                     const std::ptrdiff_t   stride,
+                                     const int              channels,
+                                     const Eigen::VectorXd& parameters,
+                                     const SimdLevel        level,
+                                     Load                   load,
+                                     Store                  store)
+            {
+                assert(channels == 3 || channels == 4);
+
+                const KernelCoefficients coefficients = computeKernelCoefficients(decodeParameters(parameters));
+                const PlanesKernel       kernel       = getPlanesKernel(level);
+
+                alignas(64) float r[block_size];
+                alignas(64) float g[block_size];
+                alignas(64) float b[block_size];
+
+                for (int y = 0; y < height; ++y)
+                {
+                    const T* src_row = getRow(src, stride, y);
+                    T*       dst_row = getRow(dst, stride, y);
+
+                    for (int x_begin = 0; x_begin < width; x_begin += block_size)
+                    {
+                        const int count = std::min(block_size, width - x_begin);
+
+                        for (int i = 0; i < count; ++i)
+                        {
+                            const T* src_pixel = src_row + (x_begin + i) * channels;
+                            r[i] = load(src_pixel[0]);
+                            g[i] = load(src_pixel[1]);
+                            b[i] = load(src_pixel[2]);
+                        }
+
+                        kernel(r, g, b, count, coefficients);
+
+                        for (int i = 0; i < count; ++i)
+                        {
+                            const T* src_pixel = src_row + (x_begin + i) * channels;
+                            T*       dst_pixel = dst_row + (x_begin + i) * channels;
+                            if (channels == 4) { dst_pixel[3] = src_pixel[3]; }
+                            dst_pixel[0] = store(r[i]);
+                            dst_pixel[1] = store(g[i]);
+                            dst_pixel[2] = store(b[i]);
+                        }
+                    }
+                }
+            }
+        } // namespace simd
+    } // namespace internal
+
+    inline SimdLevel detectSimdLevel()
+    {
+#if defined(ENHANCER_SIMD_X86)
+        static const SimdLevel level = []()
+        {
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma")) { return SimdLevel::Avx512; }
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) { return SimdLevel::Avx2; }
+            return SimdLevel::Scalar;
+        }();
+        return level;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    inline void enhance_image_simd(const float*           src,
+                                   float*                 dst,
+                                   const int              width,
+                                   const int              height,
+                                   const std::ptrdiff_t   stride,
+                                   const int              channels,
+                                   const Eigen::VectorXd& parameters,
+                                   const SimdLevel        level)
+    {
+        internal::simd::enhanceImage(src, dst, width, height, stride, channels, parameters, level,
+                                     [](const float value) { return value; },
+                                     [](const float value) { return value; });
+    }
+
+    inline void enhance_image_simd(const std::uint8_t*    src,
+                                   std::uint8_t*          dst,
+                                   const int              width,
+                                   const int              height,
+                                   const std::ptrdiff_t   stride,
+                                   const int              channels,
+                                   const Eigen::VectorXd& parameters,
+                                   const SimdLevel        level)
+    {
+        internal::simd::enhanceImage(src, dst, width, height, stride, channels, parameters, level,
+                                     [](const std::uint8_t value) { return static_cast<float>(value) * (1.0f / 255.0f); },
+                                     [](const float value) { return static_cast<std::uint8_t>(value * 255.0f + 0.5f); });
+    }
+} // namespace enhancer
+
+#endif /* enhancer_simd_hpp */
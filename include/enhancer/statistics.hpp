@@ -0,0 +1,342 @@
+#ifndef enhancer_statistics_hpp
+#define enhancer_statistics_hpp
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <enhancer/image.hpp>
+#include <enhancer/parallel.hpp>
+#include <enhancer/threadpool.hpp>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // Histograms and sums of the color channels and of the luminance (Rec. 709 weights on the encoded values) of an
+    // enhanced image, e.g., for auto-exposure and quality checks. The statistics are of the values as written to the
+    // output, i.e., after quantization for the integral types.
+    struct ImageStatistics
+    {
+        static constexpr int num_bins = 256;
+
+        typedef std::array<std::uint64_t, num_bins> Histogram;
+
+        // Bin i counts the values in [i / num_bins, (i + 1) / num_bins); values below 0 are counted in the first bin
+        // and values of 1 and above (e.g., scene-referred outputs) in the last one
+        Histogram red_histogram{};
+        Histogram green_histogram{};
+        Histogram blue_histogram{};
+        Histogram luminance_histogram{};
+
+        std::uint64_t   num_pixels    = 0;
+        Eigen::Vector3d rgb_sum       = Eigen::Vector3d::Zero();
+        double          luminance_sum = 0.0;
+
+        void merge(const ImageStatistics& other);
+
+        Eigen::Vector3d getMeanRgb() const { return num_pixels > 0 ? Eigen::Vector3d(rgb_sum / num_pixels) : Eigen::Vector3d::Zero(); }
+        double          getMeanLuminance() const { return num_pixels > 0 ? luminance_sum / num_pixels : 0.0; }
+
+        // The value below which `fraction` (in [0, 1]) of the pixels fall, interpolated linearly within the bin
+        double        getLuminancePercentile(const double fraction) const { return getPercentile(luminance_histogram, fraction); }
+        static double getPercentile(const Histogram& histogram, const double fraction);
+    };
+
+    // Enhances `src` into `dst` as the view-based enhance_image does and adds the statistics of `dst` to `statistics`.
+    // Each row is accumulated right after it is written, while it is still in the cache, instead of in a second pass
+    // over the output. Statistics are added, so several images can be accumulated into one.
+    template <typename T>
+    void enhance_image_with_statistics(const typename ImageView<T>::ConstView& src,
+                                       const ImageView<T>&                     dst,
+                                       const Eigen::VectorXd&                  parameters,
+                                       ImageStatistics&                        statistics,
+                                       const Accuracy                          accuracy = Accuracy::Exact,
+                                       const ValueRange                        range    = ValueRange::Display);
+
+    // Adds the statistics of the image that enhance_image would write (as RGB of type `T`) to `statistics` without
+    // writing any pixel; each row is enhanced into a scratch row that stays in the L1 cache
+    template <typename T>
+    void compute_enhanced_statistics(const typename ImageView<T>::ConstView& src,
+                                     const Eigen::VectorXd&                  parameters,
+                                     ImageStatistics&                        statistics,
+                                     const Accuracy                          accuracy = Accuracy::Exact,
+                                     const ValueRange                        range    = ValueRange::Display);
+
+    // Adds the statistics of an existing image (e.g., a GPU readback) to `statistics`
+    template <typename T> void compute_image_statistics(const ImageView<const T>& image, ImageStatistics& statistics);
+
+    // Parallel versions; each thread of `pool` accumulates its tiles into its own statistics, which are merged at
+    // the end
+    template <typename T>
+    void enhance_image_parallel_with_statistics(ThreadPool&                             pool,
+                                                const typename ImageView<T>::ConstView& src,
+                                                const ImageView<T>&                     dst,
+                                                const Eigen::VectorXd&                  parameters,
+                                                ImageStatistics&                        statistics,
+                                                const Accuracy                          accuracy  = Accuracy::Exact,
+                                                const ValueRange                        range     = ValueRange::Display,
+                                                const TileSize&                         tile_size = TileSize());
+
+    template <typename T>
+    void compute_enhanced_statistics_parallel(ThreadPool&                             pool,
+                                              const typename ImageView<T>::ConstView& src,
+                                              const Eigen::VectorXd&                  parameters,
+                                              ImageStatistics&                        statistics,
+                                              const Accuracy                          accuracy  = Accuracy::Exact,
+                                              const ValueRange                        range     = ValueRange::Display,
+                                              const TileSize&                         tile_size = TileSize());
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline void ImageStatistics::merge(const ImageStatistics& other)
+    {
+        for (int i = 0; i < num_bins; ++i)
+        {
+            red_histogram[i] += other.red_histogram[i];
+            green_histogram[i] += other.green_histogram[i];
+            blue_histogram[i] += other.blue_histogram[i];
+            luminance_histogram[i] += other.luminance_histogram[i];
+        }
+
+        num_pixels += other.num_pixels;
+        rgb_sum += other.rgb_sum;
+        luminance_sum += other.luminance_sum;
+    }
+
+    inline double ImageStatistics::getPercentile(const Histogram& histogram, const double fraction)
+    {
+        std::uint64_t count = 0;
+        for (const std::uint64_t bin_count : histogram) { count += bin_count; }
+
+        if (count == 0) { return 0.0; }
+
+        const double target = std::max(0.0, std::min(fraction, 1.0)) * static_cast<double>(count);
+
+        std::uint64_t cumulative_count = 0;
+        for (int i = 0; i < num_bins; ++i)
+        {
+            const std::uint64_t next_count = cumulative_count + histogram[i];
+            if (histogram[i] > 0 && static_cast<double>(next_count) >= target)
+            {
+                const double position = (target - static_cast<double>(cumulative_count)) / static_cast<double>(histogram[i]);
+                return (static_cast<double>(i) + std::max(0.0, position)) / num_bins;
+            }
+            cumulative_count = next_count;
+        }
+
+        return 1.0;
+    }
+
+    namespace internal
+    {
+        inline int getHistogramBin(const double value)
+        {
+            if (!(value > 0.0)) { return 0; }
+            return value < 1.0 ? static_cast<int>(value * ImageStatistics::num_bins) : ImageStatistics::num_bins - 1;
+        }
+
+        // Adds the pixels of a row of `width` pixels in `order` to `statistics`
+        template <typename T>
+        inline void accumulateStatistics(const T* row, const ChannelOrder order, const int width, ImageStatistics& statistics)
+        {
+            typedef ChannelTraits<T> Traits;
+
+            const int            channels = getNumChannels(order);
+            const ChannelIndices indices  = getChannelIndices(order);
+
+            double r_sum         = 0.0;
+            double g_sum         = 0.0;
+            double b_sum         = 0.0;
+            double luminance_sum = 0.0;
+
+            for (int x = 0; x < width; ++x)
+            {
+                const T*     pixel     = row + x * channels;
+                const double r         = Traits::toDouble(pixel[indices.r]);
+                const double g         = Traits::toDouble(pixel[indices.g]);
+                const double b         = Traits::toDouble(pixel[indices.b]);
+                const double luminance = 0.2126 * r + 0.7152 * g + 0.0722 * b;
+
+                ++statistics.red_histogram[getHistogramBin(r)];
+                ++statistics.green_histogram[getHistogramBin(g)];
+                ++statistics.blue_histogram[getHistogramBin(b)];
+                ++statistics.luminance_histogram[getHistogramBin(luminance)];
+
+                r_sum += r;
+                g_sum += g;
+                b_sum += b;
+                luminance_sum += luminance;
+            }
+
+            statistics.num_pixels += static_cast<std::uint64_t>(width);
+            statistics.rgb_sum += Eigen::Vector3d(r_sum, g_sum, b_sum);
+            statistics.luminance_sum += luminance_sum;
+        }
+
+        // Without `dst`, the rows are enhanced into a scratch row in RGB order
+        template <Accuracy A, ValueRange R, typename T>
+        inline void enhanceRowsWithStatistics(const ImageView<const T>& src,
+                                              const ImageView<T>*       dst,
+                                              const DecodedParameters&  decoded,
+                                              ImageStatistics&          statistics)
+        {
+            const ChannelOrder         out_order = dst != nullptr ? dst->order : ChannelOrder::RGB;
+            const RowEnhancer<A, R, T> row_enhancer(src.order, out_order, decoded);
+
+            std::vector<T> scratch_row(dst != nullptr ? 0 : static_cast<std::size_t>(src.width) * 3);
+
+            for (int y = 0; y < src.height; ++y)
+            {
+                T* out_row = dst != nullptr ? dst->getRow(y) : scratch_row.data();
+
+                row_enhancer(src.getRow(y), out_row, src.width);
+                accumulateStatistics(static_cast<const T*>(out_row), out_order, src.width, statistics);
+            }
+        }
+
+        template <ValueRange R, typename T>
+        inline void enhanceRowsWithStatistics(const ImageView<const T>& src,
+                                              const ImageView<T>*       dst,
+                                              const DecodedParameters&  decoded,
+                                              ImageStatistics&          statistics,
+                                              const Accuracy            accuracy)
+        {
+            switch (accuracy)
+            {
+                case Accuracy::Fast: enhanceRowsWithStatistics<Accuracy::Fast, R>(src, dst, decoded, statistics); break;
+                case Accuracy::Fastest: enhanceRowsWithStatistics<Accuracy::Fastest, R>(src, dst, decoded, statistics); break;
+                default: enhanceRowsWithStatistics<Accuracy::Exact, R>(src, dst, decoded, statistics); break;
+            }
+        }
+
+        template <typename T>
+        inline void enhanceRowsWithStatistics(const ImageView<const T>& src,
+                                              const ImageView<T>*       dst,
+                                              const DecodedParameters&  decoded,
+                                              ImageStatistics&          statistics,
+                                              const Accuracy            accuracy,
+                                              const ValueRange          range)
+        {
+            assert(dst == nullptr || (src.width == dst->width && src.height == dst->height));
+
+            // As in enhance_image, integral outputs are always display-referred
+            if (range == ValueRange::SceneReferred && !std::is_integral<T>::value)
+            {
+                enhanceRowsWithStatistics<ValueRange::SceneReferred>(src, dst, decoded, statistics, accuracy);
+            }
+            else
+            {
+                enhanceRowsWithStatistics<ValueRange::Display>(src, dst, decoded, statistics, accuracy);
+            }
+        }
+
+        template <typename T>
+        inline void enhanceTilesWithStatistics(ThreadPool&               pool,
+                                               const ImageView<const T>& src,
+                                               const ImageView<T>*       dst,
+                                               const Eigen::VectorXd&    parameters,
+                                               ImageStatistics&          statistics,
+                                               const Accuracy            accuracy,
+                                               const ValueRange          range,
+                                               const TileSize&           tile_size)
+        {
+            assert(tile_size.width > 0 && tile_size.height > 0);
+
+            struct ThreadStatistics
+            {
+                std::mutex      mutex;
+                ImageStatistics statistics;
+            };
+
+            const DecodedParameters decoded = decodeParameters(parameters);
+
+            const TileGrid grid(src.width, src.height, tile_size);
+
+            // Allocated separately so that the histograms of different threads do not share cache lines
+            std::vector<std::unique_ptr<ThreadStatistics>> thread_statistics;
+            for (int i = 0; i < pool.getNumThreads(); ++i) { thread_statistics.push_back(std::make_unique<ThreadStatistics>()); }
+
+            pool.parallelFor(grid.getNumTiles(), [&](const int i)
+            {
+                const Tile               tile     = grid.getTile(i);
+                const ImageView<const T> src_tile = src.getSubView(tile.x, tile.y, tile.width, tile.height);
+                ThreadStatistics&        local    = *thread_statistics[pool.getCurrentThreadIndex()];
+
+                std::lock_guard<std::mutex> lock(local.mutex);
+
+                if (dst != nullptr)
+                {
+                    const ImageView<T> dst_tile = dst->getSubView(tile.x, tile.y, tile.width, tile.height);
+                    enhanceRowsWithStatistics(src_tile, &dst_tile, decoded, local.statistics, accuracy, range);
+                }
+                else
+                {
+                    enhanceRowsWithStatistics<T>(src_tile, nullptr, decoded, local.statistics, accuracy, range);
+                }
+            });
+
+            for (const std::unique_ptr<ThreadStatistics>& local : thread_statistics) { statistics.merge(local->statistics); }
+        }
+    } // namespace internal
+
+    template <typename T>
+    void enhance_image_with_statistics(const typename ImageView<T>::ConstView& src,
+                                       const ImageView<T>&                     dst,
+                                       const Eigen::VectorXd&                  parameters,
+                                       ImageStatistics&                        statistics,
+                                       const Accuracy                          accuracy,
+                                       const ValueRange                        range)
+    {
+        internal::enhanceRowsWithStatistics(src, &dst, internal::decodeParameters(parameters), statistics, accuracy, range);
+    }
+
+    template <typename T>
+    void compute_enhanced_statistics(const typename ImageView<T>::ConstView& src,
+                                     const Eigen::VectorXd&                  parameters,
+                                     ImageStatistics&                        statistics,
+                                     const Accuracy                          accuracy,
+                                     const ValueRange                        range)
+    {
+        internal::enhanceRowsWithStatistics<T>(src, nullptr, internal::decodeParameters(parameters), statistics, accuracy, range);
+    }
+
+    template <typename T> void compute_image_statistics(const ImageView<const T>& image, ImageStatistics& statistics)
+    {
+        for (int y = 0; y < image.height; ++y) { internal::accumulateStatistics(image.getRow(y), image.order, image.width, statistics); }
+    }
+
+    template <typename T>
+    void enhance_image_parallel_with_statistics(ThreadPool&                             pool,
+                                                const typename ImageView<T>::ConstView& src,
+                                                const ImageView<T>&                     dst,
+                                                const Eigen::VectorXd&                  parameters,
+                                                ImageStatistics&                        statistics,
+                                                const Accuracy                          accuracy,
+                                                const ValueRange                        range,
+                                                const TileSize&                         tile_size)
+    {
+        internal::enhanceTilesWithStatistics(pool, src, &dst, parameters, statistics, accuracy, range, tile_size);
+    }
+
+    template <typename T>
+    void compute_enhanced_statistics_parallel(ThreadPool&                             pool,
+                                              const typename ImageView<T>::ConstView& src,
+                                              const Eigen::VectorXd&                  parameters,
+                                              ImageStatistics&                        statistics,
+                                              const Accuracy                          accuracy,
+                                              const ValueRange                        range,
+                                              const TileSize&                         tile_size)
+    {
+        internal::enhanceTilesWithStatistics<T>(pool, src, nullptr, parameters, statistics, accuracy, range, tile_size);
+    }
+} // namespace enhancer
+
+#endif /* enhancer_statistics_hpp */
@@ -0,0 +1,326 @@
+#ifndef enhancer_stream_hpp
+#define enhancer_stream_hpp
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <enhancer/parallel.hpp>
+#include <exception>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // One preallocated buffer of the frame ring. Rows are tightly packed (stride = width * channels * sizeof(T)).
+    template <typename T> struct Frame
+    {
+        std::vector<T> data;
+        int            width;
+        int            height;
+        int            channels;
+        std::ptrdiff_t stride;
+
+        // Set by the pipeline before the frame is handed to the source
+        int index;
+
+        // The interpolated parameters the frame is enhanced with
+        Eigen::VectorXd parameters;
+    };
+
+    // Parameter vectors at some frame indices, linearly interpolated in between and held constant before the first
+    // and after the last keyframe
+    class ParameterKeyframes
+    {
+    public:
+        ParameterKeyframes() = default;
+        explicit ParameterKeyframes(const Eigen::VectorXd& parameters) { setKeyframe(0, parameters); }
+
+        void setKeyframe(const int frame_index, const Eigen::VectorXd& parameters) { m_keyframes[frame_index] = parameters; }
+
+        bool empty() const { return m_keyframes.empty(); }
+
+        Eigen::VectorXd evaluate(const int frame_index) const;
+
+        // Writes the result into `parameters`, which keeps its storage when it already has the right size
+        void evaluate(const int frame_index, Eigen::VectorXd& parameters) const;
+
+    private:
+        std::map<int, Eigen::VectorXd> m_keyframes;
+    };
+
+    struct StreamStats
+    {
+        int num_frames = 0;
+
+        double seconds           = 0.0;
+        double frames_per_second = 0.0;
+
+        // Time spent inside each stage; the largest one is the bottleneck
+        double source_seconds  = 0.0;
+        double enhance_seconds = 0.0;
+        double sink_seconds    = 0.0;
+
+        // The size of the frame ring, which is the whole frame memory of the pipeline
+        std::size_t buffer_bytes = 0;
+    };
+
+    // Streams a sequence of frames of a fixed size through source (decode) -> enhance -> sink (encode). The three
+    // stages run concurrently on their own threads and exchange frames of a ring of `num_buffers` preallocated
+    // buffers: the source blocks when all the buffers are in flight (backpressure), so the memory use does not depend
+    // on the length of the sequence. Frames are enhanced in place, tile-parallel on `pool`, and reach the sink in
+    // order.
+    template <typename T> class FramePipeline
+    {
+    public:
+        FramePipeline(ThreadPool& pool, const int width, const int height, const int channels, const int num_buffers = 4);
+
+        // `source(Frame<T>& frame)` fills frame.data for frame.index and returns false when the sequence has ended;
+        // `sink(const Frame<T>& frame)` consumes the enhanced frame; `kernel` has the signature of enhance_image.
+        // Exceptions thrown by the source, the sink, or the kernel stop the pipeline and are rethrown here.
+        template <typename Source, typename Sink, typename Kernel = internal::EnhanceImageKernel>
+        StreamStats run(Source source, Sink sink, const ParameterKeyframes& keyframes, Kernel kernel = Kernel());
+
+        std::size_t getBufferBytes() const;
+
+    private:
+        ThreadPool&           m_pool;
+        std::vector<Frame<T>> m_frames;
+    };
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline Eigen::VectorXd ParameterKeyframes::evaluate(const int frame_index) const
+    {
+        Eigen::VectorXd parameters;
+        evaluate(frame_index, parameters);
+        return parameters;
+    }
+
+    inline void ParameterKeyframes::evaluate(const int frame_index, Eigen::VectorXd& parameters) const
+    {
+        assert(!m_keyframes.empty());
+
+        const auto next = m_keyframes.lower_bound(frame_index);
+        if (next == m_keyframes.end())
+        {
+            parameters = std::prev(next)->second;
+        }
+        else if (next->first == frame_index || next == m_keyframes.begin())
+        {
+            parameters = next->second;
+        }
+        else
+        {
+            const auto   prev = std::prev(next);
+            const double t    = static_cast<double>(frame_index - prev->first) / static_cast<double>(next->first - prev->first);
+
+            parameters = (1.0 - t) * prev->second + t * next->second;
+        }
+    }
+
+    namespace internal
+    {
+        // A blocking FIFO of buffer indices; its capacity never needs to exceed the number of buffers
+        class FrameQueue
+        {
+        public:
+            void push(const int index)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_indices.push_back(index);
+                }
+                m_condition.notify_one();
+            }
+
+            // Returns false once the queue is closed and drained
+            bool pop(int& index)
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [&]() { return !m_indices.empty() || m_is_closed; });
+                if (m_indices.empty()) { return false; }
+
+                index = m_indices.front();
+                m_indices.pop_front();
+                return true;
+            }
+
+            void close()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_is_closed = true;
+                }
+                m_condition.notify_all();
+            }
+
+        private:
+            std::mutex              m_mutex;
+            std::condition_variable m_condition;
+            std::deque<int>         m_indices;
+            bool                    m_is_closed = false;
+        };
+
+        template <typename Func> inline double measureStageSeconds(Func func)
+        {
+            const auto begin = std::chrono::steady_clock::now();
+            func();
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        }
+    } // namespace internal
+
+    template <typename T>
+    FramePipeline<T>::FramePipeline(ThreadPool& pool, const int width, const int height, const int channels, const int num_buffers) :
+    m_pool(pool)
+    {
+        assert(width > 0 && height > 0 && (channels == 3 || channels == 4) && num_buffers > 0);
+
+        m_frames.resize(num_buffers);
+        for (Frame<T>& frame : m_frames)
+        {
+            frame.data.resize(static_cast<std::size_t>(width) * height * channels);
+            frame.width    = width;
+            frame.height   = height;
+            frame.channels = channels;
+            frame.stride   = static_cast<std::ptrdiff_t>(width) * channels * sizeof(T);
+            frame.index    = -1;
+        }
+    }
+
+    template <typename T> std::size_t FramePipeline<T>::getBufferBytes() const
+    {
+        return m_frames.size() * m_frames.front().data.size() * sizeof(T);
+    }
+
+    template <typename T>
+    template <typename Source, typename Sink, typename Kernel>
+    StreamStats FramePipeline<T>::run(Source source, Sink sink, const ParameterKeyframes& keyframes, Kernel kernel)
+    {
+        assert(!keyframes.empty());
+
+        const int num_buffers = static_cast<int>(m_frames.size());
+
+        // Every buffer index is always in exactly one of the queues or owned by one of the stages
+        internal::FrameQueue free_queue;
+        internal::FrameQueue decoded_queue;
+        internal::FrameQueue enhanced_queue;
+        for (int i = 0; i < num_buffers; ++i) { free_queue.push(i); }
+
+        std::mutex         exception_mutex;
+        std::exception_ptr exception;
+
+        const auto stop_with = [&](std::exception_ptr e)
+        {
+            {
+                std::lock_guard<std::mutex> lock(exception_mutex);
+                if (!exception) { exception = e; }
+            }
+            free_queue.close();
+            decoded_queue.close();
+            enhanced_queue.close();
+        };
+
+        StreamStats stats;
+        stats.buffer_bytes = getBufferBytes();
+
+        const auto begin = std::chrono::steady_clock::now();
+
+        std::thread source_thread([&]()
+        {
+            try
+            {
+                int buffer_index;
+                for (int frame_index = 0; free_queue.pop(buffer_index); ++frame_index)
+                {
+                    Frame<T>& frame = m_frames[buffer_index];
+                    frame.index     = frame_index;
+
+                    bool is_decoded = false;
+                    stats.source_seconds += internal::measureStageSeconds([&]() { is_decoded = source(frame); });
+                    if (!is_decoded) { break; }
+
+                    decoded_queue.push(buffer_index);
+                }
+            }
+            catch (...)
+            {
+                stop_with(std::current_exception());
+            }
+            decoded_queue.close();
+        });
+
+        std::thread sink_thread([&]()
+        {
+            try
+            {
+                int buffer_index;
+                while (enhanced_queue.pop(buffer_index))
+                {
+                    stats.sink_seconds += internal::measureStageSeconds([&]() { sink(static_cast<const Frame<T>&>(m_frames[buffer_index])); });
+                    ++stats.num_frames;
+
+                    free_queue.push(buffer_index);
+                }
+            }
+            catch (...)
+            {
+                stop_with(std::current_exception());
+            }
+            free_queue.close();
+        });
+
+        // The enhancement stage runs on the calling thread, which also takes part in the tile-parallel kernel
+        try
+        {
+            int buffer_index;
+            while (decoded_queue.pop(buffer_index))
+            {
+                Frame<T>& frame = m_frames[buffer_index];
+                keyframes.evaluate(frame.index, frame.parameters);
+
+                stats.enhance_seconds += internal::measureStageSeconds([&]()
+                {
+                    processImageTiles(m_pool,
+                                      frame.data.data(),
+                                      frame.data.data(),
+                                      frame.width,
+                                      frame.height,
+                                      frame.stride,
+                                      frame.channels,
+                                      frame.parameters,
+                                      kernel);
+                });
+
+                enhanced_queue.push(buffer_index);
+            }
+        }
+        catch (...)
+        {
+            stop_with(std::current_exception());
+        }
+        enhanced_queue.close();
+
+        source_thread.join();
+        sink_thread.join();
+
+        stats.seconds           = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        stats.frames_per_second = stats.seconds > 0.0 ? stats.num_frames / stats.seconds : 0.0;
+
+        if (exception) { std::rethrow_exception(exception); }
+
+        return stats;
+    }
+} // namespace enhancer
+
+#endif /* enhancer_stream_hpp */
@@ -0,0 +1,311 @@
+#ifndef enhancer_sweep_hpp
+#define enhancer_sweep_hpp
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/enhancer.hpp>
+#include <enhancer/image.hpp>
+#include <enhancer/imageview.hpp>
+#include <enhancer/parallel.hpp>
+#include <enhancer/threadpool.hpp>
+#include <type_traits>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // A grid of `columns` x `rows` cells of `cell_width` x `cell_height` pixels in one buffer, for laying out the
+    // outputs of a sweep side by side (e.g., the candidates of a preference-learning UI). Cell k is at column
+    // k % columns and row k / columns, counted from the top-left corner.
+    struct AtlasLayout
+    {
+        int cell_width;
+        int cell_height;
+        int columns;
+        int rows;
+
+        int getWidth() const { return columns * cell_width; }
+        int getHeight() const { return rows * cell_height; }
+
+        int getCellX(const int index) const { return (index % columns) * cell_width; }
+        int getCellY(const int index) const { return (index / columns) * cell_height; }
+
+        // The view of cell `index` within a view of the whole atlas
+        template <typename T> ImageView<T> getCellView(const ImageView<T>& atlas, const int index) const;
+
+        // The views of the first `num_cells` cells, as taken by enhance_image_sweep
+        template <typename T> std::vector<ImageView<T>> getCellViews(const ImageView<T>& atlas, const int num_cells) const;
+    };
+
+    // The layout of `num_cells` cells; `columns` = 0 chooses a nearly square grid
+    inline AtlasLayout make_atlas_layout(const int cell_width, const int cell_height, const int num_cells, const int columns = 0);
+
+    // Enhances `src` with each of `parameter_sets` at once, writing the k-th result to `dsts[k]` (e.g., the cells of
+    // an AtlasLayout). The output is identical to calling the view-based enhance_image for each parameter vector, but
+    // the parameter-independent work (reading and converting the source channels and the input linearization) is
+    // done once per pixel: each row is linearized into a small buffer that stays in the L1 cache while all the
+    // candidates are evaluated from it. The remaining stages all depend on the parameters (the hue, for example, is
+    // taken after the temperature/tint shift) and are evaluated per candidate. `dsts` must have the size of `src`
+    // and must not overlap it.
+    template <typename T>
+    void enhance_image_sweep(const typename ImageView<T>::ConstView& src,
+                             const std::vector<ImageView<T>>&        dsts,
+                             const std::vector<Eigen::VectorXd>&     parameter_sets,
+                             const Accuracy                          accuracy = Accuracy::Exact,
+                             const ValueRange                        range    = ValueRange::Display);
+
+    // Parallel version of enhance_image_sweep; each tile of `src` is linearized once and enhanced with all the
+    // parameter vectors by the same task
+    template <typename T>
+    void enhance_image_sweep_parallel(ThreadPool&                             pool,
+                                      const typename ImageView<T>::ConstView& src,
+                                      const std::vector<ImageView<T>>&        dsts,
+                                      const std::vector<Eigen::VectorXd>&     parameter_sets,
+                                      const Accuracy                          accuracy  = Accuracy::Exact,
+                                      const ValueRange                        range     = ValueRange::Display,
+                                      const TileSize&                         tile_size = TileSize());
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    template <typename T> ImageView<T> AtlasLayout::getCellView(const ImageView<T>& atlas, const int index) const
+    {
+        assert(atlas.width >= getWidth() && atlas.height >= getHeight());
+        return atlas.getSubView(getCellX(index), getCellY(index), cell_width, cell_height);
+    }
+
+    template <typename T> std::vector<ImageView<T>> AtlasLayout::getCellViews(const ImageView<T>& atlas, const int num_cells) const
+    {
+        assert(num_cells <= columns * rows);
+
+        std::vector<ImageView<T>> views;
+        views.reserve(num_cells);
+        for (int i = 0; i < num_cells; ++i) { views.push_back(getCellView(atlas, i)); }
+        return views;
+    }
+
+    inline AtlasLayout make_atlas_layout(const int cell_width, const int cell_height, const int num_cells, const int columns)
+    {
+        assert(num_cells > 0);
+
+        const int num_columns = columns > 0 ? columns : static_cast<int>(std::ceil(std::sqrt(static_cast<double>(num_cells))));
+        return AtlasLayout{ cell_width, cell_height, num_columns, (num_cells + num_columns - 1) / num_columns };
+    }
+
+    namespace internal
+    {
+        // Converts rows of source pixels to linear RGB with the power functions of the selected accuracy, so that the
+        // values are exactly those the single-image paths compute
+        template <typename T> class SweepLinearizer
+        {
+        public:
+            explicit SweepLinearizer(const Accuracy accuracy) : m_accuracy(accuracy) {}
+
+            void linearizeRow(const T* row, const int width, const int channels, const ChannelIndices& indices, Eigen::Vector3d* linear_row) const
+            {
+                switch (m_accuracy)
+                {
+                    case Accuracy::Fast: linearizeRowWith<math::Fast>(row, width, channels, indices, linear_row); break;
+                    case Accuracy::Fastest: linearizeRowWith<math::Fastest>(row, width, channels, indices, linear_row); break;
+                    default: linearizeRowWith<math::Exact>(row, width, channels, indices, linear_row); break;
+                }
+            }
+
+        private:
+            Accuracy m_accuracy;
+
+            template <typename Math>
+            static void linearizeRowWith(const T* row, const int width, const int channels, const ChannelIndices& indices, Eigen::Vector3d* linear_row)
+            {
+                typedef ChannelTraits<T> Traits;
+
+                for (int x = 0; x < width; ++x, row += channels)
+                {
+                    linear_row[x] = convertRgbToLinearRgb<Math>(Eigen::Vector3d(Traits::toDouble(row[indices.r]), Traits::toDouble(row[indices.g]), Traits::toDouble(row[indices.b])));
+                }
+            }
+        };
+
+        // An 8-bit channel has only 256 possible values, so the linearization is tabulated once per sweep
+        template <> class SweepLinearizer<std::uint8_t>
+        {
+        public:
+            explicit SweepLinearizer(const Accuracy accuracy)
+            {
+                switch (accuracy)
+                {
+                    case Accuracy::Fast: fillTable<math::Fast>(); break;
+                    case Accuracy::Fastest: fillTable<math::Fastest>(); break;
+                    default: fillTable<math::Exact>(); break;
+                }
+            }
+
+            void linearizeRow(const std::uint8_t* row, const int width, const int channels, const ChannelIndices& indices, Eigen::Vector3d* linear_row) const
+            {
+                for (int x = 0; x < width; ++x, row += channels)
+                {
+                    linear_row[x] = Eigen::Vector3d(m_linear_table[row[indices.r]], m_linear_table[row[indices.g]], m_linear_table[row[indices.b]]);
+                }
+            }
+
+        private:
+            std::array<double, 256> m_linear_table;
+
+            template <typename Math> void fillTable()
+            {
+                for (int i = 0; i < 256; ++i)
+                {
+                    m_linear_table[i] = convertRgbToLinearRgb<Math>(Eigen::Vector3d::Constant(static_cast<double>(i) / 255.0))(0);
+                }
+            }
+        };
+
+        // Enhances one linearized row with one parameter vector; the alpha is taken from `src_row` as in enhance_image
+        template <Accuracy A, ValueRange R, typename T>
+        inline void enhanceSweepRow(const Eigen::Vector3d*   linear_row,
+                                    const T*                 src_row,
+                                    const int                src_channels,
+                                    T*                       dst_row,
+                                    const int                dst_channels,
+                                    const ChannelIndices&    dst_indices,
+                                    const int                width,
+                                    const DecodedParameters& decoded)
+        {
+            typedef ChannelTraits<T> Traits;
+
+            for (int x = 0; x < width; ++x, src_row += src_channels, dst_row += dst_channels)
+            {
+                const Eigen::Vector3d rgb = enhanceLinearRgb<A, R>(linear_row[x], decoded);
+
+                if (dst_channels == 4) { dst_row[3] = src_channels == 4 ? src_row[3] : Traits::fromDouble(1.0); }
+                dst_row[dst_indices.r] = Traits::fromDouble(rgb(0));
+                dst_row[dst_indices.g] = Traits::fromDouble(rgb(1));
+                dst_row[dst_indices.b] = Traits::fromDouble(rgb(2));
+            }
+        }
+
+        template <ValueRange R, typename T>
+        inline void enhanceSweepRow(const Eigen::Vector3d*   linear_row,
+                                    const T*                 src_row,
+                                    const int                src_channels,
+                                    T*                       dst_row,
+                                    const int                dst_channels,
+                                    const ChannelIndices&    dst_indices,
+                                    const int                width,
+                                    const DecodedParameters& decoded,
+                                    const Accuracy           accuracy)
+        {
+            switch (accuracy)
+            {
+                case Accuracy::Fast: enhanceSweepRow<Accuracy::Fast, R>(linear_row, src_row, src_channels, dst_row, dst_channels, dst_indices, width, decoded); break;
+                case Accuracy::Fastest: enhanceSweepRow<Accuracy::Fastest, R>(linear_row, src_row, src_channels, dst_row, dst_channels, dst_indices, width, decoded); break;
+                default: enhanceSweepRow<Accuracy::Exact, R>(linear_row, src_row, src_channels, dst_row, dst_channels, dst_indices, width, decoded); break;
+            }
+        }
+
+        // The state shared by the tiles of a sweep: the decoded parameter vectors and the linearizer
+        template <typename T> struct Sweep
+        {
+            const ImageView<const T>&        src;
+            const std::vector<ImageView<T>>& dsts;
+            std::vector<DecodedParameters>   decoded;
+            SweepLinearizer<T>               linearizer;
+            Accuracy                         accuracy;
+            ValueRange                       range;
+
+            Sweep(const ImageView<const T>&           src,
+                  const std::vector<ImageView<T>>&    dsts,
+                  const std::vector<Eigen::VectorXd>& parameter_sets,
+                  const Accuracy                      accuracy,
+                  const ValueRange                    range) :
+            src(src), dsts(dsts), linearizer(accuracy), accuracy(accuracy), range(std::is_integral<T>::value ? ValueRange::Display : range)
+            {
+                assert(dsts.size() == parameter_sets.size());
+
+                decoded.reserve(parameter_sets.size());
+                for (const Eigen::VectorXd& parameters : parameter_sets) { decoded.push_back(decodeParameters(parameters)); }
+            }
+
+            // Processes a tile row by row; `linear_row` is the row buffer of the calling task
+            void processTile(const Tile& tile, std::vector<Eigen::Vector3d>& linear_row) const
+            {
+                const int            src_channels = src.getNumChannels();
+                const ChannelIndices src_indices  = getChannelIndices(src.order);
+
+                linear_row.resize(tile.width);
+
+                for (int y = tile.y; y < tile.y + tile.height; ++y)
+                {
+                    const T* src_row = src.getRow(y) + tile.x * src_channels;
+                    linearizer.linearizeRow(src_row, tile.width, src_channels, src_indices, linear_row.data());
+
+                    for (std::size_t k = 0; k < dsts.size(); ++k)
+                    {
+                        const ImageView<T>&  dst          = dsts[k];
+                        const int            dst_channels = dst.getNumChannels();
+                        const ChannelIndices dst_indices  = getChannelIndices(dst.order);
+                        T*                   dst_row      = dst.getRow(y) + tile.x * dst_channels;
+
+                        if (range == ValueRange::SceneReferred)
+                        {
+                            enhanceSweepRow<ValueRange::SceneReferred>(linear_row.data(), src_row, src_channels, dst_row, dst_channels, dst_indices, tile.width, decoded[k], accuracy);
+                        }
+                        else
+                        {
+                            enhanceSweepRow<ValueRange::Display>(linear_row.data(), src_row, src_channels, dst_row, dst_channels, dst_indices, tile.width, decoded[k], accuracy);
+                        }
+                    }
+                }
+            }
+        };
+    } // namespace internal
+
+    template <typename T>
+    void enhance_image_sweep(const typename ImageView<T>::ConstView& src,
+                             const std::vector<ImageView<T>>&        dsts,
+                             const std::vector<Eigen::VectorXd>&     parameter_sets,
+                             const Accuracy                          accuracy,
+                             const ValueRange                        range)
+    {
+        assert(std::all_of(dsts.begin(), dsts.end(), [&](const ImageView<T>& dst) { return dst.width == src.width && dst.height == src.height; }));
+
+        const internal::Sweep<T> sweep(src, dsts, parameter_sets, accuracy, range);
+
+        std::vector<Eigen::Vector3d> linear_row;
+        sweep.processTile(internal::Tile{ 0, 0, 0, src.width, src.height }, linear_row);
+    }
+
+    template <typename T>
+    void enhance_image_sweep_parallel(ThreadPool&                             pool,
+                                      const typename ImageView<T>::ConstView& src,
+                                      const std::vector<ImageView<T>>&        dsts,
+                                      const std::vector<Eigen::VectorXd>&     parameter_sets,
+                                      const Accuracy                          accuracy,
+                                      const ValueRange                        range,
+                                      const TileSize&                         tile_size)
+    {
+        assert(tile_size.width > 0 && tile_size.height > 0);
+        assert(std::all_of(dsts.begin(), dsts.end(), [&](const ImageView<T>& dst) { return dst.width == src.width && dst.height == src.height; }));
+
+        const internal::Sweep<T> sweep(src, dsts, parameter_sets, accuracy, range);
+
+        const internal::TileGrid grid(src.width, src.height, tile_size);
+
+        pool.parallelFor(grid.getNumTiles(), [&](const int i)
+        {
+            // Kept by each worker across tiles and calls, so that the steady state does not allocate
+            static thread_local std::vector<Eigen::Vector3d> linear_row;
+            sweep.processTile(grid.getTile(i), linear_row);
+        });
+    }
+} // namespace enhancer
+
+#endif /* enhancer_sweep_hpp */
@@ -0,0 +1,288 @@
+#ifndef enhancer_threadpool_hpp
+#define enhancer_threadpool_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace enhancer
+{
+    ///////////////////////////////////////////////////////////
+    // Interface
+    ///////////////////////////////////////////////////////////
+
+    // A persistent pool of worker threads with one task queue per thread. Each thread takes tasks from the back of
+    // its own queue and, when that queue is empty, steals from the front of the others, so uneven tiles do not leave
+    // threads idle. The thread calling parallelFor also executes tasks while waiting, which makes nested calls
+    // (e.g., processing tiles of several images at once) safe; once no task is left to take, it sleeps until its
+    // own tasks have finished. Scheduling does not allocate once the queues have grown to the largest batch, so
+    // repeated calls are free of heap allocations.
+    class ThreadPool
+    {
+    public:
+        // `num_threads` counts the thread calling parallelFor; i.e., num_threads - 1 workers are spawned and a pool
+        // with a single thread runs everything on the calling thread
+        explicit ThreadPool(const int num_threads = getDefaultNumThreads());
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        int getNumThreads() const { return static_cast<int>(m_queues.size()); }
+
+        // The index in [0, getNumThreads()) of the calling thread, for per-thread accumulators. Threads that do not
+        // belong to the pool (e.g., two threads calling parallelFor at the same time) all get 0, so such accumulators
+        // still need a lock, which is however uncontended in the common case.
+        int getCurrentThreadIndex() const { return getCurrentQueueIndex(); }
+
+        // Calls func(i) for every i in [0, count) and returns when all the calls have finished. If a call throws, the
+        // calls that have not started yet are skipped, and the first exception is rethrown once the others are done.
+        template <typename Func> void parallelFor(const int count, const Func& func);
+
+        static int getDefaultNumThreads() { return std::max(1, static_cast<int>(std::thread::hardware_concurrency())); }
+
+    private:
+        // The tasks of one parallelFor, which lives on the stack of its caller until all of them have finished
+        struct Batch
+        {
+            std::atomic<int>   num_remaining_tasks;
+            std::atomic<bool>  is_failed;
+            std::mutex         exception_mutex;
+            std::exception_ptr exception;
+
+            explicit Batch(const int count) : num_remaining_tasks(count), is_failed(false) {}
+        };
+
+        // A call of func(index) for a parallelFor; `func` points to the caller's function object, which outlives the
+        // task because parallelFor waits for all of its tasks
+        struct Task
+        {
+            void (*run)(const void* func, const int index);
+            const void* func;
+            Batch*      batch;
+            int         index;
+        };
+
+        // A ring buffer used as a stack by its owner and as a queue by the thieves; the buffer only grows
+        struct Queue
+        {
+            std::mutex        mutex;
+            std::vector<Task> tasks;
+            std::size_t       first = 0;
+            std::size_t       size  = 0;
+
+            void pushBack(const Task& task);
+            Task popBack();
+            Task popFront();
+        };
+
+        std::vector<std::unique_ptr<Queue>> m_queues;
+        std::vector<std::thread>            m_threads;
+
+        std::mutex              m_mutex;
+        std::condition_variable m_condition;
+        std::atomic<int>        m_num_pending_tasks;
+        bool                    m_stop;
+
+        void push(const int queue_index, const Task& task);
+        bool tryRunTask(const int queue_index);
+        void runWorker(const int queue_index);
+
+        // The queue owned by the current thread; threads that do not belong to this pool use the first queue
+        int getCurrentQueueIndex() const;
+
+        static const ThreadPool*& getCurrentPool()
+        {
+            static thread_local const ThreadPool* pool = nullptr;
+            return pool;
+        }
+
+        static int& getCurrentWorkerIndex()
+        {
+            static thread_local int index = 0;
+            return index;
+        }
+    };
+
+    ///////////////////////////////////////////////////////////
+    // Implementation
+    ///////////////////////////////////////////////////////////
+
+    inline ThreadPool::ThreadPool(const int num_threads) : m_num_pending_tasks(0), m_stop(false)
+    {
+        const int num_queues = std::max(1, num_threads);
+
+        for (int i = 0; i < num_queues; ++i)
+        {
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+        for (int i = 1; i < num_queues; ++i)
+        {
+            m_threads.emplace_back(&ThreadPool::runWorker, this, i);
+        }
+    }
+
+    inline ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+
+        for (std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    inline int ThreadPool::getCurrentQueueIndex() const
+    {
+        return getCurrentPool() == this ? getCurrentWorkerIndex() : 0;
+    }
+
+    inline void ThreadPool::Queue::pushBack(const Task& task)
+    {
+        if (size == tasks.size())
+        {
+            // Unrolls the ring into a buffer of twice the size
+            std::vector<Task> grown(std::max<std::size_t>(16, 2 * tasks.size()));
+            for (std::size_t i = 0; i < size; ++i) { grown[i] = tasks[(first + i) % tasks.size()]; }
+            tasks = std::move(grown);
+            first = 0;
+        }
+        tasks[(first + size) % tasks.size()] = task;
+        ++size;
+    }
+
+    inline ThreadPool::Task ThreadPool::Queue::popBack()
+    {
+        --size;
+        return tasks[(first + size) % tasks.size()];
+    }
+
+    inline ThreadPool::Task ThreadPool::Queue::popFront()
+    {
+        const Task task = tasks[first];
+        first           = (first + 1) % tasks.size();
+        --size;
+        return task;
+    }
+
+    inline void ThreadPool::push(const int queue_index, const Task& task)
+    {
+        Queue& queue = *m_queues[queue_index];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.pushBack(task);
+        }
+        ++m_num_pending_tasks;
+    }
+
+    inline bool ThreadPool::tryRunTask(const int queue_index)
+    {
+        const int num_queues = getNumThreads();
+
+        Task task;
+        bool is_found = false;
+        for (int offset = 0; offset < num_queues && !is_found; ++offset)
+        {
+            Queue& queue = *m_queues[(queue_index + offset) % num_queues];
+
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.size == 0) { continue; }
+
+            // The own queue is used as a stack for locality, and the others are stolen from the opposite end
+            task     = offset == 0 ? queue.popBack() : queue.popFront();
+            is_found = true;
+        }
+
+        if (!is_found) { return false; }
+
+        --m_num_pending_tasks;
+
+        // An exception must neither escape a worker nor leave the batch waiting, so it is kept for the caller
+        Batch& batch = *task.batch;
+        if (!batch.is_failed)
+        {
+            try
+            {
+                task.run(task.func, task.index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(batch.exception_mutex);
+                if (!batch.exception) { batch.exception = std::current_exception(); }
+                batch.is_failed = true;
+            }
+        }
+
+        // The caller of parallelFor may be asleep waiting for the last task of its batch
+        if (--batch.num_remaining_tasks == 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+            }
+            m_condition.notify_all();
+        }
+
+        return true;
+    }
+
+    inline void ThreadPool::runWorker(const int queue_index)
+    {
+        getCurrentPool()        = this;
+        getCurrentWorkerIndex() = queue_index;
+
+        while (true)
+        {
+            if (tryRunTask(queue_index)) { continue; }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [&]() { return m_stop || m_num_pending_tasks > 0; });
+            if (m_stop) { return; }
+        }
+    }
+
+    template <typename Func> void ThreadPool::parallelFor(const int count, const Func& func)
+    {
+        if (count <= 0) { return; }
+
+        const int num_queues = getNumThreads();
+        const int own_index  = getCurrentQueueIndex();
+
+        Batch batch(count);
+
+        const auto run = [](const void* func, const int index) { (*static_cast<const Func*>(func))(index); };
+
+        // Tasks are dealt round-robin so that every thread starts from its own queue without stealing
+        for (int i = 0; i < count; ++i)
+        {
+            push((own_index + i) % num_queues, Task{ run, &func, &batch, i });
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+        }
+        m_condition.notify_all();
+
+        // Helps with any queued task (including those of other batches, which nested calls may be waiting for) and
+        // sleeps when there is none, until the last task of this batch wakes it up
+        while (batch.num_remaining_tasks > 0)
+        {
+            if (tryRunTask(own_index)) { continue; }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [&]() { return batch.num_remaining_tasks == 0 || m_num_pending_tasks > 0; });
+        }
+
+        if (batch.exception) { std::rethrow_exception(batch.exception); }
+    }
+} // namespace enhancer
+
+#endif /* enhancer_threadpool_hpp */
@@ -4,14 +4,100 @@ smooth in vec2 vertex_uv;
 out vec4 frag_color;
 uniform sampler2D texture_sampler;
 
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+#define NUM_PARAMETERS 12
+#else
+#define NUM_PARAMETERS 5
+#endif
+
 #if defined(ENHANCER_V_1_0)
 uniform float parameters[6];
-#elif defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
-uniform float parameters[12];
 #else
-uniform float parameters[5];
+uniform float parameters[NUM_PARAMETERS];
 #endif
 
+#if defined(ENHANCER_WITH_LOCAL_ADJUSTMENTS)
+// Up to four local adjustments (see enhancer/local.hpp), blended into the parameters of each fragment. Positions are
+// normalized with the origin at the top-left corner of the image; the rows of the source texture are top-down, so the
+// image row of a fragment is local_origin.y + gl_FragCoord.y.
+#define MAX_LOCAL_ADJUSTMENTS 4
+
+uniform int   num_local_adjustments;
+uniform int   local_shapes[MAX_LOCAL_ADJUSTMENTS];   // 0: mask, 1: linear gradient, 2: radial gradient, 3: grid
+uniform vec4  local_geometry[MAX_LOCAL_ADJUSTMENTS]; // start (xy) and end (zw), or center (xy) and radii (zw)
+uniform float local_feather[MAX_LOCAL_ADJUSTMENTS];
+uniform float local_offsets[MAX_LOCAL_ADJUSTMENTS * NUM_PARAMETERS]; // opacity * (adjustment parameters - parameters)
+
+uniform vec2 local_origin;     // the pixel position of the tile in the image
+uniform vec2 local_image_size; // the size of the image in pixels
+
+uniform sampler2D local_mask_sampler; // channel k is the mask of adjustment k, one texel per pixel of the tile
+uniform sampler3D local_grid_sampler; // channel k is the guidance grid of adjustment k
+
+// Same as computeFalloff in enhancer/local.hpp
+float computeFalloff(const float inner, const float outer, const float distance)
+{
+    if (distance <= inner) return 1.0;
+    if (distance >= outer) return 0.0;
+
+    float t = (distance - inner) / (outer - inner);
+    return 1.0 - t * t * (3.0 - 2.0 * t);
+}
+
+float computeLocalWeight(const int k, const vec2 position, const vec3 color)
+{
+    vec4 geometry = local_geometry[k];
+
+    if (local_shapes[k] == 0)
+    {
+        return texelFetch(local_mask_sampler, ivec2(gl_FragCoord.xy), 0)[k];
+    }
+    else if (local_shapes[k] == 1)
+    {
+        vec2 direction = geometry.zw - geometry.xy;
+        return 1.0 - clamp(dot(position - geometry.xy, direction) / dot(direction, direction), 0.0, 1.0);
+    }
+    else if (local_shapes[k] == 2)
+    {
+        return computeFalloff(1.0 - local_feather[k], 1.0, length((position - geometry.xy) / geometry.zw));
+    }
+    return texture(local_grid_sampler, vec3(position, dot(color, vec3(0.2126, 0.7152, 0.0722))))[k];
+}
+#endif
+
+// ENHANCER_ACCURACY_FASTEST replaces the gamma curves with the mantissa polynomials of Accuracy::Fastest (see
+// enhancer.hpp), which saves the log2 of each pow. Other pow calls are left as is in every mode since GPUs evaluate
+// them as exp2(y * log2(x)) in hardware already; hence ENHANCER_ACCURACY_FAST has no effect on the shader.
+#if defined(ENHANCER_ACCURACY_FASTEST)
+// x^p as (1 + f)^p * 2^(e * p) for x = (1 + f) * 2^e, where (1 + f)^p is a cubic polynomial in f
+float powMantissaApprox(const float x, const float p, const vec4 coefficients)
+{
+    if (x < 1.17549435e-38) return 0.0;
+
+    int   bits     = floatBitsToInt(x);
+    int   exponent = (bits >> 23) - 127;
+    float f        = intBitsToFloat((bits & 0x007fffff) | 0x3f800000) - 1.0;
+
+    float polynomial = coefficients.x + f * (coefficients.y + f * (coefficients.z + f * coefficients.w));
+    return polynomial * exp2(float(exponent) * p);
+}
+
+vec3 convertRgbToLinearRgb(const vec3 rgb)
+{
+    const vec4 coefficients = vec4(1.0000313515071373, 2.1984700509337243, 1.3303186249161785, 0.0661174463298021);
+    return vec3(powMantissaApprox(rgb.r, 2.2, coefficients),
+                powMantissaApprox(rgb.g, 2.2, coefficients),
+                powMantissaApprox(rgb.b, 2.2, coefficients));
+}
+
+vec3 convertLinearRgbToRgb(const vec3 linear_rgb)
+{
+    const vec4 coefficients = vec4(1.0000721846371292, 0.4516915554304192, -0.10635521311473461, 0.02504137605588145);
+    return vec3(powMantissaApprox(linear_rgb.r, 1.0 / 2.2, coefficients),
+                powMantissaApprox(linear_rgb.g, 1.0 / 2.2, coefficients),
+                powMantissaApprox(linear_rgb.b, 1.0 / 2.2, coefficients));
+}
+#else
 vec3 convertRgbToLinearRgb(const vec3 rgb)
 {
     return pow(rgb, vec3(2.2));
@@ -21,6 +107,7 @@ vec3 convertLinearRgbToRgb(const vec3 linear_rgb)
 {
     return pow(linear_rgb, vec3(1.0 / 2.2));
 }
+#endif
 
 // Y'UV (BT.709) to linear RGB
 // Values are from https://en.wikipedia.org/wiki/YUV
@@ -259,7 +346,7 @@ vec3 applyContrastEffect(const vec3 linear_rgb, const float contrast)
     return convertRgbToLinearRgb(max(contrast_coef * (convertLinearRgbToRgb(linear_rgb) - vec3(0.5)) + vec3(0.5), 0.0));
 }
 
-vec3 enhance(vec3 color)
+vec3 enhance(vec3 color, const float parameters[NUM_PARAMETERS])
 {
     // Retrieve enhancement parameters
     float brightness   = clamp(parameters[0], 0.0, 1.0) - 0.5;
@@ -340,8 +427,17 @@ void main()
     // Enhance
 #ifdef ENHANCER_V_1_0
     frag_color.xyz = enhance_v1(color.xyz);
+#elif defined(ENHANCER_WITH_LOCAL_ADJUSTMENTS)
+    vec2  position = (local_origin + gl_FragCoord.xy) / local_image_size;
+    float pixel_parameters[NUM_PARAMETERS] = parameters;
+    for (int k = 0; k < num_local_adjustments; ++k)
+    {
+        float weight = computeLocalWeight(k, position, color.xyz);
+        for (int i = 0; i < NUM_PARAMETERS; ++i) pixel_parameters[i] += weight * local_offsets[k * NUM_PARAMETERS + i];
+    }
+    frag_color.xyz = enhance(color.xyz, pixel_parameters);
 #else
-    frag_color.xyz = enhance(color.xyz);
+    frag_color.xyz = enhance(color.xyz, parameters);
 #endif
     frag_color.w   = 1.0;
 }
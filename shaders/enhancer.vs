@@ -3,8 +3,17 @@
 layout(location = 0) in vec2 vertex_position;
 smooth out vec2 vertex_uv;
 
+#if defined(ENHANCER_WITH_UV_RECT)
+// The part of the texture shown in the viewport: the texture coordinates of its lower-left corner (xy) and its size (zw)
+uniform vec4 uv_rect;
+#endif
+
 void main()
 {
     gl_Position = vec4(vertex_position, 0.0, 1.0);
+#if defined(ENHANCER_WITH_UV_RECT)
+    vertex_uv = uv_rect.xy + (vertex_position * vec2(0.5) + vec2(0.5)) * uv_rect.zw;
+#else
     vertex_uv = vertex_position * vec2(0.5) + vec2(0.5);
+#endif
 }
@@ -1,17 +1,157 @@
-#include <QFile>
+#include "gputimer.hpp"
+#include "shaderprogram.hpp"
+#include "texturepool.hpp"
+#include <QOpenGLFramebufferObject>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
+#include <QRect>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <enhancer/enhancerwidget.hpp>
+#include <enhancer/instrumentation.hpp>
 #include <iostream>
+#include <vector>
 
 #define TEXTURE_UNIT_ID 0
 
 namespace enhancer
 {
+    namespace internal
+    {
+        // How an image is uploaded: 8-bit images as RGBA8, 16-bit images as RGBA16 (which keeps all the 16 bits,
+        // unlike RGBA16F), and half/float images as RGBA16F/RGBA32F, so that deep images are neither quantized to 8
+        // bits nor converted when they are already in the upload format
+        struct UploadFormat
+        {
+            QImage::Format                image_format;
+            QOpenGLTexture::TextureFormat texture_format;
+            GLenum                        pixel_format;
+            GLenum                        pixel_type;
+            int                           pixel_size;
+        };
+
+        // A texture holding the pixels of `rect` (top-down, in the pixels of its level). `is_current` is cleared when
+        // a new image of the same size is set, in which case the previous pixels are shown until the tile is uploaded.
+        struct TextureTile
+        {
+            QRect                           rect;
+            std::unique_ptr<QOpenGLTexture> texture;
+            bool                            is_current = false;
+        };
+
+        struct TextureLevel
+        {
+            int                      width;
+            int                      height;
+            std::vector<TextureTile> tiles;
+
+            // The pixels of the level in the upload format; null for views and until the level is first needed
+            QImage image;
+        };
+
+        // The image on the GPU. Level 0 has the full resolution; for QImage sources, each further level halves the
+        // previous one down to the first level that fits in a single tile (the preview level).
+        struct TiledImage
+        {
+            UploadFormat              format;
+            std::vector<TextureLevel> levels;
+            int                       selected_level = 0;
+        };
+    } // namespace internal
+
+    namespace
+    {
+        constexpr int max_tile_size = 2048;
+
+        // Tiles beyond this amount are left to the following frames, which keeps a large image from stalling the UI
+        constexpr std::size_t max_upload_bytes_per_frame = 32 << 20;
+
+        std::vector<internal::TextureTile> makeTiles(const int width, const int height, const int tile_size)
+        {
+            std::vector<internal::TextureTile> tiles;
+            for (int y = 0; y < height; y += tile_size)
+            {
+                for (int x = 0; x < width; x += tile_size)
+                {
+                    internal::TextureTile tile;
+                    tile.rect = QRect(x, y, std::min(tile_size, width - x), std::min(tile_size, height - y));
+                    tiles.push_back(std::move(tile));
+                }
+            }
+            return tiles;
+        }
+
+        int countPyramidLevels(int width, int height, const int tile_size)
+        {
+            int num_levels = 1;
+            while (width > tile_size || height > tile_size)
+            {
+                width  = std::max(1, width / 2);
+                height = std::max(1, height / 2);
+                ++num_levels;
+            }
+            return num_levels;
+        }
+        internal::UploadFormat selectUploadFormat(const QImage::Format format)
+        {
+            switch (format)
+            {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+                case QImage::Format_RGBX64:
+                case QImage::Format_RGBA64:
+                case QImage::Format_RGBA64_Premultiplied:
+                    return { QImage::Format_RGBA64, QOpenGLTexture::RGBA16_UNorm, GL_RGBA, GL_UNSIGNED_SHORT, 8 };
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+                case QImage::Format_RGBX16FPx4:
+                case QImage::Format_RGBA16FPx4:
+                case QImage::Format_RGBA16FPx4_Premultiplied:
+                    return { QImage::Format_RGBA16FPx4, QOpenGLTexture::RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8 };
+                case QImage::Format_RGBX32FPx4:
+                case QImage::Format_RGBA32FPx4:
+                case QImage::Format_RGBA32FPx4_Premultiplied:
+                    return { QImage::Format_RGBA32FPx4, QOpenGLTexture::RGBA32F, GL_RGBA, GL_FLOAT, 16 };
+#endif
+                default:
+                    return { QImage::Format_RGBA8888, QOpenGLTexture::RGBA8_UNorm, GL_RGBA, GL_UNSIGNED_BYTE, 4 };
+            }
+        }
+
+        // Views are uploaded in their own channel order, which OpenGL swizzles during the transfer
+        template <typename T>
+        internal::UploadFormat selectUploadFormat(const ImageView<const T>&           image,
+                                                  const QOpenGLTexture::TextureFormat texture_format,
+                                                  const GLenum                        pixel_type)
+        {
+            GLenum pixel_format;
+            switch (image.order)
+            {
+                case ChannelOrder::RGB: pixel_format = GL_RGB; break;
+                case ChannelOrder::BGR: pixel_format = GL_BGR; break;
+                case ChannelOrder::BGRA: pixel_format = GL_BGRA; break;
+                default: pixel_format = GL_RGBA; break;
+            }
+
+            const int pixel_size = image.getNumChannels() * static_cast<int>(sizeof(T));
+            return { QImage::Format_Invalid, texture_format, pixel_format, pixel_type, pixel_size };
+        }
+    } // namespace
+
     EnhancerWidget::EnhancerWidget(const Policy policy, QWidget* parent) :
     QOpenGLWidget(parent),
     m_dirty(true),
-    m_policy(policy)
+    m_policy(policy),
+    m_needs_render(true),
+    m_accuracy(Accuracy::Exact),
+    m_program_accuracy(Accuracy::Exact),
+    m_max_tile_size(max_tile_size),
+    m_upload_buffers{ QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer), QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer) },
+    m_upload_index(0),
+    m_readback_buffer(QOpenGLBuffer::PixelPackBuffer),
+    m_readback_fence(nullptr),
+    m_readback_width(0),
+    m_readback_height(0)
     {
         m_image = QImage(64, 64, QImage::Format_RGBA8888);
         m_image.fill(Qt::GlobalColor::darkGray);
@@ -24,7 +164,15 @@ namespace enhancer
         makeCurrent();
         m_vbo.destroy();
         m_vao.destroy();
-        if (m_texture.get() != nullptr) { m_texture->destroy(); }
+        m_tiled_image.reset();
+        m_texture_pool.reset();
+        for (QOpenGLBuffer& upload_buffer : m_upload_buffers) { upload_buffer.destroy(); }
+        m_readback_buffer.destroy();
+        m_readback_fbo.reset();
+        m_frame_fbo.reset();
+        if (m_readback_fence != nullptr) { glDeleteSync(m_readback_fence); }
+        m_program.reset();
+        m_gpu_timer.reset();
         doneCurrent();
     }
 
@@ -32,6 +180,33 @@ namespace enhancer
     {
         m_image = image;
         m_dirty = true;
+        update();
+    }
+
+    bool EnhancerWidget::setImage(const ImageView<const std::uint8_t>& image)
+    {
+        return uploadView(image.getRow(0), image.getTopDownStride(), image.width, image.height, selectUploadFormat(image, QOpenGLTexture::RGBA8_UNorm, GL_UNSIGNED_BYTE));
+    }
+
+    bool EnhancerWidget::setImage(const ImageView<const std::uint16_t>& image)
+    {
+        return uploadView(image.getRow(0), image.getTopDownStride(), image.width, image.height, selectUploadFormat(image, QOpenGLTexture::RGBA16_UNorm, GL_UNSIGNED_SHORT));
+    }
+
+    bool EnhancerWidget::setImage(const ImageView<const Eigen::half>& image)
+    {
+        return uploadView(image.getRow(0), image.getTopDownStride(), image.width, image.height, selectUploadFormat(image, QOpenGLTexture::RGBA16F, GL_HALF_FLOAT));
+    }
+
+    bool EnhancerWidget::setImage(const ImageView<const float>& image)
+    {
+        return uploadView(image.getRow(0), image.getTopDownStride(), image.width, image.height, selectUploadFormat(image, QOpenGLTexture::RGBA32F, GL_FLOAT));
+    }
+
+    void EnhancerWidget::requestEnhancedImage(std::function<void(const QImage&)> callback)
+    {
+        m_requested_readback_callback = std::move(callback);
+        update();
     }
 
     void EnhancerWidget::initializeGL()
@@ -57,129 +232,499 @@ namespace enhancer
             -1.0, +1.0,
         };
 
-        const auto code_loader = [](const char* file_name) -> QString
+        m_vbo.create();
+        m_vbo.bind();
+        m_vbo.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        m_vbo.allocate(vertex_data, sizeof(vertex_data) * sizeof(GLfloat));
+        m_vbo.release();
+
+        m_vao.create();
+
+        m_texture_pool = std::make_unique<internal::TexturePool>();
+
+        if (is_instrumentation_enabled) { m_gpu_timer = std::make_unique<internal::GpuTimer>(); }
+
+        GLint max_texture_size = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+        m_max_tile_size = std::min(max_tile_size, static_cast<int>(max_texture_size));
+
+        if (!buildProgram(m_accuracy))
+        {
+            exit(1);
+        }
+
+        for (QOpenGLBuffer& upload_buffer : m_upload_buffers)
         {
-            QFile file(file_name);
+            upload_buffer.create();
+            upload_buffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+        }
+        m_readback_buffer.create();
+        m_readback_buffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+    }
+
+    bool EnhancerWidget::buildProgram(const Accuracy accuracy)
+    {
+        std::shared_ptr<QOpenGLShaderProgram> program = internal::createEnhancerProgram(TEXTURE_UNIT_ID, accuracy, true);
+        if (program == nullptr) { return false; }
 
-            if (!file.open(QIODevice::ReadOnly))
+        m_program          = program;
+        m_program_accuracy = accuracy;
+
+        m_vao.bind();
+
+        m_vbo.bind();
+        m_program->enableAttributeArray("vertex_position");
+        m_program->setAttributeBuffer("vertex_position", GL_FLOAT, 0, 2, 2 * sizeof(GLfloat));
+
+        m_vao.release();
+
+        return true;
+    }
+
+    void EnhancerWidget::prepareTiledImage(const int width, const int height, const internal::UploadFormat& format, const bool has_pyramid)
+    {
+        const int num_levels = has_pyramid ? countPyramidLevels(width, height, m_max_tile_size) : 1;
+
+        // The textures are kept as long as the size, the format, and the levels do not change
+        const bool is_reusable = m_tiled_image != nullptr && m_tiled_image->levels.front().width == width &&
+                                 m_tiled_image->levels.front().height == height &&
+                                 m_tiled_image->format.texture_format == format.texture_format &&
+                                 static_cast<int>(m_tiled_image->levels.size()) == num_levels;
+        if (is_reusable)
+        {
+            m_tiled_image->format = format;
+            for (internal::TextureLevel& level : m_tiled_image->levels)
             {
-                std::cerr << "Error: failed to load shader codes." << std::endl;
+                level.image = QImage();
+                for (internal::TextureTile& tile : level.tiles) { tile.is_current = false; }
             }
+            return;
+        }
 
-#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
-            QString code;
-            QTextStream stream(&file);
-            while (!stream.atEnd())
+        // Otherwise, the textures go back to the pool, from which tiles of the same size (e.g., the full tiles of
+        // another image) take them again
+        if (m_tiled_image != nullptr)
+        {
+            for (internal::TextureLevel& level : m_tiled_image->levels)
             {
-                QString line = stream.readLine();
+                for (internal::TextureTile& tile : level.tiles) { m_texture_pool->release(std::move(tile.texture)); }
+            }
+        }
+
+        m_tiled_image         = std::make_unique<internal::TiledImage>();
+        m_tiled_image->format = format;
+
+        int level_width  = width;
+        int level_height = height;
+        for (int i = 0; i < num_levels; ++i)
+        {
+            m_tiled_image->levels.push_back(internal::TextureLevel{ level_width, level_height, makeTiles(level_width, level_height, m_max_tile_size), QImage() });
+
+            level_width  = std::max(1, level_width / 2);
+            level_height = std::max(1, level_height / 2);
+        }
+    }
 
-                if (line.contains("#version"))
+    void EnhancerWidget::uploadImage()
+    {
+        const internal::UploadFormat upload_format = selectUploadFormat(m_image.format());
+
+        // Only the tiles that are shown are uploaded, from drawImage
+        prepareTiledImage(m_image.width(), m_image.height(), upload_format, true);
+        m_tiled_image->levels.front().image = m_image.convertToFormat(upload_format.image_format);
+    }
+
+    bool EnhancerWidget::uploadView(const void*                   top_row,
+                                    const std::ptrdiff_t          top_down_stride,
+                                    const int                     width,
+                                    const int                     height,
+                                    const internal::UploadFormat& format)
+    {
+        if (!isValid())
+        {
+            std::cerr << "Error: the widget has no OpenGL context yet to upload the image view to." << std::endl;
+            return false;
+        }
+
+        makeCurrent();
+        prepareTiledImage(width, height, format, false);
+        for (internal::TextureTile& tile : m_tiled_image->levels.front().tiles)
+        {
+            const std::uint8_t* tile_top_row = static_cast<const std::uint8_t*>(top_row) + tile.rect.y() * top_down_stride + tile.rect.x() * format.pixel_size;
+            uploadPixels(tile, tile_top_row, top_down_stride, format);
+        }
+        doneCurrent();
+
+        // The view supersedes any image set before, which is therefore not uploaded in the next paintGL
+        m_image        = QImage();
+        m_dirty        = false;
+        m_needs_render = true;
+        update();
+
+        return true;
+    }
+
+    void EnhancerWidget::uploadTile(const int level, internal::TextureTile& tile)
+    {
+        std::vector<internal::TextureLevel>& levels = m_tiled_image->levels;
+        assert(!levels.front().image.isNull());
+
+        // The levels are built on demand by halving the finer ones (with area averaging)
+        for (int i = 1; i <= level; ++i)
+        {
+            if (!levels[i].image.isNull()) { continue; }
+            levels[i].image = levels[i - 1].image.scaled(levels[i].width, levels[i].height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                                                 .convertToFormat(m_tiled_image->format.image_format);
+        }
+
+        const QImage& image = levels[level].image;
+        uploadPixels(tile, image.constScanLine(tile.rect.y()) + tile.rect.x() * m_tiled_image->format.pixel_size, image.bytesPerLine(), m_tiled_image->format);
+    }
+
+    void EnhancerWidget::uploadPixels(internal::TextureTile&        tile,
+                                      const std::uint8_t*           top_row,
+                                      const std::ptrdiff_t          top_down_stride,
+                                      const internal::UploadFormat& format)
+    {
+        // Timed on the CPU (mapping and filling the buffer); the transfer itself runs on the GPU with the next draw
+        const internal::TraceSpan span("gpu_upload", InstrumentedStage::GpuUpload);
+
+        const int width    = tile.rect.width();
+        const int height   = tile.rect.height();
+        const int row_size = format.pixel_size * width;
+        const int size     = row_size * height;
+
+        if (tile.texture == nullptr) { tile.texture = m_texture_pool->acquire(width, height, format.texture_format); }
+
+        // Alternating between two buffers (and orphaning the old storage) lets the driver keep transferring the
+        // previous frame while the next one is written, instead of blocking on the map
+        QOpenGLBuffer& upload_buffer = m_upload_buffers[m_upload_index];
+        m_upload_index               = (m_upload_index + 1) % static_cast<int>(m_upload_buffers.size());
+
+        upload_buffer.bind();
+        upload_buffer.allocate(size);
+
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped != nullptr)
+        {
+            const std::uint8_t* bottom_row = top_row + (height - 1) * top_down_stride;
+
+            // OpenGL expects the bottom row first, so top-down rows are flipped while being copied; packed bottom-up
+            // rows are already in that order
+            if (top_down_stride == -row_size)
+            {
+                std::memcpy(mapped, bottom_row, size);
+            }
+            else
+            {
+                for (int y = 0; y < height; ++y)
                 {
-                    line.append("\n\n#define ENHANCER_WITH_LIFT_GAMMA_GAIN\n");
+                    std::memcpy(static_cast<std::uint8_t*>(mapped) + static_cast<std::size_t>(y) * row_size, bottom_row - y * top_down_stride, row_size);
                 }
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            // The rows in the buffer are packed, which RGB rows may not be at the default alignment of 4
+            tile.texture->bind();
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format.pixel_format, format.pixel_type, nullptr);
+            tile.texture->release();
+
+            tile.texture->generateMipMaps();
+            tile.is_current = true;
+        }
+        else
+        {
+            std::cerr << "Error: failed to map a pixel buffer object." << std::endl;
+        }
+
+        upload_buffer.release();
+    }
+
+    void EnhancerWidget::drawTile(const internal::TextureTile& tile, const QRectF& uv_rect)
+    {
+        m_program->setUniformValue("uv_rect", GLfloat(uv_rect.x()), GLfloat(uv_rect.y()), GLfloat(uv_rect.width()), GLfloat(uv_rect.height()));
+
+        tile.texture->bind(TEXTURE_UNIT_ID);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        tile.texture->release();
+    }
+
+    bool EnhancerWidget::drawImage(const int w, const int h)
+    {
+        std::vector<internal::TextureLevel>& levels = m_tiled_image->levels;
 
-                code.append(line).append("\n");
+        const int image_width  = levels.front().width;
+        const int image_height = levels.front().height;
+
+        // The region of interest is scaled (in device pixels per image pixel) to fit or fill the widget and centered
+        const QRectF region   = m_region_of_interest.isEmpty() ? QRectF(0.0, 0.0, image_width, image_height) : m_region_of_interest;
+        const double scale_x  = w / region.width();
+        const double scale_y  = h / region.height();
+        const double scale    = m_policy == Policy::AspectFit ? std::min(scale_x, scale_y) : std::max(scale_x, scale_y);
+        const double offset_x = 0.5 * w - region.center().x() * scale;
+        const double offset_y = 0.5 * h - region.center().y() * scale;
+
+        // The coarsest level that still has at least one pixel per device pixel; the mipmaps of its tiles take care
+        // of the remaining minification (less than 2x)
+        const int preview_level = static_cast<int>(levels.size()) - 1;
+        int       level         = 0;
+        while (level < preview_level && scale * image_width / levels[level + 1].width <= 1.0) { ++level; }
+
+        // Only the textures of the shown level and of the preview are kept; the others return to the pool
+        if (level != m_tiled_image->selected_level)
+        {
+            for (int i = 0; i < preview_level; ++i)
+            {
+                if (i == level) { continue; }
+                for (internal::TextureTile& tile : levels[i].tiles)
+                {
+                    m_texture_pool->release(std::move(tile.texture));
+                    tile.is_current = false;
+                }
             }
-#else
-            const QString code = QTextStream(&file).readAll();
-#endif
+            m_tiled_image->selected_level = level;
+        }
+
+        // The visible part of a tile of level `i` in device pixels (as a glViewport rectangle) and in the texture
+        // coordinates of the tile. The edges (rather than the sizes) are rounded so that adjacent tiles are seamless.
+        const auto locate = [&](const int i, const internal::TextureTile& tile, QRect& viewport, QRectF& uv_rect)
+        {
+            const double level_scale_x = scale * image_width / levels[i].width;
+            const double level_scale_y = scale * image_height / levels[i].height;
+
+            const int left   = std::max(0, static_cast<int>(std::lround(offset_x + tile.rect.x() * level_scale_x)));
+            const int right  = std::min(w, static_cast<int>(std::lround(offset_x + (tile.rect.x() + tile.rect.width()) * level_scale_x)));
+            const int top    = std::max(0, static_cast<int>(std::lround(offset_y + tile.rect.y() * level_scale_y)));
+            const int bottom = std::min(h, static_cast<int>(std::lround(offset_y + (tile.rect.y() + tile.rect.height()) * level_scale_y)));
+            if (left >= right || top >= bottom) { return false; }
 
-            file.close();
+            viewport = QRect(left, h - bottom, right - left, bottom - top);
 
-            return code;
+            // The rows of the texture are bottom-up, so v is measured from the bottom edge of the tile
+            const double tile_bottom = tile.rect.y() + tile.rect.height();
+            const double u0          = ((left - offset_x) / level_scale_x - tile.rect.x()) / tile.rect.width();
+            const double u1          = ((right - offset_x) / level_scale_x - tile.rect.x()) / tile.rect.width();
+            const double v0          = (tile_bottom - (bottom - offset_y) / level_scale_y) / tile.rect.height();
+            const double v1          = (tile_bottom - (top - offset_y) / level_scale_y) / tile.rect.height();
+            uv_rect                  = QRectF(u0, v0, u1 - u0, v1 - v0);
+
+            return true;
         };
 
-        const QString vert_code = code_loader("://shaders/enhancer.vs");
-        const QString frag_code = code_loader("://shaders/enhancer.fs");
+        // The preview is always complete, so that there is something to show while the finer tiles arrive
+        for (internal::TextureTile& tile : levels[preview_level].tiles)
+        {
+            if (!tile.is_current) { uploadTile(preview_level, tile); }
+        }
+
+        QRect       viewport;
+        QRectF      uv_rect;
+        std::size_t uploaded_bytes = 0;
+        bool        is_complete    = true;
+        bool        has_gaps       = false;
+        for (internal::TextureTile& tile : levels[level].tiles)
+        {
+            if (tile.is_current || !locate(level, tile, viewport, uv_rect)) { continue; }
+
+            if (uploaded_bytes < max_upload_bytes_per_frame)
+            {
+                uploadTile(level, tile);
+                uploaded_bytes += static_cast<std::size_t>(tile.rect.width()) * tile.rect.height() * m_tiled_image->format.pixel_size;
+            }
+            else
+            {
+                is_complete = false;
+                has_gaps    = has_gaps || tile.texture == nullptr;
+            }
+        }
 
-        m_program = std::make_shared<QOpenGLShaderProgram>();
-        m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vert_code);
-        m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, frag_code);
-        m_program->link();
         m_program->bind();
-        m_program->setUniformValue("texture_sampler", TEXTURE_UNIT_ID);
+        m_program->setUniformValueArray("parameters", m_parameters.data(), NUM_PARAMETERS, 1);
+        m_vao.bind();
+
+        const auto draw_level = [&](const int i)
+        {
+            for (const internal::TextureTile& tile : levels[i].tiles)
+            {
+                if (tile.texture == nullptr || !locate(i, tile, viewport, uv_rect)) { continue; }
+
+                glViewport(viewport.x(), viewport.y(), viewport.width(), viewport.height());
+                drawTile(tile, uv_rect);
+            }
+        };
+
+        if (has_gaps) { draw_level(preview_level); }
+        draw_level(level);
+
+        m_vao.release();
         m_program->release();
 
-        m_vbo.create();
-        m_vbo.bind();
-        m_vbo.setUsagePattern(QOpenGLBuffer::StaticDraw);
-        m_vbo.allocate(vertex_data, sizeof(vertex_data) * sizeof(GLfloat));
-        m_vbo.release();
+        // The remaining tiles are uploaded in the following frames
+        if (!is_complete) { update(); }
 
-        m_vao.create();
+        return is_complete;
+    }
+
+    void EnhancerWidget::startReadback()
+    {
+        internal::TextureLevel& level = m_tiled_image->levels.front();
+
+        const int width  = level.width;
+        const int height = level.height;
+
+        // The full-resolution tiles that have not been shown are uploaded now, regardless of the upload budget
+        for (internal::TextureTile& tile : level.tiles)
+        {
+            if (!tile.is_current) { uploadTile(0, tile); }
+        }
+
+        // The tiles are rendered one by one into a framebuffer of the size of the first (largest) tile
+        const QRect& first_rect = level.tiles.front().rect;
+        if (m_readback_fbo.get() == nullptr || m_readback_fbo->width() != first_rect.width() || m_readback_fbo->height() != first_rect.height())
+        {
+            m_readback_fbo = std::make_shared<QOpenGLFramebufferObject>(first_rect.width(), first_rect.height());
+        }
+        m_readback_width  = width;
+        m_readback_height = height;
+
+        m_readback_buffer.bind();
+        m_readback_buffer.allocate(4 * width * height);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_PACK_ROW_LENGTH, width);
+
+        m_readback_fbo->bind();
+        m_program->bind();
+        m_program->setUniformValueArray("parameters", m_parameters.data(), NUM_PARAMETERS, 1);
         m_vao.bind();
 
-        m_vbo.bind();
-        m_program->enableAttributeArray("vertex_position");
-        m_program->setAttributeBuffer("vertex_position", GL_FLOAT, 0, 2, 2 * sizeof(GLfloat));
+        for (const internal::TextureTile& tile : level.tiles)
+        {
+            glViewport(0, 0, tile.rect.width(), tile.rect.height());
+            drawTile(tile, QRectF(0.0, 0.0, 1.0, 1.0));
+
+            // Each tile is written to its place in the buffer, which holds the whole image bottom row first
+            const std::size_t offset = 4 * (static_cast<std::size_t>(height - tile.rect.y() - tile.rect.height()) * width + tile.rect.x());
+            glReadPixels(0, 0, tile.rect.width(), tile.rect.height(), GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<void*>(offset));
+        }
 
         m_vao.release();
+        m_program->release();
+
+        // If another level is shown, the next drawImage releases the full-resolution tiles again
+        if (m_tiled_image->selected_level != 0) { m_tiled_image->selected_level = -1; }
+
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+        m_readback_buffer.release();
+
+        m_readback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        m_readback_fbo->release();
+        glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+
+        m_in_flight_readback_callback = std::move(m_requested_readback_callback);
+        m_requested_readback_callback = nullptr;
     }
 
-    void EnhancerWidget::paintGL()
+    void EnhancerWidget::finishReadbackIfReady()
     {
-        glClearColor(0.0, 0.0, 0.0, 1.0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        const GLenum status = glClientWaitSync(m_readback_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            // Check again in the next frame
+            update();
+            return;
+        }
 
-        const int image_width = this->m_image.width();
-        const int image_height = this->m_image.height();
-        const int w = width() * devicePixelRatio();
-        const int h = height() * devicePixelRatio();
+        glDeleteSync(m_readback_fence);
+        m_readback_fence = nullptr;
+
+        const int width  = m_readback_width;
+        const int height = m_readback_height;
+
+        QImage enhanced_image(width, height, QImage::Format_RGBA8888);
 
-        switch (m_policy) {
-            case Policy::AspectFit:
+        {
+            // Only the copy out of the buffer remains, since the fence has already been signaled
+            const internal::TraceSpan span("gpu_readback", InstrumentedStage::GpuReadback);
+
+            m_readback_buffer.bind();
+            const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4 * width * height, GL_MAP_READ_BIT);
+            if (mapped != nullptr)
             {
-                if (w * image_height == h * image_width)
-                {
-                    glViewport(0, 0, w, h);
-                }
-                else if (w * image_height > h * image_width)
+                for (int y = 0; y < height; ++y)
                 {
-                    const int w_corrected = h * image_width / image_height;
-                    glViewport((w - w_corrected) / 2, 0, w_corrected, h);
+                    std::memcpy(enhanced_image.scanLine(y), static_cast<const std::uint8_t*>(mapped) + static_cast<std::size_t>(height - 1 - y) * 4 * width, 4 * width);
                 }
-                else if (w * image_height < h * image_width)
-                {
-                    const int h_corrected = w * image_height / image_width;
-                    glViewport(0, (h - h_corrected) / 2, w, h_corrected);
-                }
-                break;
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
             }
-            case Policy::AspectFill:
+            else
             {
-                if (w * image_height == h * image_width)
-                {
-                    glViewport(0, 0, w, h);
-                }
-                else if (w * image_height > h * image_width)
-                {
-                    const int h_corrected = w * image_height / image_width;
-                    glViewport(0, (h - h_corrected) / 2, w, h_corrected);
-                }
-                else if (w * image_height < h * image_width)
-                {
-                    const int w_corrected = h * image_width / image_height;
-                    glViewport((w - w_corrected) / 2, 0, w_corrected, h);
-                }
-                break;
+                std::cerr << "Error: failed to map a pixel buffer object." << std::endl;
+                enhanced_image = QImage();
             }
+            m_readback_buffer.release();
+        }
+
+        const auto callback = std::move(m_in_flight_readback_callback);
+        m_in_flight_readback_callback = nullptr;
+        callback(enhanced_image);
+
+        // A request made while this readback was in flight could not start it, so it needs another frame
+        if (m_requested_readback_callback) { update(); }
+    }
+
+    void EnhancerWidget::paintGL()
+    {
+        // The draws of earlier frames are read when they have finished, so that timing never stalls a frame
+        if (m_gpu_timer != nullptr) { m_gpu_timer->collect(false); }
+
+        if (m_accuracy != m_program_accuracy)
+        {
+            if (!buildProgram(m_accuracy)) { m_accuracy = m_program_accuracy; }
+            m_needs_render = true;
         }
 
         if (m_dirty)
         {
-            m_texture = std::make_shared<QOpenGLTexture>(m_image.mirrored(), QOpenGLTexture::DontGenerateMipMaps);
-            m_dirty = false;
+            uploadImage();
+            m_dirty        = false;
+            m_needs_render = true;
         }
 
-        m_program->bind();
-        m_program->setUniformValueArray("parameters", m_parameters.data(), NUM_PARAMETERS, 1);
+        // The readback renders into its own framebuffer, so it is started before the viewport is set for the widget
+        if (m_requested_readback_callback && m_readback_fence == nullptr) { startReadback(); }
 
-        m_texture->bind(TEXTURE_UNIT_ID);
-        m_vao.bind();
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-        m_vao.release();
-        m_texture->release();
-        m_program->release();
+        const int w = width() * devicePixelRatio();
+        const int h = height() * devicePixelRatio();
+
+        if (m_frame_fbo.get() == nullptr || m_frame_fbo->width() != w || m_frame_fbo->height() != h)
+        {
+            m_frame_fbo    = std::make_shared<QOpenGLFramebufferObject>(w, h);
+            m_needs_render = true;
+        }
+
+        if (m_needs_render)
+        {
+            m_frame_fbo->bind();
+
+            glClearColor(0.0, 0.0, 0.0, 1.0);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            // Includes the transfers of the tiles that drawImage uploads on demand
+            if (m_gpu_timer != nullptr) { m_gpu_timer->begin(InstrumentedStage::GpuDraw); }
+            m_needs_render = !drawImage(w, h);
+            if (m_gpu_timer != nullptr) { m_gpu_timer->end(); }
+
+            m_frame_fbo->release();
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_frame_fbo->handle());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, defaultFramebufferObject());
+        glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+
+        if (m_readback_fence != nullptr) { finishReadbackIfReady(); }
     }
 
     void EnhancerWidget::resizeGL(int width, int height) {}
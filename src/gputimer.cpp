@@ -0,0 +1,83 @@
+#include "gputimer.hpp"
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+namespace enhancer
+{
+    namespace internal
+    {
+        GpuTimer::GpuTimer()
+        {
+            const QOpenGLContext* context = QOpenGLContext::currentContext();
+            if (context == nullptr) { return; }
+
+            const QSurfaceFormat format          = context->format();
+            const bool           is_core_33      = format.majorVersion() > 3 || (format.majorVersion() == 3 && format.minorVersion() >= 3);
+            const bool           has_timer_query = context->hasExtension("GL_ARB_timer_query");
+            if ((!is_core_33 && !has_timer_query) || !initializeOpenGLFunctions()) { return; }
+
+            glGenQueries(num_queries, m_queries.data());
+            m_is_valid = true;
+        }
+
+        GpuTimer::~GpuTimer()
+        {
+            if (m_is_valid) { glDeleteQueries(num_queries, m_queries.data()); }
+        }
+
+        void GpuTimer::begin(const InstrumentedStage stage)
+        {
+            if (!m_is_valid) { return; }
+
+            // All the queries are in flight; the oldest one has to finish before its object can be reused
+            if (m_num_pending == num_queries)
+            {
+                GLuint nanoseconds = 0;
+                glGetQueryObjectuiv(m_queries[m_first_pending], GL_QUERY_RESULT, &nanoseconds);
+                addMeasuredStageTime(m_stages[m_first_pending], nanoseconds);
+
+                m_first_pending = (m_first_pending + 1) % num_queries;
+                --m_num_pending;
+            }
+
+            const int index = (m_first_pending + m_num_pending) % num_queries;
+            m_stages[index] = stage;
+            glBeginQuery(GL_TIME_ELAPSED, m_queries[index]);
+        }
+
+        void GpuTimer::end()
+        {
+            if (!m_is_valid) { return; }
+
+            glEndQuery(GL_TIME_ELAPSED);
+            ++m_num_pending;
+        }
+
+        void GpuTimer::collect(const bool wait)
+        {
+            while (m_is_valid && m_num_pending > 0)
+            {
+                const GLuint query = m_queries[m_first_pending];
+
+                if (!wait)
+                {
+                    GLuint is_available = GL_FALSE;
+                    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &is_available);
+                    if (is_available == GL_FALSE) { return; }
+                }
+
+                // 32 bits of nanoseconds cover draws of up to about 4 seconds, which is far beyond a single tile
+                GLuint nanoseconds = 0;
+                glGetQueryObjectuiv(query, GL_QUERY_RESULT, &nanoseconds);
+                addMeasuredStageTime(m_stages[m_first_pending], nanoseconds);
+
+                m_first_pending = (m_first_pending + 1) % num_queries;
+                --m_num_pending;
+            }
+        }
+    } // namespace internal
+} // namespace enhancer
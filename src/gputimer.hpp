@@ -0,0 +1,49 @@
+#ifndef enhancer_gputimer_hpp
+#define enhancer_gputimer_hpp
+
+#include <QOpenGLFunctions_3_2_Core>
+#include <array>
+#include <enhancer/instrumentation.hpp>
+
+namespace enhancer
+{
+    namespace internal
+    {
+        // Measures draws on the GPU with GL_TIME_ELAPSED queries (OpenGL 3.3 or GL_ARB_timer_query) and adds the
+        // results to the instrumentation stats (see enhancer/instrumentation.hpp). The queries are read back only
+        // when their results are available, so timing does not stall the pipeline unless collect is asked to wait.
+        // The context has to be current for all the calls, including the destructor.
+        class GpuTimer : protected QOpenGLFunctions_3_2_Core
+        {
+        public:
+            GpuTimer();
+            ~GpuTimer();
+
+            GpuTimer(const GpuTimer&) = delete;
+            GpuTimer& operator=(const GpuTimer&) = delete;
+
+            // False if the context supports no timer queries, in which case the other calls do nothing
+            bool isValid() const { return m_is_valid; }
+
+            // Brackets the GL commands to measure; queries cannot be nested
+            void begin(const InstrumentedStage stage);
+            void end();
+
+            // Adds the results of the finished queries; with `wait`, of all the queries that have been ended
+            void collect(const bool wait);
+
+        private:
+            static constexpr int num_queries = 8;
+
+            bool                                       m_is_valid = false;
+            std::array<GLuint, num_queries>            m_queries;
+            std::array<InstrumentedStage, num_queries> m_stages;
+
+            // The queries in flight are [m_first_pending, m_first_pending + m_num_pending) modulo num_queries
+            int m_first_pending = 0;
+            int m_num_pending   = 0;
+        };
+    } // namespace internal
+} // namespace enhancer
+
+#endif /* enhancer_gputimer_hpp */
@@ -0,0 +1,637 @@
+#include "gputimer.hpp"
+#include "shaderprogram.hpp"
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QSurfaceFormat>
+#include <algorithm>
+#include <cstring>
+#include <enhancer/instrumentation.hpp>
+#include <enhancer/local.hpp>
+#include <enhancer/offscreenenhancer.hpp>
+#include <enhancer/statistics.hpp>
+#include <enhancer/sweep.hpp>
+#include <iostream>
+#include <type_traits>
+
+#define TEXTURE_UNIT_ID 0
+#define MASK_TEXTURE_UNIT_ID (TEXTURE_UNIT_ID + 1)
+#define GRID_TEXTURE_UNIT_ID (TEXTURE_UNIT_ID + 2)
+#define MAX_LOCAL_ADJUSTMENTS 4
+
+namespace enhancer
+{
+    OffscreenEnhancer::OffscreenEnhancer(const int max_tile_size) :
+    m_max_tile_size(std::max(1, max_tile_size)), m_accuracy(Accuracy::Exact)
+    {
+        m_parameters.fill(0.5);
+
+        QSurfaceFormat format;
+        format.setVersion(3, 2);
+        format.setProfile(QSurfaceFormat::CoreProfile);
+
+        m_context = std::make_unique<QOpenGLContext>();
+        m_context->setFormat(format);
+        if (!m_context->create())
+        {
+            std::cerr << "Error: Failed to create an OpenGL context." << std::endl;
+            return;
+        }
+
+        m_surface = std::make_unique<QOffscreenSurface>();
+        m_surface->setFormat(m_context->format());
+        m_surface->create();
+        if (!m_surface->isValid() || !m_context->makeCurrent(m_surface.get()))
+        {
+            std::cerr << "Error: Failed to create an offscreen surface." << std::endl;
+            return;
+        }
+
+        if (!initializeOpenGLFunctions())
+        {
+            std::cerr << "Error: Failed to prepare OpenGL profile." << std::endl;
+            m_context->doneCurrent();
+            return;
+        }
+
+        GLint max_texture_size = 0;
+        GLint max_viewport_dims[2] = { 0, 0 };
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+        glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport_dims);
+        m_max_tile_size = std::min({ m_max_tile_size, int(max_texture_size), int(max_viewport_dims[0]), int(max_viewport_dims[1]) });
+
+        constexpr GLfloat vertex_data[] =
+        {
+            -1.0, -1.0,
+            +1.0, -1.0,
+            +1.0, +1.0,
+            -1.0, +1.0,
+        };
+
+        m_vbo.create();
+        m_vbo.bind();
+        m_vbo.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        m_vbo.allocate(vertex_data, sizeof(vertex_data));
+        m_vbo.release();
+
+        m_vao.create();
+
+        buildProgram(m_accuracy);
+
+        if (is_instrumentation_enabled) { m_gpu_timer = std::make_unique<internal::GpuTimer>(); }
+
+        m_context->doneCurrent();
+    }
+
+    OffscreenEnhancer::~OffscreenEnhancer()
+    {
+        if (m_context == nullptr || !m_context->isValid() || m_surface == nullptr || !m_surface->isValid()) { return; }
+
+        m_context->makeCurrent(m_surface.get());
+        m_vbo.destroy();
+        m_vao.destroy();
+        m_fbo.reset();
+        m_texture.reset();
+        m_mask_texture.reset();
+        m_grid_texture.reset();
+        m_program.reset();
+        m_local_program.reset();
+        m_gpu_timer.reset();
+        m_context->doneCurrent();
+    }
+
+    void OffscreenEnhancer::setAccuracy(const Accuracy accuracy)
+    {
+        if (!isValid() || accuracy == m_accuracy) { return; }
+        if (!m_context->makeCurrent(m_surface.get())) { return; }
+
+        buildProgram(accuracy);
+
+        m_context->doneCurrent();
+    }
+
+    bool OffscreenEnhancer::buildProgram(const Accuracy accuracy)
+    {
+        std::shared_ptr<QOpenGLShaderProgram> program = internal::createEnhancerProgram(TEXTURE_UNIT_ID, accuracy);
+        if (program == nullptr) { return false; }
+
+        std::shared_ptr<QOpenGLShaderProgram> local_program;
+        if (!m_local_adjustments.empty())
+        {
+            local_program = internal::createEnhancerProgram(TEXTURE_UNIT_ID, accuracy, false, true);
+            if (local_program == nullptr) { return false; }
+        }
+
+        m_program       = program;
+        m_local_program = local_program;
+        m_accuracy      = accuracy;
+
+        // Both variants declare vertex_position at location 0, so the binding holds for the local one too
+        m_vao.bind();
+
+        m_vbo.bind();
+        m_program->enableAttributeArray("vertex_position");
+        m_program->setAttributeBuffer("vertex_position", GL_FLOAT, 0, 2, 2 * sizeof(GLfloat));
+
+        m_vao.release();
+
+        return true;
+    }
+
+    bool OffscreenEnhancer::setLocalAdjustments(const std::vector<LocalAdjustment>& adjustments)
+    {
+        if (adjustments.empty())
+        {
+            clearLocalAdjustments();
+            return true;
+        }
+        if (!isValid()) { return false; }
+
+        if (adjustments.size() > MAX_LOCAL_ADJUSTMENTS)
+        {
+            std::cerr << "Error: At most " << MAX_LOCAL_ADJUSTMENTS << " local adjustments are supported." << std::endl;
+            return false;
+        }
+
+        const GuidanceGrid* grid = nullptr;
+        for (const LocalAdjustment& adjustment : adjustments)
+        {
+            assert(adjustment.parameters.size() == NUM_PARAMETERS);
+
+            if (adjustment.shape != LocalAdjustment::Shape::Grid) { continue; }
+
+            const GuidanceGrid& other = *adjustment.grid;
+            if (grid != nullptr && (other.width != grid->width || other.height != grid->height || other.depth != grid->depth))
+            {
+                std::cerr << "Error: The guidance grids of the local adjustments must have the same size." << std::endl;
+                return false;
+            }
+            grid = &other;
+        }
+
+        if (!m_context->makeCurrent(m_surface.get())) { return false; }
+
+        if (m_local_program == nullptr) { m_local_program = internal::createEnhancerProgram(TEXTURE_UNIT_ID, m_accuracy, false, true); }
+
+        const bool is_succeeded = m_local_program != nullptr;
+        if (is_succeeded)
+        {
+            m_local_adjustments = adjustments;
+            m_grid_texture.reset();
+        }
+
+        // Channel k of the texture holds the grid of adjustment k; the hardware trilinear filtering follows the same
+        // texel center convention as GuidanceGrid::sample
+        if (is_succeeded && grid != nullptr)
+        {
+            std::vector<GLfloat> texels(4 * grid->weights.size(), 0.0f);
+            for (std::size_t k = 0; k < adjustments.size(); ++k)
+            {
+                if (adjustments[k].shape != LocalAdjustment::Shape::Grid) { continue; }
+
+                const std::vector<float>& weights = adjustments[k].grid->weights;
+                for (std::size_t i = 0; i < weights.size(); ++i) { texels[4 * i + k] = weights[i]; }
+            }
+
+            m_grid_texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target3D);
+            m_grid_texture->setFormat(QOpenGLTexture::RGBA32F);
+            m_grid_texture->setSize(grid->width, grid->height, grid->depth);
+            m_grid_texture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+            m_grid_texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+            m_grid_texture->allocateStorage();
+            m_grid_texture->setData(QOpenGLTexture::RGBA, QOpenGLTexture::Float32, texels.data());
+        }
+
+        m_context->doneCurrent();
+
+        return is_succeeded;
+    }
+
+    void OffscreenEnhancer::clearLocalAdjustments()
+    {
+        m_local_adjustments.clear();
+
+        if (!isValid() || !m_context->makeCurrent(m_surface.get())) { return; }
+
+        m_local_program.reset();
+        m_mask_texture.reset();
+        m_grid_texture.reset();
+
+        m_context->doneCurrent();
+    }
+
+    void OffscreenEnhancer::setLocalUniforms(const int width, const int height)
+    {
+        const int num_adjustments = static_cast<int>(m_local_adjustments.size());
+
+        std::array<GLint, MAX_LOCAL_ADJUSTMENTS>                     shapes   = {};
+        std::array<GLfloat, 4 * MAX_LOCAL_ADJUSTMENTS>               geometry = {};
+        std::array<GLfloat, MAX_LOCAL_ADJUSTMENTS>                   feather  = {};
+        std::array<GLfloat, MAX_LOCAL_ADJUSTMENTS * NUM_PARAMETERS> offsets  = {};
+
+        for (int k = 0; k < num_adjustments; ++k)
+        {
+            const LocalAdjustment& adjustment = m_local_adjustments[k];
+            const bool             is_radial  = adjustment.shape == LocalAdjustment::Shape::RadialGradient;
+            const Eigen::Vector2d  first      = is_radial ? adjustment.center : adjustment.start;
+            const Eigen::Vector2d  second     = is_radial ? adjustment.radii : adjustment.end;
+
+            // The shape codes of the shader follow the order of LocalAdjustment::Shape
+            shapes[k]           = static_cast<GLint>(adjustment.shape);
+            geometry[4 * k + 0] = static_cast<GLfloat>(first(0));
+            geometry[4 * k + 1] = static_cast<GLfloat>(first(1));
+            geometry[4 * k + 2] = static_cast<GLfloat>(second(0));
+            geometry[4 * k + 3] = static_cast<GLfloat>(second(1));
+            feather[k]          = static_cast<GLfloat>(adjustment.feather);
+
+            for (int i = 0; i < NUM_PARAMETERS; ++i)
+            {
+                offsets[k * NUM_PARAMETERS + i] = static_cast<GLfloat>(adjustment.opacity * (adjustment.parameters[i] - m_parameters[i]));
+            }
+        }
+
+        m_local_program->setUniformValue("num_local_adjustments", num_adjustments);
+        m_local_program->setUniformValueArray("local_shapes", shapes.data(), MAX_LOCAL_ADJUSTMENTS);
+        m_local_program->setUniformValueArray("local_geometry", geometry.data(), MAX_LOCAL_ADJUSTMENTS, 4);
+        m_local_program->setUniformValueArray("local_feather", feather.data(), MAX_LOCAL_ADJUSTMENTS, 1);
+        m_local_program->setUniformValueArray("local_offsets", offsets.data(), MAX_LOCAL_ADJUSTMENTS * NUM_PARAMETERS, 1);
+        m_local_program->setUniformValue("local_image_size", static_cast<GLfloat>(width), static_cast<GLfloat>(height));
+    }
+
+    void OffscreenEnhancer::uploadLocalMasks(const int tile_x, const int tile_y, const int tile_width, const int tile_height)
+    {
+        m_mask_buffer.assign(static_cast<std::size_t>(tile_width) * tile_height * 4, 0);
+
+        for (std::size_t k = 0; k < m_local_adjustments.size(); ++k)
+        {
+            const LocalAdjustment& adjustment = m_local_adjustments[k];
+            if (adjustment.shape != LocalAdjustment::Shape::Mask) { continue; }
+
+            for (int y = 0; y < tile_height; ++y)
+            {
+                const std::uint8_t* mask_pixel = adjustment.mask_data + (tile_y + y) * adjustment.mask_stride +
+                                                 tile_x * adjustment.mask_channels + adjustment.mask_channel;
+                std::uint8_t*       texel      = m_mask_buffer.data() + static_cast<std::size_t>(y) * tile_width * 4 + k;
+
+                for (int x = 0; x < tile_width; ++x, mask_pixel += adjustment.mask_channels, texel += 4) { *texel = *mask_pixel; }
+            }
+        }
+
+        // The source rows may be uploaded with a row length, while the mask rows are packed
+        GLint row_length = 0;
+        glGetIntegerv(GL_UNPACK_ROW_LENGTH, &row_length);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+        glActiveTexture(GL_TEXTURE0 + MASK_TEXTURE_UNIT_ID);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tile_width, tile_height, GL_RGBA, GL_UNSIGNED_BYTE, m_mask_buffer.data());
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_ID);
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+    }
+
+    bool OffscreenEnhancer::enhanceImage(const std::uint8_t*  src,
+                                         std::uint8_t*        dst,
+                                         const int            width,
+                                         const int            height,
+                                         const std::ptrdiff_t stride,
+                                         const int            channels,
+                                         ImageStatistics*     statistics)
+    {
+        return render(src, dst, width, height, stride, stride, channels, statistics);
+    }
+
+    bool OffscreenEnhancer::enhanceImage(const float*         src,
+                                         float*               dst,
+                                         const int            width,
+                                         const int            height,
+                                         const std::ptrdiff_t stride,
+                                         const int            channels,
+                                         ImageStatistics*     statistics)
+    {
+        return render(src, dst, width, height, stride, stride, channels, statistics);
+    }
+
+    bool OffscreenEnhancer::computeStatistics(const std::uint8_t*  src,
+                                              const int            width,
+                                              const int            height,
+                                              const std::ptrdiff_t stride,
+                                              const int            channels,
+                                              ImageStatistics&     statistics)
+    {
+        return render(src, static_cast<std::uint8_t*>(nullptr), width, height, stride, 0, channels, &statistics);
+    }
+
+    bool OffscreenEnhancer::computeStatistics(const float*         src,
+                                              const int            width,
+                                              const int            height,
+                                              const std::ptrdiff_t stride,
+                                              const int            channels,
+                                              ImageStatistics&     statistics)
+    {
+        return render(src, static_cast<float*>(nullptr), width, height, stride, 0, channels, &statistics);
+    }
+
+    QImage OffscreenEnhancer::enhanceImage(const QImage& image, ImageStatistics* statistics)
+    {
+        QImage enhanced_image;
+        return enhanceImage(image, enhanced_image, statistics) ? enhanced_image : QImage();
+    }
+
+    bool OffscreenEnhancer::enhanceImage(const QImage& image, QImage& enhanced_image, ImageStatistics* statistics)
+    {
+        // Shares the pixels when the image already has the format, in which case its rows keep their stride (e.g., an
+        // image wrapping an external buffer with padded rows) and may differ from those of `enhanced_image`
+        const QImage source_image = image.convertToFormat(QImage::Format_RGBA8888);
+
+        if (enhanced_image.size() != source_image.size() || enhanced_image.format() != QImage::Format_RGBA8888)
+        {
+            enhanced_image = QImage(source_image.size(), QImage::Format_RGBA8888);
+        }
+
+        return render(source_image.constBits(),
+                      enhanced_image.bits(),
+                      source_image.width(),
+                      source_image.height(),
+                      source_image.bytesPerLine(),
+                      enhanced_image.bytesPerLine(),
+                      4,
+                      statistics);
+    }
+
+    void OffscreenEnhancer::prepareTargets(const int  texture_width,
+                                           const int  texture_height,
+                                           const int  framebuffer_width,
+                                           const int  framebuffer_height,
+                                           const bool is_float)
+    {
+        const QOpenGLTexture::TextureFormat texture_format = is_float ? QOpenGLTexture::RGBA32F : QOpenGLTexture::RGBA8_UNorm;
+
+        const bool is_texture_reusable = m_texture != nullptr && m_texture->width() == texture_width &&
+                                         m_texture->height() == texture_height && m_texture->format() == texture_format;
+        if (!is_texture_reusable)
+        {
+            m_texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+            m_texture->setFormat(texture_format);
+            m_texture->setSize(texture_width, texture_height);
+            m_texture->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+            m_texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+            m_texture->allocateStorage();
+        }
+
+        const GLenum fbo_format = is_float ? GL_RGBA32F : GL_RGBA8;
+
+        const bool is_fbo_reusable = m_fbo != nullptr && m_fbo->width() == framebuffer_width &&
+                                     m_fbo->height() == framebuffer_height && m_fbo->format().internalTextureFormat() == fbo_format;
+        if (!is_fbo_reusable)
+        {
+            m_fbo = std::make_unique<QOpenGLFramebufferObject>(framebuffer_width,
+                                                               framebuffer_height,
+                                                               QOpenGLFramebufferObject::NoAttachment,
+                                                               GL_TEXTURE_2D,
+                                                               fbo_format);
+        }
+    }
+
+    QImage OffscreenEnhancer::enhanceImageAtlas(const QImage& image, const std::vector<Eigen::VectorXd>& parameter_sets, const int columns)
+    {
+        if (!isValid() || image.isNull() || parameter_sets.empty()) { return QImage(); }
+
+        const int         width  = image.width();
+        const int         height = image.height();
+        const AtlasLayout layout = make_atlas_layout(width, height, static_cast<int>(parameter_sets.size()), columns);
+        if (layout.getWidth() > m_max_tile_size || layout.getHeight() > m_max_tile_size)
+        {
+            std::cerr << "Error: The atlas exceeds the maximum tile size." << std::endl;
+            return QImage();
+        }
+
+        if (!m_context->makeCurrent(m_surface.get())) { return QImage(); }
+
+        const QImage source_image = image.convertToFormat(QImage::Format_RGBA8888);
+        QImage       atlas_image(layout.getWidth(), layout.getHeight(), QImage::Format_RGBA8888);
+
+        prepareTargets(width, height, layout.getWidth(), layout.getHeight(), false);
+
+        // RGBA8888 rows are multiples of four bytes, so the row lengths can be given in pixels
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(source_image.bytesPerLine() / 4));
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_PACK_ROW_LENGTH, static_cast<GLint>(atlas_image.bytesPerLine() / 4));
+
+        m_texture->bind(TEXTURE_UNIT_ID);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, source_image.constBits());
+
+        m_fbo->bind();
+        glViewport(0, 0, layout.getWidth(), layout.getHeight());
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        m_program->bind();
+        m_vao.bind();
+
+        // As in render, the rows of the texture and the framebuffer are top-down in memory, so the cell at the atlas
+        // row r starts at the framebuffer row r * height
+        std::array<GLfloat, NUM_PARAMETERS> parameters;
+        for (int k = 0; k < static_cast<int>(parameter_sets.size()); ++k)
+        {
+            assert(parameter_sets[k].size() == NUM_PARAMETERS);
+            for (int i = 0; i < NUM_PARAMETERS; ++i) { parameters[i] = static_cast<GLfloat>(parameter_sets[k][i]); }
+
+            m_program->setUniformValueArray("parameters", parameters.data(), NUM_PARAMETERS, 1);
+            glViewport(layout.getCellX(k), layout.getCellY(k), width, height);
+            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        }
+
+        glReadPixels(0, 0, layout.getWidth(), layout.getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, atlas_image.bits());
+
+        m_vao.release();
+        m_texture->release();
+        m_program->release();
+        m_fbo->release();
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+        const bool is_succeeded = glGetError() == GL_NO_ERROR;
+        if (!is_succeeded) { std::cerr << "Error: OpenGL error during offscreen rendering." << std::endl; }
+
+        m_context->doneCurrent();
+
+        if (!is_succeeded) { return QImage(); }
+
+        // The shader writes alpha = 1, so the alpha of the source is copied to each cell
+        for (int k = 0; k < static_cast<int>(parameter_sets.size()); ++k)
+        {
+            for (int y = 0; y < height; ++y)
+            {
+                const std::uint8_t* src_pixel = source_image.constScanLine(y);
+                std::uint8_t*       dst_pixel = atlas_image.scanLine(layout.getCellY(k) + y) + 4 * layout.getCellX(k);
+                for (int x = 0; x < width; ++x, src_pixel += 4, dst_pixel += 4) { dst_pixel[3] = src_pixel[3]; }
+            }
+        }
+
+        return atlas_image;
+    }
+
+    template <typename T>
+    bool OffscreenEnhancer::render(const T*             src,
+                                   T*                   dst,
+                                   const int            width,
+                                   const int            height,
+                                   const std::ptrdiff_t src_stride,
+                                   const std::ptrdiff_t dst_stride,
+                                   const int            channels,
+                                   ImageStatistics*     statistics)
+    {
+        assert(channels == 3 || channels == 4);
+
+        if (!isValid() || width <= 0 || height <= 0) { return false; }
+        if (!m_context->makeCurrent(m_surface.get())) { return false; }
+
+        constexpr bool is_float = std::is_same<T, float>::value;
+
+        const GLenum type      = is_float ? GL_FLOAT : GL_UNSIGNED_BYTE;
+        const GLenum format    = channels == 4 ? GL_RGBA : GL_RGB;
+        const int    pixel_size = channels * static_cast<int>(sizeof(T));
+
+        // The texture and the framebuffer always have the size of a full tile; smaller tiles at the right and
+        // bottom edges use their lower-left corners, which keeps texels and fragments aligned one-to-one
+        const int tile_width  = std::min(width, m_max_tile_size);
+        const int tile_height = std::min(height, m_max_tile_size);
+        prepareTargets(tile_width, tile_height, tile_width, tile_height, is_float);
+
+        m_readback_buffer.resize(static_cast<std::size_t>(tile_width) * tile_height * 4 * sizeof(T));
+
+        // Rows of a QImage are top-down, and so are the rows of the texture and the framebuffer here; since
+        // glReadPixels returns the rows in the same order as glTexSubImage2D takes them, no flip is needed
+        const bool is_row_length_usable = src_stride % pixel_size == 0;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, is_row_length_usable ? static_cast<GLint>(src_stride / pixel_size) : 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+        m_fbo->bind();
+        glViewport(0, 0, tile_width, tile_height);
+
+        const bool with_local_adjustments = !m_local_adjustments.empty();
+        const bool with_masks             = std::any_of(m_local_adjustments.begin(), m_local_adjustments.end(), [](const LocalAdjustment& adjustment)
+        {
+            return adjustment.shape == LocalAdjustment::Shape::Mask;
+        });
+
+        QOpenGLShaderProgram* program = with_local_adjustments ? m_local_program.get() : m_program.get();
+
+        program->bind();
+        program->setUniformValueArray("parameters", m_parameters.data(), NUM_PARAMETERS, 1);
+        m_texture->bind(TEXTURE_UNIT_ID);
+        m_vao.bind();
+
+        if (with_local_adjustments) { setLocalUniforms(width, height); }
+        if (with_masks)
+        {
+            const bool is_mask_reusable = m_mask_texture != nullptr && m_mask_texture->width() == tile_width && m_mask_texture->height() == tile_height;
+            if (!is_mask_reusable)
+            {
+                m_mask_texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+                m_mask_texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+                m_mask_texture->setSize(tile_width, tile_height);
+                m_mask_texture->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+                m_mask_texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+                m_mask_texture->allocateStorage();
+            }
+            m_mask_texture->bind(MASK_TEXTURE_UNIT_ID);
+        }
+        if (with_local_adjustments && m_grid_texture != nullptr) { m_grid_texture->bind(GRID_TEXTURE_UNIT_ID); }
+
+        for (int tile_y = 0; tile_y < height; tile_y += tile_height)
+        {
+            for (int tile_x = 0; tile_x < width; tile_x += tile_width)
+            {
+                const int w = std::min(tile_width, width - tile_x);
+                const int h = std::min(tile_height, height - tile_y);
+
+                const auto get_src_pixel = [&](const int y) -> const T*
+                {
+                    return reinterpret_cast<const T*>(reinterpret_cast<const std::uint8_t*>(src) + (tile_y + y) * src_stride) + tile_x * channels;
+                };
+
+                {
+                    // Timed on the CPU: the driver copies client memory before glTexSubImage2D returns
+                    const internal::TraceSpan span("gpu_upload", InstrumentedStage::GpuUpload);
+
+                    if (is_row_length_usable)
+                    {
+                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, format, type, get_src_pixel(0));
+                    }
+                    else
+                    {
+                        for (int y = 0; y < h; ++y)
+                        {
+                            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, w, 1, format, type, get_src_pixel(y));
+                        }
+                    }
+                }
+
+                if (with_local_adjustments) { program->setUniformValue("local_origin", static_cast<GLfloat>(tile_x), static_cast<GLfloat>(tile_y)); }
+                if (with_masks) { uploadLocalMasks(tile_x, tile_y, w, h); }
+
+                if (m_gpu_timer != nullptr) { m_gpu_timer->begin(InstrumentedStage::GpuDraw); }
+                glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+                if (m_gpu_timer != nullptr) { m_gpu_timer->end(); }
+
+                {
+                    // Includes the wait for the draw, since glReadPixels into client memory is synchronous
+                    const internal::TraceSpan span("gpu_readback", InstrumentedStage::GpuReadback);
+                    glReadPixels(0, 0, w, h, GL_RGBA, type, m_readback_buffer.data());
+                }
+
+                // The shader writes alpha = 1, so only the color channels are taken from the framebuffer
+                const T* result = reinterpret_cast<const T*>(m_readback_buffer.data());
+
+                if (statistics != nullptr)
+                {
+                    compute_image_statistics(ImageView<const T>(result, w, h, static_cast<std::ptrdiff_t>(w) * 4 * sizeof(T)), *statistics);
+                }
+                if (dst == nullptr) { continue; }
+
+                for (int y = 0; y < h; ++y)
+                {
+                    const T* src_pixel = get_src_pixel(y);
+                    T*       dst_pixel = reinterpret_cast<T*>(reinterpret_cast<std::uint8_t*>(dst) + (tile_y + y) * dst_stride) + tile_x * channels;
+                    const T* res_pixel = result + static_cast<std::size_t>(y) * w * 4;
+
+                    for (int x = 0; x < w; ++x, src_pixel += channels, dst_pixel += channels, res_pixel += 4)
+                    {
+                        if (channels == 4) { dst_pixel[3] = src_pixel[3]; }
+                        std::memcpy(dst_pixel, res_pixel, 3 * sizeof(T));
+                    }
+                }
+            }
+        }
+
+        m_vao.release();
+        m_texture->release();
+        if (with_masks) { m_mask_texture->release(MASK_TEXTURE_UNIT_ID); }
+        if (with_local_adjustments && m_grid_texture != nullptr) { m_grid_texture->release(GRID_TEXTURE_UNIT_ID); }
+        program->release();
+        m_fbo->release();
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+        // The draws have finished with the last readback, so this does not wait
+        if (m_gpu_timer != nullptr) { m_gpu_timer->collect(true); }
+
+        const bool is_succeeded = glGetError() == GL_NO_ERROR;
+        if (!is_succeeded) { std::cerr << "Error: OpenGL error during offscreen rendering." << std::endl; }
+
+        m_context->doneCurrent();
+
+        return is_succeeded;
+    }
+} // namespace enhancer
@@ -0,0 +1,218 @@
+#include "shaderprogram.hpp"
+#include <QFile>
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QString>
+#include <chrono>
+#include <enhancer/shadercache.hpp>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace enhancer
+{
+    namespace internal
+    {
+        namespace
+        {
+            // Programs are shared within a share group; the texture unit is part of the key because the sampler
+            // uniform is set once when the program is built
+            struct ProgramKey
+            {
+                QOpenGLContextGroup* share_group;
+                int                  texture_unit_id;
+                std::string          defines;
+
+                bool operator<(const ProgramKey& other) const
+                {
+                    return std::tie(share_group, texture_unit_id, defines) <
+                           std::tie(other.share_group, other.texture_unit_id, other.defines);
+                }
+            };
+
+            // The process-wide state; everything is guarded by `mutex`, which is also held while a program is built so
+            // that two threads never build the same variant for the same share group
+            struct ShaderCache
+            {
+                std::mutex mutex;
+
+                std::map<std::string, std::string>                        sources;
+                std::map<ProgramKey, std::weak_ptr<QOpenGLShaderProgram>> programs;
+                ShaderCacheStatistics                                     statistics;
+            };
+
+            ShaderCache& getShaderCache()
+            {
+                static ShaderCache cache;
+                return cache;
+            }
+
+            double getMilliseconds(const std::chrono::steady_clock::time_point& start)
+            {
+                return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            // Read from the Qt resources once per process; a failed read is not cached, so that it is retried (e.g.,
+            // after the resources have been initialized) and reported every time
+            bool loadShaderCode(ShaderCache& cache, const char* file_name, std::string& code)
+            {
+                auto iter = cache.sources.find(file_name);
+                if (iter != cache.sources.end())
+                {
+                    code = iter->second;
+                    return true;
+                }
+
+                QFile file(file_name);
+                if (!file.open(QIODevice::ReadOnly))
+                {
+                    std::cerr << "Error: failed to load shader codes." << std::endl;
+                    return false;
+                }
+
+                code = file.readAll().toStdString();
+                file.close();
+
+                cache.sources.emplace(file_name, code);
+                return true;
+            }
+
+            // `defines` are inserted right after the #version line
+            std::string insertDefines(const std::string& code, const std::string& defines)
+            {
+                const std::size_t version_pos = code.find("#version");
+                if (version_pos == std::string::npos || defines.empty()) { return code; }
+
+                const std::size_t line_end = code.find('\n', version_pos);
+                if (line_end == std::string::npos) { return code + "\n\n" + defines; }
+
+                return code.substr(0, line_end + 1) + "\n" + defines + code.substr(line_end + 1);
+            }
+
+            std::string makeDefines(const Accuracy        accuracy,
+                                    const bool            with_uv_rect,
+                                    const bool            with_local_adjustments,
+                                    const PipelineVersion pipeline_version)
+            {
+                std::string defines;
+
+                if (pipeline_version == PipelineVersion::V1) { defines.append("#define ENHANCER_V_1_0\n"); }
+
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+                defines.append("#define ENHANCER_WITH_LIFT_GAMMA_GAIN\n");
+#endif
+
+                if (with_uv_rect) { defines.append("#define ENHANCER_WITH_UV_RECT\n"); }
+                if (with_local_adjustments) { defines.append("#define ENHANCER_WITH_LOCAL_ADJUSTMENTS\n"); }
+
+                switch (accuracy)
+                {
+                    case Accuracy::Fast: defines.append("#define ENHANCER_ACCURACY_FAST\n"); break;
+                    case Accuracy::Fastest: defines.append("#define ENHANCER_ACCURACY_FASTEST\n"); break;
+                    default: break;
+                }
+
+                return defines;
+            }
+
+            std::shared_ptr<QOpenGLShaderProgram> buildProgram(ShaderCache& cache, const int texture_unit_id, const std::string& defines)
+            {
+                std::string vert_code;
+                std::string frag_code;
+                if (!loadShaderCode(cache, "://shaders/enhancer.vs", vert_code) || !loadShaderCode(cache, "://shaders/enhancer.fs", frag_code))
+                {
+                    return nullptr;
+                }
+                vert_code = insertDefines(vert_code, defines);
+                frag_code = insertDefines(frag_code, defines);
+
+                const auto start = std::chrono::steady_clock::now();
+
+                std::shared_ptr<QOpenGLShaderProgram> program = std::make_shared<QOpenGLShaderProgram>();
+
+                // Qt keeps the linked binaries of cacheable shaders in its own disk cache (keyed by the sources and
+                // the driver), and then links from there instead of compiling
+#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
+                const bool is_compiled = program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, QString::fromStdString(vert_code)) &&
+                                         program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, QString::fromStdString(frag_code));
+#else
+                const bool is_compiled = program->addShaderFromSourceCode(QOpenGLShader::Vertex, QString::fromStdString(vert_code)) &&
+                                         program->addShaderFromSourceCode(QOpenGLShader::Fragment, QString::fromStdString(frag_code));
+#endif
+
+                if (!is_compiled || !program->link())
+                {
+                    std::cerr << "Error: failed to build the shader program." << std::endl;
+                    std::cerr << program->log().toStdString() << std::endl;
+                    return nullptr;
+                }
+
+                cache.statistics.num_built += 1;
+                cache.statistics.build_milliseconds += getMilliseconds(start);
+
+                program->bind();
+                program->setUniformValue("texture_sampler", texture_unit_id);
+
+                // Inactive in the variants without local adjustments, where setting them is a no-op
+                program->setUniformValue("local_mask_sampler", texture_unit_id + 1);
+                program->setUniformValue("local_grid_sampler", texture_unit_id + 2);
+                program->release();
+
+                return program;
+            }
+        } // namespace
+
+        std::shared_ptr<QOpenGLShaderProgram> createEnhancerProgram(const int             texture_unit_id,
+                                                                    const Accuracy        accuracy,
+                                                                    const bool            with_uv_rect,
+                                                                    const bool            with_local_adjustments,
+                                                                    const PipelineVersion pipeline_version)
+        {
+            ShaderCache&                cache = getShaderCache();
+            std::lock_guard<std::mutex> lock(cache.mutex);
+
+            cache.statistics.num_requests += 1;
+
+            // The defines identify the variant, so V1 and V2 programs never share an entry
+            const ProgramKey key{QOpenGLContext::currentContext()->shareGroup(),
+                                 texture_unit_id,
+                                 makeDefines(accuracy, with_uv_rect, with_local_adjustments, pipeline_version)};
+
+            // Entries of programs released by all their users are dropped here, which also keeps a share group
+            // re-allocated at the same address from getting a program of a destroyed one
+            for (auto iter = cache.programs.begin(); iter != cache.programs.end();)
+            {
+                iter = iter->second.expired() ? cache.programs.erase(iter) : std::next(iter);
+            }
+
+            auto iter = cache.programs.find(key);
+            if (iter != cache.programs.end())
+            {
+                cache.statistics.num_shared += 1;
+                return iter->second.lock();
+            }
+
+            std::shared_ptr<QOpenGLShaderProgram> program = buildProgram(cache, texture_unit_id, key.defines);
+            if (program != nullptr) { cache.programs.emplace(key, program); }
+
+            return program;
+        }
+    } // namespace internal
+
+    ShaderCacheStatistics get_shader_cache_statistics()
+    {
+        internal::ShaderCache&      cache = internal::getShaderCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+
+        return cache.statistics;
+    }
+
+    void reset_shader_cache_statistics()
+    {
+        internal::ShaderCache&      cache = internal::getShaderCache();
+        std::lock_guard<std::mutex> lock(cache.mutex);
+
+        cache.statistics = ShaderCacheStatistics();
+    }
+} // namespace enhancer
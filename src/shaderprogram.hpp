@@ -0,0 +1,35 @@
+#ifndef enhancer_shaderprogram_hpp
+#define enhancer_shaderprogram_hpp
+
+#include <enhancer/enhancer.hpp>
+#include <enhancer/preset.hpp>
+#include <memory>
+
+class QOpenGLShaderProgram;
+
+namespace enhancer
+{
+    namespace internal
+    {
+        // Compiles and links enhancer.vs/enhancer.fs (from the Qt resources) for the current OpenGL context, with
+        // ENHANCER_WITH_LIFT_GAMMA_GAIN injected when it is defined for the C++ side and the ENHANCER_ACCURACY_* define
+        // of `accuracy`. `with_uv_rect` adds ENHANCER_WITH_UV_RECT, with which the vertex shader maps the viewport to
+        // the part of the texture given by the `uv_rect` uniform. `with_local_adjustments` adds
+        // ENHANCER_WITH_LOCAL_ADJUSTMENTS (see enhancer/local.hpp), whose mask and grid samplers are bound to the
+        // texture units `texture_unit_id` + 1 and + 2. `pipeline_version` V1 adds ENHANCER_V_1_0, with which the
+        // fragment shader runs the original pipeline on six "parameters" instead (see enhancer/preset.hpp). The sampler
+        // of the source is bound to texture unit `texture_unit_id`. Returns nullptr (after printing the log) when
+        // compilation or linking fails.
+        //
+        // Programs are shared: a program of the same variant already built in the share group of the current context
+        // is returned as is, and new ones go through Qt's shader disk cache (see enhancer/shadercache.hpp). The
+        // "parameters", "uv_rect", and "local_*" uniforms therefore have to be set before each draw.
+        std::shared_ptr<QOpenGLShaderProgram> createEnhancerProgram(const int             texture_unit_id,
+                                                                    const Accuracy        accuracy               = Accuracy::Exact,
+                                                                    const bool            with_uv_rect           = false,
+                                                                    const bool            with_local_adjustments = false,
+                                                                    const PipelineVersion pipeline_version       = CURRENT_PIPELINE_VERSION);
+    } // namespace internal
+} // namespace enhancer
+
+#endif /* enhancer_shaderprogram_hpp */
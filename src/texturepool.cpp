@@ -0,0 +1,80 @@
+#include "texturepool.hpp"
+#include <iterator>
+
+namespace enhancer
+{
+    namespace internal
+    {
+        namespace
+        {
+            int getBytesPerPixel(const QOpenGLTexture::TextureFormat format)
+            {
+                switch (format)
+                {
+                    case QOpenGLTexture::RGBA16_UNorm:
+                    case QOpenGLTexture::RGBA16F:
+                        return 8;
+                    case QOpenGLTexture::RGBA32F:
+                        return 16;
+                    default:
+                        return 4;
+                }
+            }
+        } // namespace
+
+        std::unique_ptr<QOpenGLTexture> TexturePool::acquire(const int width, const int height, const QOpenGLTexture::TextureFormat format)
+        {
+            // The most recently returned match is taken, which is the most likely to be still resident
+            for (auto entry = m_entries.rbegin(); entry != m_entries.rend(); ++entry)
+            {
+                if (entry->width != width || entry->height != height || entry->format != format) { continue; }
+
+                std::unique_ptr<QOpenGLTexture> texture = std::move(entry->texture);
+                m_cached_bytes -= entry->bytes;
+                m_entries.erase(std::next(entry).base());
+
+                return texture;
+            }
+
+            std::unique_ptr<QOpenGLTexture> texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+            texture->setFormat(format);
+            texture->setSize(width, height);
+            texture->setMipLevels(texture->maximumMipLevels());
+            texture->setMinMagFilters(QOpenGLTexture::LinearMipMapLinear, QOpenGLTexture::Linear);
+            texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+            texture->allocateStorage();
+
+            return texture;
+        }
+
+        void TexturePool::release(std::unique_ptr<QOpenGLTexture> texture)
+        {
+            if (texture == nullptr) { return; }
+
+            const int                           width  = texture->width();
+            const int                           height = texture->height();
+            const QOpenGLTexture::TextureFormat format = texture->format();
+
+            // A full mipmap chain adds a third to the base level
+            const std::size_t bytes = static_cast<std::size_t>(width) * height * getBytesPerPixel(format) * 4 / 3;
+            if (bytes > m_max_cached_bytes) { return; }
+
+            m_entries.push_back(Entry{ width, height, format, bytes, std::move(texture) });
+            m_cached_bytes += bytes;
+
+            std::size_t num_evicted = 0;
+            while (m_cached_bytes > m_max_cached_bytes)
+            {
+                m_cached_bytes -= m_entries[num_evicted].bytes;
+                ++num_evicted;
+            }
+            m_entries.erase(m_entries.begin(), m_entries.begin() + num_evicted);
+        }
+
+        void TexturePool::clear()
+        {
+            m_entries.clear();
+            m_cached_bytes = 0;
+        }
+    } // namespace internal
+} // namespace enhancer
@@ -0,0 +1,55 @@
+#ifndef enhancer_texturepool_hpp
+#define enhancer_texturepool_hpp
+
+#include <QOpenGLTexture>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace enhancer
+{
+    namespace internal
+    {
+        // A cache of the tile textures that a widget no longer shows (e.g., the tiles of a previous image of another
+        // size, or of a pyramid level left when zooming), keyed by their size and format, so that switching between
+        // images or levels reuses storage instead of allocating textures again. The textures have full mipmap chains,
+        // linear filtering, and clamping to the edges. The least recently returned textures are destroyed first once
+        // the cache exceeds `max_cached_bytes`. The context has to be current for all the calls, including the
+        // destructor.
+        class TexturePool
+        {
+        public:
+            explicit TexturePool(const std::size_t max_cached_bytes = std::size_t(256) << 20) : m_max_cached_bytes(max_cached_bytes) {}
+
+            TexturePool(const TexturePool&) = delete;
+            TexturePool& operator=(const TexturePool&) = delete;
+
+            // Returns a cached texture of the size and the format, or a newly allocated one; its contents are undefined
+            std::unique_ptr<QOpenGLTexture> acquire(const int width, const int height, const QOpenGLTexture::TextureFormat format);
+
+            // Keeps `texture` for a later acquire; null textures are ignored
+            void release(std::unique_ptr<QOpenGLTexture> texture);
+
+            void clear();
+
+            std::size_t getCachedBytes() const { return m_cached_bytes; }
+
+        private:
+            struct Entry
+            {
+                int                             width;
+                int                             height;
+                QOpenGLTexture::TextureFormat   format;
+                std::size_t                     bytes;
+                std::unique_ptr<QOpenGLTexture> texture;
+            };
+
+            // The oldest entries first
+            std::vector<Entry> m_entries;
+            std::size_t        m_cached_bytes = 0;
+            std::size_t        m_max_cached_bytes;
+        };
+    } // namespace internal
+} // namespace enhancer
+
+#endif /* enhancer_texturepool_hpp */
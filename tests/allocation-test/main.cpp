@@ -0,0 +1,174 @@
+// Makes Eigen check for heap allocations while they are disallowed (see countSteadyStateAllocations)
+#define EIGEN_RUNTIME_NO_MALLOC
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <enhancer/bufferpool.hpp>
+#include <enhancer/enhancer.hpp>
+#include <enhancer/instrumentation.hpp>
+#include <enhancer/parallel.hpp>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <random>
+#include <vector>
+
+// Checks that the CPU paths meant for interactive use and video do not touch the heap once warmed up. Without
+// instrumentation, a frame must not allocate at all; with it, each thread of the pool may allocate its row buffer the
+// first time it gets a tile.
+
+// The global allocation functions are replaced by ones counting the calls (from any thread) while
+// countSteadyStateAllocations has counting enabled. Every block, aligned or not, is taken from malloc with room for a
+// header holding the address returned by malloc, so that all the forms of operator delete free it the same way.
+namespace
+{
+    constexpr int num_threads = 4;
+
+    std::atomic<bool>        is_counting_allocations(false);
+    std::atomic<std::size_t> num_heap_allocations(0);
+
+    void* allocateCounted(const std::size_t size, const std::size_t alignment)
+    {
+        if (is_counting_allocations) { ++num_heap_allocations; }
+
+        const std::size_t align = std::max(alignment, alignof(std::max_align_t));
+        void* const       block = std::malloc(size + align + sizeof(void*));
+        if (block == nullptr) { throw std::bad_alloc(); }
+
+        // The header sits right below the aligned block
+        const std::uintptr_t address = (reinterpret_cast<std::uintptr_t>(block) + sizeof(void*) + align - 1) & ~std::uintptr_t(align - 1);
+        void* const          data    = reinterpret_cast<void*>(address);
+
+        static_cast<void**>(data)[-1] = block;
+        return data;
+    }
+
+    void freeCounted(void* data)
+    {
+        if (data != nullptr) { std::free(static_cast<void**>(data)[-1]); }
+    }
+} // namespace
+
+void* operator new(std::size_t size) { return allocateCounted(size, 1); }
+void* operator new[](std::size_t size) { return allocateCounted(size, 1); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateCounted(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateCounted(size, static_cast<std::size_t>(alignment)); }
+
+void operator delete(void* data) noexcept { freeCounted(data); }
+void operator delete[](void* data) noexcept { freeCounted(data); }
+void operator delete(void* data, std::size_t) noexcept { freeCounted(data); }
+void operator delete[](void* data, std::size_t) noexcept { freeCounted(data); }
+void operator delete(void* data, std::align_val_t) noexcept { freeCounted(data); }
+void operator delete[](void* data, std::align_val_t) noexcept { freeCounted(data); }
+void operator delete(void* data, std::size_t, std::align_val_t) noexcept { freeCounted(data); }
+void operator delete[](void* data, std::size_t, std::align_val_t) noexcept { freeCounted(data); }
+
+namespace
+{
+    // Runs the CPU entry points that are meant to be allocation-free once warmed up (the per-pixel enhance with a
+    // ParameterVector and with an expression, enhance_image, both enhance_image_parallel, enhance_images_parallel, and
+    // a frame in a BufferPool buffer) three times and returns the number of heap allocations of the last run (or the
+    // maximum if the results are not finite). Eigen allocations are disallowed meanwhile, which fails an assertion in
+    // builds with assertions.
+    std::size_t countSteadyStateAllocations(const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        const int                       width            = 97;
+        const int                       height           = (static_cast<int>(colors.size()) + width - 1) / width;
+        const std::ptrdiff_t            stride           = 3 * width * sizeof(float);
+        const enhancer::TileSize        tile_size        = { 32, 8 };
+        const enhancer::ParameterVector fixed_parameters = parameters;
+
+        std::vector<float> pixels(3 * width * height, 0.0f);
+        for (std::size_t i = 0; i < colors.size(); ++i)
+        {
+            for (int c = 0; c < 3; ++c) { pixels[3 * i + c] = static_cast<float>(colors[i](c)); }
+        }
+        std::vector<float> result(pixels.size());
+
+        const enhancer::ImageView<const float> src_view(pixels.data(), width, height, stride, enhancer::ChannelOrder::RGB);
+        const enhancer::ImageView<float>       dst_view(result.data(), width, height, stride, enhancer::ChannelOrder::RGB);
+
+        const std::vector<enhancer::ImageTask<float>> tasks = {
+            { pixels.data(), result.data(), width, height / 2, stride, 3, parameters },
+            { pixels.data() + 3 * width * (height / 2), result.data() + 3 * width * (height / 2), width, height - height / 2, stride, 3, parameters },
+        };
+
+        enhancer::ThreadPool pool(num_threads);
+        enhancer::BufferPool buffer_pool;
+
+        double checksum = 0.0;
+        const auto run  = [&]()
+        {
+            for (const Eigen::Vector3d& color : colors)
+            {
+                checksum += enhancer::enhance(color, fixed_parameters).sum();
+                checksum += enhancer::enhance(color, 0.5 * (fixed_parameters + parameters)).sum();
+            }
+
+            enhancer::enhance_image(pixels.data(), result.data(), width, height, stride, 3, parameters);
+            enhancer::enhance_image_parallel(pool, pixels.data(), result.data(), width, height, stride, 3, parameters, tile_size);
+            enhancer::enhance_image_parallel<float>(pool, src_view, dst_view, parameters, enhancer::Accuracy::Exact, enhancer::ValueRange::Display, tile_size);
+            enhancer::enhance_images_parallel(pool, tasks, tile_size);
+
+            const enhancer::PooledBuffer frame = buffer_pool.acquire(pixels.size() * sizeof(float));
+            enhancer::enhance_image_parallel<float>(pool, src_view, frame.getImageView<float>(width, height, enhancer::ChannelOrder::RGB), parameters);
+            checksum += frame.getData<float>()[0];
+        };
+
+        run();
+        run();
+        enhancer::reset_instrumentation();
+
+        num_heap_allocations    = 0;
+        is_counting_allocations = true;
+        Eigen::internal::set_is_malloc_allowed(false);
+        run();
+        Eigen::internal::set_is_malloc_allowed(true);
+        is_counting_allocations = false;
+        const std::size_t num_allocations = num_heap_allocations;
+
+        if (!std::isfinite(checksum)) { return std::numeric_limits<std::size_t>::max(); }
+
+        return num_allocations;
+    }
+} // namespace
+
+int main()
+{
+    // A 16^3 grid of colors
+    std::vector<Eigen::Vector3d> colors;
+    for (int r = 0; r < 16; ++r)
+    {
+        for (int g = 0; g < 16; ++g)
+        {
+            for (int b = 0; b < 16; ++b) { colors.push_back(Eigen::Vector3d(r, g, b) / 15.0); }
+        }
+    }
+
+    std::mt19937                           engine(0);
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+    std::vector<Eigen::VectorXd> parameter_sets = { Eigen::VectorXd::Constant(enhancer::NUM_PARAMETERS, 0.5) };
+    for (int i = 0; i < 4; ++i) { parameter_sets.push_back(Eigen::VectorXd::NullaryExpr(enhancer::NUM_PARAMETERS, [&]() { return distribution(engine); })); }
+
+    const std::size_t max_allocations = enhancer::is_instrumentation_enabled ? num_threads : 0;
+
+    bool is_passed = true;
+    for (const Eigen::VectorXd& parameters : parameter_sets)
+    {
+        const std::size_t num_allocations = countSteadyStateAllocations(colors, parameters);
+        if (num_allocations > max_allocations)
+        {
+            std::cerr << "Failed: " << num_allocations << " allocations (at most " << max_allocations << " are allowed) with parameters " << parameters.transpose() << std::endl;
+            is_passed = false;
+        }
+    }
+
+    if (!is_passed) { return 1; }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <QImage>
-#include <enhancer/enhancer.hpp>
+#include <cstdint>
+#include <enhancer/sweep.hpp>
 #include <iomanip>
 #include <sstream>
 #include <string>
@@ -19,35 +20,6 @@ std::string convertParametersToString(const Eigen::VectorXd& parameters)
     return sstream.str();
 }
 
-inline QRgb convertEigenToQRgb(const Eigen::Vector3d& color)
-{
-    return qRgb(color[0] * 255.0, color[1] * 255.0, color[2] * 255.0);
-}
-
-inline Eigen::Vector3d convertQRgbToEigen(const QRgb& color)
-{
-    return Eigen::Vector3d(qRed(color), qGreen(color), qBlue(color)) / 255.0;
-}
-
-QImage enhanceQImage(const QImage& target_image, const Eigen::VectorXd& parameters)
-{
-    QImage enhanced_image(target_image.size(), target_image.format());
-    for (int x = 0; x < target_image.width(); ++x)
-    {
-        for (int y = 0; y < target_image.height(); ++y)
-        {
-            const QRgb            qrgb_color           = target_image.pixel(x, y);
-            const Eigen::Vector3d eigen_color          = convertQRgbToEigen(qrgb_color);
-            const Eigen::Vector3d eigen_enhanced_color = enhancer::enhance(eigen_color, parameters);
-            const QRgb            qrgb_enhanced_color  = convertEigenToQRgb(eigen_enhanced_color);
-
-            enhanced_image.setPixel(x, y, qrgb_enhanced_color);
-        }
-    }
-
-    return enhanced_image;
-}
-
 int main(int argc, char** argv)
 {
     constexpr int num_steps    = 5;
@@ -55,7 +27,9 @@ int main(int argc, char** argv)
 
     Q_INIT_RESOURCE(enhancer_resources);
     const QImage target_image = QImage("://test-images/DSC03039.JPG").scaledToWidth(target_width);
+    const QImage source_image = target_image.convertToFormat(QImage::Format_RGBA8888);
 
+    std::vector<Eigen::VectorXd> parameter_sets;
     for (int dim = 0; dim < enhancer::NUM_PARAMETERS; ++dim)
     {
         for (int step = 0; step < num_steps; ++step)
@@ -63,13 +37,30 @@ int main(int argc, char** argv)
             std::vector<double> parameters_data(enhancer::NUM_PARAMETERS, 0.5);
             parameters_data[dim] = static_cast<double>(step) / static_cast<double>(num_steps - 1);
 
-            const Eigen::VectorXd parameters     = Eigen::Map<const Eigen::VectorXd>(parameters_data.data(), enhancer::NUM_PARAMETERS);
-            const QImage          enhanced_image = enhanceQImage(target_image, parameters);
-            const std::string     path           = "./" + convertParametersToString(parameters) + ".png";
-
-            enhanced_image.save(QString::fromStdString(path));
+            parameter_sets.push_back(Eigen::Map<const Eigen::VectorXd>(parameters_data.data(), enhancer::NUM_PARAMETERS));
         }
     }
 
+    // All the presets are evaluated in one sweep, which reads and linearizes each source pixel only once
+    std::vector<QImage>                            enhanced_images;
+    std::vector<enhancer::ImageView<std::uint8_t>> enhanced_views;
+    for (std::size_t i = 0; i < parameter_sets.size(); ++i)
+    {
+        enhanced_images.emplace_back(source_image.size(), QImage::Format_RGBA8888);
+    }
+    for (QImage& enhanced_image : enhanced_images)
+    {
+        enhanced_views.emplace_back(enhanced_image.bits(), enhanced_image.width(), enhanced_image.height(), enhanced_image.bytesPerLine());
+    }
+
+    const enhancer::ImageView<const std::uint8_t> source_view(source_image.constBits(), source_image.width(), source_image.height(), source_image.bytesPerLine());
+    enhancer::enhance_image_sweep(source_view, enhanced_views, parameter_sets);
+
+    for (std::size_t i = 0; i < parameter_sets.size(); ++i)
+    {
+        const std::string path = "./" + convertParametersToString(parameter_sets[i]) + ".png";
+        enhanced_images[i].save(QString::fromStdString(path));
+    }
+
     return 0;
 }
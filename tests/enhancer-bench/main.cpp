@@ -0,0 +1,521 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <enhancer/enhancer.hpp>
+#include <enhancer/gradient.hpp>
+#include <enhancer/image.hpp>
+#include <enhancer/instrumentation.hpp>
+#include <enhancer/local.hpp>
+#include <enhancer/lut.hpp>
+#include <enhancer/outofcore.hpp>
+#include <enhancer/parallel.hpp>
+#include <enhancer/pipeline.hpp>
+#include <enhancer/preset.hpp>
+#include <enhancer/simd.hpp>
+#include <enhancer/statistics.hpp>
+#include <enhancer/sweep.hpp>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+    constexpr double min_seconds_per_measurement = 0.25;
+    constexpr int    max_repeats                 = 1000;
+    constexpr int    num_stage_samples           = 1 << 16;
+
+    struct Result
+    {
+        std::string group;
+        std::string name;
+        std::string preset;
+        int         width;
+        int         height;
+        int         num_repeats;
+        double      seconds; // The fastest repeat
+        double      nanoseconds_per_pixel;
+        double      mega_pixels_per_second;
+    };
+
+    struct Preset
+    {
+        std::string     name;
+        Eigen::VectorXd parameters;
+    };
+
+    struct Size
+    {
+        int width;
+        int height;
+    };
+
+    struct Options
+    {
+        std::string json_path;
+        std::string trace_path;
+        std::string filter;
+        bool        is_full = false;
+    };
+
+    // Results are accumulated into this value so that the compiler cannot remove the benchmarked calls
+    volatile double g_sink = 0.0;
+
+    std::vector<Result> g_results;
+
+    Options g_options;
+
+    // Runs `func` (once as a warm-up, and then until the time budget is spent) and records the fastest run
+    void measure(const std::string&           group,
+                 const std::string&           name,
+                 const std::string&           preset,
+                 const int                    width,
+                 const int                    height,
+                 const std::function<void()>& func)
+    {
+        const std::string label = group + "/" + name + "/" + preset;
+        if (!g_options.filter.empty() && label.find(g_options.filter) == std::string::npos) { return; }
+
+        double best_seconds  = std::numeric_limits<double>::infinity();
+        double total_seconds = 0.0;
+        int    num_repeats   = 0;
+        while (num_repeats == 0 || (total_seconds < min_seconds_per_measurement && num_repeats < max_repeats))
+        {
+            const auto begin = std::chrono::steady_clock::now();
+            func();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+            best_seconds = std::min(best_seconds, seconds);
+            total_seconds += seconds;
+            ++num_repeats;
+        }
+
+        const double num_pixels = static_cast<double>(width) * height;
+        const Result result{ group, name, preset, width, height, num_repeats, best_seconds, 1e+09 * best_seconds / num_pixels, 1e-06 * num_pixels / best_seconds };
+        g_results.push_back(result);
+
+        std::cout << std::left << std::setw(56) << label << std::right << std::setw(6) << width << " x " << std::setw(5) << height
+                  << std::fixed << std::setprecision(2) << std::setw(12) << result.nanoseconds_per_pixel << " ns/px"
+                  << std::setw(10) << result.mega_pixels_per_second << " MP/s" << std::endl;
+    }
+
+    void accumulate(const Eigen::Vector3d& rgb) { g_sink = g_sink + rgb.sum(); }
+
+    std::vector<Preset> getPresets()
+    {
+        const int n = enhancer::NUM_PARAMETERS;
+
+        Eigen::VectorXd brightness = Eigen::VectorXd::Constant(n, 0.5);
+        brightness(0)              = 0.7;
+
+        Eigen::VectorXd all = Eigen::VectorXd::Constant(n, 0.5);
+        for (int i = 0; i < n; ++i) { all(i) = (i % 2 == 0) ? 0.62 : 0.41; }
+
+        return { { "neutral", Eigen::VectorXd::Constant(n, 0.5) }, { "brightness", brightness }, { "all", all } };
+    }
+
+    std::vector<Eigen::Vector3d> generateColors(const int count)
+    {
+        std::mt19937                           engine(0);
+        std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+        std::vector<Eigen::Vector3d> colors(count);
+        for (Eigen::Vector3d& color : colors) { color = Eigen::Vector3d(distribution(engine), distribution(engine), distribution(engine)); }
+        return colors;
+    }
+
+    template <typename T> std::vector<T> generateImage(const int width, const int height)
+    {
+        std::mt19937                           engine(0);
+        std::uniform_int_distribution<int>     integer_distribution(0, std::is_integral<T>::value ? std::numeric_limits<T>::max() : 0);
+        std::uniform_real_distribution<float>  float_distribution(0.0f, 1.0f);
+
+        std::vector<T> image(static_cast<std::size_t>(width) * height * 4);
+        for (T& value : image)
+        {
+            if constexpr (std::is_integral<T>::value) { value = static_cast<T>(integer_distribution(engine)); }
+            else { value = static_cast<T>(float_distribution(engine)); }
+        }
+        return image;
+    }
+
+    // Per-color stage functions of enhancer::internal, measured over random colors
+    void runStageBenchmarks()
+    {
+        using namespace enhancer::internal;
+
+        const std::vector<Eigen::Vector3d> colors = generateColors(num_stage_samples);
+
+        const std::vector<std::pair<std::string, std::function<Eigen::Vector3d(const Eigen::Vector3d&)>>> stages =
+        {
+            { "convertRgbToLinearRgb", [](const Eigen::Vector3d& c) { return convertRgbToLinearRgb(c); } },
+            { "convertLinearRgbToRgb", [](const Eigen::Vector3d& c) { return convertLinearRgbToRgb(c); } },
+            { "rgb2yuv", [](const Eigen::Vector3d& c) { return rgb2yuv(c); } },
+            { "yuv2rgb", [](const Eigen::Vector3d& c) { return yuv2rgb(c); } },
+            { "rgb2hsv", [](const Eigen::Vector3d& c) { return rgb2hsv(c); } },
+            { "hsv2rgb", [](const Eigen::Vector3d& c) { return hsv2rgb(c); } },
+            { "rgb2hsl", [](const Eigen::Vector3d& c) { return rgb2hsl(c); } },
+            { "hsl2rgb", [](const Eigen::Vector3d& c) { return hsl2rgb(c); } },
+            { "applyTemperatureTintEffect", [](const Eigen::Vector3d& c) { return applyTemperatureTintEffect(c, 0.12, -0.09); } },
+            { "applyLiftGammaGainEffect", [](const Eigen::Vector3d& c) { return applyLiftGammaGainEffect(c, Eigen::Vector3d(1.1, 0.9, 1.0), Eigen::Vector3d(0.9, 1.0, 1.2), Eigen::Vector3d(1.0, 1.1, 0.8)); } },
+            { "applyBrightnessEffect", [](const Eigen::Vector3d& c) { return applyBrightnessEffect(c, 0.12); } },
+            { "applyContrastEffect", [](const Eigen::Vector3d& c) { return applyContrastEffect(c, -0.09); } },
+            { "applySaturationEffect", [](const Eigen::Vector3d& c) { return applySaturationEffect(c, 0.12); } },
+            { "changeColorBalance", [](const Eigen::Vector3d& c) { return changeColorBalance(c, Eigen::Vector3d(0.1, -0.05, 0.0)); } },
+        };
+
+        for (const auto& stage : stages)
+        {
+            measure("stage", stage.first, "-", num_stage_samples, 1, [&]()
+            {
+                for (const Eigen::Vector3d& color : colors) { accumulate(stage.second(color)); }
+            });
+        }
+    }
+
+    // Whole pipeline per color, through each C++ entry point
+    void runPixelBenchmarks(const Preset& preset)
+    {
+        const std::vector<Eigen::Vector3d> colors = generateColors(num_stage_samples);
+        const int                          count  = num_stage_samples;
+
+        const Eigen::VectorXd& parameters = preset.parameters;
+
+        const enhancer::internal::DecodedParameters decoded = enhancer::internal::decodeParameters(parameters);
+        const enhancer::Enhancer<enhancer::ConfiguredParams> compiled_enhancer(parameters.head<enhancer::NUM_PARAMETERS>());
+        const enhancer::CompiledPipeline                     pipeline(parameters);
+
+        Eigen::VectorXd parameters_v1 = Eigen::VectorXd::Constant(6, 0.5);
+        parameters_v1.head(std::min(6, static_cast<int>(parameters.size()))) = parameters.head(std::min(6, static_cast<int>(parameters.size())));
+
+        measure("pixel", "enhance", preset.name, count, 1, [&]() { for (const auto& c : colors) { accumulate(enhancer::enhance(c, parameters)); } });
+        measure("pixel", "enhance (decoded)", preset.name, count, 1, [&]() { for (const auto& c : colors) { accumulate(enhancer::internal::enhance(c, decoded)); } });
+        measure("pixel", "Enhancer<ConfiguredParams>", preset.name, count, 1, [&]() { for (const auto& c : colors) { accumulate(compiled_enhancer(c)); } });
+        measure("pixel", "CompiledPipeline", preset.name, count, 1, [&]() { for (const auto& c : colors) { accumulate(pipeline(c)); } });
+        measure("pixel", "enhance_v1", preset.name, count, 1, [&]() { for (const auto& c : colors) { accumulate(enhancer::internal::enhance_v1(c, parameters_v1)); } });
+
+        // One enhance_with_jacobian against the NUM_PARAMETERS + 1 evaluations of a forward-difference Jacobian
+        enhancer::ColorJacobian jacobian;
+        measure("pixel", "enhance_with_jacobian", preset.name, count, 1, [&]() { for (const auto& c : colors) { accumulate(enhancer::enhance_with_jacobian(c, parameters, jacobian)); } });
+    }
+
+    // Image-level paths (RGBA, tightly packed)
+    void runImageBenchmarks(const Preset& preset, const Size& size, enhancer::ThreadPool& pool)
+    {
+        const int            w      = size.width;
+        const int            h      = size.height;
+        const std::ptrdiff_t stride = 4 * static_cast<std::ptrdiff_t>(w);
+
+        const Eigen::VectorXd& parameters = preset.parameters;
+
+        const std::vector<std::uint8_t> src_u8 = generateImage<std::uint8_t>(w, h);
+        const std::vector<float>        src_f  = generateImage<float>(w, h);
+        std::vector<std::uint8_t>       dst_u8(src_u8.size());
+        std::vector<float>              dst_f(src_f.size());
+
+        const auto checksum = [&]() { g_sink = g_sink + dst_u8[dst_u8.size() / 2] + dst_f[dst_f.size() / 2]; };
+
+        measure("image", "enhance_image<uint8>", preset.name, w, h, [&]() { enhancer::enhance_image(src_u8.data(), dst_u8.data(), w, h, stride, 4, parameters); checksum(); });
+        measure("image", "enhance_image<float>", preset.name, w, h, [&]() { enhancer::enhance_image(src_f.data(), dst_f.data(), w, h, 4 * stride, 4, parameters); checksum(); });
+        {
+            const std::vector<std::uint16_t> src_u16 = generateImage<std::uint16_t>(w, h);
+            const std::vector<Eigen::half>   src_h   = generateImage<Eigen::half>(w, h);
+            std::vector<std::uint16_t>       dst_u16(src_u16.size());
+            std::vector<Eigen::half>         dst_h(src_h.size());
+
+            measure("image", "enhance_image<uint16>", preset.name, w, h, [&]() { enhancer::enhance_image(src_u16.data(), dst_u16.data(), w, h, 2 * stride, 4, parameters); g_sink = g_sink + dst_u16[dst_u16.size() / 2]; });
+            measure("image", "enhance_image<half>", preset.name, w, h, [&]() { enhancer::enhance_image(src_h.data(), dst_h.data(), w, h, 2 * stride, 4, parameters); g_sink = g_sink + static_cast<float>(dst_h[dst_h.size() / 2]); });
+        }
+        measure("image", "enhance_image<uint8>/fast", preset.name, w, h, [&]() { enhancer::enhance_image(src_u8.data(), dst_u8.data(), w, h, stride, 4, parameters, enhancer::Accuracy::Fast); checksum(); });
+        measure("image", "enhance_image<uint8>/fastest", preset.name, w, h, [&]() { enhancer::enhance_image(src_u8.data(), dst_u8.data(), w, h, stride, 4, parameters, enhancer::Accuracy::Fastest); checksum(); });
+
+        // A sweep over 25 candidates, against 25 enhance_image calls; the pixels are the output pixels of all the
+        // candidates, which overwrite one buffer to keep the memory footprint of the large sizes small
+        {
+            constexpr int num_candidates = 25;
+
+            std::vector<Eigen::VectorXd> parameter_sets(num_candidates, parameters);
+            for (int k = 0; k < num_candidates; ++k) { parameter_sets[k](k % enhancer::NUM_PARAMETERS) = static_cast<double>(k) / (num_candidates - 1); }
+
+            const enhancer::ImageView<const std::uint8_t>        src_view_u8(src_u8.data(), w, h, stride);
+            const enhancer::ImageView<const float>               src_view_f(src_f.data(), w, h, 4 * stride);
+            const std::vector<enhancer::ImageView<std::uint8_t>> dsts_u8(num_candidates, enhancer::ImageView<std::uint8_t>(dst_u8.data(), w, h, stride));
+            const std::vector<enhancer::ImageView<float>>        dsts_f(num_candidates, enhancer::ImageView<float>(dst_f.data(), w, h, 4 * stride));
+
+            measure("image", "enhance_image<float>/x25", preset.name, w, num_candidates * h, [&]()
+            {
+                for (const Eigen::VectorXd& p : parameter_sets) { enhancer::enhance_image(src_f.data(), dst_f.data(), w, h, 4 * stride, 4, p); }
+                checksum();
+            });
+            measure("image", "enhance_image_sweep<float>/x25", preset.name, w, num_candidates * h, [&]() { enhancer::enhance_image_sweep(src_view_f, dsts_f, parameter_sets); checksum(); });
+            measure("image", "enhance_image_sweep<uint8>/x25", preset.name, w, num_candidates * h, [&]() { enhancer::enhance_image_sweep(src_view_u8, dsts_u8, parameter_sets); checksum(); });
+        }
+
+        const enhancer::SimdLevel best_level = enhancer::detectSimdLevel();
+        const std::vector<std::pair<std::string, enhancer::SimdLevel>> levels = { { "scalar", enhancer::SimdLevel::Scalar }, { "avx2", enhancer::SimdLevel::Avx2 }, { "avx512", enhancer::SimdLevel::Avx512 } };
+        for (const auto& level : levels)
+        {
+            if (level.second > best_level) { continue; }
+
+            measure("image", "enhance_image_simd<uint8>/" + level.first, preset.name, w, h, [&]() { enhancer::enhance_image_simd(src_u8.data(), dst_u8.data(), w, h, stride, 4, parameters, level.second); checksum(); });
+            measure("image", "enhance_image_simd<float>/" + level.first, preset.name, w, h, [&]() { enhancer::enhance_image_simd(src_f.data(), dst_f.data(), w, h, 4 * stride, 4, parameters, level.second); checksum(); });
+        }
+
+        const enhancer::CompiledPipeline pipeline(parameters);
+        measure("image", "CompiledPipeline<uint8>", preset.name, w, h, [&]() { pipeline.apply(src_u8.data(), dst_u8.data(), w, h, stride, 4); checksum(); });
+
+        const enhancer::Lut3D lut(parameters);
+        measure("image", "Lut3D<uint8>/tetrahedral", preset.name, w, h, [&]() { lut.apply(src_u8.data(), dst_u8.data(), w, h, stride, 4, enhancer::Lut3D::Interpolation::Tetrahedral); checksum(); });
+        measure("image", "Lut3D<uint8>/trilinear", preset.name, w, h, [&]() { lut.apply(src_u8.data(), dst_u8.data(), w, h, stride, 4, enhancer::Lut3D::Interpolation::Trilinear); checksum(); });
+        measure("image", "Lut3D<float>/tetrahedral", preset.name, w, h, [&]() { lut.apply(src_f.data(), dst_f.data(), w, h, 4 * stride, 4, enhancer::Lut3D::Interpolation::Tetrahedral); checksum(); });
+
+        const std::string threads = "/threads=" + std::to_string(pool.getNumThreads());
+        measure("image", "enhance_image_parallel<uint8>" + threads, preset.name, w, h, [&]() { enhancer::enhance_image_parallel(pool, src_u8.data(), dst_u8.data(), w, h, stride, 4, parameters); checksum(); });
+        {
+            const enhancer::ImageView<const std::uint8_t> src_view(src_u8.data(), w, h, stride);
+            const enhancer::ImageView<const std::uint8_t> target_view(dst_u8.data(), w, h, stride);
+            measure("image", "compute_loss_and_gradient<uint8>" + threads, preset.name, w, h, [&]() { g_sink = g_sink + enhancer::compute_loss_and_gradient(pool, src_view, target_view, parameters).loss; });
+        }
+        {
+            // Statistics of the output in a second pass, fused with the enhancement, and without writing the output
+            const enhancer::ImageView<const std::uint8_t> src_view(src_u8.data(), w, h, stride);
+            const enhancer::ImageView<std::uint8_t>       dst_view(dst_u8.data(), w, h, stride);
+
+            const auto sink_statistics = [](const enhancer::ImageStatistics& statistics) { g_sink = g_sink + statistics.getMeanLuminance(); };
+
+            measure("image", "enhance_image_parallel<uint8>+statistics" + threads, preset.name, w, h, [&]()
+            {
+                enhancer::ImageStatistics statistics;
+                enhancer::enhance_image_parallel<std::uint8_t>(pool, src_view, dst_view, parameters);
+                enhancer::compute_image_statistics<std::uint8_t>(dst_view, statistics);
+                sink_statistics(statistics);
+            });
+            measure("image", "enhance_image_parallel_with_statistics<uint8>" + threads, preset.name, w, h, [&]()
+            {
+                enhancer::ImageStatistics statistics;
+                enhancer::enhance_image_parallel_with_statistics<std::uint8_t>(pool, src_view, dst_view, parameters, statistics);
+                sink_statistics(statistics);
+            });
+            measure("image", "compute_enhanced_statistics_parallel<uint8>" + threads, preset.name, w, h, [&]()
+            {
+                enhancer::ImageStatistics statistics;
+                enhancer::compute_enhanced_statistics_parallel<std::uint8_t>(pool, src_view, parameters, statistics);
+                sink_statistics(statistics);
+            });
+        }
+        {
+            // Local adjustments in one pass: without any (the cost of the per-pixel weights machinery alone), and
+            // with a mask and two gradients, where the parameters are blended and decoded per pixel
+            const enhancer::ImageView<const std::uint8_t> src_view(src_u8.data(), w, h, stride);
+            const enhancer::ImageView<std::uint8_t>       dst_view(dst_u8.data(), w, h, stride);
+
+            std::vector<std::uint8_t> mask(static_cast<std::size_t>(w) * h);
+            for (std::size_t i = 0; i < mask.size(); ++i) { mask[i] = static_cast<std::uint8_t>(i % 256); }
+
+            const Eigen::VectorXd                        adjusted    = Eigen::VectorXd::Ones(parameters.size()) - parameters;
+            const std::vector<enhancer::LocalAdjustment> adjustments = {
+                enhancer::make_mask_adjustment(adjusted, mask.data(), w),
+                enhancer::make_linear_gradient_adjustment(adjusted, Eigen::Vector2d(0.0, 0.0), Eigen::Vector2d(0.0, 0.5)),
+                enhancer::make_radial_gradient_adjustment(adjusted, Eigen::Vector2d(0.5, 0.5), Eigen::Vector2d(0.3, 0.3)),
+            };
+
+            measure("image", "enhance_image_local_parallel<uint8>/none" + threads, preset.name, w, h, [&]() { enhancer::enhance_image_local_parallel(pool, src_view, dst_view, parameters, {}); checksum(); });
+            measure("image", "enhance_image_local_parallel<uint8>/x3" + threads, preset.name, w, h, [&]() { enhancer::enhance_image_local_parallel(pool, src_view, dst_view, parameters, adjustments); checksum(); });
+        }
+        measure("image", "processImageTiles<uint8>/simd" + threads, preset.name, w, h, [&]()
+        {
+            enhancer::processImageTiles(pool, src_u8.data(), dst_u8.data(), w, h, stride, 4, parameters, [](const std::uint8_t* s, std::uint8_t* d, int tw, int th, std::ptrdiff_t st, int ch, const Eigen::VectorXd& p)
+            {
+                enhancer::enhance_image_simd(s, d, tw, th, st, ch, p);
+            });
+            checksum();
+        });
+
+        // Streaming between files in the page cache with a 16 MiB working set, which shows the cost of the band
+        // mapping and the write-back over enhance_image_parallel (the disk is not measured)
+        const std::filesystem::path directory = std::filesystem::temp_directory_path();
+        const std::string           src_path  = (directory / "enhancer-bench-src.raw").string();
+        const std::string           dst_path  = (directory / "enhancer-bench-dst.tif").string();
+        {
+            enhancer::ImageFile src_file;
+            enhancer::ImageFile dst_file;
+            if (src_file.createRaw(src_path, w, h, 4, enhancer::SampleType::UInt8) && dst_file.createTiff(dst_path, w, h, 4, enhancer::SampleType::UInt8))
+            {
+                {
+                    const enhancer::MappedRegion rows = src_file.mapRows(0, h);
+                    std::copy(src_u8.begin(), src_u8.end(), rows.getData());
+                }
+
+                enhancer::OutOfCoreOptions options;
+                options.working_set_bytes = std::size_t(16) << 20;
+
+                measure("image", "enhance_image_file<uint8>" + threads, preset.name, w, h, [&]()
+                {
+                    enhancer::enhance_image_file(pool, src_file, dst_file, parameters, enhancer::Accuracy::Exact, enhancer::ValueRange::Display, options);
+                });
+            }
+        }
+        std::error_code ignored;
+        std::filesystem::remove(src_path, ignored);
+        std::filesystem::remove(dst_path, ignored);
+    }
+
+    // One-time costs of the table-based paths; the "pixels" are the table entries
+    void runSetupBenchmarks(const Preset& preset)
+    {
+        measure("setup", "Lut3D(33)", preset.name, 33 * 33, 33, [&]() { const enhancer::Lut3D lut(preset.parameters); g_sink = g_sink + lut.getData()[0]; });
+        measure("setup", "CompiledPipeline", preset.name, 1, 1, [&]() { const enhancer::CompiledPipeline pipeline(preset.parameters); g_sink = g_sink + pipeline.getNumPowCalls(); });
+
+        // Loading the same LUT from a preset file, which maps it instead of computing it (the pages are only touched
+        // by the first apply, so the file is mostly in the page cache here)
+        const std::string preset_path = (std::filesystem::temp_directory_path() / "enhancer-bench.preset").string();
+        if (enhancer::save_preset(preset_path, enhancer::make_preset(preset.name, preset.parameters, 33)))
+        {
+            measure("setup", "MappedPreset(33)", preset.name, 33 * 33, 33, [&]()
+            {
+                enhancer::MappedPreset mapped_preset;
+                if (mapped_preset.open(preset_path)) { g_sink = g_sink + mapped_preset.getLut().getData()[0]; }
+            });
+            std::error_code ignored;
+            std::filesystem::remove(preset_path, ignored);
+        }
+
+        if (g_options.is_full)
+        {
+            measure("setup", "ExactLut8", preset.name, 4096, 4096, [&]() { const enhancer::ExactLut8 lut(preset.parameters); g_sink = g_sink + lut.getParameters()(0); });
+        }
+    }
+
+    std::string escapeJson(const std::string& text)
+    {
+        std::string escaped;
+        for (const char c : text)
+        {
+            if (c == '"' || c == '\\') { escaped.push_back('\\'); }
+            escaped.push_back(c);
+        }
+        return escaped;
+    }
+
+    const char* getSimdLevelName(const enhancer::SimdLevel level)
+    {
+        switch (level)
+        {
+            case enhancer::SimdLevel::Avx512: return "avx512";
+            case enhancer::SimdLevel::Avx2: return "avx2";
+            case enhancer::SimdLevel::Scalar: return "scalar";
+        }
+        return "unknown";
+    }
+
+    void writeJson(const std::string& path, const int num_threads)
+    {
+        std::ofstream stream(path);
+        if (!stream)
+        {
+            std::cerr << "Error: failed to open " << path << "." << std::endl;
+            return;
+        }
+
+        stream << "{\n";
+        stream << "  \"num_parameters\": " << enhancer::NUM_PARAMETERS << ",\n";
+        stream << "  \"simd_level\": \"" << getSimdLevelName(enhancer::detectSimdLevel()) << "\",\n";
+        stream << "  \"num_threads\": " << num_threads << ",\n";
+#if defined(__VERSION__)
+        stream << "  \"compiler\": \"" << escapeJson(__VERSION__) << "\",\n";
+#endif
+        stream << "  \"results\": [\n";
+        for (std::size_t i = 0; i < g_results.size(); ++i)
+        {
+            const Result& r = g_results[i];
+            stream << "    {\"group\": \"" << escapeJson(r.group) << "\", \"name\": \"" << escapeJson(r.name) << "\", \"preset\": \"" << escapeJson(r.preset)
+                   << "\", \"width\": " << r.width << ", \"height\": " << r.height << ", \"repeats\": " << r.num_repeats
+                   << std::setprecision(9) << ", \"seconds\": " << r.seconds << ", \"ns_per_pixel\": " << r.nanoseconds_per_pixel
+                   << ", \"mp_per_second\": " << r.mega_pixels_per_second << "}" << (i + 1 < g_results.size() ? "," : "") << "\n";
+        }
+        stream << "  ]\n";
+        stream << "}\n";
+    }
+
+    // The per-stage totals over all the benchmarks run; the stages are timed per row, so the totals include the
+    // overhead of the timers, which matters for the cheap stages
+    void printInstrumentationStats()
+    {
+        const enhancer::InstrumentationStats stats = enhancer::get_instrumentation_stats();
+
+        std::cout << std::left << std::setw(20) << "stage" << std::right << std::setw(14) << "count" << std::setw(14) << "seconds"
+                  << std::setw(14) << "ns/pixel" << std::endl;
+        for (int i = 0; i < enhancer::num_instrumented_stages; ++i)
+        {
+            const enhancer::TimingStats& stage = stats.stages[i];
+            if (stage.count == 0) { continue; }
+
+            const double ns_per_pixel = stats.pixels_processed > 0 ? 1e9 * stage.seconds / stats.pixels_processed : 0.0;
+            std::cout << std::left << std::setw(20) << enhancer::get_stage_name(static_cast<enhancer::InstrumentedStage>(i)) << std::right
+                      << std::setw(14) << stage.count << std::fixed << std::setprecision(3) << std::setw(14) << stage.seconds
+                      << std::setw(14) << ns_per_pixel << std::defaultfloat << std::endl;
+        }
+        for (std::size_t i = 0; i < stats.thread_tiles.size(); ++i)
+        {
+            std::cout << std::left << std::setw(20) << ("tiles (thread " + std::to_string(i) + ")") << std::right << std::setw(14)
+                      << stats.thread_tiles[i].count << std::fixed << std::setprecision(3) << std::setw(14) << stats.thread_tiles[i].seconds
+                      << std::defaultfloat << std::endl;
+        }
+        if (stats.num_dropped_spans > 0) { std::cout << "Spans dropped from the trace: " << stats.num_dropped_spans << std::endl; }
+    }
+} // namespace
+
+// Usage: enhancer-bench [--json <path>] [--trace <path>] [--filter <substring>] [--full]
+//   --json    writes all the results to a JSON file (e.g., for tracking regressions between releases)
+//   --trace   prints the per-stage totals and writes a Chrome trace (needs ENHANCER_USE_INSTRUMENTATION)
+//   --filter  runs only the measurements whose "group/name/preset" label contains the substring
+//   --full    adds a 4K image size and the 256^3 ExactLut8 construction
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) { g_options.json_path = argv[++i]; }
+        else if (arg == "--trace" && i + 1 < argc) { g_options.trace_path = argv[++i]; }
+        else if (arg == "--filter" && i + 1 < argc) { g_options.filter = argv[++i]; }
+        else if (arg == "--full") { g_options.is_full = true; }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--json <path>] [--trace <path>] [--filter <substring>] [--full]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Size> sizes = { { 256, 256 }, { 1920, 1080 } };
+    if (g_options.is_full) { sizes.push_back({ 3840, 2160 }); }
+
+    enhancer::ThreadPool pool;
+
+    std::cout << "Parameters: " << enhancer::NUM_PARAMETERS << ", SIMD: " << getSimdLevelName(enhancer::detectSimdLevel()) << ", threads: " << pool.getNumThreads() << std::endl;
+
+    runStageBenchmarks();
+
+    for (const Preset& preset : getPresets())
+    {
+        runPixelBenchmarks(preset);
+        runSetupBenchmarks(preset);
+
+        for (const Size& size : sizes) { runImageBenchmarks(preset, size, pool); }
+    }
+
+    if (!g_options.json_path.empty()) { writeJson(g_options.json_path, pool.getNumThreads()); }
+    if (!g_options.trace_path.empty())
+    {
+        if (!enhancer::is_instrumentation_enabled) { std::cerr << "Warning: Built without ENHANCER_USE_INSTRUMENTATION; the trace is empty." << std::endl; }
+        printInstrumentationStats();
+        enhancer::write_chrome_trace(g_options.trace_path);
+    }
+
+    return 0;
+}
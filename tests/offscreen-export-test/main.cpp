@@ -0,0 +1,94 @@
+#include <QGuiApplication>
+#include <QImage>
+#include <algorithm>
+#include <cstdlib>
+#include <enhancer/image.hpp>
+#include <enhancer/offscreenenhancer.hpp>
+#include <enhancer/shadercache.hpp>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+std::string convertParametersToString(const Eigen::VectorXd& parameters)
+{
+    std::ostringstream sstream;
+
+    sstream << "p";
+    for (int i = 0; i < parameters.size(); ++i)
+    {
+        sstream << "_";
+        sstream << std::fixed << std::setprecision(2) << parameters[i];
+    }
+
+    return sstream.str();
+}
+
+int computeMaxDifference(const QImage& a, const QImage& b)
+{
+    int max_difference = 0;
+    for (int y = 0; y < a.height(); ++y)
+    {
+        const uchar* a_row = a.constScanLine(y);
+        const uchar* b_row = b.constScanLine(y);
+        for (int x = 0; x < 4 * a.width(); ++x)
+        {
+            max_difference = std::max(max_difference, std::abs(int(a_row[x]) - int(b_row[x])));
+        }
+    }
+    return max_difference;
+}
+
+// Renders the test image at its full resolution without any window (e.g., QT_QPA_PLATFORM=offscreen) and reports
+// the maximum difference from the C++ implementation in 8-bit levels
+int main(int argc, char** argv)
+{
+    constexpr int num_steps = 5;
+
+    QGuiApplication app(argc, argv);
+
+    Q_INIT_RESOURCE(enhancer_resources);
+    const QImage source_image = QImage("://test-images/DSC03039.JPG").convertToFormat(QImage::Format_RGBA8888);
+
+    // A small maximum tile size exercises the tiled rendering
+    enhancer::OffscreenEnhancer offscreen_enhancer(1024);
+    if (!offscreen_enhancer.isValid()) { return 1; }
+
+    // A second run is faster, as Qt links the program from its shader disk cache instead of compiling it
+    const enhancer::ShaderCacheStatistics statistics = enhancer::get_shader_cache_statistics();
+    std::cout << "Shader program: " << statistics.num_built << " built (" << statistics.build_milliseconds << " ms)" << std::endl;
+
+    std::cout << "Image: " << source_image.width() << " x " << source_image.height() << ", tile size: " << offscreen_enhancer.getMaxTileSize() << std::endl;
+
+    for (int dim = 0; dim < enhancer::NUM_PARAMETERS; ++dim)
+    {
+        for (int step = 0; step < num_steps; ++step)
+        {
+            std::vector<double> parameters_data(enhancer::NUM_PARAMETERS, 0.5);
+            parameters_data[dim] = static_cast<double>(step) / static_cast<double>(num_steps - 1);
+
+            const Eigen::VectorXd parameters = Eigen::Map<const Eigen::VectorXd>(parameters_data.data(), enhancer::NUM_PARAMETERS);
+            const std::string     path       = "./" + convertParametersToString(parameters) + ".png";
+
+            offscreen_enhancer.setParameters(parameters);
+            const QImage enhanced_image = offscreen_enhancer.enhanceImage(source_image);
+            if (enhanced_image.isNull()) { return 1; }
+
+            QImage reference_image(source_image.size(), QImage::Format_RGBA8888);
+            enhancer::enhance_image(source_image.constBits(),
+                                    reference_image.bits(),
+                                    source_image.width(),
+                                    source_image.height(),
+                                    source_image.bytesPerLine(),
+                                    4,
+                                    parameters);
+
+            std::cout << convertParametersToString(parameters) << ": max difference = " << computeMaxDifference(enhanced_image, reference_image) << std::endl;
+
+            enhanced_image.save(QString::fromStdString(path));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/outofcore.hpp>
+#include <enhancer/parallel.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+// Streams images through enhance_image_file and checks that the output files match enhance_image_parallel in memory,
+// that the working set depends on the tile size and the number of threads but not on the image height, and that a
+// malformed TIFF file is rejected.
+namespace
+{
+    int num_failures = 0;
+
+    void check(const bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "Failed: " << description << std::endl;
+            ++num_failures;
+        }
+    }
+
+    std::string getTemporaryPath(const std::string& name) { return (std::filesystem::temp_directory_path() / name).string(); }
+
+    template <typename T> std::vector<T> generatePixels(const std::size_t count)
+    {
+        std::mt19937                       engine(0);
+        std::uniform_int_distribution<int> distribution(0, std::numeric_limits<T>::max());
+
+        std::vector<T> pixels(count);
+        for (T& value : pixels) { value = static_cast<T>(distribution(engine)); }
+        return pixels;
+    }
+
+    // A 16-bit RGBA TIFF file streamed with a budget of a few rows
+    void testTiff(enhancer::ThreadPool& pool, const Eigen::VectorXd& parameters)
+    {
+        const std::string src_path = getTemporaryPath("enhancer-outofcore-test-src.tif");
+        const std::string dst_path = getTemporaryPath("enhancer-outofcore-test-dst.tif");
+
+        const int width  = 97;
+        const int height = 61;
+
+        enhancer::OutOfCoreOptions options;
+        options.working_set_bytes = 20 * width * 8;
+        options.tile_size         = enhancer::TileSize{ 13, 2 };
+
+        std::vector<std::uint16_t> pixels = generatePixels<std::uint16_t>(4 * width * height);
+        for (std::size_t i = 3; i < pixels.size(); i += 4) { pixels[i] = 65535; }
+
+        {
+            enhancer::ImageFile src_file;
+            enhancer::ImageFile dst_file;
+            if (!src_file.createTiff(src_path, width, height, 4, enhancer::SampleType::UInt16) ||
+                !dst_file.createTiff(dst_path, width, height, 4, enhancer::SampleType::UInt16))
+            {
+                check(false, "creating the TIFF files");
+                return;
+            }
+            {
+                const enhancer::MappedRegion rows = src_file.mapRows(0, height);
+                std::copy(pixels.begin(), pixels.end(), reinterpret_cast<std::uint16_t*>(rows.getData()));
+            }
+
+            enhancer::ImageFile      reopened_src_file;
+            enhancer::OutOfCoreStats stats;
+            check(reopened_src_file.openTiff(src_path), "reopening the TIFF file");
+            check(enhancer::enhance_image_file(pool, reopened_src_file, dst_file, parameters, enhancer::Accuracy::Exact, enhancer::ValueRange::Display, options, &stats),
+                  "enhance_image_file on a TIFF file");
+            check(stats.peak_mapped_bytes <= options.working_set_bytes, "the mapped bytes of the TIFF files are within the budget");
+
+            std::vector<std::uint16_t> expected(pixels.size());
+            enhancer::enhance_image_parallel(pool, pixels.data(), expected.data(), width, height, 8 * width, 4, parameters);
+            {
+                const enhancer::MappedRegion rows   = dst_file.mapRows(0, height);
+                const std::uint16_t*         actual = reinterpret_cast<const std::uint16_t*>(rows.getData());
+                check(std::equal(expected.begin(), expected.end(), actual), "the streamed TIFF file matches enhance_image_parallel");
+            }
+        }
+        {
+            // A RowsPerStrip of 0 (the LONG entry of tag 278 in the classic TIFF directory) has to be rejected
+            std::fstream file(src_path, std::ios::in | std::ios::out | std::ios::binary);
+            std::string  bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            const std::string entry("\x16\x01\x04\x00\x01\x00\x00\x00", 8);
+            const std::size_t position = bytes.find(entry);
+            const char        zeros[4] = {};
+            check(position != std::string::npos, "the RowsPerStrip entry is written");
+            if (position != std::string::npos)
+            {
+                file.seekp(static_cast<std::streamoff>(position + entry.size()));
+                file.write(zeros, sizeof(zeros));
+                file.close();
+
+                enhancer::ImageFile malformed_file;
+                check(!malformed_file.openTiff(src_path), "a RowsPerStrip of 0 is rejected");
+            }
+        }
+
+        std::error_code ignored;
+        std::filesystem::remove(src_path, ignored);
+        std::filesystem::remove(dst_path, ignored);
+    }
+
+    // A raw 8-bit RGB file with padded rows, processed row by row
+    void testRaw(enhancer::ThreadPool& pool, const Eigen::VectorXd& parameters)
+    {
+        const std::string src_path = getTemporaryPath("enhancer-outofcore-test.raw");
+        const std::string dst_path = getTemporaryPath("enhancer-outofcore-test-dst.raw");
+
+        const int            width  = 97;
+        const int            height = 61;
+        const std::ptrdiff_t stride = 3 * width + 5;
+
+        enhancer::OutOfCoreOptions options;
+        options.working_set_bytes = 20 * width * 8;
+        options.tile_size         = enhancer::TileSize{ 13, 2 };
+
+        const std::vector<std::uint8_t> pixels = generatePixels<std::uint8_t>(3 * width * height);
+        {
+            enhancer::MappedFile file;
+            if (!file.create(src_path, stride * height))
+            {
+                check(false, "creating the raw file");
+                return;
+            }
+
+            const enhancer::MappedRegion rows = file.map(0, stride * height);
+            for (int y = 0; y < height; ++y) { std::copy_n(&pixels[3 * width * y], 3 * width, rows.getData() + stride * y); }
+        }
+
+        enhancer::ImageFile      src_file;
+        enhancer::ImageFile      dst_file;
+        enhancer::OutOfCoreStats stats;
+        check(src_file.openRaw(src_path, width, height, 3, enhancer::SampleType::UInt8, 0, stride), "opening the raw file");
+        check(dst_file.createRaw(dst_path, width, height, 3, enhancer::SampleType::UInt8), "creating the raw file");
+        check(enhancer::enhance_image_file(pool, src_file, dst_file, parameters, enhancer::Accuracy::Exact, enhancer::ValueRange::Display, options, &stats),
+              "enhance_image_file on a raw file");
+        check(stats.peak_mapped_bytes <= options.working_set_bytes, "the mapped bytes of the raw files are within the budget");
+
+        std::vector<std::uint8_t> expected(pixels.size());
+        enhancer::enhance_image_parallel(pool, pixels.data(), expected.data(), width, height, 3 * width, 3, parameters);
+        {
+            const enhancer::MappedRegion rows = dst_file.mapRows(0, height);
+            check(std::equal(expected.begin(), expected.end(), rows.getData()), "the streamed raw file matches enhance_image_parallel");
+        }
+
+        std::error_code ignored;
+        std::filesystem::remove(src_path, ignored);
+        std::filesystem::remove(dst_path, ignored);
+    }
+
+    // Streams a raw image of the given size with the default budget and returns the statistics
+    enhancer::OutOfCoreStats streamRawImage(enhancer::ThreadPool& pool, const int width, const int height, const enhancer::OutOfCoreOptions& options)
+    {
+        const std::string src_path = getTemporaryPath("enhancer-outofcore-test-src.raw");
+        const std::string dst_path = getTemporaryPath("enhancer-outofcore-test-dst.raw");
+
+        enhancer::OutOfCoreStats stats;
+        {
+            enhancer::ImageFile src_file;
+            enhancer::ImageFile dst_file;
+            const bool          is_streamed =
+                src_file.createRaw(src_path, width, height, 4, enhancer::SampleType::UInt8) && dst_file.createRaw(dst_path, width, height, 4, enhancer::SampleType::UInt8) &&
+                enhancer::enhance_image_file(pool, src_file, dst_file, Eigen::VectorXd::Constant(enhancer::NUM_PARAMETERS, 0.5), enhancer::Accuracy::Exact,
+                                             enhancer::ValueRange::Display, options, &stats);
+            check(is_streamed, "streaming a " + std::to_string(width) + " x " + std::to_string(height) + " image");
+        }
+
+        std::error_code ignored;
+        std::filesystem::remove(src_path, ignored);
+        std::filesystem::remove(dst_path, ignored);
+
+        return stats;
+    }
+
+    // The bands hold tiles_per_thread tiles per thread, so they grow with the number of threads but not with the
+    // image height, and keep their size when the same tiles are spread over more, narrower rows
+    void testWorkingSet()
+    {
+        enhancer::OutOfCoreOptions options;
+        options.tile_size        = enhancer::TileSize{ 16, 4 };
+        options.tiles_per_thread = 2;
+
+        enhancer::ThreadPool two_threads(2);
+        enhancer::ThreadPool four_threads(4);
+
+        const enhancer::OutOfCoreStats short_stats  = streamRawImage(two_threads, 64, 40, options);
+        const enhancer::OutOfCoreStats tall_stats   = streamRawImage(two_threads, 64, 400, options);
+        const enhancer::OutOfCoreStats narrow_stats = streamRawImage(two_threads, 32, 400, options);
+        const enhancer::OutOfCoreStats more_stats   = streamRawImage(four_threads, 64, 400, options);
+
+        // 2 tiles x 2 threads of 16 x 4 pixels fill one row of tiles of a 64-pixel-wide image
+        check(short_stats.band_height == 4 && tall_stats.band_height == 4, "the bands do not depend on the image height");
+        check(narrow_stats.band_height == 8, "the bands of a narrower image have more rows");
+        check(more_stats.band_height == 8, "the bands are proportional to the number of threads");
+
+        // At most num_bands bands of 4-byte pixels in the source and the destination are mapped at once
+        const std::size_t band_bytes = std::size_t(2) * 2 * 16 * 4 * 4 * 2;
+        check(tall_stats.peak_mapped_bytes <= options.num_bands * band_bytes, "the mapped bytes are within num_bands bands");
+        check(more_stats.peak_mapped_bytes <= options.num_bands * 2 * band_bytes, "the mapped bytes are within num_bands bands of twice the threads");
+    }
+} // namespace
+
+int main()
+{
+    enhancer::ThreadPool pool(4);
+
+    for (const Eigen::VectorXd& parameters :
+         { Eigen::VectorXd(Eigen::VectorXd::Constant(enhancer::NUM_PARAMETERS, 0.5)), Eigen::VectorXd(Eigen::VectorXd::LinSpaced(enhancer::NUM_PARAMETERS, 0.1, 0.9)) })
+    {
+        testTiff(pool, parameters);
+        testRaw(pool, parameters);
+    }
+    testWorkingSet();
+
+    if (num_failures > 0)
+    {
+        std::cerr << num_failures << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
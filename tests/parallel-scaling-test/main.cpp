@@ -0,0 +1,133 @@
+#include <QImage>
+#include <chrono>
+#include <cstdlib>
+#include <enhancer/parallel.hpp>
+#include <enhancer/simd.hpp>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct SimdKernel
+    {
+        template <typename T>
+        void operator()(const T*               src,
+                        T*                     dst,
+                        const int              width,
+                        const int              height,
+                        const std::ptrdiff_t   stride,
+                        const int              channels,
+                        const Eigen::VectorXd& parameters) const
+        {
+            enhancer::enhance_image_simd(src, dst, width, height, stride, channels, parameters);
+        }
+    };
+
+    template <typename Func> double measureSeconds(const int num_repeats, Func func)
+    {
+        func(); // Warm-up
+
+        const auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < num_repeats; ++i) { func(); }
+        const auto end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double>(end - begin).count() / num_repeats;
+    }
+
+    std::vector<int> getThreadCounts(const int max_num_threads)
+    {
+        std::vector<int> counts;
+        for (int n = 1; n < max_num_threads; n *= 2) { counts.push_back(n); }
+        counts.push_back(max_num_threads);
+        return counts;
+    }
+} // namespace
+
+// Usage: parallel-scaling-test [max_num_threads] [--exact]
+int main(int argc, char** argv)
+{
+    constexpr int num_repeats      = 5;
+    constexpr int num_small_images = 64;
+    constexpr int small_width      = 640;
+
+    int  max_num_threads = enhancer::ThreadPool::getDefaultNumThreads();
+    bool use_exact       = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--exact") { use_exact = true; }
+        else { max_num_threads = std::max(1, std::atoi(argv[i])); }
+    }
+
+    Q_INIT_RESOURCE(enhancer_resources);
+    const QImage source_image = QImage("://test-images/DSC03039.JPG").convertToFormat(QImage::Format_RGBA8888);
+    const QImage small_image  = source_image.scaledToWidth(small_width).convertToFormat(QImage::Format_RGBA8888);
+
+    QImage              enhanced_image(source_image.size(), QImage::Format_RGBA8888);
+    std::vector<QImage> enhanced_small_images(num_small_images, QImage(small_image.size(), QImage::Format_RGBA8888));
+
+    Eigen::VectorXd parameters = Eigen::VectorXd::Constant(enhancer::NUM_PARAMETERS, 0.5);
+    parameters.head<3>() << 0.6, 0.4, 0.6;
+
+    std::vector<enhancer::ImageTask<std::uint8_t>> small_tasks;
+    for (QImage& enhanced_small_image : enhanced_small_images)
+    {
+        small_tasks.push_back({ small_image.constBits(), enhanced_small_image.bits(), small_image.width(), small_image.height(), small_image.bytesPerLine(), 4, parameters });
+    }
+
+    const double mega_pixels       = source_image.width() * source_image.height() * 1e-6;
+    const double small_mega_pixels = num_small_images * small_image.width() * small_image.height() * 1e-6;
+
+    std::cout << "Image: " << source_image.width() << " x " << source_image.height() << " (" << mega_pixels << " MP), kernel: " << (use_exact ? "exact" : "simd") << std::endl;
+    std::cout << "threads | single image [s]  MP/s  speedup  efficiency | " << num_small_images << " small images [s]  MP/s  speedup" << std::endl;
+
+    double single_base_seconds = 0.0;
+    double batch_base_seconds  = 0.0;
+    for (const int num_threads : getThreadCounts(max_num_threads))
+    {
+        enhancer::ThreadPool pool(num_threads);
+
+        const auto run_single = [&]()
+        {
+            if (use_exact)
+            {
+                enhancer::enhance_image_parallel(pool, source_image.constBits(), enhanced_image.bits(), source_image.width(), source_image.height(), source_image.bytesPerLine(), 4, parameters);
+            }
+            else
+            {
+                enhancer::processImageTiles(pool, source_image.constBits(), enhanced_image.bits(), source_image.width(), source_image.height(), source_image.bytesPerLine(), 4, parameters, SimdKernel());
+            }
+        };
+        const auto run_batch = [&]()
+        {
+            if (use_exact) { enhancer::enhance_images_parallel(pool, small_tasks); }
+            else { enhancer::processImages(pool, small_tasks, SimdKernel()); }
+        };
+
+        const double single_seconds = measureSeconds(use_exact ? 1 : num_repeats, run_single);
+        const double batch_seconds  = measureSeconds(use_exact ? 1 : num_repeats, run_batch);
+
+        if (num_threads == 1)
+        {
+            single_base_seconds = single_seconds;
+            batch_base_seconds  = batch_seconds;
+        }
+
+        const double speedup = single_base_seconds / single_seconds;
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << std::setw(7) << num_threads << " | "
+                  << std::setw(16) << single_seconds << "  "
+                  << std::setw(4) << mega_pixels / single_seconds << "  "
+                  << std::setw(7) << speedup << "  "
+                  << std::setw(10) << speedup / num_threads << " | "
+                  << std::setw(20) << batch_seconds << "  "
+                  << std::setw(4) << small_mega_pixels / batch_seconds << "  "
+                  << std::setw(7) << batch_base_seconds / batch_seconds << std::endl;
+    }
+
+    enhanced_image.save("./parallel-scaling-test.jpg");
+
+    return 0;
+}
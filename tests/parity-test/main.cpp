@@ -0,0 +1,934 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <enhancer/enhancer.hpp>
+#include <enhancer/gradient.hpp>
+#include <enhancer/image.hpp>
+#include <enhancer/imageview.hpp>
+#include <enhancer/instrumentation.hpp>
+#include <enhancer/local.hpp>
+#include <enhancer/lut.hpp>
+#include <enhancer/parallel.hpp>
+#include <enhancer/pipeline.hpp>
+#include <enhancer/simd.hpp>
+#include <enhancer/statistics.hpp>
+#include <enhancer/sweep.hpp>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(ENHANCER_PARITY_TEST_WITH_GPU)
+#include <QGuiApplication>
+#include <enhancer/offscreenenhancer.hpp>
+#endif
+
+// Compares every implementation of the pipeline with the double-precision reference (enhancer::enhance) over a dense
+// grid of 8-bit RGB colors and a set of parameter vectors, and reports the maximum and mean CIE76 color difference
+// (Delta E*ab) per implementation and per stage. Each stage is isolated by moving only its parameter(s) from 0.5;
+// "combined" uses random parameter vectors. The test fails if any value exceeds the budget of the implementation.
+//
+// Known sources of differences from the reference:
+// - The shader runs in single precision and treats HSV saturations below 0.001 as gray (the C++ code uses 1e-14).
+// - enhance_image_simd uses polynomial approximations of log2/exp2 (documented error below 1e-3).
+// - enhance_image with Accuracy::Fast/Fastest approximates the power functions (see enhancer::Accuracy).
+// - Lut3D interpolates between lattice points.
+// - The 8-bit, 16-bit, and half-precision paths (and the 8-bit views and sweeps) quantize the output.
+// - CompiledPipeline skips neutral stages that are not exactly the identity in the reference.
+//
+// --cpu and --shader restrict the test to the C++ implementations and checks or to the shader. Without an OpenGL 3.2
+// Core context, the shader is left out (and --shader exits with the code for skipped tests).
+//
+// Usage: parity-test [--cpu | --shader] [--grid <levels per axis>] [--budget <implementation> <max> <mean>]...
+namespace
+{
+    constexpr int    exit_code_skipped = 77;
+    constexpr double white_x           = 0.95047;
+    constexpr double white_z           = 1.08883;
+
+    struct Budget
+    {
+        double max_delta_e;
+        double mean_delta_e;
+    };
+
+    struct Statistics
+    {
+        double max_delta_e = 0.0;
+        double sum_delta_e = 0.0;
+        long   count       = 0;
+
+        Eigen::Vector3d worst_input  = Eigen::Vector3d::Zero();
+        Eigen::VectorXd worst_params;
+
+        double getMean() const { return count > 0 ? sum_delta_e / count : 0.0; }
+    };
+
+    struct ParameterSet
+    {
+        std::string     stage;
+        Eigen::VectorXd parameters;
+    };
+
+    // A function that enhances all the colors (RGB triplets in [0, 1]) with the given parameters
+    using Implementation = std::function<std::vector<Eigen::Vector3d>(const std::vector<Eigen::Vector3d>&, const Eigen::VectorXd&)>;
+
+    // The pipeline works on gamma-2.2-encoded values with the BT.709 primaries; the comparison uses CIELAB (D65)
+    Eigen::Vector3d convertRgbToLab(const Eigen::Vector3d& rgb)
+    {
+        const Eigen::Vector3d linear_rgb = rgb.cwiseMax(0.0).array().pow(2.2).matrix();
+
+        Eigen::Matrix3d m;
+        m << 0.4124564, 0.3575761, 0.1804375,
+             0.2126729, 0.7151522, 0.0721750,
+             0.0193339, 0.1191920, 0.9503041;
+        const Eigen::Vector3d xyz = m * linear_rgb;
+
+        const auto f = [](const double t) { return t > 216.0 / 24389.0 ? std::cbrt(t) : (24389.0 / 27.0 * t + 16.0) / 116.0; };
+
+        const double fx = f(xyz(0) / white_x);
+        const double fy = f(xyz(1));
+        const double fz = f(xyz(2) / white_z);
+
+        return Eigen::Vector3d(116.0 * fy - 16.0, 500.0 * (fx - fy), 200.0 * (fy - fz));
+    }
+
+    double computeDeltaE(const Eigen::Vector3d& rgb_a, const Eigen::Vector3d& rgb_b)
+    {
+        return (convertRgbToLab(rgb_a) - convertRgbToLab(rgb_b)).norm();
+    }
+
+    std::vector<std::string> getParameterNames()
+    {
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+        return { "brightness", "contrast", "saturation", "lift", "lift", "lift", "gamma", "gamma", "gamma", "gain", "gain", "gain" };
+#else
+        return { "brightness", "contrast", "saturation", "temperature", "tint" };
+#endif
+    }
+
+    std::vector<ParameterSet> generateParameterSets()
+    {
+        const int                      n     = enhancer::NUM_PARAMETERS;
+        const std::vector<std::string> names = getParameterNames();
+
+        std::vector<ParameterSet> parameter_sets = { { "neutral", Eigen::VectorXd::Constant(n, 0.5) } };
+
+        for (int dim = 0; dim < n; ++dim)
+        {
+            for (const double value : { 0.0, 0.25, 0.75, 1.0 })
+            {
+                Eigen::VectorXd parameters = Eigen::VectorXd::Constant(n, 0.5);
+                parameters(dim)            = value;
+                parameter_sets.push_back({ names[dim], parameters });
+            }
+        }
+
+        std::mt19937                           engine(0);
+        std::uniform_real_distribution<double> distribution(0.0, 1.0);
+        for (int i = 0; i < 16; ++i)
+        {
+            Eigen::VectorXd parameters(n);
+            for (int dim = 0; dim < n; ++dim) { parameters(dim) = distribution(engine); }
+            parameter_sets.push_back({ "combined", parameters });
+        }
+
+        return parameter_sets;
+    }
+
+    // Colors whose channels are multiples of 1/255, so that the 8-bit paths see exactly the same inputs
+    std::vector<Eigen::Vector3d> generateColors(const int levels)
+    {
+        std::vector<Eigen::Vector3d> colors;
+        for (int b = 0; b < levels; ++b)
+        {
+            for (int g = 0; g < levels; ++g)
+            {
+                for (int r = 0; r < levels; ++r)
+                {
+                    const auto to_value = [&](const int i) { return std::round(255.0 * i / (levels - 1)) / 255.0; };
+                    colors.push_back(Eigen::Vector3d(to_value(r), to_value(g), to_value(b)));
+                }
+            }
+        }
+        return colors;
+    }
+
+    // The channel value corresponding to 1 (integer types are normalized, floating-point types are not)
+    template <typename T> double getWhiteValue()
+    {
+        return std::is_integral<T>::value ? static_cast<double>(std::numeric_limits<T>::max()) : 1.0;
+    }
+
+    template <typename T, typename Func>
+    std::vector<Eigen::Vector3d> runImageFunction(const std::vector<Eigen::Vector3d>& colors, Func func)
+    {
+        const int    count = static_cast<int>(colors.size());
+        const double white = getWhiteValue<T>();
+
+        std::vector<T> src(4 * colors.size());
+        std::vector<T> dst(4 * colors.size());
+        for (int i = 0; i < count; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                if constexpr (std::is_integral<T>::value) { src[4 * i + c] = static_cast<T>(std::lround(white * colors[i](c))); }
+                else { src[4 * i + c] = static_cast<T>(static_cast<float>(colors[i](c))); }
+            }
+            src[4 * i + 3] = static_cast<T>(static_cast<float>(white));
+        }
+
+        // A single row
+        func(src.data(), dst.data(), count, 1, static_cast<std::ptrdiff_t>(4 * count * sizeof(T)), 4);
+
+        std::vector<Eigen::Vector3d> results(colors.size());
+        for (int i = 0; i < count; ++i)
+        {
+            for (int c = 0; c < 3; ++c) { results[i](c) = static_cast<double>(static_cast<float>(dst[4 * i + c])) / white; }
+        }
+        return results;
+    }
+
+    // Lays the colors out as a bottom-up BGR image with padded rows (as a Windows DIB is) and runs `func` on it through
+    // the view-based API, writing a top-down RGBA image
+    template <typename Func>
+    std::vector<Eigen::Vector3d> runViewFunction(const std::vector<Eigen::Vector3d>& colors, Func func)
+    {
+        const int            count      = static_cast<int>(colors.size());
+        const int            width      = (count + 1) / 2;
+        const int            height     = 2;
+        const std::ptrdiff_t src_stride = 3 * width + 1;
+
+        std::vector<std::uint8_t> src(src_stride * height);
+        std::vector<std::uint8_t> dst(4 * width * height);
+
+        const enhancer::ImageView<std::uint8_t> src_view(src.data(), width, height, src_stride, enhancer::ChannelOrder::BGR, true);
+        const enhancer::ImageView<std::uint8_t> dst_view(dst.data(), width, height, 4 * width, enhancer::ChannelOrder::RGBA);
+        for (int i = 0; i < count; ++i)
+        {
+            std::uint8_t* pixel = src_view.getRow(i / width) + 3 * (i % width);
+            for (int c = 0; c < 3; ++c) { pixel[2 - c] = static_cast<std::uint8_t>(std::lround(255.0 * colors[i](c))); }
+        }
+
+        func(src_view, dst_view);
+
+        std::vector<Eigen::Vector3d> results(colors.size());
+        for (int i = 0; i < count; ++i)
+        {
+            for (int c = 0; c < 3; ++c) { results[i](c) = static_cast<double>(dst[4 * i + c]) / 255.0; }
+        }
+        return results;
+    }
+
+    // Runs `func` (a sweep) with `parameters` as the second of three candidates laid out in a 2 x 2 atlas and returns
+    // the colors of its cell
+    template <typename T, typename Func>
+    std::vector<Eigen::Vector3d> runSweepFunction(const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters, Func func)
+    {
+        const std::vector<Eigen::VectorXd> parameter_sets = { Eigen::VectorXd::Constant(parameters.size(), 0.5),
+                                                              parameters,
+                                                              Eigen::VectorXd::Ones(parameters.size()) - parameters };
+
+        return runImageFunction<T>(colors, [&](const T* src, T* dst, const int width, const int height, const std::ptrdiff_t stride, const int channels)
+        {
+            const enhancer::AtlasLayout layout = enhancer::make_atlas_layout(width, height, static_cast<int>(parameter_sets.size()));
+
+            std::vector<T>               atlas(4 * layout.getWidth() * layout.getHeight());
+            const enhancer::ImageView<T> atlas_view(atlas.data(), layout.getWidth(), layout.getHeight(), 4 * layout.getWidth() * sizeof(T));
+
+            func(enhancer::ImageView<const T>(src, width, height, stride, enhancer::ChannelOrder::RGBA),
+                 layout.getCellViews(atlas_view, static_cast<int>(parameter_sets.size())),
+                 parameter_sets);
+
+            const enhancer::ImageView<T> cell_view = layout.getCellView(atlas_view, 1);
+            for (int y = 0; y < height; ++y)
+            {
+                std::copy_n(cell_view.getRow(y), channels * width, enhancer::internal::getRow(dst, stride, y));
+            }
+        });
+    }
+
+    // (enhance(parameters + step * e_index) - enhance(parameters)) / step, backward for negative steps
+    Eigen::Vector3d computeDifference(const Eigen::Vector3d& color, const Eigen::VectorXd& parameters, const int index, const double step)
+    {
+        Eigen::VectorXd moved = parameters;
+        moved[index] += step;
+
+        return (enhancer::enhance(color, moved) - enhancer::enhance(color, parameters)) / step;
+    }
+
+    // Compares enhance_with_jacobian with central differences of enhance and returns the fraction of the Jacobian
+    // columns that disagree. At the kinks of the pipeline (clamping, hue sectors), often followed by the infinite
+    // slope of the 1/2.2 gamma at zero, the derivative depends on the side; columns whose forward and backward
+    // differences disagree are thus skipped, as are outputs with nearly black channels, where the gamma amplifies
+    // the rounding of the reference. The step is large enough for the single-precision rounding of internal::clamp.
+    double computeJacobianMismatchRate(const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        constexpr double step      = 1e-3;
+        constexpr double tolerance = 1e-2;
+
+        const auto is_close = [&](const Eigen::Vector3d& a, const Eigen::Vector3d& b) { return (a - b).cwiseAbs().maxCoeff() <= tolerance * (1.0 + b.cwiseAbs().maxCoeff()); };
+
+        int num_columns    = 0;
+        int num_mismatches = 0;
+        for (const Eigen::Vector3d& color : colors)
+        {
+            enhancer::ColorJacobian jacobian;
+            if (enhancer::enhance_with_jacobian(color, parameters, jacobian).minCoeff() < 1e-2) { continue; }
+
+            for (int i = 0; i < parameters.size(); ++i)
+            {
+                if (parameters[i] - step <= 0.0 || parameters[i] + step >= 1.0) { continue; }
+
+                const Eigen::Vector3d forward_difference  = computeDifference(color, parameters, i, step);
+                const Eigen::Vector3d backward_difference = computeDifference(color, parameters, i, -step);
+                if (!is_close(forward_difference, backward_difference)) { continue; }
+
+                ++num_columns;
+                if (!is_close(jacobian.col(i), 0.5 * (forward_difference + backward_difference))) { ++num_mismatches; }
+            }
+        }
+        return num_columns > 0 ? static_cast<double>(num_mismatches) / num_columns : 0.0;
+    }
+
+    // The relative difference between compute_loss_and_gradient (on a float image) and the same loss and gradient
+    // accumulated from enhance_with_jacobian, with the colors enhanced towards the colors in the reverse order
+    double computeLossGradientError(const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        const int          count = static_cast<int>(colors.size());
+        std::vector<float> src(3 * colors.size());
+        std::vector<float> target(3 * colors.size());
+        for (int i = 0; i < count; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                src[3 * i + c]    = static_cast<float>(colors[i](c));
+                target[3 * i + c] = static_cast<float>(colors[count - 1 - i](c));
+            }
+        }
+
+        enhancer::ThreadPool                   pool(2);
+        const enhancer::ImageView<const float> src_view(src.data(), count, 1, 3 * count * sizeof(float), enhancer::ChannelOrder::RGB);
+        const enhancer::ImageView<const float> target_view(target.data(), count, 1, 3 * count * sizeof(float), enhancer::ChannelOrder::RGB);
+
+        const enhancer::LossAndGradient result = enhancer::compute_loss_and_gradient(pool, src_view, target_view, parameters, enhancer::TileSize{ 256, 1 });
+
+        double          loss     = 0.0;
+        Eigen::VectorXd gradient = Eigen::VectorXd::Zero(parameters.size());
+        for (int i = 0; i < count; ++i)
+        {
+            const Eigen::Vector3d color(src[3 * i + 0], src[3 * i + 1], src[3 * i + 2]);
+            const Eigen::Vector3d target_color(target[3 * i + 0], target[3 * i + 1], target[3 * i + 2]);
+
+            enhancer::ColorJacobian jacobian;
+            const Eigen::Vector3d   difference = enhancer::enhance_with_jacobian(color, parameters, jacobian) - target_color;
+
+            loss += difference.squaredNorm();
+            gradient += 2.0 * jacobian.transpose() * difference;
+        }
+        loss /= count;
+        gradient /= count;
+
+        return std::max(std::abs(result.loss - loss) / std::max(loss, 1e-12), (result.gradient - gradient).norm() / std::max(gradient.norm(), 1e-12));
+    }
+
+    // Compares the statistics gathered while enhancing (serially and in parallel, with and without writing the pixels)
+    // with a second pass over the output of enhance_image. Returns the number of histogram bins that differ plus the
+    // relative error of the means, whose sums are accumulated in different orders.
+    double computeStatisticsError(const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        const int count = static_cast<int>(colors.size());
+
+        std::vector<std::uint8_t> src(3 * colors.size());
+        std::vector<std::uint8_t> dst(3 * colors.size());
+        for (int i = 0; i < count; ++i)
+        {
+            for (int c = 0; c < 3; ++c) { src[3 * i + c] = static_cast<std::uint8_t>(std::lround(255.0 * colors[i](c))); }
+        }
+
+        const enhancer::ImageView<const std::uint8_t> src_view(src.data(), count, 1, 3 * count, enhancer::ChannelOrder::RGB);
+        const enhancer::ImageView<std::uint8_t>       dst_view(dst.data(), count, 1, 3 * count, enhancer::ChannelOrder::RGB);
+
+        enhancer::enhance_image<std::uint8_t>(src_view, dst_view, parameters);
+
+        // An 8-bit value v falls into bin v
+        enhancer::ImageStatistics reference;
+        for (int i = 0; i < count; ++i)
+        {
+            const Eigen::Vector3d rgb       = Eigen::Vector3d(dst[3 * i + 0], dst[3 * i + 1], dst[3 * i + 2]) / 255.0;
+            const double          luminance = 0.2126 * rgb(0) + 0.7152 * rgb(1) + 0.0722 * rgb(2);
+
+            ++reference.red_histogram[dst[3 * i + 0]];
+            ++reference.green_histogram[dst[3 * i + 1]];
+            ++reference.blue_histogram[dst[3 * i + 2]];
+            ++reference.luminance_histogram[std::min(255, static_cast<int>(luminance * 256.0))];
+            reference.rgb_sum += rgb;
+            reference.luminance_sum += luminance;
+        }
+        reference.num_pixels = count;
+
+        enhancer::ThreadPool pool(2);
+        const auto           tile_size = enhancer::TileSize{ 100, 1 };
+
+        std::vector<enhancer::ImageStatistics>  results(3);
+        std::vector<std::uint8_t>               fused_dst(dst.size());
+        const enhancer::ImageView<std::uint8_t> fused_view(fused_dst.data(), count, 1, 3 * count, enhancer::ChannelOrder::RGB);
+
+        enhancer::enhance_image_with_statistics<std::uint8_t>(src_view, fused_view, parameters, results[0]);
+        enhancer::compute_enhanced_statistics<std::uint8_t>(src_view, parameters, results[1]);
+        enhancer::compute_enhanced_statistics_parallel<std::uint8_t>(pool, src_view, parameters, results[2], enhancer::Accuracy::Exact, enhancer::ValueRange::Display, tile_size);
+
+        double error = fused_dst == dst ? 0.0 : 1.0;
+        for (const enhancer::ImageStatistics& result : results)
+        {
+            for (int i = 0; i < enhancer::ImageStatistics::num_bins; ++i)
+            {
+                error += result.red_histogram[i] != reference.red_histogram[i];
+                error += result.green_histogram[i] != reference.green_histogram[i];
+                error += result.blue_histogram[i] != reference.blue_histogram[i];
+                error += result.luminance_histogram[i] != reference.luminance_histogram[i];
+            }
+            error += result.num_pixels != reference.num_pixels;
+            error += (result.getMeanRgb() - reference.getMeanRgb()).norm() / std::max(reference.getMeanRgb().norm(), 1e-12);
+            error += std::abs(result.getMeanLuminance() - reference.getMeanLuminance()) / std::max(reference.getMeanLuminance(), 1e-12);
+        }
+        return error;
+    }
+
+    // Compares enhance_image_local (serially and in parallel) with the reference pipeline evaluated per pixel with the
+    // blended parameters, for a mask, a linear and a radial gradient, and a guidance grid overlapping each other.
+    // Returns the largest channel difference.
+    double computeLocalError(const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        const int count  = static_cast<int>(colors.size());
+        const int width  = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+        const int height = (count + width - 1) / width;
+
+        std::vector<float>        src(3 * width * height, 0.0f);
+        std::vector<std::uint8_t> mask(width * height);
+        for (int i = 0; i < width * height; ++i)
+        {
+            if (i < count)
+            {
+                for (int c = 0; c < 3; ++c) { src[3 * i + c] = static_cast<float>(colors[i](c)); }
+            }
+            mask[i] = static_cast<std::uint8_t>((i * 37) % 256);
+        }
+
+        const auto grid = std::make_shared<enhancer::GuidanceGrid>(4, 3, 8);
+        for (std::size_t i = 0; i < grid->weights.size(); ++i) { grid->weights[i] = static_cast<float>((i * 7) % 11) / 10.0f; }
+
+        const Eigen::VectorXd                 base        = Eigen::VectorXd::Ones(parameters.size()) - parameters;
+        std::vector<enhancer::LocalAdjustment> adjustments = {
+            enhancer::make_mask_adjustment(parameters, mask.data(), width),
+            enhancer::make_linear_gradient_adjustment(Eigen::VectorXd::Constant(parameters.size(), 0.5), Eigen::Vector2d(0.2, 0.1), Eigen::Vector2d(0.7, 0.9)),
+            enhancer::make_radial_gradient_adjustment(Eigen::VectorXd::Zero(parameters.size()), Eigen::Vector2d(0.4, 0.6), Eigen::Vector2d(0.5, 0.3), 0.7),
+            enhancer::make_grid_adjustment(Eigen::VectorXd::Ones(parameters.size()), grid),
+        };
+        adjustments[2].opacity = 0.5;
+
+        const enhancer::ImageView<const float> src_view(src.data(), width, height, 3 * width * sizeof(float), enhancer::ChannelOrder::RGB);
+
+        std::vector<std::vector<float>> results(2, std::vector<float>(src.size()));
+        const auto                      get_view = [&](const int k) { return enhancer::ImageView<float>(results[k].data(), width, height, 3 * width * sizeof(float), enhancer::ChannelOrder::RGB); };
+
+        enhancer::ThreadPool pool(2);
+        enhancer::enhance_image_local<float>(src_view, get_view(0), base, adjustments);
+        enhancer::enhance_image_local_parallel<float>(pool, src_view, get_view(1), base, adjustments, enhancer::Accuracy::Exact, enhancer::ValueRange::Display, enhancer::TileSize{ 7, 5 });
+
+        double error = 0.0;
+        for (int i = 0; i < count; ++i)
+        {
+            const int             x         = i % width;
+            const int             y         = i / width;
+            const Eigen::Vector3d rgb       = Eigen::Vector3d(src[3 * i + 0], src[3 * i + 1], src[3 * i + 2]);
+            const double          luminance = 0.2126 * rgb(0) + 0.7152 * rgb(1) + 0.0722 * rgb(2);
+
+            Eigen::VectorXd blended = base;
+            for (const enhancer::LocalAdjustment& adjustment : adjustments)
+            {
+                const double weight = enhancer::internal::computeLocalWeight(adjustment, x, y, width, height, luminance);
+                blended += adjustment.opacity * weight * (adjustment.parameters - base);
+            }
+            const Eigen::Vector3d reference = enhancer::enhance(rgb, blended);
+
+            for (const std::vector<float>& result : results)
+            {
+                for (int c = 0; c < 3; ++c) { error = std::max(error, std::abs(result[3 * i + c] - reference(c))); }
+            }
+        }
+        return error;
+    }
+
+    // Runs enhance_image_parallel on the colors and returns the number of pixels that differ from enhance plus the
+    // number of inconsistent counters. With instrumentation, the stages run row by row instead of pixel by pixel, which
+    // must not change a single bit; without it, nothing may be recorded.
+    double computeInstrumentationError(const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        using enhancer::InstrumentedStage;
+
+        const int                width     = 97;
+        const int                height    = (static_cast<int>(colors.size()) + width - 1) / width;
+        const enhancer::TileSize tile_size = { 32, 8 };
+        const int                num_tiles = ((width + tile_size.width - 1) / tile_size.width) * ((height + tile_size.height - 1) / tile_size.height);
+
+        std::vector<float> pixels(3 * width * height, 0.0f);
+        for (std::size_t i = 0; i < colors.size(); ++i)
+        {
+            for (int c = 0; c < 3; ++c) { pixels[3 * i + c] = static_cast<float>(colors[i](c)); }
+        }
+
+        enhancer::reset_instrumentation();
+
+        enhancer::ThreadPool pool(4);
+        std::vector<float>   result(pixels.size());
+        enhancer::enhance_image_parallel(pool, pixels.data(), result.data(), width, height, 3 * width * sizeof(float), 3, parameters, tile_size);
+
+        double error = 0.0;
+        for (int i = 0; i < width * height; ++i)
+        {
+            const Eigen::Vector3d expected = enhancer::enhance(Eigen::Vector3d(pixels[3 * i], pixels[3 * i + 1], pixels[3 * i + 2]), parameters);
+            for (int c = 0; c < 3; ++c)
+            {
+                if (result[3 * i + c] != static_cast<float>(expected(c)))
+                {
+                    error += 1.0;
+                    break;
+                }
+            }
+        }
+
+        const enhancer::InstrumentationStats stats = enhancer::get_instrumentation_stats();
+
+        std::uint64_t num_tiles_recorded = 0;
+        for (const enhancer::TimingStats& thread_tiles : stats.thread_tiles) { num_tiles_recorded += thread_tiles.count; }
+
+        // Every stage of the configured parameter set is timed once per row of each tile
+        const std::uint64_t num_rows = enhancer::is_instrumentation_enabled ? static_cast<std::uint64_t>(height) * ((width + tile_size.width - 1) / tile_size.width) : 0;
+        const std::map<InstrumentedStage, unsigned> stage_bits = {
+            { InstrumentedStage::TemperatureTint, enhancer::stage::temperature_tint },
+            { InstrumentedStage::LiftGammaGain, enhancer::stage::lift_gamma_gain },
+            { InstrumentedStage::Brightness, enhancer::stage::brightness },
+            { InstrumentedStage::Contrast, enhancer::stage::contrast },
+            { InstrumentedStage::Saturation, enhancer::stage::saturation },
+        };
+        error += stats.getStage(InstrumentedStage::Linearize).count != num_rows;
+        error += stats.getStage(InstrumentedStage::Encode).count != num_rows;
+        for (const auto& stage_bit : stage_bits)
+        {
+            const bool is_used = (enhancer::ConfiguredParams::all_stages & stage_bit.second) != 0;
+            error += stats.getStage(stage_bit.first).count != (is_used ? num_rows : 0);
+        }
+
+        error += stats.pixels_processed != (enhancer::is_instrumentation_enabled ? static_cast<std::uint64_t>(width) * height : 0);
+        error += num_tiles_recorded != (enhancer::is_instrumentation_enabled ? static_cast<std::uint64_t>(num_tiles) : 0);
+        error += stats.thread_tiles.size() > static_cast<std::size_t>(pool.getNumThreads());
+
+        // One "tile" and one "enhance_image" span per tile
+        std::ostringstream trace;
+        enhancer::write_chrome_trace(trace);
+        const std::string json      = trace.str();
+        std::size_t       num_spans = 0;
+        for (std::size_t position = json.find("\"ph\":\"X\""); position != std::string::npos; position = json.find("\"ph\":\"X\"", position + 1)) { ++num_spans; }
+        error += num_spans != (enhancer::is_instrumentation_enabled ? 2 * static_cast<std::size_t>(num_tiles) : 0);
+
+        return error;
+    }
+
+    const char* getSimdLevelName(const enhancer::SimdLevel level)
+    {
+        switch (level)
+        {
+            case enhancer::SimdLevel::Avx512: return "avx512";
+            case enhancer::SimdLevel::Avx2: return "avx2";
+            case enhancer::SimdLevel::Scalar: return "scalar";
+        }
+        return "unknown";
+    }
+
+    // Prints one row per parameter set with the values returned by `check`, one per column, and returns whether each
+    // of them is within the maximum of its column
+    bool reportChecks(const std::string&                                                section,
+                      const std::string&                                                function_name,
+                      const std::vector<std::pair<std::string, double>>&                columns,
+                      const std::vector<ParameterSet>&                                  parameter_sets,
+                      const std::function<std::vector<double>(const Eigen::VectorXd&)>& check)
+    {
+        std::cout << std::left << std::setw(36) << section << std::setw(14) << "stage" << std::right;
+        for (const auto& column : columns) { std::cout << std::setw(12) << column.first; }
+        std::cout << std::endl;
+
+        bool is_passed = true;
+        for (const ParameterSet& parameter_set : parameter_sets)
+        {
+            const std::vector<double> values = check(parameter_set.parameters);
+            assert(values.size() == columns.size());
+
+            bool is_within = true;
+            std::cout << std::left << std::setw(36) << function_name << std::setw(14) << parameter_set.stage << std::right << std::scientific << std::setprecision(3);
+            for (std::size_t i = 0; i < columns.size(); ++i)
+            {
+                std::cout << std::setw(12) << values[i];
+                is_within = is_within && values[i] <= columns[i].second;
+            }
+            std::cout << std::defaultfloat << (is_within ? "" : "  EXCEEDED") << std::endl;
+
+            is_passed = is_passed && is_within;
+        }
+        return is_passed;
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    int                           levels           = 18;
+    bool                          is_cpu_tested    = true;
+    bool                          is_shader_tested = true;
+    std::map<std::string, Budget> budget_overrides;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--grid" && i + 1 < argc) { levels = std::max(2, std::atoi(argv[++i])); }
+        else if (arg == "--cpu") { is_shader_tested = false; }
+        else if (arg == "--shader") { is_cpu_tested = false; }
+        else if (arg == "--budget" && i + 3 < argc)
+        {
+            const std::string name = argv[++i];
+            const double      max  = std::atof(argv[++i]);
+            const double      mean = std::atof(argv[++i]);
+            budget_overrides[name] = Budget{ max, mean };
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--cpu | --shader] [--grid <levels per axis>] [--budget <implementation> <max> <mean>]..." << std::endl;
+            return 1;
+        }
+    }
+
+    // The implementations and their budgets (in Delta E*ab; a difference below 1 is generally not noticeable)
+    std::vector<std::pair<std::string, Implementation>> implementations;
+    std::map<std::string, Budget>                       budgets;
+
+    const auto insert = [&](const std::string& name, const Budget& budget, const Implementation& implementation)
+    {
+        implementations.push_back({ name, implementation });
+        budgets[name] = budget;
+    };
+
+    // The C++ implementations
+    const auto add = [&](const std::string& name, const Budget& budget, const Implementation& implementation)
+    {
+        if (is_cpu_tested) { insert(name, budget, implementation); }
+    };
+
+    add("Enhancer<ConfiguredParams>", { 1e-6, 1e-7 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        const enhancer::Enhancer<enhancer::ConfiguredParams> compiled_enhancer(parameters.head<enhancer::NUM_PARAMETERS>());
+
+        std::vector<Eigen::Vector3d> results;
+        for (const Eigen::Vector3d& color : colors) { results.push_back(compiled_enhancer(color)); }
+        return results;
+    });
+
+    add("CompiledPipeline", { 0.5, 0.01 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        const enhancer::CompiledPipeline pipeline(parameters);
+
+        std::vector<Eigen::Vector3d> results;
+        for (const Eigen::Vector3d& color : colors) { results.push_back(pipeline(color)); }
+        return results;
+    });
+
+    add("enhance_with_jacobian", { 1e-4, 1e-5 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        std::vector<Eigen::Vector3d> results;
+        enhancer::ColorJacobian      jacobian;
+        for (const Eigen::Vector3d& color : colors) { results.push_back(enhancer::enhance_with_jacobian(color, parameters, jacobian)); }
+        return results;
+    });
+
+    add("enhance_image<uint8>", { 1.0, 0.3 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        return runImageFunction<std::uint8_t>(colors, [&](auto... args) { enhancer::enhance_image(args..., parameters); });
+    });
+
+    add("enhance_image_parallel<uint8>/view", { 1.0, 0.3 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        // Small tiles exercise the sub-views of the bottom-up image
+        enhancer::ThreadPool pool(2);
+        return runViewFunction(colors, [&](const auto& src, const auto& dst)
+        {
+            enhancer::enhance_image_parallel(pool, src, dst, parameters, enhancer::Accuracy::Exact, enhancer::ValueRange::Display, enhancer::TileSize{ 100, 2 });
+        });
+    });
+
+    add("enhance_with_statistics<uint8>/view", { 1.0, 0.3 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        enhancer::ThreadPool      pool(2);
+        enhancer::ImageStatistics statistics;
+        return runViewFunction(colors, [&](const auto& src, const auto& dst)
+        {
+            enhancer::enhance_image_parallel_with_statistics(pool, src, dst, parameters, statistics, enhancer::Accuracy::Exact, enhancer::ValueRange::Display, enhancer::TileSize{ 100, 2 });
+        });
+    });
+
+    add("enhance_image_sweep<uint8>/atlas", { 1.0, 0.3 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        return runSweepFunction<std::uint8_t>(colors, parameters, [&](const auto& src, const auto& dsts, const auto& parameter_sets)
+        {
+            enhancer::enhance_image_sweep(src, dsts, parameter_sets);
+        });
+    });
+
+    add("enhance_image_sweep_parallel<float>", { 5e-4, 1e-5 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        enhancer::ThreadPool pool(2);
+        return runSweepFunction<float>(colors, parameters, [&](const auto& src, const auto& dsts, const auto& parameter_sets)
+        {
+            enhancer::enhance_image_sweep_parallel(pool, src, dsts, parameter_sets, enhancer::Accuracy::Exact, enhancer::ValueRange::Display, enhancer::TileSize{ 100, 1 });
+        });
+    });
+
+    add("enhance_image_local<float>/mask", { 5e-4, 1e-5 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        // A full-weight mask over the opposite base parameters
+        return runImageFunction<float>(colors, [&](const float* src, float* dst, const int width, const int height, const std::ptrdiff_t stride, int)
+        {
+            const std::vector<std::uint8_t> mask(width * height, 255);
+            enhancer::enhance_image_local<float>(enhancer::ImageView<const float>(src, width, height, stride, enhancer::ChannelOrder::RGBA),
+                                                 enhancer::ImageView<float>(dst, width, height, stride, enhancer::ChannelOrder::RGBA),
+                                                 Eigen::VectorXd::Ones(parameters.size()) - parameters,
+                                                 { enhancer::make_mask_adjustment(parameters, mask.data(), width) });
+        });
+    });
+
+    add("enhance_image_local_parallel<uint8>", { 1.0, 0.3 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        // A gradient of full weight over the whole image and a radial gradient of no weight anywhere
+        enhancer::ThreadPool                         pool(2);
+        const std::vector<enhancer::LocalAdjustment> adjustments = {
+            enhancer::make_linear_gradient_adjustment(parameters, Eigen::Vector2d(1.5, 0.0), Eigen::Vector2d(2.0, 0.0)),
+            enhancer::make_radial_gradient_adjustment(Eigen::VectorXd::Zero(parameters.size()), Eigen::Vector2d(-1.0, -1.0), Eigen::Vector2d(0.5, 0.5)),
+        };
+        return runViewFunction(colors, [&](const auto& src, const auto& dst)
+        {
+            enhancer::enhance_image_local_parallel(pool, src, dst, Eigen::VectorXd::Ones(parameters.size()) - parameters, adjustments, enhancer::Accuracy::Exact, enhancer::ValueRange::Display, enhancer::TileSize{ 100, 1 });
+        });
+    });
+
+    add("enhance_image<uint16>", { 0.01, 0.002 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        return runImageFunction<std::uint16_t>(colors, [&](auto... args) { enhancer::enhance_image(args..., parameters); });
+    });
+
+    add("enhance_image<half>", { 0.5, 0.05 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        return runImageFunction<Eigen::half>(colors, [&](auto... args) { enhancer::enhance_image(args..., parameters); });
+    });
+
+    add("enhance_image<float>/fast", { 0.001, 0.0001 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        return runImageFunction<float>(colors, [&](auto... args) { enhancer::enhance_image(args..., parameters, enhancer::Accuracy::Fast); });
+    });
+
+    add("enhance_image<float>/fastest", { 0.25, 0.03 }, [](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+    {
+        return runImageFunction<float>(colors, [&](auto... args) { enhancer::enhance_image(args..., parameters, enhancer::Accuracy::Fastest); });
+    });
+
+    for (const enhancer::SimdLevel level : { enhancer::SimdLevel::Scalar, enhancer::SimdLevel::Avx2, enhancer::SimdLevel::Avx512 })
+    {
+        if (level > enhancer::detectSimdLevel()) { continue; }
+
+        add(std::string("enhance_image_simd<float>/") + getSimdLevelName(level), { 0.5, 0.05 }, [level](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+        {
+            return runImageFunction<float>(colors, [&](auto... args) { enhancer::enhance_image_simd(args..., parameters, level); });
+        });
+    }
+
+    for (const auto interpolation : { enhancer::Lut3D::Interpolation::Tetrahedral, enhancer::Lut3D::Interpolation::Trilinear })
+    {
+        const bool is_tetrahedral = interpolation == enhancer::Lut3D::Interpolation::Tetrahedral;
+        // The maximum is dominated by the kinks where the saturation stage (and the lift, which clips dark channels
+        // to black) starts clipping, which a 33^3 lattice cannot follow; smooth regions stay within a few tenths
+#if defined(ENHANCER_WITH_LIFT_GAMMA_GAIN)
+        const Budget lut_budget = { 40.0, 0.3 };
+#else
+        const Budget lut_budget = { 12.0, 0.3 };
+#endif
+        add(is_tetrahedral ? "Lut3D/tetrahedral" : "Lut3D/trilinear", lut_budget, [interpolation](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+        {
+            const enhancer::Lut3D lut(parameters);
+            return runImageFunction<float>(colors, [&](auto... args) { lut.apply(args..., interpolation); });
+        });
+    }
+
+#if defined(ENHANCER_PARITY_TEST_WITH_GPU)
+    // The shader computes in single precision. A float emulation of enhancer.fs stays within 0.005 of the reference
+    // on this grid (0.007 with lift/gamma/gain); the budget leaves room for drivers whose pow/exp2/log2 have relative
+    // errors up to 1e-4, with which the emulation reaches 0.19 / 0.023.
+    const Budget shader_budget = { 0.25, 0.03 };
+
+    std::unique_ptr<QGuiApplication>             app;
+    std::unique_ptr<enhancer::OffscreenEnhancer> offscreen_enhancer;
+    if (is_shader_tested)
+    {
+        app = std::make_unique<QGuiApplication>(argc, argv);
+        Q_INIT_RESOURCE(enhancer_resources);
+
+        offscreen_enhancer = std::make_unique<enhancer::OffscreenEnhancer>();
+        if (!offscreen_enhancer->isValid())
+        {
+            if (!is_cpu_tested)
+            {
+                std::cerr << "Skipped: no OpenGL 3.2 Core context is available (try QT_QPA_PLATFORM=offscreen)." << std::endl;
+                return exit_code_skipped;
+            }
+            std::cerr << "Note: no OpenGL 3.2 Core context is available (try QT_QPA_PLATFORM=offscreen), so the shader is left out." << std::endl;
+            is_shader_tested = false;
+        }
+    }
+
+    if (is_shader_tested)
+    {
+        enhancer::OffscreenEnhancer& shader_enhancer = *offscreen_enhancer;
+
+        insert("shader", shader_budget, [&](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+        {
+            shader_enhancer.setParameters(parameters);
+            return runImageFunction<float>(colors, [&](auto... args) { shader_enhancer.enhanceImage(args...); });
+        });
+
+        insert("shader/local", shader_budget, [&](const std::vector<Eigen::Vector3d>& colors, const Eigen::VectorXd& parameters)
+        {
+            // A gradient of full weight over the whole image on the opposite base parameters
+            shader_enhancer.setParameters(Eigen::VectorXd(Eigen::VectorXd::Ones(parameters.size()) - parameters));
+            shader_enhancer.setLocalAdjustments({ enhancer::make_linear_gradient_adjustment(parameters, Eigen::Vector2d(1.5, 0.0), Eigen::Vector2d(2.0, 0.0)) });
+            const std::vector<Eigen::Vector3d> results = runImageFunction<float>(colors, [&](auto... args) { shader_enhancer.enhanceImage(args...); });
+            shader_enhancer.clearLocalAdjustments();
+            return results;
+        });
+    }
+#else
+    (void) exit_code_skipped;
+    if (!is_cpu_tested)
+    {
+        std::cerr << "Skipped: the parity test is built without Qt features, so there is no shader to test." << std::endl;
+        return exit_code_skipped;
+    }
+#endif
+
+    for (const auto& budget_override : budget_overrides)
+    {
+        if (budgets.count(budget_override.first) == 0)
+        {
+            std::cerr << "Error: unknown implementation \"" << budget_override.first << "\"." << std::endl;
+            return 1;
+        }
+        budgets[budget_override.first] = budget_override.second;
+    }
+
+    const std::vector<Eigen::Vector3d> colors         = generateColors(levels);
+    const std::vector<ParameterSet>    parameter_sets = generateParameterSets();
+
+    // statistics[implementation][stage]
+    std::map<std::string, std::map<std::string, Statistics>> statistics;
+    for (const ParameterSet& parameter_set : parameter_sets)
+    {
+        std::vector<Eigen::Vector3d> references;
+        for (const Eigen::Vector3d& color : colors) { references.push_back(enhancer::enhance(color, parameter_set.parameters)); }
+
+        for (const auto& implementation : implementations)
+        {
+            const std::vector<Eigen::Vector3d> results = implementation.second(colors, parameter_set.parameters);
+
+            Statistics& stats = statistics[implementation.first][parameter_set.stage];
+            for (std::size_t i = 0; i < colors.size(); ++i)
+            {
+                const double delta_e = computeDeltaE(results[i], references[i]);
+                if (delta_e > stats.max_delta_e || stats.count == 0)
+                {
+                    stats.max_delta_e  = delta_e;
+                    stats.worst_input  = colors[i];
+                    stats.worst_params = parameter_set.parameters;
+                }
+                stats.sum_delta_e += delta_e;
+                ++stats.count;
+            }
+        }
+    }
+
+    std::cout << "Colors: " << colors.size() << " (" << levels << "^3), parameter sets: " << parameter_sets.size() << std::endl;
+    std::cout << std::left << std::setw(36) << "implementation" << std::setw(14) << "stage" << std::right << std::setw(12) << "max dE" << std::setw(12) << "mean dE" << std::setw(16) << "budget" << std::endl;
+
+    bool is_passed = true;
+    for (const auto& implementation : implementations)
+    {
+        const Budget& budget = budgets[implementation.first];
+
+        for (const auto& stage : statistics[implementation.first])
+        {
+            const Statistics& stats     = stage.second;
+            const bool        is_within = stats.max_delta_e <= budget.max_delta_e && stats.getMean() <= budget.mean_delta_e;
+
+            std::cout << std::left << std::setw(36) << implementation.first << std::setw(14) << stage.first << std::right
+                      << std::scientific << std::setprecision(3) << std::setw(12) << stats.max_delta_e << std::setw(12) << stats.getMean()
+                      << std::defaultfloat << std::setprecision(3) << std::setw(8) << budget.max_delta_e << " / " << budget.mean_delta_e
+                      << (is_within ? "" : "  EXCEEDED") << std::endl;
+
+            if (!is_within)
+            {
+                std::cout << "    worst input: " << stats.worst_input.transpose() << ", parameters: " << stats.worst_params.transpose() << std::endl;
+                is_passed = false;
+            }
+        }
+    }
+
+    // The checks of the C++ API
+    if (is_cpu_tested)
+    {
+        // The derivatives of the gradient API; parameters within a step of 0 or 1, where they are clamped, are skipped.
+        // Every 4th color keeps the finite differences affordable.
+        std::vector<Eigen::Vector3d> gradient_colors;
+        for (std::size_t i = 0; i < colors.size(); i += 4) { gradient_colors.push_back(colors[i]); }
+
+        is_passed &= reportChecks("gradient", "enhance_with_jacobian", { { "mismatch", 1e-3 }, { "loss err", 1e-9 } }, parameter_sets, [&](const Eigen::VectorXd& parameters)
+        {
+            return std::vector<double>{ computeJacobianMismatchRate(gradient_colors, parameters), computeLossGradientError(gradient_colors, parameters) };
+        });
+
+        // The statistics are of quantized outputs, so any difference in the histograms is a bug
+        is_passed &= reportChecks("statistics", "enhance_image_with_statistics", { { "error", 1e-9 } }, parameter_sets, [&](const Eigen::VectorXd& parameters)
+        {
+            return std::vector<double>{ computeStatisticsError(colors, parameters) };
+        });
+
+        // The local adjustments in float, against the reference pipeline with the blended parameters
+        is_passed &= reportChecks("local", "enhance_image_local", { { "max error", 1e-5 } }, parameter_sets, [&](const Eigen::VectorXd& parameters)
+        {
+            return std::vector<double>{ computeLocalError(colors, parameters) };
+        });
+
+        // The instrumented row loops must produce the same bits as the fused ones, and the counters must add up
+        const char* instrumentation_section = enhancer::is_instrumentation_enabled ? "instrumentation" : "instrumentation (disabled)";
+        is_passed &= reportChecks(instrumentation_section, "enhance_image_parallel", { { "mismatch", 0.0 } }, parameter_sets, [&](const Eigen::VectorXd& parameters)
+        {
+            return std::vector<double>{ computeInstrumentationError(colors, parameters) };
+        });
+    }
+
+    std::cout << (is_passed ? "All implementations are within their budgets." : "Some implementations exceeded their budgets.") << std::endl;
+
+    return is_passed ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <enhancer/lut.hpp>
+#include <enhancer/preset.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+
+// Round-trips presets with a baked LUT through the preset format (mapped and loaded) and the .cube format, which both
+// have to restore the floats exactly, and checks that a malformed preset file is rejected.
+namespace
+{
+    int num_failures = 0;
+
+    void check(const bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "Failed: " << description << std::endl;
+            ++num_failures;
+        }
+    }
+
+    bool isSameLut(const float* values, const enhancer::Lut3D& lut)
+    {
+        const int size = lut.getSize();
+        return std::equal(lut.getData(), lut.getData() + 3 * size * size * size, values);
+    }
+
+    void testRoundTrip(const std::string& directory, const Eigen::VectorXd& parameters)
+    {
+        const std::string preset_path = directory + "/enhancer-preset-test.preset";
+        const std::string cube_path   = directory + "/enhancer-preset-test.cube";
+
+        const enhancer::Preset preset = enhancer::make_preset("preset-test", parameters, 9);
+        const int              size   = preset.lut->getSize();
+
+        enhancer::MappedPreset mapped_preset;
+        enhancer::Preset       loaded_preset;
+        check(enhancer::save_preset(preset_path, preset), "save_preset");
+        check(mapped_preset.open(preset_path), "MappedPreset::open");
+        check(enhancer::load_preset(preset_path, loaded_preset), "load_preset");
+        check(enhancer::write_cube_file(cube_path, *preset.lut, preset.name), "write_cube_file");
+        const std::unique_ptr<enhancer::Lut3D> cube_lut = enhancer::read_cube_file(cube_path);
+
+        check(mapped_preset.getName() == preset.name, "the mapped name");
+        check(mapped_preset.getParameters() == parameters, "the mapped parameters");
+        check(mapped_preset.hasLut() && mapped_preset.getLutSize() == size && isSameLut(mapped_preset.getLut().getData(), *preset.lut), "the mapped LUT");
+
+        check(loaded_preset.name == preset.name, "the loaded name");
+        check(loaded_preset.parameter_set == preset.parameter_set && loaded_preset.pipeline_version == preset.pipeline_version, "the loaded description");
+        check(loaded_preset.parameters == parameters, "the loaded parameters");
+        check(loaded_preset.lut != nullptr && loaded_preset.lut->getSize() == size && isSameLut(loaded_preset.lut->getData(), *preset.lut), "the loaded LUT");
+
+        check(cube_lut != nullptr && cube_lut->getSize() == size && isSameLut(cube_lut->getData(), *preset.lut), "the .cube LUT");
+
+        // A section offset close to 2^64 must not wrap around the bounds check
+        mapped_preset = enhancer::MappedPreset();
+        {
+            std::fstream        file(preset_path, std::ios::in | std::ios::out | std::ios::binary);
+            const std::uint64_t name_offset = std::numeric_limits<std::uint64_t>::max() - 1;
+            file.seekp(offsetof(enhancer::PresetFileHeader, name_offset));
+            file.write(reinterpret_cast<const char*>(&name_offset), sizeof(name_offset));
+        }
+        enhancer::MappedPreset malformed_preset;
+        check(!malformed_preset.open(preset_path), "a malformed name offset is rejected");
+
+        std::error_code ignored;
+        std::filesystem::remove(preset_path, ignored);
+        std::filesystem::remove(cube_path, ignored);
+    }
+} // namespace
+
+int main()
+{
+    const std::string directory = std::filesystem::temp_directory_path().string();
+
+    testRoundTrip(directory, Eigen::VectorXd::Constant(enhancer::NUM_PARAMETERS, 0.5));
+    testRoundTrip(directory, Eigen::VectorXd::LinSpaced(enhancer::NUM_PARAMETERS, 0.1, 0.9));
+
+    if (num_failures > 0)
+    {
+        std::cerr << num_failures << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <enhancer/enhancer.hpp>
+#include <enhancer/stream.hpp>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams frames through a FramePipeline with a slow sink and checks that the sink sees the frames in order, each one
+// enhanced with the linear interpolation of the keyframes; that the source never has more frames in flight than there
+// are buffers; and that an exception thrown by the source, the kernel, or the sink is rethrown by run.
+namespace
+{
+    constexpr int width       = 32;
+    constexpr int height      = 8;
+    constexpr int num_buffers = 3;
+    constexpr int num_frames  = 12;
+
+    int num_failures = 0;
+
+    void check(const bool condition, const std::string& description)
+    {
+        if (!condition)
+        {
+            std::cerr << "Failed: " << description << std::endl;
+            ++num_failures;
+        }
+    }
+
+    std::vector<float> generatePixels()
+    {
+        std::vector<float> pixels(3 * width * height);
+        for (std::size_t i = 0; i < pixels.size(); ++i) { pixels[i] = static_cast<float>(i % 251) / 250.0f; }
+        return pixels;
+    }
+
+    void testKeyframes(const Eigen::VectorXd& parameters)
+    {
+        const std::ptrdiff_t  stride          = 3 * width * sizeof(float);
+        const int             last_keyframe   = 8;
+        const Eigen::VectorXd last_parameters = Eigen::VectorXd::Constant(parameters.size(), 1.0) - parameters;
+
+        const std::vector<float> pixels = generatePixels();
+
+        enhancer::ParameterKeyframes keyframes(parameters);
+        keyframes.setKeyframe(last_keyframe, last_parameters);
+
+        enhancer::ThreadPool           pool(4);
+        enhancer::FramePipeline<float> pipeline(pool, width, height, 3, num_buffers);
+
+        // Only the source increases the count, so the maximum needs no compare-exchange
+        std::atomic<int> num_in_flight(0);
+        std::atomic<int> max_in_flight(0);
+
+        const auto source = [&](enhancer::Frame<float>& frame)
+        {
+            if (frame.index >= num_frames) { return false; }
+
+            max_in_flight = std::max(max_in_flight.load(), ++num_in_flight);
+            std::copy(pixels.begin(), pixels.end(), frame.data.begin());
+            return true;
+        };
+
+        int                expected_index = 0;
+        bool               is_in_order    = true;
+        bool               is_enhanced    = true;
+        std::vector<float> expected(pixels.size());
+        const auto         sink = [&](const enhancer::Frame<float>& frame)
+        {
+            // Gives the source time to run ahead, which only the bound on the buffers can stop
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+            const double          t                   = std::min(1.0, static_cast<double>(frame.index) / last_keyframe);
+            const Eigen::VectorXd expected_parameters = (1.0 - t) * parameters + t * last_parameters;
+            enhancer::enhance_image(pixels.data(), expected.data(), width, height, stride, 3, expected_parameters);
+
+            is_in_order = is_in_order && frame.index == expected_index++;
+            is_enhanced = is_enhanced && (frame.parameters - expected_parameters).cwiseAbs().maxCoeff() <= 1e-12 && frame.data == expected;
+
+            --num_in_flight;
+        };
+
+        const enhancer::StreamStats stats = pipeline.run(source, sink, keyframes);
+        check(stats.num_frames == num_frames, "every frame reaches the sink");
+        check(is_in_order, "the frames reach the sink in order");
+        check(is_enhanced, "the frames are enhanced with the interpolated keyframes");
+        check(max_in_flight <= num_buffers, "the frames in flight are bounded by the buffers");
+    }
+
+    // A failing stage stops the others, and run rethrows its exception once every thread has finished
+    void testFailures()
+    {
+        enhancer::ThreadPool           pool(4);
+        enhancer::FramePipeline<float> pipeline(pool, width, height, 3, num_buffers);
+
+        const enhancer::ParameterKeyframes keyframes(Eigen::VectorXd::Constant(enhancer::NUM_PARAMETERS, 0.5));
+
+        enum class FailingStage { Source, Kernel, Sink };
+        for (const FailingStage failing_stage : { FailingStage::Source, FailingStage::Kernel, FailingStage::Sink })
+        {
+            const auto throw_at = [&](const FailingStage stage, const int frame_index)
+            {
+                if (stage == failing_stage && frame_index == 5) { throw std::runtime_error("stream"); }
+            };
+
+            // The kernel does not see the frame index, so it fails on its fifth call (a frame is a single tile)
+            std::atomic<int> num_kernel_calls(0);
+
+            bool is_thrown = false;
+            try
+            {
+                pipeline.run(
+                    [&](enhancer::Frame<float>& frame)
+                    {
+                        throw_at(FailingStage::Source, frame.index);
+                        return frame.index < num_frames;
+                    },
+                    [&](const enhancer::Frame<float>& frame) { throw_at(FailingStage::Sink, frame.index); },
+                    keyframes,
+                    [&](const float*, float*, int, int, std::ptrdiff_t, int, const Eigen::VectorXd&) { throw_at(FailingStage::Kernel, ++num_kernel_calls); });
+            }
+            catch (const std::runtime_error& exception)
+            {
+                is_thrown = std::string(exception.what()) == "stream";
+            }
+            const char* stage_names[] = { "source", "kernel", "sink" };
+            check(is_thrown, std::string("an exception of the ") + stage_names[static_cast<int>(failing_stage)] + " is rethrown");
+        }
+    }
+} // namespace
+
+int main()
+{
+    testKeyframes(Eigen::VectorXd::Constant(enhancer::NUM_PARAMETERS, 0.5));
+    testKeyframes(Eigen::VectorXd::LinSpaced(enhancer::NUM_PARAMETERS, 0.1, 0.9));
+    testFailures();
+
+    if (num_failures > 0)
+    {
+        std::cerr << num_failures << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}